@@ -545,6 +545,29 @@ typedef union {
   void *ptr;
 } nghttp2_data_source;
 
+/**
+ * @enum
+ *
+ * The flags used to set in |*eof| output parameter in
+ * :type:`nghttp2_data_source_read_callback`.
+ */
+typedef enum {
+  /**
+   * No flag set.
+   */
+  NGHTTP2_DATA_FLAG_NONE = 0,
+  /**
+   * Indicates EOF was sensed.
+   */
+  NGHTTP2_DATA_FLAG_EOF = 0x01,
+  /**
+   * Indicates that the library should not copy data to the frame
+   * buffer. The application writes the DATA frame payload itself in
+   * :type:`nghttp2_send_data_callback`.
+   */
+  NGHTTP2_DATA_FLAG_NO_COPY = 0x02
+} nghttp2_data_flag;
+
 /**
  * @functypedef
  *
@@ -553,7 +576,16 @@ typedef union {
  * implementation of this function must read at most |length| bytes of
  * data from |source| (or possibly other places) and store them in
  * |buf| and return number of data stored in |buf|. If EOF is reached,
- * set |*eof| to 1.  If the application wants to postpone DATA frames,
+ * set |*eof| to 1.  The |*eof| is actually a bitwise OR of
+ * :type:`nghttp2_data_flag` and setting it to 1 is the same as
+ * setting :enum:`NGHTTP2_DATA_FLAG_EOF`. If the application sets
+ * :enum:`NGHTTP2_DATA_FLAG_NO_COPY` to |*eof|, it must not store data
+ * in |buf|. Instead, it just returns the number of bytes to send,
+ * and the library calls
+ * :member:`nghttp2_session_callbacks.send_data_callback` later to let
+ * the application write the DATA frame itself. See
+ * :type:`nghttp2_send_data_callback` for details.  If the
+ * application wants to postpone DATA frames,
  * (e.g., asynchronous I/O, or reading data blocks for long time), it
  * is achieved by returning :enum:`NGHTTP2_ERR_DEFERRED` without
  * reading any data in this invocation.  The library removes DATA
@@ -1202,6 +1234,43 @@ typedef ssize_t (*nghttp2_select_padding_callback)
  size_t max_payloadlen,
  void *user_data);
 
+/**
+ * @functypedef
+ *
+ * Callback function invoked when the library wants to send the DATA
+ * frame whose payload was not copied to the frame buffer because
+ * :type:`nghttp2_data_source_read_callback` set
+ * :enum:`NGHTTP2_DATA_FLAG_NO_COPY`. The |framehd| is the 8 bytes
+ * serialized frame header. The |length| is the number of bytes of
+ * the payload, which is the value returned from
+ * :type:`nghttp2_data_source_read_callback`. The |source| is the
+ * same pointer passed to :type:`nghttp2_data_source_read_callback`.
+ *
+ * The application must send the frame header and then |length|
+ * bytes of payload, in this order, before any other data produced by
+ * this |session|. No padding is added to this frame.
+ *
+ * This callback is invoked from `nghttp2_session_send()` and
+ * `nghttp2_session_mem_send()`. In the latter case, the application
+ * must write out the data returned from the previous
+ * `nghttp2_session_mem_send()` call before writing this frame.
+ *
+ * The implementation of this function must return 0 if it succeeds.
+ * If it cannot send the frame without blocking, it must return
+ * :enum:`NGHTTP2_ERR_WOULDBLOCK` without sending anything, and the
+ * library will call this function again later.  Returning
+ * :enum:`NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE` will close the stream
+ * by issuing RST_STREAM with :enum:`NGHTTP2_INTERNAL_ERROR`. For
+ * other errors, it must return
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`.
+ */
+typedef int (*nghttp2_send_data_callback)
+(nghttp2_session *session,
+ nghttp2_frame *frame,
+ const uint8_t *framehd, size_t length,
+ nghttp2_data_source *source,
+ void *user_data);
+
 /**
  * @struct
  *
@@ -1274,6 +1343,14 @@ typedef struct {
    * much padding is required for the transmission of the given frame.
    */
   nghttp2_select_padding_callback select_padding_callback;
+  /**
+   * Callback function invoked when the library wants to send the
+   * DATA frame whose payload is written by the application. This
+   * callback is required if
+   * :type:`nghttp2_data_source_read_callback` sets
+   * :enum:`NGHTTP2_DATA_FLAG_NO_COPY`.
+   */
+  nghttp2_send_data_callback send_data_callback;
 } nghttp2_session_callbacks;
 
 /**
@@ -86,6 +86,11 @@ typedef struct {
    * exclusively by nghttp2 library and not in the spec.
    */
   uint8_t eof;
+  /**
+   * The flag to indicate that the payload of the current DATA frame
+   * is written by the application in send_data_callback.
+   */
+  uint8_t no_copy;
 } nghttp2_private_data;
 
 int nghttp2_frame_is_data_frame(uint8_t *head);
@@ -1865,6 +1865,9 @@ static int nghttp2_session_after_frame_sent(nghttp2_session *session)
 
         return 0;
       }
+      /* The previous frame was completely sent. Start over from the
+         beginning of the buffer so that it does not keep growing. */
+      nghttp2_buf_reset(framebuf);
       rv = nghttp2_session_pack_data(session, framebuf, next_readmax,
                                      data_frame);
       if(nghttp2_is_fatal(rv)) {
@@ -1894,6 +1897,11 @@ static int nghttp2_session_after_frame_sent(nghttp2_session *session)
       assert(rv >= 0);
       framebuf->mark = framebuf->last;
 
+      /* The next chunk may be sent in the different mode from the
+         previous one. */
+      aob->state = data_frame->no_copy ?
+        NGHTTP2_OB_SEND_NO_COPY : NGHTTP2_OB_SEND_DATA;
+
       return 0;
     }
     /* Update seq to interleave other streams with the same
@@ -1911,6 +1919,43 @@ static int nghttp2_session_after_frame_sent(nghttp2_session *session)
   assert(0);
 }
 
+/*
+ * Calls send_data_callback to let the application write DATA frame
+ * |data_frame|, whose frame header is stored in |framebuf|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_WOULDBLOCK
+ *     The application could not write the frame.
+ * NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE
+ *     The callback failed (stream error).
+ * NGHTTP2_ERR_CALLBACK_FAILURE
+ *     The callback failed.
+ */
+static int session_call_send_data(nghttp2_session *session,
+                                  nghttp2_private_data *data_frame,
+                                  nghttp2_buf *framebuf)
+{
+  int rv;
+  nghttp2_frame frame;
+
+  nghttp2_frame_data_init(&frame.data, data_frame);
+
+  rv = session->callbacks.send_data_callback
+    (session, &frame, framebuf->pos, data_frame->hd.length,
+     &data_frame->data_prd.source, session->user_data);
+
+  switch(rv) {
+  case 0:
+  case NGHTTP2_ERR_WOULDBLOCK:
+  case NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE:
+    return rv;
+  default:
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+}
+
 ssize_t nghttp2_session_mem_send(nghttp2_session *session,
                                  const uint8_t **data_ptr)
 {
@@ -1993,6 +2038,15 @@ ssize_t nghttp2_session_mem_send(nghttp2_session *session,
 
       } else {
         framebuf->mark = framebuf->last;
+
+        if(nghttp2_outbound_item_get_data_frame(item)->no_copy) {
+          DEBUGF(fprintf(stderr, "start transmitting DATA frame in no copy "
+                         "mode\n"));
+
+          aob->state = NGHTTP2_OB_SEND_NO_COPY;
+
+          break;
+        }
       }
 
       DEBUGF(fprintf(stderr, "start transmitting type %d frame %zd bytes\n",
@@ -2002,6 +2056,48 @@ ssize_t nghttp2_session_mem_send(nghttp2_session *session,
 
       break;
     }
+    case NGHTTP2_OB_SEND_NO_COPY: {
+      nghttp2_private_data *data_frame;
+
+      data_frame = nghttp2_outbound_item_get_data_frame(aob->item);
+
+      if(nghttp2_session_get_stream(session,
+                                    data_frame->hd.stream_id) == NULL) {
+        /* The stream was closed while we were waiting for the
+           application to be able to write. Nothing has been written
+           for this frame yet, so just drop it. */
+        nghttp2_active_outbound_item_reset(aob);
+        break;
+      }
+
+      rv = session_call_send_data(session, data_frame, framebuf);
+      if(rv == NGHTTP2_ERR_WOULDBLOCK) {
+        return 0;
+      }
+      if(rv == NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE) {
+        rv = nghttp2_session_add_rst_stream(session,
+                                            data_frame->hd.stream_id,
+                                            NGHTTP2_INTERNAL_ERROR);
+        nghttp2_active_outbound_item_reset(aob);
+        if(nghttp2_is_fatal(rv)) {
+          return rv;
+        }
+        break;
+      }
+      if(rv != 0) {
+        return rv;
+      }
+
+      framebuf->pos = framebuf->mark;
+
+      rv = nghttp2_session_after_frame_sent(session);
+      if(rv < 0) {
+        /* FATAL */
+        assert(nghttp2_is_fatal(rv));
+        return rv;
+      }
+      break;
+    }
     case NGHTTP2_OB_SEND_DATA: {
       size_t datalen;
 
@@ -4617,14 +4713,25 @@ ssize_t nghttp2_session_pack_data(nghttp2_session *session,
     return NGHTTP2_ERR_CALLBACK_FAILURE;
   }
 
-  buf->last = buf->pos + NGHTTP2_FRAME_HDLEN + payloadlen;
+  if(eof_flags & NGHTTP2_DATA_FLAG_NO_COPY) {
+    if(session->callbacks.send_data_callback == NULL) {
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+    frame->no_copy = 1;
+    /* The payload is written by the application, so the frame
+       buffer only contains the frame header. */
+    buf->last = buf->pos + NGHTTP2_FRAME_HDLEN;
+  } else {
+    frame->no_copy = 0;
+    buf->last = buf->pos + NGHTTP2_FRAME_HDLEN + payloadlen;
+  }
 
   /* Clear flags, because this may contain previous flags of previous
      DATA */
   frame->hd.flags &= (NGHTTP2_FLAG_END_STREAM | NGHTTP2_FLAG_END_SEGMENT);
   flags = NGHTTP2_FLAG_NONE;
 
-  if(eof_flags) {
+  if(eof_flags & NGHTTP2_DATA_FLAG_EOF) {
     frame->eof = 1;
     if(frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
       flags |= NGHTTP2_FLAG_END_STREAM;
@@ -4642,10 +4749,16 @@ ssize_t nghttp2_session_pack_data(nghttp2_session *session,
   data_frame.hd.type = NGHTTP2_DATA;
   data_frame.hd.flags = flags;
 
-  padded_payloadlen = session_call_select_padding(session, &data_frame,
-                                                  datamax);
-  if(nghttp2_is_fatal(padded_payloadlen)) {
-    return padded_payloadlen;
+  if(frame->no_copy) {
+    /* We don't add padding to the frame written by the
+       application. */
+    padded_payloadlen = payloadlen;
+  } else {
+    padded_payloadlen = session_call_select_padding(session, &data_frame,
+                                                    datamax);
+    if(nghttp2_is_fatal(padded_payloadlen)) {
+      return padded_payloadlen;
+    }
   }
 
   padlen = padded_payloadlen - payloadlen;
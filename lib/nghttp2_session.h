@@ -50,7 +50,8 @@ typedef enum {
 
 typedef enum {
   NGHTTP2_OB_POP_ITEM,
-  NGHTTP2_OB_SEND_DATA
+  NGHTTP2_OB_SEND_DATA,
+  NGHTTP2_OB_SEND_NO_COPY
 } nghttp2_outbound_state;
 
 typedef struct {
@@ -512,7 +513,9 @@ nghttp2_stream* nghttp2_session_get_stream(nghttp2_session *session,
  * |*bufoff_ptr| offset. The |*bufoff_ptr| is calculated based on
  * usage of padding. Remaining bytes are the DATA apyload and are
  * filled using |frame->data_prd|. The length of payload is at most
- * |datamax| bytes.
+ * |datamax| bytes. If the read_callback sets
+ * NGHTTP2_DATA_FLAG_NO_COPY, only frame header is stored and
+ * |frame->no_copy| is set to 1.
  *
  * This function returns the size of packed frame if it succeeds, or
  * one of the following negative error codes:
@@ -34,6 +34,8 @@
 
 #include <cassert>
 #include <set>
+#include <list>
+#include <unordered_map>
 #include <iostream>
 #include <thread>
 
@@ -62,6 +64,8 @@ const std::string STATUS_400 = "400";
 const std::string STATUS_404 = "404";
 const std::string DEFAULT_HTML = "index.html";
 const std::string NGHTTPD_SERVER = "nghttpd nghttp2/" NGHTTP2_VERSION;
+// The length of frame header passed to send_data_callback
+const size_t FRAME_HDLEN = 8;
 } // namespace
 
 Config::Config()
@@ -69,7 +73,9 @@ Config::Config()
     output_upper_thres(1024*1024),
     padding(0),
     num_worker(1),
+    file_cache_size(256),
     header_table_size(-1),
+    file_cache_ttl(1.0),
     port(0),
     verbose(false),
     daemon(false),
@@ -78,8 +84,55 @@ Config::Config()
     error_gzip(false)
 {}
 
+FileEntry::FileEntry(std::string path, int fd, const struct stat& st)
+  : path(std::move(path)),
+    last_valid(std::chrono::steady_clock::now()),
+    length(st.st_size),
+    mtime(st.st_mtime),
+    dev(st.st_dev),
+    ino(st.st_ino),
+    fd(fd)
+{
+#ifdef HAVE_EVBUFFER_FILE_SEGMENT
+  // The segment is only touched by the worker thread which owns this
+  // entry.
+  seg = evbuffer_file_segment_new(fd, 0, length,
+                                  EVBUF_FS_CLOSE_ON_FREE |
+                                  EVBUF_FS_DISABLE_LOCKING);
+#endif // HAVE_EVBUFFER_FILE_SEGMENT
+}
+
+FileEntry::FileEntry(std::string path)
+  : path(std::move(path)),
+    last_valid(std::chrono::steady_clock::now()),
+    length(0),
+    mtime(0),
+    dev(0),
+    ino(0),
+    fd(-1)
+{
+#ifdef HAVE_EVBUFFER_FILE_SEGMENT
+  seg = nullptr;
+#endif // HAVE_EVBUFFER_FILE_SEGMENT
+}
+
+FileEntry::~FileEntry()
+{
+#ifdef HAVE_EVBUFFER_FILE_SEGMENT
+  if(seg) {
+    // fd is closed when the output buffers release the segment.
+    evbuffer_file_segment_free(seg);
+    return;
+  }
+#endif // HAVE_EVBUFFER_FILE_SEGMENT
+  if(fd != -1) {
+    close(fd);
+  }
+}
+
 Request::Request(int32_t stream_id)
-  : stream_id(stream_id),
+  : file_offset(0),
+    stream_id(stream_id),
     file(-1)
 {}
 
@@ -169,7 +222,83 @@ public:
     }
     add_handler(handler.release());
   }
+  // Returns the opened file entry for |path|, or nullptr if it
+  // cannot be opened. The cached entry is returned without touching
+  // file system unless it is older than config_->file_cache_ttl.
+  // If |cache_absence| is true, the absence of file is also cached,
+  // so that looking up optional files (e.g., precompressed variant)
+  // is cheap. It must not be used for the paths requested by
+  // clients; otherwise requests to random missing paths would evict
+  // the hot entries.
+  std::shared_ptr<FileEntry> get_file_entry(const std::string& path,
+                                            bool cache_absence = false)
+  {
+    auto now = std::chrono::steady_clock::now();
+    auto itr = file_index_.find(path);
+    if(itr != std::end(file_index_)) {
+      auto i = (*itr).second;
+      auto& ent = *i;
+      bool fresh = now - ent->last_valid <
+        std::chrono::duration<double>(config_->file_cache_ttl);
+      if(!fresh) {
+        struct stat st;
+        if(ent->fd == -1) {
+          fresh = stat(path.c_str(), &st) == -1 && errno == ENOENT;
+        } else {
+          fresh = stat(path.c_str(), &st) == 0 &&
+            st.st_dev == ent->dev && st.st_ino == ent->ino &&
+            st.st_mtime == ent->mtime && st.st_size == ent->length;
+        }
+        if(fresh) {
+          ent->last_valid = now;
+        }
+      }
+      if(fresh) {
+        file_lru_.splice(std::begin(file_lru_), file_lru_, i);
+        if(ent->fd == -1) {
+          return nullptr;
+        }
+        return ent;
+      }
+      // Requests still in progress keep their reference to the old
+      // file.
+      file_lru_.erase(i);
+      file_index_.erase(itr);
+    }
+    std::shared_ptr<FileEntry> ent;
+    int fd = open(path.c_str(), O_RDONLY | O_BINARY);
+    if(fd == -1) {
+      if(!cache_absence || errno != ENOENT) {
+        return nullptr;
+      }
+      ent = std::make_shared<FileEntry>(path);
+    } else {
+      struct stat st;
+      if(fstat(fd, &st) == -1) {
+        close(fd);
+        return nullptr;
+      }
+      ent = std::make_shared<FileEntry>(path, fd, st);
+    }
+    if(config_->file_cache_size > 0) {
+      if(file_lru_.size() == config_->file_cache_size) {
+        file_index_.erase(file_lru_.back()->path);
+        file_lru_.pop_back();
+      }
+      file_lru_.push_front(ent);
+      file_index_[path] = std::begin(file_lru_);
+    }
+    if(ent->fd == -1) {
+      return nullptr;
+    }
+    return ent;
+  }
 private:
+  typedef std::list<std::shared_ptr<FileEntry>> FileEntryList;
+  // MRU entry comes first.
+  FileEntryList file_lru_;
+  // path -> entry in file_lru_
+  std::unordered_map<std::string, FileEntryList::iterator> file_index_;
   std::set<Http2Handler*> handlers_;
   event_base *evbase_;
   const Config *config_;
@@ -339,6 +468,7 @@ int Http2Handler::setup_bev()
     bev_ = bufferevent_socket_new(sessions_->get_evbase(), fd_,
                                   BEV_OPT_DEFER_CALLBACKS);
   }
+  evbbuf_.reset(bufferevent_get_output(bev_), wbuf_, sizeof(wbuf_));
   bufferevent_enable(bev_, EV_READ);
   bufferevent_setcb(bev_, connhd_readcb, writecb, eventcb, this);
   // TODO set up timeout here
@@ -367,12 +497,10 @@ int Http2Handler::on_read()
 int Http2Handler::on_write()
 {
   int rv;
-  uint8_t buf[4096];
   auto output = bufferevent_get_output(bev_);
-  util::EvbufferBuffer evbbuf(output, buf, sizeof(buf));
 
   for(;;) {
-    if(evbuffer_get_length(output) + evbbuf.get_buflen() >
+    if(evbuffer_get_length(output) + evbbuf_.get_buflen() >
        sessions_->get_config()->output_upper_thres) {
       break;
     }
@@ -388,13 +516,13 @@ int Http2Handler::on_write()
     if(datalen == 0) {
       break;
     }
-    rv = evbbuf.add(data, datalen);
+    rv = evbbuf_.add(data, datalen);
     if(rv != 0) {
       std::cerr << "evbuffer_add() failed" << std::endl;
       return -1;
     }
   }
-  rv = evbbuf.flush();
+  rv = evbbuf_.flush();
   if(rv != 0) {
     std::cerr << "evbuffer_add() failed" << std::endl;
     return -1;
@@ -484,6 +612,9 @@ int Http2Handler::submit_file_response(const std::string& status,
                                        int32_t stream_id,
                                        time_t last_modified,
                                        off_t file_length,
+                                       const std::vector
+                                       <std::pair<std::string, std::string>>&
+                                       headers,
                                        nghttp2_data_provider *data_prd)
 {
   std::string date_str = util::http_date(time(0));
@@ -500,6 +631,9 @@ int Http2Handler::submit_file_response(const std::string& status,
     last_modified_str = util::http_date(last_modified);
     nva.push_back(http2::make_nv_ls("last-modified", last_modified_str));
   }
+  for(auto& nv : headers) {
+    nva.push_back(http2::make_nv(nv.first, nv.second));
+  }
   return nghttp2_submit_response(session_, stream_id, nva.data(), nva.size(),
                                  data_prd);
 }
@@ -563,6 +697,32 @@ int Http2Handler::submit_push_promise(Request *req,
                                      nullptr);
 }
 
+int Http2Handler::send_file_data(const uint8_t *framehd, size_t length,
+                                 Request *req)
+{
+#ifdef HAVE_EVBUFFER_FILE_SEGMENT
+  auto output = bufferevent_get_output(bev_);
+  if(evbuffer_get_length(output) + evbbuf_.get_buflen() >
+     sessions_->get_config()->output_upper_thres) {
+    return NGHTTP2_ERR_WOULDBLOCK;
+  }
+  // The data which precede this frame must be written first.
+  if(evbbuf_.add(framehd, FRAME_HDLEN) != 0 ||
+     evbbuf_.flush() != 0) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+  // file_offset was already advanced in file_entry_read_callback.
+  if(length > 0 &&
+     evbuffer_add_file_segment(output, req->file_ent->seg,
+                               req->file_offset - length, length) != 0) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+  return 0;
+#else // !HAVE_EVBUFFER_FILE_SEGMENT
+  return NGHTTP2_ERR_CALLBACK_FAILURE;
+#endif // !HAVE_EVBUFFER_FILE_SEGMENT
+}
+
 void Http2Handler::add_stream(int32_t stream_id, std::unique_ptr<Request> req)
 {
   id2req_[stream_id] = std::move(req);
@@ -640,6 +800,71 @@ ssize_t file_read_callback
   }
 }
 
+namespace {
+// Returns true if the file of |ent| still has the length which we
+// told in content-length. If the file was truncated after it was
+// cached, the file segment must not be used: mmap(2) raises SIGBUS,
+// and sendfile(2) writes less than the frame length.
+bool file_length_unchanged(const FileEntry *ent)
+{
+  struct stat st;
+  return fstat(ent->fd, &st) == 0 && st.st_size == ent->length;
+}
+} // namespace
+
+namespace {
+ssize_t file_entry_read_callback
+(nghttp2_session *session, int32_t stream_id,
+ uint8_t *buf, size_t length, int *eof,
+ nghttp2_data_source *source, void *user_data)
+{
+  auto hd = static_cast<Http2Handler*>(user_data);
+  auto req = hd->get_stream(stream_id);
+  if(!req || !req->file_ent) {
+    return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+  }
+  auto& ent = req->file_ent;
+  // The file descriptor is shared with other requests, so use
+  // pread() with our own offset. We do not read beyond the length
+  // which we told in content-length.
+  auto left = ent->length - req->file_offset;
+  if(left < static_cast<int64_t>(length)) {
+    length = left;
+  }
+#ifdef HAVE_EVBUFFER_FILE_SEGMENT
+  // The library does not pad DATA frames written by us, so we copy
+  // them if padding is requested.
+  if(ent->seg && hd->get_config()->padding == 0 &&
+     file_length_unchanged(ent.get())) {
+    // The payload is written in send_data_callback.
+    req->file_offset += length;
+    *eof = NGHTTP2_DATA_FLAG_NO_COPY;
+    if(req->file_offset == ent->length) {
+      *eof |= NGHTTP2_DATA_FLAG_EOF;
+    }
+    return length;
+  }
+#endif // HAVE_EVBUFFER_FILE_SEGMENT
+  ssize_t r = 0;
+  if(length > 0) {
+    while((r = pread(ent->fd, buf, length, req->file_offset)) == -1 &&
+          errno == EINTR);
+    if(r == -1) {
+      return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+    }
+    req->file_offset += r;
+  }
+  if(req->file_offset == ent->length) {
+    *eof = 1;
+  } else if(r == 0) {
+    // The file was truncated. We cannot send the length which we
+    // told in content-length.
+    return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+  }
+  return r;
+}
+} // namespace
+
 namespace {
 bool check_url(const std::string& url)
 {
@@ -741,27 +966,51 @@ void prepare_response(Request *req, Http2Handler *hd, bool allow_push = true)
   if(path[path.size()-1] == '/') {
     path += DEFAULT_HTML;
   }
-  int file = open(path.c_str(), O_RDONLY | O_BINARY);
-  if(file == -1) {
+  auto sessions = hd->get_sessions();
+  auto ent = sessions->get_file_entry(path);
+  if(!ent) {
     prepare_status_response(req, hd, STATUS_404);
-  } else {
-    struct stat buf;
-    if(fstat(file, &buf) == -1) {
-      close(file);
-      prepare_status_response(req, hd, STATUS_404);
-    } else {
-      req->file = file;
-      nghttp2_data_provider data_prd;
-      data_prd.source.fd = file;
-      data_prd.read_callback = file_read_callback;
-      if(last_mod_found && buf.st_mtime <= last_mod) {
-        prepare_status_response(req, hd, STATUS_304);
-      } else {
-        hd->submit_file_response(STATUS_200, req->stream_id, buf.st_mtime,
-                                 buf.st_size, &data_prd);
+    return;
+  }
+  std::vector<std::pair<std::string, std::string>> headers;
+  bool vary = false;
+  // If precompressed file foo.gz exists next to foo, serve it to the
+  // client which accepts gzip.
+  if(!util::endsWith(path, ".gz")) {
+    auto gzent = sessions->get_file_entry(path + ".gz", true);
+    if(gzent) {
+      auto ae = std::lower_bound(std::begin(req->headers),
+                                 std::end(req->headers),
+                                 std::make_pair(std::string("accept-encoding"),
+                                                std::string()));
+      if(ae != std::end(req->headers) && (*ae).first == "accept-encoding" &&
+         http2::accept_gzip((*ae).second)) {
+        ent = std::move(gzent);
+        headers.emplace_back("content-encoding", "gzip");
       }
+      headers.emplace_back("vary", "accept-encoding");
+      vary = true;
     }
   }
+  if(last_mod_found && ent->mtime <= last_mod) {
+    // 304 response must carry vary so that caches do not mix up the
+    // variants, but not the representation metadata like
+    // content-encoding.
+    std::vector<std::pair<std::string, std::string>> nm_headers;
+    if(vary) {
+      nm_headers.emplace_back("vary", "accept-encoding");
+    }
+    hd->submit_response(STATUS_304, req->stream_id, nm_headers, nullptr);
+    return;
+  }
+  auto mtime = ent->mtime;
+  auto length = ent->length;
+  req->file_ent = std::move(ent);
+  nghttp2_data_provider data_prd;
+  data_prd.source.ptr = nullptr;
+  data_prd.read_callback = file_entry_read_callback;
+  hd->submit_file_response(STATUS_200, req->stream_id, mtime, length,
+                           headers, &data_prd);
 }
 } // namespace
 
@@ -978,6 +1227,21 @@ int on_stream_close_callback
 }
 } // namespace
 
+namespace {
+int send_data_callback
+(nghttp2_session *session, nghttp2_frame *frame,
+ const uint8_t *framehd, size_t length,
+ nghttp2_data_source *source, void *user_data)
+{
+  auto hd = static_cast<Http2Handler*>(user_data);
+  auto req = hd->get_stream(frame->hd.stream_id);
+  if(!req || !req->file_ent) {
+    return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+  }
+  return hd->send_file_data(framehd, length, req);
+}
+} // namespace
+
 namespace {
 void fill_callback(nghttp2_session_callbacks& callbacks, const Config *config)
 {
@@ -998,6 +1262,7 @@ void fill_callback(nghttp2_session_callbacks& callbacks, const Config *config)
   if(config->padding) {
     callbacks.select_padding_callback = select_padding_callback;
   }
+  callbacks.send_data_callback = send_data_callback;
 }
 } // namespace
 
@@ -29,6 +29,7 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <cstdlib>
 
@@ -36,15 +37,23 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <chrono>
 
 #include <openssl/ssl.h>
 
 #include <event2/event.h>
+#include <event2/buffer.h>
 #include <event2/bufferevent.h>
 
 #include <nghttp2/nghttp2.h>
 
 #include "http2.h"
+#include "util.h"
+
+// evbuffer_file_segment is available since libevent 2.1.1-alpha.
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+# define HAVE_EVBUFFER_FILE_SEGMENT 1
+#endif // LIBEVENT_VERSION_NUMBER >= 0x02010100
 
 namespace nghttp2 {
 
@@ -58,7 +67,13 @@ struct Config {
   size_t output_upper_thres;
   size_t padding;
   size_t num_worker;
+  // The maximum number of entries in per worker file cache. 0
+  // disables the cache. Each entry keeps the file descriptor open.
+  size_t file_cache_size;
   ssize_t header_table_size;
+  // The cached file entry is revalidated by stat(2) if it is older
+  // than this value in seconds.
+  double file_cache_ttl;
   uint16_t port;
   bool verbose;
   bool daemon;
@@ -68,9 +83,36 @@ struct Config {
   Config();
 };
 
+// Opened file and its metadata shared by the requests for the same
+// path. The file descriptor is closed when the last reference is
+// gone.
+struct FileEntry {
+  FileEntry(std::string path, int fd, const struct stat& st);
+  // Creates the entry which records that |path| does not exist.
+  FileEntry(std::string path);
+  ~FileEntry();
+  std::string path;
+  // The last time when this entry was known to be fresh.
+  std::chrono::steady_clock::time_point last_valid;
+  int64_t length;
+  time_t mtime;
+  dev_t dev;
+  ino_t ino;
+  // -1 if the file does not exist.
+  int fd;
+#ifdef HAVE_EVBUFFER_FILE_SEGMENT
+  // The whole file, which is added to the output buffer without
+  // copying. This owns fd if it is not nullptr.
+  evbuffer_file_segment *seg;
+#endif // HAVE_EVBUFFER_FILE_SEGMENT
+};
+
 struct Request {
   Headers headers;
   std::pair<std::string, size_t> response_body;
+  std::shared_ptr<FileEntry> file_ent;
+  // The offset in file_ent to read next.
+  int64_t file_offset;
   int32_t stream_id;
   int file;
   Request(int32_t stream_id);
@@ -97,6 +139,8 @@ public:
                            int32_t stream_id,
                            time_t last_modified,
                            off_t file_length,
+                           const std::vector
+                           <std::pair<std::string, std::string>>& headers,
                            nghttp2_data_provider *data_prd);
 
   int submit_response(const std::string& status,
@@ -110,6 +154,10 @@ public:
    nghttp2_data_provider *data_prd);
 
   int submit_push_promise(Request *req, const std::string& push_path);
+  // Writes DATA frame header |framehd| and |length| bytes of the
+  // file in |req| to the output buffer without copying file
+  // content.
+  int send_file_data(const uint8_t *framehd, size_t length, Request *req);
 
   void add_stream(int32_t stream_id, std::unique_ptr<Request> req);
   void remove_stream(int32_t stream_id);
@@ -123,6 +171,7 @@ public:
   void terminate_session(nghttp2_error_code error_code);
 private:
   std::map<int32_t, std::unique_ptr<Request>> id2req_;
+  util::EvbufferBuffer evbbuf_;
   int64_t session_id_;
   nghttp2_session *session_;
   Sessions *sessions_;
@@ -131,6 +180,7 @@ private:
   event *settings_timerev_;
   size_t left_connhd_len_;
   int fd_;
+  uint8_t wbuf_[4096];
 };
 
 class HttpServer {
@@ -30,11 +30,18 @@
 #include <netinet/tcp.h>
 
 #include <cstdio>
+#include <cerrno>
+#include <cstdint>
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <chrono>
 #include <thread>
+#include <algorithm>
+#include <limits>
 
 #ifdef HAVE_SPDYLAY
 #include <spdylay/spdylay.h>
@@ -47,6 +54,8 @@
 #include "http-parser/http_parser.h"
 
 #include "h2load_http2_session.h"
+#include "h2load_http1_session.h"
+#include "h2load_report.h"
 #ifdef HAVE_SPDYLAY
 #include "h2load_spdy_session.h"
 #endif // HAVE_SPDYLAY
@@ -66,7 +75,13 @@ Config::Config()
     max_concurrent_streams(1),
     window_bits(16),
     connection_window_bits(16),
+    rate(0),
+    duration(0),
+    warm_up_time(0),
+    conn_max_requests(0),
     port(0),
+    h1(false),
+    tls_resume(false),
     verbose(false)
 {}
 
@@ -102,34 +117,49 @@ void debug(const char *format, ...)
 }
 } // namespace
 
+namespace {
+uint64_t elapsed_usec(const std::chrono::steady_clock::time_point& since)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>
+    (std::chrono::steady_clock::now() - since).count();
+}
+} // namespace
+
 Stream::Stream()
-  : status_success(-1)
+  : data_offset(0),
+    request_time(std::chrono::steady_clock::now()),
+    status(0),
+    status_success(-1),
+    first_byte_received(false)
 {}
 
 Client::Client(Worker *worker)
   : worker(worker),
     ssl(nullptr),
+    ssl_session(nullptr),
     bev(nullptr),
     next_addr(config.addrs),
-    state(CLIENT_IDLE)
+    conn_req_started(0),
+    state(CLIENT_IDLE),
+    eof(false)
 {}
 
 Client::~Client()
 {
   disconnect();
+  if(ssl_session) {
+    SSL_SESSION_free(ssl_session);
+  }
 }
 
 int Client::connect()
 {
-  if(config.scheme == "https") {
-    ssl = SSL_new(worker->ssl_ctx);
-    bev = bufferevent_openssl_socket_new(worker->evbase, -1, ssl,
-                                         BUFFEREVENT_SSL_CONNECTING,
-                                         BEV_OPT_DEFER_CALLBACKS);
-  } else {
-    bev = bufferevent_socket_new(worker->evbase, -1,
-                                 BEV_OPT_DEFER_CALLBACKS);
-  }
+  // For https, TCP connection is established first, and then SSL/TLS
+  // handshake is started by start_tls(), so that we can measure them
+  // separately.
+  bev = bufferevent_socket_new(worker->evbase, -1, BEV_OPT_DEFER_CALLBACKS);
+  connect_start_time = std::chrono::steady_clock::now();
+  conn_req_started = 0;
 
   int rv = -1;
   while(next_addr) {
@@ -148,6 +178,32 @@ int Client::connect()
   return 0;
 }
 
+int Client::start_tls()
+{
+  auto fd = bufferevent_getfd(bev);
+  bufferevent_disable(bev, EV_READ | EV_WRITE);
+  bufferevent_free(bev);
+  ssl = SSL_new(worker->ssl_ctx);
+  if(ssl_session) {
+    SSL_set_session(ssl, ssl_session);
+  }
+  bev = bufferevent_openssl_socket_new(worker->evbase, fd, ssl,
+                                       BUFFEREVENT_SSL_CONNECTING,
+                                       BEV_OPT_DEFER_CALLBACKS);
+  if(!bev) {
+    return -1;
+  }
+  connect_start_time = std::chrono::steady_clock::now();
+  bufferevent_enable(bev, EV_READ);
+  bufferevent_setcb(bev, readcb, writecb, eventcb, this);
+  return 0;
+}
+
+void Client::record_connect_time(Histogram& hist)
+{
+  hist.record(elapsed_usec(connect_start_time));
+}
+
 void Client::disconnect()
 {
   process_abandoned_streams();
@@ -156,14 +212,27 @@ void Client::disconnect()
   }
   int fd = -1;
   streams.clear();
+  request_times.clear();
   session.reset();
+  if(ssl && config.tls_resume && state == CLIENT_CONNECTED) {
+    // The session is taken here rather than after handshake, because
+    // TLSv1.3 server sends session ticket after handshake.
+    if(ssl_session) {
+      SSL_SESSION_free(ssl_session);
+    }
+    ssl_session = SSL_get1_session(ssl);
+  }
   state = CLIENT_IDLE;
+  eof = false;
   if(ssl) {
     fd = SSL_get_fd(ssl);
     SSL_set_shutdown(ssl, SSL_RECEIVED_SHUTDOWN);
     SSL_shutdown(ssl);
   }
   if(bev) {
+    if(!ssl) {
+      fd = bufferevent_getfd(bev);
+    }
     bufferevent_disable(bev, EV_READ | EV_WRITE);
     bufferevent_free(bev);
     bev = nullptr;
@@ -178,22 +247,60 @@ void Client::disconnect()
   }
 }
 
+int Client::reconnect()
+{
+  disconnect();
+  if(worker->stats.req_started >= worker->stats.req_todo) {
+    return 0;
+  }
+  next_addr = config.addrs;
+  return connect();
+}
+
+bool Client::connection_done() const
+{
+  return config.conn_max_requests > 0 && state == CLIENT_CONNECTED &&
+    conn_req_started >= config.conn_max_requests && get_num_inflight() == 0;
+}
+
 void Client::submit_request()
 {
-  session->submit_request();
+  submit_request(std::chrono::steady_clock::now());
+}
+
+void Client::submit_request
+(std::chrono::steady_clock::time_point request_time)
+{
+  request_times.push_back(request_time);
+  session->submit_request(worker->get_next_request());
   ++worker->stats.req_started;
+  ++conn_req_started;
+}
+
+size_t Client::get_num_inflight() const
+{
+  return streams.size() + request_times.size();
+}
+
+bool Client::can_submit_request() const
+{
+  return state == CLIENT_CONNECTED && session && !eof &&
+    get_num_inflight() < config.max_concurrent_streams &&
+    (config.conn_max_requests == 0 ||
+     conn_req_started < config.conn_max_requests);
 }
 
 void Client::process_abandoned_streams()
 {
-  worker->stats.req_failed += streams.size();
-  worker->stats.req_error += streams.size();
-  worker->stats.req_done += streams.size();
+  auto nabandoned = streams.size() + request_times.size();
+  worker->stats.req_failed += nabandoned;
+  worker->stats.req_error += nabandoned;
+  worker->stats.req_done += nabandoned;
 }
 
 void Client::report_progress()
 {
-  if(worker->id == 0 &&
+  if(worker->id == 0 && config.duration == 0 &&
      worker->stats.req_done % worker->progress_interval == 0) {
     std::cout << "progress: "
               << worker->stats.req_done * 100 / worker->stats.req_todo
@@ -209,7 +316,11 @@ void Client::terminate_session()
 
 void Client::on_request(int32_t stream_id)
 {
-  streams[stream_id] = Stream();
+  auto& stream = streams[stream_id] = Stream();
+  if(!request_times.empty()) {
+    stream.request_time = request_times.front();
+    request_times.pop_front();
+  }
 }
 
 void Client::on_header(int32_t stream_id,
@@ -221,6 +332,11 @@ void Client::on_header(int32_t stream_id,
     return;
   }
   auto& stream = (*itr).second;
+  if(!stream.first_byte_received) {
+    stream.first_byte_received = true;
+    stream.first_byte_time = std::chrono::steady_clock::now();
+    worker->stats.ttfb_times.record(elapsed_usec(stream.request_time));
+  }
   if(stream.status_success == -1 &&
      namelen == 7 && util::streq(":status", 7, name, namelen)) {
     int status = 0;
@@ -236,6 +352,7 @@ void Client::on_header(int32_t stream_id,
         break;
       }
     }
+    stream.status = status;
 
     if(status >= 200 && status < 300) {
       ++worker->stats.status[2];
@@ -255,11 +372,27 @@ void Client::on_header(int32_t stream_id,
 void Client::on_stream_close(int32_t stream_id, bool success)
 {
   ++worker->stats.req_done;
-  if(success && streams[stream_id].status_success == 1) {
+  auto& stream = streams[stream_id];
+  if(success && stream.status_success == 1) {
     ++worker->stats.req_success;
   } else {
     ++worker->stats.req_failed;
   }
+  if(success) {
+    worker->stats.request_times.record(elapsed_usec(stream.request_time));
+  }
+  if(!config.csv_file.empty()) {
+    RequestTiming timing;
+    timing.start = std::chrono::duration_cast<std::chrono::microseconds>
+      (stream.request_time - config.start_time).count();
+    timing.ttfb = stream.first_byte_received ?
+      std::chrono::duration_cast<std::chrono::microseconds>
+      (stream.first_byte_time - stream.request_time).count() : -1;
+    timing.total = elapsed_usec(stream.request_time);
+    timing.status = stream.status;
+    timing.success = success && stream.status_success == 1;
+    worker->stats.timings.push_back(timing);
+  }
   report_progress();
   streams.erase(stream_id);
   if(worker->stats.req_done == worker->stats.req_todo) {
@@ -267,7 +400,18 @@ void Client::on_stream_close(int32_t stream_id, bool success)
     return;
   }
 
-  if(worker->stats.req_started < worker->stats.req_todo) {
+  if(worker->rate > 0) {
+    // The response is not written here since we are in the callback
+    // of session. The caller flushes it after processing input.
+    if(!worker->backlog.empty() && can_submit_request()) {
+      submit_request(worker->backlog.front());
+      worker->backlog.pop_front();
+    }
+    return;
+  }
+
+  if(worker->stats.req_started < worker->stats.req_todo &&
+     can_submit_request()) {
     submit_request();
     return;
   }
@@ -277,9 +421,21 @@ int Client::on_connect()
 {
   session->on_connect();
 
+  if(worker->rate > 0) {
+    worker->start_rate_timer();
+    while(!worker->backlog.empty() && can_submit_request()) {
+      submit_request(worker->backlog.front());
+      worker->backlog.pop_front();
+    }
+    return 0;
+  }
+
   auto nreq = std::min(worker->stats.req_todo - worker->stats.req_started,
                        std::min(worker->stats.req_todo / worker->clients.size(),
                                 config.max_concurrent_streams));
+  if(config.conn_max_requests > 0) {
+    nreq = std::min(nreq, config.conn_max_requests);
+  }
   for(; nreq > 0; --nreq) {
     submit_request();
   }
@@ -294,7 +450,21 @@ int Client::on_read()
   }
   worker->stats.bytes_total += rv;
 
-  return on_write();
+  if(on_write() != 0) {
+    return -1;
+  }
+  if(connection_done()) {
+    return reconnect();
+  }
+  return 0;
+}
+
+void Client::on_eof()
+{
+  eof = true;
+  if(session) {
+    session->on_eof();
+  }
 }
 
 int Client::on_write()
@@ -302,11 +472,38 @@ int Client::on_write()
   return session->on_write();
 }
 
+namespace {
+event_base* create_evbase()
+{
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+  // libevent 2.1 uses the coarse monotonic clock by default, whose
+  // resolution is a few milliseconds. That is too coarse to issue
+  // requests on schedule in rate mode.
+  auto cfg = event_config_new();
+  event_config_set_flag(cfg, EVENT_BASE_FLAG_PRECISE_TIMER);
+  auto evbase = event_base_new_with_config(cfg);
+  event_config_free(cfg);
+  if(evbase) {
+    return evbase;
+  }
+#endif // LIBEVENT_VERSION_NUMBER >= 0x02010100
+  return event_base_new();
+}
+} // namespace
+
 Worker::Worker(uint32_t id, SSL_CTX *ssl_ctx, size_t req_todo, size_t nclients,
                Config *config)
-  : stats{0}, evbase(event_base_new()), ssl_ctx(ssl_ctx), config(config),
+  : stats{}, evbase(create_evbase()), ssl_ctx(ssl_ctx), config(config),
+    rate_timer(nullptr), tick_timer(nullptr),
+    rate(static_cast<double>(config->rate) / config->nthreads),
+    req_scheduled(0), rng(id), next_client(0), elapsed_sec(0),
+    last_snapshot{0, 0},
     id(id), term_timer_started(false)
 {
+  if(config->duration > 0) {
+    // req_todo is fixed when the deadline comes.
+    req_todo = std::numeric_limits<size_t>::max();
+  }
   stats.req_todo = req_todo;
   progress_interval = std::max((size_t)1, req_todo / 10);
   for(size_t i = 0; i < nclients; ++i) {
@@ -316,11 +513,30 @@ Worker::Worker(uint32_t id, SSL_CTX *ssl_ctx, size_t req_todo, size_t nclients,
 
 Worker::~Worker()
 {
+  if(rate_timer) {
+    event_free(rate_timer);
+  }
+  if(tick_timer) {
+    event_free(tick_timer);
+  }
   event_base_free(evbase);
 }
 
+namespace {
+void tick_timeout_cb(evutil_socket_t fd, short what, void *arg)
+{
+  auto worker = static_cast<Worker*>(arg);
+  worker->on_tick();
+}
+} // namespace
+
 void Worker::run()
 {
+  if(config->duration > 0) {
+    tick_timer = event_new(evbase, -1, EV_PERSIST, tick_timeout_cb, this);
+    timeval tv = { 1, 0 };
+    evtimer_add(tick_timer, &tv);
+  }
   for(auto& client : clients) {
     if(client->connect() != 0) {
       std::cerr << "client could not connect to host" << std::endl;
@@ -349,6 +565,154 @@ void Worker::schedule_terminate()
   evtimer_add(term_timer, &timeout);
 }
 
+namespace {
+void rate_timeout_cb(evutil_socket_t fd, short what, void *arg)
+{
+  auto worker = static_cast<Worker*>(arg);
+  worker->on_rate_timeout();
+}
+} // namespace
+
+void Worker::start_rate_timer()
+{
+  if(rate_timer) {
+    return;
+  }
+  rate_start_time = std::chrono::steady_clock::now();
+  rate_timer = evtimer_new(evbase, rate_timeout_cb, this);
+  on_rate_timeout();
+}
+
+void Worker::on_rate_timeout()
+{
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>
+    (now - rate_start_time).count();
+  auto due = std::min(stats.req_todo,
+                      static_cast<size_t>(elapsed * rate) + 1);
+  for(; req_scheduled < due; ++req_scheduled) {
+    backlog.push_back(get_scheduled_time(req_scheduled));
+  }
+
+  std::vector<Client*> submitted;
+  while(!backlog.empty()) {
+    Client *client = nullptr;
+    for(size_t i = 0; i < clients.size(); ++i) {
+      auto c = clients[next_client].get();
+      next_client = (next_client + 1) % clients.size();
+      if(c->can_submit_request()) {
+        client = c;
+        break;
+      }
+    }
+    if(!client) {
+      break;
+    }
+    client->submit_request(backlog.front());
+    backlog.pop_front();
+    if(std::find(std::begin(submitted), std::end(submitted), client) ==
+       std::end(submitted)) {
+      submitted.push_back(client);
+    }
+  }
+  for(auto client : submitted) {
+    if(client->on_write() != 0) {
+      client->disconnect();
+    }
+  }
+
+  auto alive = std::any_of(std::begin(clients), std::end(clients),
+                           [](const std::unique_ptr<Client>& client)
+                           {
+                             return client->bev != nullptr;
+                           });
+  // The backlog is also drained when streams are closed, so the timer
+  // is only needed to schedule the remaining requests. If all clients
+  // are gone, they are never issued; let event loop exit.
+  if(!alive || req_scheduled == stats.req_todo) {
+    return;
+  }
+  auto timeout = std::chrono::duration_cast<std::chrono::microseconds>
+    (get_scheduled_time(req_scheduled) - std::chrono::steady_clock::now())
+    .count();
+  timeout = std::max(static_cast<decltype(timeout)>(0), timeout);
+  timeval tv = { static_cast<time_t>(timeout / 1000000),
+                 static_cast<suseconds_t>(timeout % 1000000) };
+  evtimer_add(rate_timer, &tv);
+}
+
+const Request* Worker::get_next_request()
+{
+  if(config->reqs.size() == 1) {
+    return &config->reqs[0];
+  }
+  auto r = std::uniform_int_distribution<uint64_t>
+    (0, config->weight_sums.back() - 1)(rng);
+  auto i = std::upper_bound(std::begin(config->weight_sums),
+                            std::end(config->weight_sums), r)
+    - std::begin(config->weight_sums);
+  return &config->reqs[i];
+}
+
+std::chrono::steady_clock::time_point
+Worker::get_scheduled_time(size_t n) const
+{
+  return rate_start_time +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>
+    (std::chrono::duration<double>(n / rate));
+}
+
+void Worker::on_tick()
+{
+  ++elapsed_sec;
+  if(elapsed_sec <= config->warm_up_time) {
+    if(elapsed_sec == config->warm_up_time) {
+      reset_stats();
+    }
+    return;
+  }
+  auto bytes = stats.bytes_head + stats.bytes_body;
+  stats.snapshots.push_back(Snapshot{stats.req_done - last_snapshot.req_done,
+                                     bytes - last_snapshot.bytes});
+  last_snapshot.req_done = stats.req_done;
+  last_snapshot.bytes = bytes;
+
+  if(elapsed_sec == config->warm_up_time + config->duration) {
+    event_del(tick_timer);
+    stop_issuing_requests();
+  }
+}
+
+void Worker::reset_stats()
+{
+  // The requests in flight finish during measurement, so they are
+  // counted as started in the new stats.
+  size_t inflight = 0;
+  for(auto& client : clients) {
+    inflight += client->get_num_inflight();
+  }
+  Stats new_stats{};
+  new_stats.req_todo = stats.req_todo;
+  new_stats.req_started = inflight;
+  last_snapshot = Snapshot{0, 0};
+  new_stats.connect_times = std::move(stats.connect_times);
+  new_stats.tls_handshake_times = std::move(stats.tls_handshake_times);
+  stats = std::move(new_stats);
+}
+
+void Worker::stop_issuing_requests()
+{
+  stats.req_todo = stats.req_started;
+  backlog.clear();
+  req_scheduled = stats.req_todo;
+  if(rate_timer) {
+    event_del(rate_timer);
+  }
+  if(stats.req_done == stats.req_todo) {
+    schedule_terminate();
+  }
+}
+
 void Worker::terminate_session()
 {
   for(auto& client : clients) {
@@ -368,9 +732,9 @@ void debug_nextproto_error()
 {
 #ifdef HAVE_SPDYLAY
   debug("no supported protocol was negotiated, expected: %s, "
-        "spdy/2, spdy/3, spdy/3.1\n", NGHTTP2_PROTO_VERSION_ID);
+        "spdy/2, spdy/3, spdy/3.1, http/1.1\n", NGHTTP2_PROTO_VERSION_ID);
 #else // !HAVE_SPDYLAY
-  debug("no supported protocol was negotiated, expected: %s\n",
+  debug("no supported protocol was negotiated, expected: %s, http/1.1\n",
         NGHTTP2_PROTO_VERSION_ID);
 #endif // !HAVE_SPDYLAY
 }
@@ -382,20 +746,29 @@ void eventcb(bufferevent *bev, short events, void *ptr)
   int rv;
   auto client = static_cast<Client*>(ptr);
   if(events & BEV_EVENT_CONNECTED) {
+    if(config.scheme == "https" && !client->ssl) {
+      client->record_connect_time(client->worker->stats.connect_times);
+      if(client->start_tls() != 0) {
+        debug("could not start SSL/TLS handshake\n");
+        client->disconnect();
+      }
+      return;
+    }
     if(client->ssl) {
+      client->record_connect_time
+        (client->worker->stats.tls_handshake_times);
       const unsigned char *next_proto = nullptr;
       unsigned int next_proto_len;
       SSL_get0_next_proto_negotiated(client->ssl,
                                      &next_proto, &next_proto_len);
 
-      if(!next_proto) {
-        debug_nextproto_error();
-        client->disconnect();
-        return;
-      }
-
-      if(next_proto_len == NGHTTP2_PROTO_VERSION_ID_LEN &&
-         memcmp(NGHTTP2_PROTO_VERSION_ID, next_proto, next_proto_len) == 0) {
+      if(!next_proto || config.h1 ||
+         util::streq("http/1.1", 8, next_proto, next_proto_len)) {
+        // If the server does not support NPN, assume HTTP/1.1.
+        client->session = util::make_unique<Http1Session>(client);
+      } else if(next_proto_len == NGHTTP2_PROTO_VERSION_ID_LEN &&
+                memcmp(NGHTTP2_PROTO_VERSION_ID, next_proto,
+                       next_proto_len) == 0) {
         client->session = util::make_unique<Http2Session>(client);
       } else {
 #ifdef HAVE_SPDYLAY
@@ -416,17 +789,27 @@ void eventcb(bufferevent *bev, short events, void *ptr)
 #endif // !HAVE_SPDYLAY
       }
     } else {
-      client->session = util::make_unique<Http2Session>(client);
+      client->record_connect_time(client->worker->stats.connect_times);
+      if(config.h1) {
+        client->session = util::make_unique<Http1Session>(client);
+      } else {
+        client->session = util::make_unique<Http2Session>(client);
+      }
     }
     int fd = bufferevent_getfd(bev);
     int val = 1;
     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
                reinterpret_cast<char *>(&val), sizeof(val));
+    ++client->worker->stats.conn_success;
+    if(client->ssl && SSL_session_reused(client->ssl)) {
+      ++client->worker->stats.conn_resumed;
+    }
     client->state = CLIENT_CONNECTED;
     client->on_connect();
     return;
   }
   if(events & BEV_EVENT_EOF) {
+    client->on_eof();
     client->disconnect();
     return;
   }
@@ -505,15 +888,21 @@ int client_select_next_proto_cb(SSL* ssl,
                                 const unsigned char *in, unsigned int inlen,
                                 void *arg)
 {
-  if(nghttp2_select_next_protocol(out, outlen, in, inlen) > 0) {
-    return SSL_TLSEXT_ERR_OK;
-  }
+  if(!config.h1) {
+    if(nghttp2_select_next_protocol(out, outlen, in, inlen) > 0) {
+      return SSL_TLSEXT_ERR_OK;
+    }
 #ifdef HAVE_SPDYLAY
-  else if(spdylay_select_next_protocol(out, outlen, in, inlen) > 0) {
-    return SSL_TLSEXT_ERR_OK;
+    if(spdylay_select_next_protocol(out, outlen, in, inlen) > 0) {
+      return SSL_TLSEXT_ERR_OK;
+    }
+#endif // HAVE_SPDYLAY
   }
-#endif
-  return SSL_TLSEXT_ERR_NOACK;
+  // Fall back to HTTP/1.1. NPN lets the client select the protocol
+  // the server did not advertise.
+  *out = reinterpret_cast<unsigned char*>(const_cast<char*>("http/1.1"));
+  *outlen = 8;
+  return SSL_TLSEXT_ERR_OK;
 }
 } // namespace
 
@@ -527,7 +916,7 @@ void print_version(std::ostream& out)
 namespace {
 void print_usage(std::ostream& out)
 {
-  out << "Usage: h2load [OPTIONS]... <URI>\n"
+  out << "Usage: h2load [OPTIONS]... [URI]...\n"
       << "benchmarking tool for HTTP/2 and SPDY server" << std::endl;
 }
 } // namespace
@@ -537,7 +926,10 @@ void print_help(std::ostream& out)
 {
   print_usage(out);
   out << "\n"
-      << "  <URI>              Specify URI to access.\n"
+      << "  <URI>              Specify URI to access.  If more than one\n"
+      << "                     URI is given, each request is sent to one\n"
+      << "                     of them chosen at random.  All URIs must\n"
+      << "                     have the same scheme, host and port.\n"
       << "Options:\n"
       << "  -n, --requests=<N> Number of requests. Default: "
       << config.nreqs << "\n"
@@ -558,6 +950,67 @@ void print_help(std::ostream& out)
       << "                     size to 2**<N>-1. This option does not work\n"
       << "                     with SPDY.\n"
       << "                     instead.\n"
+      << "  -r, --rate=<N>     Issue <N> requests per second in total on\n"
+      << "                     the fixed schedule, regardless of how fast\n"
+      << "                     the server responds.  The requests which\n"
+      << "                     cannot be issued on time because all\n"
+      << "                     clients have -m streams in flight are\n"
+      << "                     queued, and the latency is measured from\n"
+      << "                     the scheduled time.  0 means that a new\n"
+      << "                     request is issued when the previous one\n"
+      << "                     finishes.  Default: "
+      << config.rate << "\n"
+      << "  -D, --duration=<N> Run the benchmark for <N> seconds instead\n"
+      << "                     of issuing -n requests, and show the\n"
+      << "                     throughput of each second.  The requests\n"
+      << "                     in flight at the deadline are allowed to\n"
+      << "                     finish.\n"
+      << "  --warm-up-time=<N> Start measurement after <N> seconds, and\n"
+      << "                     discard the stats collected before that,\n"
+      << "                     except for the time for connect and\n"
+      << "                     SSL/TLS handshake.  This option requires\n"
+      << "                     -D.  Default: "
+      << config.warm_up_time << "\n"
+      << "  -i, --input-file=<FILE>\n"
+      << "                     Read URIs from <FILE> in addition to the\n"
+      << "                     command-line.  Each line contains URI,\n"
+      << "                     followed by optional TAB separated\n"
+      << "                     fields: \"weight=<N>\" makes the URI <N>\n"
+      << "                     times as likely to be chosen, \"header=\n"
+      << "                     <NAME>: <VALUE>\" adds a header field, and\n"
+      << "                     \"data=<FILE>\" posts the content of\n"
+      << "                     <FILE>.  Empty lines and lines starting\n"
+      << "                     with '#' are ignored.\n"
+      << "  -H, --header=<HEADER>\n"
+      << "                     Add a header to all requests.  The pseudo\n"
+      << "                     header fields override the ones derived\n"
+      << "                     from URI.\n"
+      << "                     Example: -H':method: PUT'\n"
+      << "  -d, --data=<FILE>  Post the content of <FILE> in all requests\n"
+      << "                     unless overridden in the input file.\n"
+      << "  --h1               Use HTTP/1.1 for all requests.  Without\n"
+      << "                     this option, HTTP/1.1 is used only if\n"
+      << "                     the server does not negotiate HTTP/2 or\n"
+      << "                     SPDY via NPN.  With HTTP/1.1, -m sets\n"
+      << "                     the number of pipelined requests.\n"
+      << "  --requests-per-connection=<N>\n"
+      << "                     Issue at most <N> requests on a\n"
+      << "                     connection.  When they finish, the client\n"
+      << "                     closes the connection and connects again.\n"
+      << "                     This measures the cost of connection\n"
+      << "                     setup.  0 means unlimited.  Default: "
+      << config.conn_max_requests << "\n"
+      << "  --tls-resume       Resume the previous SSL/TLS session when\n"
+      << "                     the client connects again.\n"
+      << "  --json=<FILE>      Write the configuration, the merged and per\n"
+      << "                     thread stats, latency histograms and the\n"
+      << "                     throughput of each second to <FILE> in\n"
+      << "                     JSON.\n"
+      << "  --csv=<FILE>       Write the timing of each request to <FILE>\n"
+      << "                     in CSV.  The columns are thread, start,\n"
+      << "                     ttfb, total, status and success.  The\n"
+      << "                     times are in microseconds, and start is\n"
+      << "                     relative to the start of benchmark.\n"
       << "  -v, --verbose      Output debug information.\n"
       << "  --version          Display version information and exit.\n"
       << "  -h, --help         Display this help and exit.\n"
@@ -565,8 +1018,323 @@ void print_help(std::ostream& out)
 }
 } // namespace
 
+namespace {
+// Formats |usec| in the unit which keeps the number short.
+std::string format_duration(uint64_t usec)
+{
+  std::ostringstream ss;
+  if(usec < 1000) {
+    ss << usec << "us";
+  } else {
+    ss << std::fixed << std::setprecision(2);
+    if(usec < 1000 * 1000) {
+      ss << usec / 1000.0 << "ms";
+    } else {
+      ss << usec / (1000.0 * 1000) << "s";
+    }
+  }
+  return ss.str();
+}
+} // namespace
+
+namespace {
+void print_latency(std::ostream& out, const char *label,
+                   const Histogram& hist)
+{
+  out << std::left << std::setw(18) << label << std::right;
+  if(hist.count() == 0) {
+    out << "no data\n";
+    return;
+  }
+  uint64_t values[] = {
+    hist.min(), static_cast<uint64_t>(hist.mean()),
+    hist.percentile(50), hist.percentile(90), hist.percentile(99),
+    hist.percentile(99.9), hist.max()
+  };
+  for(auto v : values) {
+    out << std::setw(11) << format_duration(v);
+  }
+  out << "\n";
+}
+} // namespace
+
+namespace {
+std::string describe_work(size_t nreqs)
+{
+  if(config.duration > 0) {
+    return "running for " + util::utos(config.duration) + " seconds";
+  }
+  return util::utos(nreqs) + " total requests";
+}
+} // namespace
+
+namespace {
+void merge_stats(Stats& dest, const Stats& src)
+{
+  dest.req_todo += src.req_todo;
+  dest.req_started += src.req_started;
+  dest.req_done += src.req_done;
+  dest.req_success += src.req_success;
+  dest.req_failed += src.req_failed;
+  dest.req_error += src.req_error;
+  dest.bytes_total += src.bytes_total;
+  dest.bytes_head += src.bytes_head;
+  dest.bytes_body += src.bytes_body;
+  dest.conn_success += src.conn_success;
+  dest.conn_resumed += src.conn_resumed;
+  for(size_t j = 0; j < 6; ++j) {
+    dest.status[j] += src.status[j];
+  }
+  dest.request_times.merge(src.request_times);
+  dest.ttfb_times.merge(src.ttfb_times);
+  dest.connect_times.merge(src.connect_times);
+  dest.tls_handshake_times.merge(src.tls_handshake_times);
+  if(dest.snapshots.size() < src.snapshots.size()) {
+    dest.snapshots.resize(src.snapshots.size(), Snapshot{0, 0});
+  }
+  for(size_t i = 0; i < src.snapshots.size(); ++i) {
+    dest.snapshots[i].req_done += src.snapshots[i].req_done;
+    dest.snapshots[i].bytes += src.snapshots[i].bytes;
+  }
+  // timings are written per worker, and not merged.
+}
+} // namespace
+
+namespace {
+int read_file(std::string& out, const char *path)
+{
+  std::ifstream f(path, std::ios::binary);
+  if(!f) {
+    std::cerr << "could not open file: " << path << std::endl;
+    return -1;
+  }
+  std::ostringstream ss;
+  ss << f.rdbuf();
+  out = ss.str();
+  return 0;
+}
+} // namespace
+
+namespace {
+// Parses |header| in the form "<NAME>: <VALUE>", and appends it to
+// |headers|. The name is lower-cased. Returns 0 if it succeeds, or
+// -1.
+int parse_header(Headers& headers, const std::string& header)
+{
+  // Skip first possible ':' in the header name
+  auto pos = header.find(':', 1);
+  if(pos == std::string::npos || pos == 1) {
+    std::cerr << "invalid header: " << header << std::endl;
+    return -1;
+  }
+  auto value = header.substr(pos + 1);
+  value.erase(0, value.find_first_not_of(" \t"));
+  if(value.empty()) {
+    std::cerr << "invalid header - value missing: " << header << std::endl;
+    return -1;
+  }
+  headers.emplace_back(header.substr(0, pos), value);
+  util::inp_strlower(headers.back().first);
+  return 0;
+}
+} // namespace
+
+namespace {
+// Appends the request to |uri| to config.reqs. The request carries
+// |headers| in addition to the pseudo header fields. If |data| is
+// not empty, it is sent as request body with POST. The first URI
+// determines the host to connect to, and the other URIs must have the
+// same scheme, host and port. Returns 0 if it succeeds, or -1.
+int add_request(const std::string& uri, const Headers& headers,
+                const std::string& data, uint32_t weight)
+{
+  http_parser_url u;
+  memset(&u, 0, sizeof(u));
+  if(http_parser_parse_url(uri.c_str(), uri.size(), 0, &u) != 0 ||
+     !util::has_uri_field(u, UF_SCHEMA) || !util::has_uri_field(u, UF_HOST)) {
+    std::cerr << "invalid URI: " << uri << std::endl;
+    return -1;
+  }
+  auto scheme = util::get_uri_field(uri.c_str(), u, UF_SCHEMA);
+  auto host = util::get_uri_field(uri.c_str(), u, UF_HOST);
+  auto default_port = util::get_default_port(uri.c_str(), u);
+  uint16_t port = util::has_uri_field(u, UF_PORT) ? u.port : default_port;
+
+  if(config.reqs.empty()) {
+    config.scheme = scheme;
+    config.host = host;
+    config.port = port;
+  } else if(config.scheme != scheme || config.host != host ||
+            config.port != port) {
+    std::cerr << "all URIs must have the same scheme, host and port: "
+              << uri << std::endl;
+    return -1;
+  }
+
+  std::string path;
+  if(util::has_uri_field(u, UF_PATH)) {
+    path = util::get_uri_field(uri.c_str(), u, UF_PATH);
+  } else {
+    path = "/";
+  }
+  if(util::has_uri_field(u, UF_QUERY)) {
+    path += "?";
+    path += util::get_uri_field(uri.c_str(), u, UF_QUERY);
+  }
+
+  Request req;
+  req.uri = uri;
+  req.headers.emplace_back(":scheme", scheme);
+  if(port != default_port) {
+    req.headers.emplace_back(":authority", host + ":" + util::utos(port));
+  } else {
+    req.headers.emplace_back(":authority", host);
+  }
+  req.headers.emplace_back(":path", path);
+  req.headers.emplace_back(":method", data.empty() ? "GET" : "POST");
+  for(auto& header : headers) {
+    // The pseudo header fields given by the user override the ones
+    // derived from the URI.
+    auto itr = std::end(req.headers);
+    if(header.first[0] == ':') {
+      itr = std::find_if(std::begin(req.headers), std::end(req.headers),
+                         [&header](const Headers::value_type& nv)
+                         {
+                           return nv.first == header.first;
+                         });
+    }
+    if(itr == std::end(req.headers)) {
+      req.headers.push_back(header);
+    } else {
+      (*itr).second = header.second;
+    }
+  }
+  if(!data.empty()) {
+    req.headers.emplace_back("content-length", util::utos(data.size()));
+  }
+  req.data = data;
+  req.weight = weight;
+  config.reqs.push_back(std::move(req));
+  return 0;
+}
+} // namespace
+
+namespace {
+// Reads the requests from the file at |path|. Each line contains URI
+// followed by optional TAB separated fields: "weight=<N>",
+// "header=<NAME>: <VALUE>" and "data=<FILE>". header may appear more
+// than once, and is added to |headers|. data overrides |data|. Empty
+// lines and lines starting with '#' are ignored. Returns 0 if it
+// succeeds, or -1.
+int read_input_file(const char *path, const Headers& headers,
+                    const std::string& data)
+{
+  std::ifstream f(path);
+  if(!f) {
+    std::cerr << "-i: could not open file: " << path << std::endl;
+    return -1;
+  }
+  std::string line;
+  for(size_t lineno = 1; std::getline(f, line); ++lineno) {
+    if(line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::vector<std::string> fields;
+    size_t pos = 0;
+    for(;;) {
+      auto end = line.find('\t', pos);
+      fields.push_back(line.substr(pos, end - pos));
+      if(end == std::string::npos) {
+        break;
+      }
+      pos = end + 1;
+    }
+    auto req_headers = headers;
+    auto req_data = data;
+    uint32_t weight = 1;
+    for(size_t i = 1; i < fields.size(); ++i) {
+      auto& field = fields[i];
+      if(util::startsWith(field, "weight=")) {
+        char *end;
+        errno = 0;
+        auto n = strtoul(field.c_str() + 7, &end, 10);
+        if(errno != 0 || *end != '\0' || n == 0 || n > UINT32_MAX) {
+          std::cerr << path << ":" << lineno << ": invalid weight: "
+                    << field << std::endl;
+          return -1;
+        }
+        weight = n;
+      } else if(util::startsWith(field, "header=")) {
+        if(parse_header(req_headers, field.substr(7)) != 0) {
+          std::cerr << path << ":" << lineno << ": invalid field" << std::endl;
+          return -1;
+        }
+      } else if(util::startsWith(field, "data=")) {
+        if(read_file(req_data, field.c_str() + 5) != 0) {
+          return -1;
+        }
+      } else if(!field.empty()) {
+        std::cerr << path << ":" << lineno << ": unknown field: "
+                  << field << std::endl;
+        return -1;
+      }
+    }
+    if(add_request(fields[0], req_headers, req_data, weight) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+} // namespace
+
+namespace {
+// Builds nva, nv and h1_header of |req| from its headers.
+void build_nv(Request& req)
+{
+  std::string method, path, authority, rest;
+  for(auto& nv : req.headers) {
+    if(nv.first == ":method") {
+      method = nv.second;
+    } else if(nv.first == ":path") {
+      path = nv.second;
+    } else if(nv.first == ":authority") {
+      authority = nv.second;
+    } else if(nv.first[0] != ':') {
+      rest += nv.first;
+      rest += ": ";
+      rest += nv.second;
+      rest += "\r\n";
+    }
+  }
+  req.h1_header = method + " " + path + " HTTP/1.1\r\n";
+  req.h1_header += "host: " + authority + "\r\n";
+  req.h1_header += rest;
+  req.h1_header += "\r\n";
+  req.h1_head = method == "HEAD";
+
+  for(auto& nv : req.headers) {
+    req.nva.push_back(http2::make_nv(nv.first, nv.second));
+  }
+
+  for(auto& nv : req.headers) {
+    if(nv.first == ":authority") {
+      req.nv.push_back(":host");
+    } else {
+      req.nv.push_back(nv.first.c_str());
+    }
+    req.nv.push_back(nv.second.c_str());
+  }
+  req.nv.push_back(":version");
+  req.nv.push_back("HTTP/1.1");
+  req.nv.push_back(nullptr);
+}
+} // namespace
+
 int main(int argc, char **argv)
 {
+  Headers headers;
+  std::string data;
+  const char *input_file = nullptr;
   while(1) {
     int flag = 0;
     static option long_options[] = {
@@ -576,13 +1344,24 @@ int main(int argc, char **argv)
       {"max-concurrent-streams", required_argument, nullptr, 'm'},
       {"window-bits", required_argument, nullptr, 'w'},
       {"connection-window-bits", required_argument, nullptr, 'W'},
+      {"rate", required_argument, nullptr, 'r'},
+      {"header", required_argument, nullptr, 'H'},
+      {"data", required_argument, nullptr, 'd'},
+      {"input-file", required_argument, nullptr, 'i'},
+      {"duration", required_argument, nullptr, 'D'},
+      {"warm-up-time", required_argument, &flag, 2},
+      {"h1", no_argument, &flag, 3},
+      {"requests-per-connection", required_argument, &flag, 4},
+      {"tls-resume", no_argument, &flag, 5},
+      {"json", required_argument, &flag, 6},
+      {"csv", required_argument, &flag, 7},
       {"verbose", no_argument, nullptr, 'v'},
       {"help", no_argument, nullptr, 'h'},
       {"version", no_argument, &flag, 1},
       {nullptr, 0, nullptr, 0 }
     };
     int option_index = 0;
-    auto c = getopt_long(argc, argv, "hvW:c:m:n:t:w:", long_options,
+    auto c = getopt_long(argc, argv, "hvD:H:W:c:d:i:m:n:r:t:w:", long_options,
                          &option_index);
     if(c == -1) {
       break;
@@ -600,6 +1379,25 @@ int main(int argc, char **argv)
     case 'm':
       config.max_concurrent_streams = strtoul(optarg, nullptr, 10);
       break;
+    case 'r':
+      config.rate = strtoul(optarg, nullptr, 10);
+      break;
+    case 'D':
+      config.duration = strtoul(optarg, nullptr, 10);
+      break;
+    case 'H':
+      if(parse_header(headers, optarg) != 0) {
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'd':
+      if(read_file(data, optarg) != 0) {
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'i':
+      input_file = optarg;
+      break;
     case 'w':
     case 'W': {
       errno = 0;
@@ -634,6 +1432,30 @@ int main(int argc, char **argv)
         // version option
         print_version(std::cout);
         exit(EXIT_SUCCESS);
+      case 2:
+        // warm-up-time option
+        config.warm_up_time = strtoul(optarg, nullptr, 10);
+        break;
+      case 3:
+        // h1 option
+        config.h1 = true;
+        break;
+      case 4:
+        // requests-per-connection option
+        config.conn_max_requests = strtoul(optarg, nullptr, 10);
+        break;
+      case 5:
+        // tls-resume option
+        config.tls_resume = true;
+        break;
+      case 6:
+        // json option
+        config.json_file = optarg;
+        break;
+      case 7:
+        // csv option
+        config.csv_file = optarg;
+        break;
       }
       break;
     default:
@@ -641,11 +1463,6 @@ int main(int argc, char **argv)
     }
   }
 
-  if(argc == optind) {
-    std::cerr << "no URI given" << std::endl;
-    exit(EXIT_FAILURE);
-  }
-
   if(config.nreqs == 0) {
     std::cerr << "-n: the number of requests must be strictly greater than 0."
               << std::endl;
@@ -665,7 +1482,12 @@ int main(int argc, char **argv)
     exit(EXIT_FAILURE);
   }
 
-  if(config.nreqs < config.nclients) {
+  if(config.warm_up_time > 0 && config.duration == 0) {
+    std::cerr << "--warm-up-time: requires -D" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if(config.duration == 0 && config.nreqs < config.nclients) {
     std::cerr << "-n, -c: the number of requests must be greater than or "
               << "equal to the concurrent clients."
               << std::endl;
@@ -687,26 +1509,25 @@ int main(int argc, char **argv)
 
   ssl::LibsslGlobalLock();
 
-  http_parser_url u;
-  memset(&u, 0, sizeof(u));
-  auto uri = argv[optind];
-  if(http_parser_parse_url(uri, strlen(uri), 0, &u) != 0 ||
-     !util::has_uri_field(u, UF_SCHEMA) || !util::has_uri_field(u, UF_HOST)) {
-    std::cerr << "invalid URI: " << uri << std::endl;
+  for(int i = optind; i < argc; ++i) {
+    if(add_request(argv[i], headers, data, 1) != 0) {
+      exit(EXIT_FAILURE);
+    }
+  }
+  if(input_file && read_input_file(input_file, headers, data) != 0) {
     exit(EXIT_FAILURE);
   }
-
-  config.scheme = util::get_uri_field(uri, u, UF_SCHEMA);
-  config.host = util::get_uri_field(uri, u, UF_HOST);
-  if(util::has_uri_field(u, UF_PORT)) {
-    config.port = u.port;
-  } else {
-    config.port = util::get_default_port(uri, u);
+  if(config.reqs.empty()) {
+    std::cerr << "no URI given" << std::endl;
+    exit(EXIT_FAILURE);
   }
-  if(util::has_uri_field(u, UF_PATH)) {
-    config.path = util::get_uri_field(uri, u, UF_PATH);
-  } else {
-    config.path = "/";
+  // config.reqs is not modified after this point, so that nva and nv
+  // can point to its strings.
+  uint64_t weight_sum = 0;
+  for(auto& req : config.reqs) {
+    build_nv(req);
+    weight_sum += req.weight;
+    config.weight_sums.push_back(weight_sum);
   }
 
   auto ssl_ctx = SSL_CTX_new(SSLv23_client_method());
@@ -717,34 +1538,6 @@ int main(int argc, char **argv)
   }
   SSL_CTX_set_next_proto_select_cb(ssl_ctx,
                                    client_select_next_proto_cb, nullptr);
-  // For nghttp2
-  Headers nva;
-  nva.emplace_back(":scheme", config.scheme);
-  if(config.port != util::get_default_port(uri, u)) {
-    nva.emplace_back(":authority",
-                     config.host + ":" + util::utos(config.port));
-  } else {
-    nva.emplace_back(":authority", config.host);
-  }
-  nva.emplace_back(":path", config.path);
-  nva.emplace_back(":method", "GET");
-
-  for(auto& nv : nva) {
-    config.nva.push_back(http2::make_nv(nv.first, nv.second));
-  }
-
-  // For spdylay
-  for(auto& nv : nva) {
-    if(nv.first == ":authority") {
-      config.nv.push_back(":host");
-    } else {
-      config.nv.push_back(nv.first.c_str());
-    }
-    config.nv.push_back(nv.second.c_str());
-  }
-  config.nv.push_back(":version");
-  config.nv.push_back("HTTP/1.1");
-  config.nv.push_back(nullptr);
 
   resolve_host();
 
@@ -758,6 +1551,7 @@ int main(int argc, char **argv)
 
   std::vector<std::thread> threads;
   auto start = std::chrono::steady_clock::now();
+  config.start_time = start;
 
   std::vector<std::unique_ptr<Worker>> workers;
   for(size_t i = 0; i < config.nthreads - 1; ++i) {
@@ -765,7 +1559,7 @@ int main(int argc, char **argv)
     auto nclients = nclients_per_thread + (nclients_rem-- > 0);
     std::cout << "spawning thread #" << i << ": "
               << nclients << " concurrent clients, "
-              << nreqs << " total requests"
+              << describe_work(nreqs)
               << std::endl;
     workers.push_back(util::make_unique<Worker>(i, ssl_ctx, nreqs, nclients,
                                                 &config));
@@ -775,7 +1569,7 @@ int main(int argc, char **argv)
   auto nclients_last = nclients_per_thread + (nclients_rem-- > 0);
   std::cout << "spawning thread #" << (config.nthreads - 1) << ": "
             << nclients_last << " concurrent clients, "
-            << nreqs_last << " total requests"
+            << describe_work(nreqs_last)
             << std::endl;
   Worker worker(config.nthreads - 1, ssl_ctx, nreqs_last, nclients_last,
                 &config);
@@ -783,42 +1577,46 @@ int main(int argc, char **argv)
 
   for(size_t i = 0; i < config.nthreads - 1; ++i) {
     threads[i].join();
-    worker.stats.req_todo += workers[i]->stats.req_todo;
-    worker.stats.req_started += workers[i]->stats.req_started;
-    worker.stats.req_done += workers[i]->stats.req_done;
-    worker.stats.req_success += workers[i]->stats.req_success;
-    worker.stats.req_failed += workers[i]->stats.req_failed;
-    worker.stats.req_error += workers[i]->stats.req_error;
-    worker.stats.bytes_total += workers[i]->stats.bytes_total;
-    worker.stats.bytes_head += workers[i]->stats.bytes_head;
-    worker.stats.bytes_body += workers[i]->stats.bytes_body;
-    for(size_t j = 0; j < 6; ++j) {
-      worker.stats.status[j] += workers[i]->stats.status[j];
-    }
   }
 
+  Stats stats{};
+  std::vector<const Stats*> worker_stats;
+  for(auto& w : workers) {
+    merge_stats(stats, w->stats);
+    worker_stats.push_back(&w->stats);
+  }
+  merge_stats(stats, worker.stats);
+  worker_stats.push_back(&worker.stats);
+
   auto end = std::chrono::steady_clock::now();
   auto duration =
     std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  // The requests issued during warm-up are not counted.
+  duration = std::max(static_cast<decltype(duration)>(0),
+                      duration - static_cast<decltype(duration)>
+                      (config.warm_up_time) * 1000 * 1000);
 
   // Requests which have not been issued due to connection errors, are
   // counted towards req_failed and req_error.
-  auto req_not_issued = worker.stats.req_todo
-    - worker.stats.req_success - worker.stats.req_failed;
-  worker.stats.req_failed += req_not_issued;
-  worker.stats.req_error += req_not_issued;
+  auto req_not_issued = stats.req_todo
+    - stats.req_success - stats.req_failed;
+  stats.req_failed += req_not_issued;
+  stats.req_error += req_not_issued;
 
   // UI is heavily inspired by weighttp
   // https://github.com/lighttpd/weighttp
   size_t rps;
   int64_t kbps;
+  size_t cps;
   if(duration > 0) {
     auto secd = static_cast<double>(duration) / (1000 * 1000);
-    rps = worker.stats.req_todo / secd;
-    kbps = (worker.stats.bytes_head + worker.stats.bytes_body) / secd / 1024;
+    rps = stats.req_todo / secd;
+    kbps = (stats.bytes_head + stats.bytes_body) / secd / 1024;
+    cps = stats.conn_success / secd;
   } else {
     rps = 0;
     kbps = 0;
+    cps = 0;
   }
 
   auto sec = duration / (1000 * 1000);
@@ -833,22 +1631,58 @@ int main(int argc, char **argv)
             << rps << " req/s, "
             << kbps << " kbytes/s\n"
             << "requests: "
-            << worker.stats.req_todo << " total, "
-            << worker.stats.req_started << " started, "
-            << worker.stats.req_done << " done, "
-            << worker.stats.req_success << " succeeded, "
-            << worker.stats.req_failed << " failed, "
-            << worker.stats.req_error << " errored\n"
+            << stats.req_todo << " total, "
+            << stats.req_started << " started, "
+            << stats.req_done << " done, "
+            << stats.req_success << " succeeded, "
+            << stats.req_failed << " failed, "
+            << stats.req_error << " errored\n"
+            << "connections: "
+            << stats.conn_success << " established, "
+            << stats.conn_resumed << " resumed, "
+            << cps << " conn/s\n"
             << "status codes: "
-            << worker.stats.status[2] << " 2xx, "
-            << worker.stats.status[3] << " 3xx, "
-            << worker.stats.status[4] << " 4xx, "
-            << worker.stats.status[5] << " 5xx\n"
+            << stats.status[2] << " 2xx, "
+            << stats.status[3] << " 3xx, "
+            << stats.status[4] << " 4xx, "
+            << stats.status[5] << " 5xx\n"
             << "traffic: "
-            << worker.stats.bytes_total << " bytes total, "
-            << worker.stats.bytes_head << " bytes headers, "
-            << worker.stats.bytes_body << " bytes data"
-            << std::endl;
+            << stats.bytes_total << " bytes total, "
+            << stats.bytes_head << " bytes headers, "
+            << stats.bytes_body << " bytes data\n"
+            << "\n"
+            << std::setw(18) << "";
+  for(auto name : {"min", "mean", "p50", "p90", "p99", "p99.9", "max"}) {
+    std::cout << std::setw(11) << name;
+  }
+  std::cout << "\n";
+  print_latency(std::cout, "time for request:", stats.request_times);
+  print_latency(std::cout, "time to 1st byte:", stats.ttfb_times);
+  print_latency(std::cout, "time for connect:", stats.connect_times);
+  if(config.scheme == "https") {
+    print_latency(std::cout, "time for TLS:",
+                  stats.tls_handshake_times);
+  }
+  if(!stats.snapshots.empty()) {
+    std::cout << "\nthroughput per second:\n";
+    for(size_t i = 0; i < stats.snapshots.size(); ++i) {
+      auto& snapshot = stats.snapshots[i];
+      std::cout << std::setw(6) << (i + 1) << "s: "
+                << snapshot.req_done << " req/s, "
+                << snapshot.bytes / 1024 << " kbytes/s\n";
+    }
+  }
+  std::cout << std::flush;
+
+  if(!config.json_file.empty() &&
+     write_json(config.json_file, config, stats, worker_stats,
+                duration) != 0) {
+    return EXIT_FAILURE;
+  }
+  if(!config.csv_file.empty() &&
+     write_csv(config.csv_file, worker_stats) != 0) {
+    return EXIT_FAILURE;
+  }
   return 0;
 }
 
@@ -35,6 +35,9 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <chrono>
+#include <deque>
+#include <random>
 
 #include <nghttp2/nghttp2.h>
 
@@ -43,16 +46,53 @@
 
 #include <openssl/ssl.h>
 
+#include "http2.h"
+#include "h2load_histogram.h"
+
+using namespace nghttp2;
+
 namespace h2load {
 
 class Session;
 
-struct Config {
+// The request to issue. The request for each stream is chosen at
+// random in proportion to weight.
+struct Request {
+  // The URI given by the user.
+  std::string uri;
+  // The header fields, including pseudo header fields. nva and nv
+  // point to the strings in this field, so this must not be modified
+  // after they are built.
+  Headers headers;
   std::vector<nghttp2_nv> nva;
+  // For spdylay. The header fields in the NULL terminated name/value
+  // list.
   std::vector<const char*> nv;
+  // For HTTP/1.1. The request line and header fields, terminated by
+  // an empty line.
+  std::string h1_header;
+  // The request body. If this is not empty, POST is used.
+  std::string data;
+  uint32_t weight;
+  // true if the request method is HEAD.
+  bool h1_head;
+};
+
+struct Config {
+  std::vector<Request> reqs;
+  // weight_sums[i] is the sum of weights of reqs[0] to reqs[i],
+  // inclusive.
+  std::vector<uint64_t> weight_sums;
   std::string scheme;
   std::string host;
-  std::string path;
+  // If not empty, the results are written to this file in JSON.
+  std::string json_file;
+  // If not empty, the timing of each request is written to this
+  // file in CSV.
+  std::string csv_file;
+  // The time when the benchmark started. The start time of requests
+  // written to csv_file is relative to this.
+  std::chrono::steady_clock::time_point start_time;
   addrinfo *addrs;
   size_t nreqs;
   size_t nclients;
@@ -61,13 +101,51 @@ struct Config {
   size_t max_concurrent_streams;
   size_t window_bits;
   size_t connection_window_bits;
+  // The number of requests issued per second in total. If this is
+  // nonzero, requests are issued on the fixed schedule regardless of
+  // responses (open loop).
+  size_t rate;
+  // The number of seconds to measure. If this is nonzero, requests
+  // are issued until the deadline instead of nreqs times.
+  size_t duration;
+  // The number of seconds before measurement starts in duration
+  // mode. The stats collected in this period are discarded.
+  size_t warm_up_time;
+  // The maximum number of requests issued on one connection. When
+  // they finish, the client reconnects. 0 means unlimited.
+  size_t conn_max_requests;
   uint16_t port;
+  // true if HTTP/1.1 is used instead of HTTP/2 and SPDY.
+  bool h1;
+  // true if SSL/TLS session is resumed when reconnecting.
+  bool tls_resume;
   bool verbose;
 
   Config();
   ~Config();
 };
 
+// The timing of a finished request. The times are in microseconds.
+struct RequestTiming {
+  // The time when the request was issued, relative to
+  // Config::start_time.
+  int64_t start;
+  // The time to the first response header, or -1 if no response
+  // header was received.
+  int64_t ttfb;
+  // The time to stream close.
+  int64_t total;
+  // The response status code, or 0 if there was no response.
+  int status;
+  bool success;
+};
+
+// The amount of work done in one second.
+struct Snapshot {
+  size_t req_done;
+  int64_t bytes;
+};
+
 struct Stats {
   // The total number of requests
   size_t req_todo;
@@ -93,6 +171,28 @@ struct Stats {
   // The number of each HTTP status category, status[i] is status code
   // in the range [i*100, (i+1)*100).
   size_t status[6];
+  // The number of connections established, including SSL/TLS
+  // handshake if it is used.
+  size_t conn_success;
+  // The number of SSL/TLS handshakes which resumed the previous
+  // session. This is subset of conn_success.
+  size_t conn_resumed;
+  // The following histograms are in microseconds.
+  // The time from request submission to stream close.
+  Histogram request_times;
+  // The time from request submission to the first response header.
+  Histogram ttfb_times;
+  // The time to establish TCP connection.
+  Histogram connect_times;
+  // The time to complete SSL/TLS handshake after TCP connection is
+  // established.
+  Histogram tls_handshake_times;
+  // The work done in each second of measurement. Only used in
+  // duration mode.
+  std::vector<Snapshot> snapshots;
+  // The timing of each request. Only recorded if Config::csv_file is
+  // set.
+  std::vector<RequestTiming> timings;
 };
 
 enum ClientState {
@@ -104,10 +204,35 @@ struct Client;
 
 struct Worker {
   std::vector<std::unique_ptr<Client>> clients;
+  // The scheduled send times of the requests which are due but not
+  // submitted yet, because no client can accept more streams. Only
+  // used in rate mode.
+  std::deque<std::chrono::steady_clock::time_point> backlog;
+  // The time when the first request is scheduled in rate mode.
+  std::chrono::steady_clock::time_point rate_start_time;
   Stats stats;
   event_base *evbase;
   SSL_CTX *ssl_ctx;
   Config *config;
+  event *rate_timer;
+  // The timer which fires every second in duration mode.
+  event *tick_timer;
+  // The number of requests per second this worker issues. 0 means
+  // closed loop.
+  double rate;
+  // The number of requests scheduled so far in rate mode.
+  size_t req_scheduled;
+  // Chooses the request to issue. This is seeded by id, so that the
+  // run is reproducible.
+  std::mt19937 rng;
+  // The index of the client which next backlog request is assigned
+  // to first.
+  size_t next_client;
+  // The number of seconds elapsed since run() in duration mode.
+  size_t elapsed_sec;
+  // The values of req_done and bytes when the last snapshot was
+  // taken.
+  Snapshot last_snapshot;
   size_t progress_interval;
   uint32_t id;
   bool term_timer_started;
@@ -118,32 +243,91 @@ struct Worker {
   void run();
   void schedule_terminate();
   void terminate_session();
+  // Starts the timer which schedules requests in rate mode. This
+  // function does nothing if the timer has already been started.
+  void start_rate_timer();
+  // Adds requests which are due to backlog and hands them out to
+  // clients.
+  void on_rate_timeout();
+  // Called every second in duration mode.
+  void on_tick();
+  // Discards stats collected during warm-up. The connection level
+  // histograms are kept because connections are usually established
+  // during warm-up.
+  void reset_stats();
+  // Stops issuing new requests, and terminates sessions after
+  // in-flight requests finish.
+  void stop_issuing_requests();
+  // Returns the request to issue next.
+  const Request* get_next_request();
+  // Returns the time when |n|-th request is scheduled in rate mode.
+  std::chrono::steady_clock::time_point get_scheduled_time(size_t n) const;
 };
 
 struct Stream {
+  // The number of bytes of request body sent so far.
+  size_t data_offset;
+  // The time when request was submitted.
+  std::chrono::steady_clock::time_point request_time;
+  // The time when the first response header was received.
+  std::chrono::steady_clock::time_point first_byte_time;
+  // The response status code, or 0 if it has not been received.
+  int status;
   int status_success;
+  // true if at least one response header has been received.
+  bool first_byte_received;
   Stream();
 };
 
 struct Client {
   std::unordered_map<int32_t, Stream> streams;
+  // The scheduled send times of the requests submitted to session,
+  // but whose HEADERS have not been sent yet, in submission order.
+  std::deque<std::chrono::steady_clock::time_point> request_times;
   std::unique_ptr<Session> session;
   Worker *worker;
   SSL *ssl;
+  // The session of the previous connection to resume.
+  SSL_SESSION *ssl_session;
   bufferevent *bev;
   addrinfo *next_addr;
+  // The time when connect() or start_tls() was started.
+  std::chrono::steady_clock::time_point connect_start_time;
+  // The number of requests issued on the current connection.
+  size_t conn_req_started;
   ClientState state;
+  // true if the server closed the current connection. No request is
+  // submitted after that.
+  bool eof;
 
   Client(Worker *worker);
   ~Client();
   int connect();
+  // Starts SSL/TLS handshake over the established TCP connection.
+  int start_tls();
   void disconnect();
+  // Closes the current connection, and connects again if there are
+  // requests to issue. This function must be called when there is no
+  // request in flight. Returns 0 if it succeeds, or -1.
+  int reconnect();
+  // Returns true if the current connection has issued the maximum
+  // number of requests, and they all finished.
+  bool connection_done() const;
   void submit_request();
+  // Submits request whose latency is measured from |request_time|.
+  void submit_request(std::chrono::steady_clock::time_point request_time);
+  // Returns the number of requests submitted but not finished yet.
+  size_t get_num_inflight() const;
+  // Returns true if this client can take another request.
+  bool can_submit_request() const;
   void process_abandoned_streams();
   void report_progress();
   void terminate_session();
+  // Records the elapsed time since connect_start_time to |hist|.
+  void record_connect_time(Histogram& hist);
   int on_connect();
   int on_read();
+  void on_eof();
   int on_write();
   void on_request(int32_t stream_id);
   void on_header(int32_t stream_id,
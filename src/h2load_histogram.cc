@@ -0,0 +1,166 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "h2load_histogram.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace h2load {
+
+namespace {
+// Each power of 2 range is divided into 2**SUB_BUCKET_BITS buckets.
+const size_t SUB_BUCKET_BITS = 7;
+const size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+const uint64_t MAX_VALUE = (1ULL << 40) - 1;
+} // namespace
+
+namespace {
+size_t log2_floor(uint64_t value)
+{
+  size_t n = 0;
+  while(value >>= 1) {
+    ++n;
+  }
+  return n;
+}
+} // namespace
+
+namespace {
+// Returns the index of the bucket |value| belongs to. The values in
+// [0, 2*SUB_BUCKET_COUNT) are mapped to themselves. For the larger
+// values, the lowest |shift| bits are discarded so that the remaining
+// sub bucket is in [SUB_BUCKET_COUNT, 2*SUB_BUCKET_COUNT).
+size_t bucket_index(uint64_t value)
+{
+  if(value < 2 * SUB_BUCKET_COUNT) {
+    return value;
+  }
+  auto shift = log2_floor(value) - SUB_BUCKET_BITS;
+  return shift * SUB_BUCKET_COUNT + (value >> shift);
+}
+} // namespace
+
+namespace {
+// Returns the highest value which is mapped to bucket |idx|.
+uint64_t highest_equivalent_value(size_t idx)
+{
+  if(idx < 2 * SUB_BUCKET_COUNT) {
+    return idx;
+  }
+  auto shift = idx / SUB_BUCKET_COUNT - 1;
+  auto sub = idx - shift * SUB_BUCKET_COUNT;
+  return (static_cast<uint64_t>(sub + 1) << shift) - 1;
+}
+} // namespace
+
+Histogram::Histogram()
+  : counts_(bucket_index(MAX_VALUE) + 1),
+    count_(0),
+    min_(0),
+    max_(0),
+    sum_(0)
+{}
+
+void Histogram::record(uint64_t value)
+{
+  value = std::min(value, MAX_VALUE);
+  ++counts_[bucket_index(value)];
+  if(count_ == 0 || value < min_) {
+    min_ = value;
+  }
+  max_ = std::max(max_, value);
+  sum_ += value;
+  ++count_;
+}
+
+void Histogram::merge(const Histogram& other)
+{
+  if(other.count_ == 0) {
+    return;
+  }
+  for(size_t i = 0; i < counts_.size(); ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  if(count_ == 0 || other.min_ < min_) {
+    min_ = other.min_;
+  }
+  max_ = std::max(max_, other.max_);
+  sum_ += other.sum_;
+  count_ += other.count_;
+}
+
+uint64_t Histogram::percentile(double percentile) const
+{
+  if(count_ == 0) {
+    return 0;
+  }
+  percentile = std::min(100.0, std::max(0.0, percentile));
+  auto target = static_cast<uint64_t>(std::ceil(percentile / 100 * count_));
+  target = std::max(static_cast<uint64_t>(1), target);
+  uint64_t cumulative = 0;
+  for(size_t i = 0; i < counts_.size(); ++i) {
+    cumulative += counts_[i];
+    if(cumulative >= target) {
+      return std::max(min_, std::min(max_, highest_equivalent_value(i)));
+    }
+  }
+  return max_;
+}
+
+uint64_t Histogram::min() const
+{
+  return min_;
+}
+
+uint64_t Histogram::max() const
+{
+  return max_;
+}
+
+double Histogram::mean() const
+{
+  if(count_ == 0) {
+    return 0;
+  }
+  return sum_ / count_;
+}
+
+uint64_t Histogram::count() const
+{
+  return count_;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> Histogram::get_buckets() const
+{
+  std::vector<std::pair<uint64_t, uint64_t>> buckets;
+  for(size_t i = 0; i < counts_.size(); ++i) {
+    if(counts_[i] > 0) {
+      buckets.emplace_back(highest_equivalent_value(i), counts_[i]);
+    }
+  }
+  return buckets;
+}
+
+} // namespace h2load
@@ -0,0 +1,74 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef H2LOAD_HISTOGRAM_H
+#define H2LOAD_HISTOGRAM_H
+
+#include "nghttp2_config.h"
+
+#include <stdint.h>
+
+#include <vector>
+#include <utility>
+
+namespace h2load {
+
+// Log-linear histogram in the spirit of HdrHistogram. Values below
+// 256 are counted exactly. Larger values are counted in buckets
+// whose width is 1/128 of their power of 2 range, so the relative
+// error of reported percentiles is less than 1%. This object is not
+// thread-safe; each worker records into its own instance and they are
+// merged after the workers finish.
+class Histogram {
+public:
+  Histogram();
+  // Records |value|. The values larger than 2**40-1 are clamped.
+  void record(uint64_t value);
+  // Adds all values recorded in |other| to this object.
+  void merge(const Histogram& other);
+  // Returns the value at |percentile| in the range [0, 100],
+  // inclusive. The returned value is the highest value equivalent to
+  // the bucket, but not greater than max(). Returns 0 if no value was
+  // recorded.
+  uint64_t percentile(double percentile) const;
+  uint64_t min() const;
+  uint64_t max() const;
+  double mean() const;
+  uint64_t count() const;
+  // Returns the non-empty buckets as the pairs of the highest value
+  // equivalent to the bucket and the number of values in it, in
+  // ascending order of value.
+  std::vector<std::pair<uint64_t, uint64_t>> get_buckets() const;
+private:
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t min_;
+  uint64_t max_;
+  // The sum of recorded values, used to compute mean.
+  double sum_;
+};
+
+} // namespace h2load
+
+#endif // H2LOAD_HISTOGRAM_H
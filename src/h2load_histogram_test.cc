@@ -0,0 +1,128 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2013 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "h2load_histogram_test.h"
+
+#include <cstdlib>
+
+#include <CUnit/CUnit.h>
+
+#include "h2load_histogram.h"
+
+namespace h2load {
+
+void test_h2load_histogram_exact(void)
+{
+  Histogram h;
+  CU_ASSERT(0 == h.count());
+  CU_ASSERT(0 == h.percentile(50));
+  CU_ASSERT(0 == h.mean());
+
+  for(uint64_t i = 0; i < 256; ++i) {
+    h.record(i);
+  }
+  CU_ASSERT(256 == h.count());
+  CU_ASSERT(0 == h.min());
+  CU_ASSERT(255 == h.max());
+  CU_ASSERT(127.5 == h.mean());
+  // The values below 256 are counted exactly.
+  auto buckets = h.get_buckets();
+  CU_ASSERT(256 == buckets.size());
+  for(size_t i = 0; i < buckets.size(); ++i) {
+    CU_ASSERT(i == buckets[i].first);
+    CU_ASSERT(1 == buckets[i].second);
+  }
+  CU_ASSERT(0 == h.percentile(0));
+  CU_ASSERT(127 == h.percentile(50));
+  CU_ASSERT(253 == h.percentile(99));
+  CU_ASSERT(255 == h.percentile(100));
+}
+
+void test_h2load_histogram_bucket(void)
+{
+  Histogram h;
+  // 256 and 257 share the bucket of width 2.
+  h.record(256);
+  h.record(257);
+  // The first value of the next bucket
+  h.record(258);
+  // The last bucket of [512, 1024) has width 4.
+  h.record(1020);
+  h.record(1023);
+  // The first bucket of [1024, 2048)
+  h.record(1024);
+
+  auto buckets = h.get_buckets();
+  CU_ASSERT(4 == buckets.size());
+  CU_ASSERT(std::make_pair(static_cast<uint64_t>(257),
+                           static_cast<uint64_t>(2)) == buckets[0]);
+  CU_ASSERT(std::make_pair(static_cast<uint64_t>(259),
+                           static_cast<uint64_t>(1)) == buckets[1]);
+  CU_ASSERT(std::make_pair(static_cast<uint64_t>(1023),
+                           static_cast<uint64_t>(2)) == buckets[2]);
+  CU_ASSERT(std::make_pair(static_cast<uint64_t>(1031),
+                           static_cast<uint64_t>(1)) == buckets[3]);
+  CU_ASSERT(256 == h.min());
+  CU_ASSERT(1024 == h.max());
+  // The percentile is clamped to max().
+  CU_ASSERT(1024 == h.percentile(100));
+  CU_ASSERT(257 == h.percentile(1));
+
+  // Too large values are clamped.
+  Histogram large;
+  large.record(UINT64_MAX);
+  CU_ASSERT((1ULL << 40) - 1 == large.max());
+  CU_ASSERT((1ULL << 40) - 1 == large.percentile(100));
+}
+
+void test_h2load_histogram_merge(void)
+{
+  Histogram a, b, empty;
+  a.record(10);
+  a.record(1000);
+  b.record(5);
+  b.record(300);
+  b.record(2000);
+
+  a.merge(empty);
+  CU_ASSERT(2 == a.count());
+  CU_ASSERT(10 == a.min());
+
+  a.merge(b);
+  CU_ASSERT(5 == a.count());
+  CU_ASSERT(5 == a.min());
+  CU_ASSERT(2000 == a.max());
+  CU_ASSERT(663 == a.mean());
+  CU_ASSERT(5 == a.get_buckets().size());
+  CU_ASSERT(5 == a.percentile(20));
+  CU_ASSERT(10 == a.percentile(40));
+
+  // Merging into the empty histogram takes min from |other|.
+  empty.merge(b);
+  CU_ASSERT(3 == empty.count());
+  CU_ASSERT(5 == empty.min());
+  CU_ASSERT(2000 == empty.max());
+}
+
+} // namespace h2load
@@ -0,0 +1,248 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "h2load_http1_session.h"
+
+#include "h2load.h"
+#include "util.h"
+
+using namespace nghttp2;
+
+namespace h2load {
+
+Http1Session::Http1Session(Client *client)
+  : client_(client),
+    next_stream_id_(1),
+    header_value_seen_(false),
+    terminated_(false)
+{
+  http_parser_init(&parser_, HTTP_RESPONSE);
+  parser_.data = this;
+}
+
+Http1Session::~Http1Session()
+{}
+
+namespace {
+int htp_status_completecb(http_parser *htp)
+{
+  return static_cast<Http1Session*>(htp->data)->on_status_complete();
+}
+} // namespace
+
+namespace {
+int htp_hdr_keycb(http_parser *htp, const char *data, size_t len)
+{
+  return static_cast<Http1Session*>(htp->data)->on_header_field(data, len);
+}
+} // namespace
+
+namespace {
+int htp_hdr_valcb(http_parser *htp, const char *data, size_t len)
+{
+  return static_cast<Http1Session*>(htp->data)->on_header_value(data, len);
+}
+} // namespace
+
+namespace {
+int htp_hdrs_completecb(http_parser *htp)
+{
+  return static_cast<Http1Session*>(htp->data)->on_headers_complete();
+}
+} // namespace
+
+namespace {
+int htp_bodycb(http_parser *htp, const char *data, size_t len)
+{
+  return static_cast<Http1Session*>(htp->data)->on_body(data, len);
+}
+} // namespace
+
+namespace {
+int htp_msg_completecb(http_parser *htp)
+{
+  return static_cast<Http1Session*>(htp->data)->on_message_complete();
+}
+} // namespace
+
+namespace {
+http_parser_settings htp_hooks = {
+  nullptr, // http_cb on_message_begin;
+  nullptr, // http_data_cb on_url;
+  htp_status_completecb, // http_cb on_status_complete;
+  htp_hdr_keycb, // http_data_cb on_header_field;
+  htp_hdr_valcb, // http_data_cb on_header_value;
+  htp_hdrs_completecb, // http_cb on_headers_complete;
+  htp_bodycb, // http_data_cb on_body;
+  htp_msg_completecb // http_cb on_message_complete;
+};
+} // namespace
+
+int Http1Session::on_status_complete()
+{
+  if(pending_.empty()) {
+    // Response without request
+    return -1;
+  }
+  if(parser_.status_code / 100 == 1) {
+    // Interim response is not the response to the request.
+    return 0;
+  }
+  auto status = util::utos(parser_.status_code);
+  client_->on_header(pending_.front().stream_id,
+                     reinterpret_cast<const uint8_t*>(":status"), 7,
+                     reinterpret_cast<const uint8_t*>(status.c_str()),
+                     status.size());
+  return 0;
+}
+
+void Http1Session::flush_header()
+{
+  if(!header_value_seen_) {
+    return;
+  }
+  if(parser_.status_code / 100 == 1) {
+    header_name_.clear();
+    header_value_.clear();
+    header_value_seen_ = false;
+    return;
+  }
+  util::inp_strlower(header_name_);
+  client_->on_header(pending_.front().stream_id,
+                     reinterpret_cast<const uint8_t*>(header_name_.c_str()),
+                     header_name_.size(),
+                     reinterpret_cast<const uint8_t*>(header_value_.c_str()),
+                     header_value_.size());
+  header_name_.clear();
+  header_value_.clear();
+  header_value_seen_ = false;
+}
+
+int Http1Session::on_header_field(const char *data, size_t len)
+{
+  flush_header();
+  header_name_.append(data, len);
+  return 0;
+}
+
+int Http1Session::on_header_value(const char *data, size_t len)
+{
+  header_value_.append(data, len);
+  header_value_seen_ = true;
+  return 0;
+}
+
+int Http1Session::on_headers_complete()
+{
+  flush_header();
+  client_->worker->stats.bytes_head += parser_.nread;
+  if(parser_.status_code / 100 == 1) {
+    // The final response follows.
+    return 0;
+  }
+  // Returning 1 tells http-parser that the response has no body.
+  return pending_.front().head ? 1 : 0;
+}
+
+int Http1Session::on_body(const char *data, size_t len)
+{
+  client_->worker->stats.bytes_body += len;
+  return 0;
+}
+
+int Http1Session::on_message_complete()
+{
+  if(parser_.status_code / 100 == 1) {
+    return 0;
+  }
+  auto stream_id = pending_.front().stream_id;
+  pending_.pop_front();
+  client_->on_stream_close(stream_id, true);
+  return 0;
+}
+
+void Http1Session::on_connect()
+{}
+
+void Http1Session::submit_request(const Request *req)
+{
+  auto stream_id = next_stream_id_;
+  next_stream_id_ += 2;
+
+  auto output = bufferevent_get_output(client_->bev);
+  evbuffer_add(output, req->h1_header.c_str(), req->h1_header.size());
+  if(!req->data.empty()) {
+    evbuffer_add(output, req->data.c_str(), req->data.size());
+  }
+  pending_.push_back(PendingResponse{stream_id, req->h1_head});
+  client_->on_request(stream_id);
+}
+
+ssize_t Http1Session::on_read()
+{
+  auto input = bufferevent_get_input(client_->bev);
+  // Process the input chunk by chunk, without linearizing it.
+  ssize_t total = 0;
+  evbuffer_iovec vec;
+  while(evbuffer_peek(input, -1, nullptr, &vec, 1) > 0) {
+    auto nread = http_parser_execute(&parser_, &htp_hooks,
+                                     static_cast<const char*>(vec.iov_base),
+                                     vec.iov_len);
+    if(HTTP_PARSER_ERRNO(&parser_) != HPE_OK) {
+      return -1;
+    }
+    evbuffer_drain(input, nread);
+    total += nread;
+    if(nread < vec.iov_len) {
+      break;
+    }
+  }
+  return total;
+}
+
+void Http1Session::on_eof()
+{
+  // Zero length input tells http-parser that the connection was
+  // closed.
+  http_parser_execute(&parser_, &htp_hooks, nullptr, 0);
+}
+
+int Http1Session::on_write()
+{
+  // The requests are written to the output buffer when they are
+  // submitted. After terminate(), the connection is closed once the
+  // pending responses are received.
+  if(terminated_ && pending_.empty() &&
+     evbuffer_get_length(bufferevent_get_output(client_->bev)) == 0) {
+    return -1;
+  }
+  return 0;
+}
+
+void Http1Session::terminate()
+{
+  terminated_ = true;
+}
+
+} // namespace h2load
@@ -0,0 +1,87 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef H2LOAD_HTTP1_SESSION_H
+#define H2LOAD_HTTP1_SESSION_H
+
+#include "h2load_session.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <deque>
+
+#include "http-parser/http_parser.h"
+
+namespace h2load {
+
+struct Client;
+
+// HTTP/1.1 session. Requests are pipelined up to max concurrent
+// streams. Each request is given the stream ID in the same way as
+// HTTP/2 so that it is tracked by Client like other sessions.
+class Http1Session : public Session {
+public:
+  Http1Session(Client *client);
+  virtual ~Http1Session();
+  virtual void on_connect();
+  virtual void submit_request(const Request *req);
+  virtual ssize_t on_read();
+  virtual void on_eof();
+  virtual int on_write();
+  virtual void terminate();
+
+  // The following functions are called from http-parser callbacks.
+  int on_status_complete();
+  int on_header_field(const char *data, size_t len);
+  int on_header_value(const char *data, size_t len);
+  int on_headers_complete();
+  int on_body(const char *data, size_t len);
+  int on_message_complete();
+private:
+  // Passes the header field buffered so far to Client.
+  void flush_header();
+
+  struct PendingResponse {
+    int32_t stream_id;
+    // true if the request method is HEAD, in which case the response
+    // has no body.
+    bool head;
+  };
+  // The requests waiting for response, in the order they were sent.
+  std::deque<PendingResponse> pending_;
+  std::string header_name_;
+  std::string header_value_;
+  http_parser parser_;
+  Client *client_;
+  int32_t next_stream_id_;
+  // true if the last header callback was on_header_value.
+  bool header_value_seen_;
+  // true if no more request is sent.
+  bool terminated_;
+};
+
+} // namespace h2load
+
+#endif // H2LOAD_HTTP1_SESSION_H
@@ -24,6 +24,9 @@
  */
 #include "h2load_http2_session.h"
 
+#include <cstring>
+#include <algorithm>
+
 #include "h2load.h"
 #include "util.h"
 
@@ -110,7 +113,7 @@ int on_stream_close_callback
 
 void Http2Session::on_connect()
 {
-  nghttp2_session_callbacks callbacks = {0};
+  nghttp2_session_callbacks callbacks = {};
   callbacks.before_frame_send_callback = before_frame_send_callback;
   callbacks.on_frame_recv_callback = on_frame_recv_callback;
   callbacks.on_data_chunk_recv_callback = on_data_chunk_recv_callback;
@@ -139,12 +142,36 @@ void Http2Session::on_connect()
                     NGHTTP2_CLIENT_CONNECTION_HEADER_LEN);
 }
 
-void Http2Session::submit_request()
+namespace {
+ssize_t data_read_callback
+(nghttp2_session *session, int32_t stream_id,
+ uint8_t *buf, size_t length, int *eof,
+ nghttp2_data_source *source, void *user_data)
+{
+  auto client = static_cast<Client*>(user_data);
+  auto req = static_cast<const Request*>(source->ptr);
+  auto itr = client->streams.find(stream_id);
+  if(itr == std::end(client->streams)) {
+    return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+  }
+  auto& stream = (*itr).second;
+  auto n = std::min(length, req->data.size() - stream.data_offset);
+  memcpy(buf, req->data.c_str() + stream.data_offset, n);
+  stream.data_offset += n;
+  if(stream.data_offset == req->data.size()) {
+    *eof = 1;
+  }
+  return n;
+}
+} // namespace
+
+void Http2Session::submit_request(const Request *req)
 {
-  nghttp2_submit_request(session_, 0,
-                         client_->worker->config->nva.data(),
-                         client_->worker->config->nva.size(),
-                         nullptr, nullptr);
+  nghttp2_data_provider data_prd;
+  data_prd.source.ptr = const_cast<Request*>(req);
+  data_prd.read_callback = data_read_callback;
+  nghttp2_submit_request(session_, 0, req->nva.data(), req->nva.size(),
+                         req->data.empty() ? nullptr : &data_prd, nullptr);
 }
 
 ssize_t Http2Session::on_read()
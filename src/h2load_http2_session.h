@@ -38,7 +38,7 @@ public:
   Http2Session(Client *client);
   virtual ~Http2Session();
   virtual void on_connect();
-  virtual void submit_request();
+  virtual void submit_request(const Request *req);
   virtual ssize_t on_read();
   virtual int on_write();
   virtual void terminate();
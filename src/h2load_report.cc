@@ -0,0 +1,231 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "h2load_report.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "h2load.h"
+
+namespace h2load {
+
+namespace {
+std::string json_string(const std::string& s)
+{
+  std::string res = "\"";
+  for(auto c : s) {
+    switch(c) {
+    case '"':
+      res += "\\\"";
+      break;
+    case '\\':
+      res += "\\\\";
+      break;
+    case '\n':
+      res += "\\n";
+      break;
+    case '\r':
+      res += "\\r";
+      break;
+    case '\t':
+      res += "\\t";
+      break;
+    default:
+      if(static_cast<unsigned char>(c) < 0x20) {
+        char buf[7];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        res += buf;
+      } else {
+        res += c;
+      }
+    }
+  }
+  res += "\"";
+  return res;
+}
+} // namespace
+
+namespace {
+const char* json_bool(bool b)
+{
+  return b ? "true" : "false";
+}
+} // namespace
+
+namespace {
+void write_histogram(std::ostream& out, const Histogram& hist)
+{
+  out << "{\"count\":" << hist.count()
+      << ",\"min\":" << hist.min()
+      << ",\"mean\":" << hist.mean()
+      << ",\"p50\":" << hist.percentile(50)
+      << ",\"p90\":" << hist.percentile(90)
+      << ",\"p99\":" << hist.percentile(99)
+      << ",\"p99.9\":" << hist.percentile(99.9)
+      << ",\"max\":" << hist.max()
+      << ",\"buckets\":[";
+  auto buckets = hist.get_buckets();
+  for(size_t i = 0; i < buckets.size(); ++i) {
+    if(i > 0) {
+      out << ",";
+    }
+    out << "[" << buckets[i].first << "," << buckets[i].second << "]";
+  }
+  out << "]}";
+}
+} // namespace
+
+namespace {
+void write_stats(std::ostream& out, const Stats& stats)
+{
+  out << "{\"requests\":{"
+      << "\"total\":" << stats.req_todo
+      << ",\"started\":" << stats.req_started
+      << ",\"done\":" << stats.req_done
+      << ",\"succeeded\":" << stats.req_success
+      << ",\"failed\":" << stats.req_failed
+      << ",\"errored\":" << stats.req_error
+      << "},\"status\":{";
+  for(size_t i = 1; i < 6; ++i) {
+    if(i > 1) {
+      out << ",";
+    }
+    out << "\"" << i << "xx\":" << stats.status[i];
+  }
+  out << "},\"connections\":{"
+      << "\"established\":" << stats.conn_success
+      << ",\"resumed\":" << stats.conn_resumed
+      << "},\"traffic\":{"
+      << "\"total\":" << stats.bytes_total
+      << ",\"headers\":" << stats.bytes_head
+      << ",\"data\":" << stats.bytes_body
+      << "},\"latency\":{\"request\":";
+  write_histogram(out, stats.request_times);
+  out << ",\"ttfb\":";
+  write_histogram(out, stats.ttfb_times);
+  out << ",\"connect\":";
+  write_histogram(out, stats.connect_times);
+  out << ",\"tls_handshake\":";
+  write_histogram(out, stats.tls_handshake_times);
+  out << "},\"snapshots\":[";
+  for(size_t i = 0; i < stats.snapshots.size(); ++i) {
+    if(i > 0) {
+      out << ",";
+    }
+    out << "{\"requests\":" << stats.snapshots[i].req_done
+        << ",\"bytes\":" << stats.snapshots[i].bytes << "}";
+  }
+  out << "]}";
+}
+} // namespace
+
+namespace {
+void write_config(std::ostream& out, const Config& config)
+{
+  out << "{\"uris\":[";
+  for(size_t i = 0; i < config.reqs.size(); ++i) {
+    if(i > 0) {
+      out << ",";
+    }
+    out << "{\"uri\":" << json_string(config.reqs[i].uri)
+        << ",\"weight\":" << config.reqs[i].weight << "}";
+  }
+  out << "],\"requests\":" << config.nreqs
+      << ",\"clients\":" << config.nclients
+      << ",\"threads\":" << config.nthreads
+      << ",\"max_concurrent_streams\":" << config.max_concurrent_streams
+      << ",\"window_bits\":" << config.window_bits
+      << ",\"connection_window_bits\":" << config.connection_window_bits
+      << ",\"rate\":" << config.rate
+      << ",\"duration\":" << config.duration
+      << ",\"warm_up_time\":" << config.warm_up_time
+      << ",\"requests_per_connection\":" << config.conn_max_requests
+      << ",\"h1\":" << json_bool(config.h1)
+      << ",\"tls_resume\":" << json_bool(config.tls_resume)
+      << "}";
+}
+} // namespace
+
+int write_json(const std::string& path, const Config& config,
+               const Stats& total,
+               const std::vector<const Stats*>& worker_stats,
+               int64_t duration)
+{
+  std::ofstream out(path);
+  if(!out) {
+    std::cerr << "--json: could not open file: " << path << std::endl;
+    return -1;
+  }
+  out << "{\"version\":" << json_string(NGHTTP2_VERSION)
+      << ",\"config\":";
+  write_config(out, config);
+  out << ",\"duration\":" << duration
+      << ",\"total\":";
+  write_stats(out, total);
+  out << ",\"threads\":[";
+  for(size_t i = 0; i < worker_stats.size(); ++i) {
+    if(i > 0) {
+      out << ",";
+    }
+    write_stats(out, *worker_stats[i]);
+  }
+  out << "]}\n";
+  out.close();
+  if(!out) {
+    std::cerr << "--json: could not write file: " << path << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+int write_csv(const std::string& path,
+              const std::vector<const Stats*>& worker_stats)
+{
+  std::ofstream out(path);
+  if(!out) {
+    std::cerr << "--csv: could not open file: " << path << std::endl;
+    return -1;
+  }
+  out << "thread,start,ttfb,total,status,success\n";
+  for(size_t i = 0; i < worker_stats.size(); ++i) {
+    for(auto& timing : worker_stats[i]->timings) {
+      out << i << ","
+          << timing.start << ","
+          << timing.ttfb << ","
+          << timing.total << ","
+          << timing.status << ","
+          << (timing.success ? 1 : 0) << "\n";
+    }
+  }
+  out.close();
+  if(!out) {
+    std::cerr << "--csv: could not write file: " << path << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+} // namespace h2load
@@ -0,0 +1,56 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef H2LOAD_REPORT_H
+#define H2LOAD_REPORT_H
+
+#include "nghttp2_config.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace h2load {
+
+struct Config;
+struct Stats;
+
+// Writes |config|, the merged stats |total|, the stats of each worker
+// |worker_stats| and |duration| of benchmark in microseconds to the
+// file at |path| in JSON. Returns 0 if it succeeds, or -1.
+int write_json(const std::string& path, const Config& config,
+               const Stats& total,
+               const std::vector<const Stats*>& worker_stats,
+               int64_t duration);
+
+// Writes the timing of each request in |worker_stats| to the file at
+// |path| in CSV. The first column is the index of worker. Returns 0
+// if it succeeds, or -1.
+int write_csv(const std::string& path,
+              const std::vector<const Stats*>& worker_stats);
+
+} // namespace h2load
+
+#endif // H2LOAD_REPORT_H
@@ -31,16 +31,21 @@
 
 namespace h2load {
 
+struct Request;
+
 class Session {
 public:
   virtual ~Session() {}
   // Called when the connection was made.
   virtual void on_connect() = 0;
-  // Called when one request must be issued.
-  virtual void submit_request() = 0;
+  // Called when one request |req| must be issued.
+  virtual void submit_request(const Request *req) = 0;
   // Called when incoming bytes are available. The subclass has to
   // return the number of bytes read.
   virtual ssize_t on_read() = 0;
+  // Called when the connection reached EOF. The responses delimited
+  // by EOF are completed here.
+  virtual void on_eof() {}
   // Called when write is available. Returns 0 on success, otherwise
   // return -1.
   virtual int on_write() = 0;
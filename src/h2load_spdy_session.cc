@@ -24,6 +24,9 @@
  */
 #include "h2load_spdy_session.h"
 
+#include <cstring>
+#include <algorithm>
+
 #include "h2load.h"
 
 namespace h2load {
@@ -131,10 +134,36 @@ void SpdySession::on_connect()
                           sizeof(iv) / sizeof(iv[0]));
 }
 
-void SpdySession::submit_request()
+namespace {
+ssize_t data_read_callback
+(spdylay_session *session, int32_t stream_id,
+ uint8_t *buf, size_t length, int *eof,
+ spdylay_data_source *source, void *user_data)
+{
+  auto client = static_cast<Client*>(user_data);
+  auto req = static_cast<const Request*>(source->ptr);
+  auto itr = client->streams.find(stream_id);
+  if(itr == std::end(client->streams)) {
+    return SPDYLAY_ERR_TEMPORAL_CALLBACK_FAILURE;
+  }
+  auto& stream = (*itr).second;
+  auto n = std::min(length, req->data.size() - stream.data_offset);
+  memcpy(buf, req->data.c_str() + stream.data_offset, n);
+  stream.data_offset += n;
+  if(stream.data_offset == req->data.size()) {
+    *eof = 1;
+  }
+  return n;
+}
+} // namespace
+
+void SpdySession::submit_request(const Request *req)
 {
-  spdylay_submit_request(session_, 0, client_->worker->config->nv.data(),
-                         nullptr, nullptr);
+  spdylay_data_provider data_prd;
+  data_prd.source.ptr = const_cast<Request*>(req);
+  data_prd.read_callback = data_read_callback;
+  spdylay_submit_request(session_, 0, const_cast<const char**>(req->nv.data()),
+                         req->data.empty() ? nullptr : &data_prd, nullptr);
 }
 
 ssize_t SpdySession::on_read()
@@ -40,7 +40,7 @@ public:
   SpdySession(Client *client, uint16_t spdy_version);
   virtual ~SpdySession();
   virtual void on_connect();
-  virtual void submit_request();
+  virtual void submit_request(const Request *req);
   virtual ssize_t on_read();
   virtual int on_write();
   virtual void terminate();
@@ -318,6 +318,101 @@ const Headers::value_type* get_header(const Headers& nva, const char *name)
   return nullptr;
 }
 
+namespace {
+bool streq(const char *a, const uint8_t *b, size_t blen)
+{
+  return memcmp(a, b, blen) == 0;
+}
+} // namespace
+
+int lookup_token(const uint8_t *name, size_t namelen)
+{
+  switch(namelen) {
+  case 3:
+    if(streq("via", name, 3)) {
+      return HD_VIA;
+    }
+    break;
+  case 4:
+    if(streq("host", name, 4)) {
+      return HD_HOST;
+    }
+    break;
+  case 5:
+    if(streq(":path", name, 5)) {
+      return HD__PATH;
+    }
+    break;
+  case 6:
+    switch(name[0]) {
+    case 'c':
+      if(streq("cookie", name, 6)) {
+        return HD_COOKIE;
+      }
+      break;
+    case 'e':
+      if(streq("expect", name, 6)) {
+        return HD_EXPECT;
+      }
+      break;
+    }
+    break;
+  case 10:
+    if(streq(":authority", name, 10)) {
+      return HD__AUTHORITY;
+    }
+    break;
+  case 14:
+    if(streq("content-length", name, 14)) {
+      return HD_CONTENT_LENGTH;
+    }
+    break;
+  case 15:
+    if(streq("x-forwarded-for", name, 15)) {
+      return HD_X_FORWARDED_FOR;
+    }
+    break;
+  case 17:
+    if(streq("transfer-encoding", name, 17)) {
+      return HD_TRANSFER_ENCODING;
+    }
+    break;
+  }
+  return -1;
+}
+
+int lookup_token(const std::string& name)
+{
+  return lookup_token(reinterpret_cast<const uint8_t*>(name.c_str()),
+                      name.size());
+}
+
+void init_hdidx(HeaderIndex& hdidx)
+{
+  hdidx.fill(-1);
+}
+
+void index_headers(HeaderIndex& hdidx, const Headers& nva)
+{
+  init_hdidx(hdidx);
+  for(size_t i = 0; i < nva.size(); ++i) {
+    auto token = lookup_token(nva[i].first);
+    if(token != -1 && hdidx[token] == -1) {
+      hdidx[token] = i;
+    }
+  }
+}
+
+const Headers::value_type* get_header(const HeaderIndex& hdidx, int token,
+                                      const Headers& nva)
+{
+  auto i = hdidx[token];
+  if(i == -1) {
+    return nullptr;
+  }
+  return &nva[i];
+}
+
 std::string value_to_str(const Headers::value_type *nv)
 {
   if(nv) {
@@ -547,6 +642,152 @@ int check_nv(const uint8_t *name, size_t namelen,
   return 1;
 }
 
+namespace {
+const char* skip_lws(const char *first, const char *last)
+{
+  for(; first != last && (*first == ' ' || *first == '\t'); ++first);
+  return first;
+}
+} // namespace
+
+namespace {
+bool in_token_delim(char c)
+{
+  return c == ' ' || c == '\t' || c == ';' || c == ',' || c == '=';
+}
+} // namespace
+
+std::vector<std::string> parse_link_header(const char *src, size_t len)
+{
+  std::vector<std::string> res;
+  auto p = src;
+  auto last = src + len;
+  for(;;) {
+    for(; p != last && (*p == ' ' || *p == '\t' || *p == ','); ++p);
+    if(p == last) {
+      return res;
+    }
+    if(*p != '<') {
+      return res;
+    }
+    auto uri_first = p + 1;
+    auto uri_last = std::find(uri_first, last, '>');
+    if(uri_last == last) {
+      return res;
+    }
+    p = uri_last + 1;
+    bool preload = false;
+    bool nopush = false;
+    for(;;) {
+      p = skip_lws(p, last);
+      if(p == last || *p == ',') {
+        break;
+      }
+      if(*p != ';') {
+        return res;
+      }
+      p = skip_lws(p + 1, last);
+      auto name_first = p;
+      for(; p != last && !in_token_delim(*p); ++p);
+      auto name_last = p;
+      if(name_first == name_last) {
+        return res;
+      }
+      p = skip_lws(p, last);
+      const char *value_first = nullptr;
+      const char *value_last = nullptr;
+      if(p != last && *p == '=') {
+        p = skip_lws(p + 1, last);
+        if(p != last && *p == '"') {
+          value_first = ++p;
+          for(; p != last && *p != '"'; ++p) {
+            if(*p == '\\' && p + 1 != last) {
+              ++p;
+            }
+          }
+          if(p == last) {
+            return res;
+          }
+          value_last = p++;
+        } else {
+          value_first = p;
+          for(; p != last && !in_token_delim(*p); ++p);
+          value_last = p;
+        }
+      }
+      auto name = reinterpret_cast<const uint8_t*>(name_first);
+      auto namelen = name_last - name_first;
+      if(util::strieq("rel", name, namelen) && value_first) {
+        // rel is a space separated list of relation types.
+        for(auto q = value_first; q != value_last;) {
+          auto rel_last = std::find(q, value_last, ' ');
+          if(util::strieq("preload", reinterpret_cast<const uint8_t*>(q),
+                          rel_last - q)) {
+            preload = true;
+          }
+          q = rel_last == value_last ? value_last : rel_last + 1;
+        }
+      } else if(util::strieq("nopush", name, namelen)) {
+        nopush = true;
+      }
+    }
+    if(preload && !nopush) {
+      res.emplace_back(uri_first, uri_last);
+    }
+  }
+}
+
+namespace {
+// Returns the q-value in parameters [first, last) of an
+// Accept-Encoding element. Returns 1 if q parameter is not present.
+double parse_qvalue(const char *first, const char *last)
+{
+  for(;;) {
+    first = std::find(first, last, ';');
+    if(first == last) {
+      return 1;
+    }
+    ++first;
+    for(; first != last && (*first == ' ' || *first == '\t'); ++first);
+    if(last - first >= 2 && (*first == 'q' || *first == 'Q') &&
+       first[1] == '=') {
+      return strtod(std::string(first + 2, last).c_str(), nullptr);
+    }
+  }
+}
+} // namespace
+
+bool accept_gzip(const std::string& value)
+{
+  // q-value of gzip and "*". -1 means not present.
+  double gzip_q = -1, any_q = -1;
+  auto p = value.c_str();
+  auto end = p + value.size();
+  while(p != end) {
+    auto last = std::find(p, end, ',');
+    auto first = p;
+    for(; first != last && (*first == ' ' || *first == '\t'); ++first);
+    auto name_last = std::find(first, last, ';');
+    auto name_end = name_last;
+    for(; name_end != first &&
+          (*(name_end - 1) == ' ' || *(name_end - 1) == '\t'); --name_end);
+    auto q = parse_qvalue(name_last, last);
+    auto name = reinterpret_cast<const uint8_t*>(first);
+    auto namelen = name_end - first;
+    if(util::strieq("gzip", name, namelen) ||
+       util::strieq("x-gzip", name, namelen)) {
+      gzip_q = q;
+    } else if(name_end - first == 1 && *first == '*') {
+      any_q = q;
+    }
+    p = last == end ? end : last + 1;
+  }
+  if(gzip_q >= 0) {
+    return gzip_q > 0;
+  }
+  return any_q > 0;
+}
+
 } // namespace http2
 
 } // namespace nghttp2
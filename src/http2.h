@@ -31,6 +31,7 @@
 #include <cstring>
 #include <string>
 #include <vector>
+#include <array>
 
 #include <nghttp2/nghttp2.h>
 
@@ -104,6 +105,43 @@ const Headers::value_type* get_unique_header(const Headers& nva,
 // nullptr.
 const Headers::value_type* get_header(const Headers& nva, const char *name);
 
+// Well-known header field names which are looked up frequently.
+// The value is the slot in HeaderIndex.
+enum {
+  HD__AUTHORITY,
+  HD__PATH,
+  HD_CONTENT_LENGTH,
+  HD_COOKIE,
+  HD_EXPECT,
+  HD_HOST,
+  HD_TRANSFER_ENCODING,
+  HD_VIA,
+  HD_X_FORWARDED_FOR,
+  HD_MAXIDX
+};
+
+// The position of the first occurrence of each well-known header
+// field in the normalized header fields, or -1 if it is not present.
+typedef std::array<int, HD_MAXIDX> HeaderIndex;
+
+// Returns the token (one of HD_*) of lowercased header field name
+// |name| with length |namelen| bytes, or -1 if |name| is not a
+// well-known header field name.
+int lookup_token(const uint8_t *name, size_t namelen);
+
+int lookup_token(const std::string& name);
+
+// Fills all slots of |hdidx| with -1.
+void init_hdidx(HeaderIndex& hdidx);
+
+// Builds |hdidx| from |nva|. This function assumes that the |nva| is
+// normalized by normalize_headers().
+void index_headers(HeaderIndex& hdidx, const Headers& nva);
+
+// Returns the header field indexed by |token| in |hdidx|, or nullptr.
+const Headers::value_type* get_header(const HeaderIndex& hdidx, int token,
+                                      const Headers& nva);
+
 // Returns nv->second if nv is not nullptr. Otherwise, returns "".
 std::string value_to_str(const Headers::value_type *nv);
 
@@ -203,6 +241,16 @@ std::string rewrite_location_uri(const std::string& uri,
 int check_nv(const uint8_t *name, size_t namelen,
              const uint8_t *value, size_t valuelen);
 
+// Parses Link header field value |src| of length |len| and returns
+// the URI references of the links which have "preload" in rel
+// parameter and do not have nopush parameter. The parsing stops at
+// the first malformed link-value.
+std::vector<std::string> parse_link_header(const char *src, size_t len);
+
+// Returns true if Accept-Encoding header field value |value| allows
+// gzip content-coding.
+bool accept_gzip(const std::string& value);
+
 } // namespace http2
 
 } // namespace nghttp2
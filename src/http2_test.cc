@@ -164,6 +164,34 @@ void test_http2_get_header(void)
   CU_ASSERT(rv == nullptr);
 }
 
+void test_http2_index_headers(void)
+{
+  auto nva = Headers{
+    { ":authority", "example.org" },
+    { "content-length", "0" },
+    { "host", "a" },
+    { "host", "b" },
+    { "via", "1.1 foo" }
+  };
+  CU_ASSERT(http2::HD_HOST == http2::lookup_token("host"));
+  CU_ASSERT(http2::HD_X_FORWARDED_FOR ==
+            http2::lookup_token("x-forwarded-for"));
+  CU_ASSERT(-1 == http2::lookup_token("hosT"));
+  CU_ASSERT(-1 == http2::lookup_token("alpha"));
+
+  http2::HeaderIndex hdidx;
+  http2::index_headers(hdidx, nva);
+  CU_ASSERT(0 == hdidx[http2::HD__AUTHORITY]);
+  CU_ASSERT(1 == hdidx[http2::HD_CONTENT_LENGTH]);
+  CU_ASSERT(2 == hdidx[http2::HD_HOST]);
+  CU_ASSERT(4 == hdidx[http2::HD_VIA]);
+  CU_ASSERT(-1 == hdidx[http2::HD_COOKIE]);
+
+  auto rv = http2::get_header(hdidx, http2::HD_HOST, nva);
+  CU_ASSERT("a" == rv->second);
+  CU_ASSERT(nullptr == http2::get_header(hdidx, http2::HD__PATH, nva));
+}
+
 void test_http2_value_lws(void)
 {
   auto nva = Headers{
@@ -298,4 +326,63 @@ void test_http2_rewrite_location_uri(void)
                              "localhost", "https", 3000);
 }
 
+namespace {
+std::vector<std::string> parse_link_header(const char *s)
+{
+  return http2::parse_link_header(s, strlen(s));
+}
+} // namespace
+
+void test_http2_parse_link_header(void)
+{
+  auto res = parse_link_header("</a.css>; rel=preload");
+  CU_ASSERT(1 == res.size());
+  CU_ASSERT("/a.css" == res[0]);
+
+  res = parse_link_header("</a.css>;rel=\"next Preload\", </b.js> ; "
+                          "as=script ; rel=preload, </c.png>; rel=next");
+  CU_ASSERT(2 == res.size());
+  CU_ASSERT("/a.css" == res[0]);
+  CU_ASSERT("/b.js" == res[1]);
+
+  // nopush is honored
+  res = parse_link_header("</a.css>; rel=preload; nopush, "
+                          "</b.css>; rel=preload");
+  CU_ASSERT(1 == res.size());
+  CU_ASSERT("/b.css" == res[0]);
+
+  // ',' in URI and quoted-string
+  res = parse_link_header("</a,b>; title=\"x,y\"; rel=preload");
+  CU_ASSERT(1 == res.size());
+  CU_ASSERT("/a,b" == res[0]);
+
+  // rel must be preload
+  res = parse_link_header("</a.css>; rel=preloadx");
+  CU_ASSERT(res.empty());
+
+  // parsing stops at malformed link-value
+  res = parse_link_header("</a.css>; rel=preload, /b.css; rel=preload");
+  CU_ASSERT(1 == res.size());
+  res = parse_link_header("</a.css; rel=preload");
+  CU_ASSERT(res.empty());
+  res = parse_link_header("");
+  CU_ASSERT(res.empty());
+}
+
+void test_http2_accept_gzip(void)
+{
+  CU_ASSERT(http2::accept_gzip("gzip"));
+  CU_ASSERT(http2::accept_gzip("deflate, GZIP;q=0.5"));
+  CU_ASSERT(http2::accept_gzip("x-gzip"));
+  CU_ASSERT(http2::accept_gzip("*"));
+  CU_ASSERT(http2::accept_gzip("br ; q=1, * ; q=0.1"));
+  CU_ASSERT(!http2::accept_gzip(""));
+  CU_ASSERT(!http2::accept_gzip("identity"));
+  CU_ASSERT(!http2::accept_gzip("gzip;q=0"));
+  CU_ASSERT(!http2::accept_gzip("gzip; q=0.000"));
+  CU_ASSERT(!http2::accept_gzip("gzip;q=0, *"));
+  CU_ASSERT(!http2::accept_gzip("*;q=0"));
+  CU_ASSERT(!http2::accept_gzip("gzipx"));
+}
+
 } // namespace shrpx
@@ -32,12 +32,15 @@ void test_http2_sort_nva(void);
 void test_http2_check_http2_headers(void);
 void test_http2_get_unique_header(void);
 void test_http2_get_header(void);
+void test_http2_index_headers(void);
 void test_http2_value_lws(void);
 void test_http2_concat_norm_headers(void);
 void test_http2_copy_norm_headers_to_nva(void);
 void test_http2_build_http1_headers_from_norm_headers(void);
 void test_http2_lws(void);
 void test_http2_rewrite_location_uri(void);
+void test_http2_parse_link_header(void);
+void test_http2_accept_gzip(void);
 
 } // namespace shrpx
 
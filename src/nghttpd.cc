@@ -26,6 +26,7 @@
 
 #include <unistd.h>
 #include <signal.h>
+#include <sys/resource.h>
 #include <getopt.h>
 
 #include <cstdlib>
@@ -135,6 +136,26 @@ void print_help(std::ostream& out)
       << "                     Set the number of worker threads.\n"
       << "                     Default: 1\n"
       << "  -e, --error-gzip   Make error response gzipped.\n"
+      << "  --file-cache-size=<N>\n"
+      << "                     Set the maximum number of opened files\n"
+      << "                     cached per worker. Specify 0 to disable\n"
+      << "                     the cache. Each cached file keeps a file\n"
+      << "                     descriptor open, so the total of all\n"
+      << "                     workers is limited to the half of\n"
+      << "                     RLIMIT_NOFILE, leaving the rest for\n"
+      << "                     connections.\n"
+      << "                     Default: 256\n"
+      << "  --file-cache-ttl=<SEC>\n"
+      << "                     Cached file is checked for modification\n"
+      << "                     if it was last checked more than <SEC>\n"
+      << "                     seconds ago. Cached file is sent without\n"
+      << "                     copying if possible, and is checked for\n"
+      << "                     its size each time. If the file was\n"
+      << "                     truncated, it is copied instead, and the\n"
+      << "                     stream is reset at the end of file.\n"
+      << "                     Files should be replaced by rename(2)\n"
+      << "                     rather than rewritten in place.\n"
+      << "                     Default: 1\n"
       << "  --version          Display version information and exit.\n"
       << "  -h, --help         Display this help and exit.\n"
       << std::endl;
@@ -161,6 +182,8 @@ int main(int argc, char **argv)
       {"no-tls", no_argument, &flag, 1},
       {"color", no_argument, &flag, 2},
       {"version", no_argument, &flag, 3},
+      {"file-cache-size", required_argument, &flag, 4},
+      {"file-cache-ttl", required_argument, &flag, 5},
       {nullptr, 0, nullptr, 0}
     };
     int option_index = 0;
@@ -230,6 +253,25 @@ int main(int argc, char **argv)
         // version
         print_version(std::cout);
         exit(EXIT_SUCCESS);
+      case 4:
+        // file-cache-size option
+        errno = 0;
+        config.file_cache_size = strtoul(optarg, &end, 10);
+        if(errno == ERANGE || *end != '\0') {
+          std::cerr << "--file-cache-size: Bad option value: " << optarg
+                    << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 5:
+        // file-cache-ttl option
+        config.file_cache_ttl = strtod(optarg, &end);
+        if(*end != '\0' || config.file_cache_ttl < 0) {
+          std::cerr << "--file-cache-ttl: Bad option value: " << optarg
+                    << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
       }
       break;
     default:
@@ -264,6 +306,21 @@ int main(int argc, char **argv)
     config.htdocs = "./";
   }
 
+  if(config.file_cache_size > 0) {
+    // Cached files must not use up file descriptors needed to accept
+    // connections.
+    rlimit rlim;
+    if(getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+       rlim.rlim_cur != RLIM_INFINITY) {
+      size_t max_size = rlim.rlim_cur / 2 / config.num_worker;
+      if(config.file_cache_size > max_size) {
+        std::cerr << "--file-cache-size: Lowered to " << max_size
+                  << " due to RLIMIT_NOFILE" << std::endl;
+        config.file_cache_size = max_size;
+      }
+    }
+  }
+
   set_color_output(color || isatty(fileno(stdout)));
 
   struct sigaction act;
@@ -31,6 +31,14 @@
 #include "shrpx_ssl_test.h"
 #include "shrpx_downstream_test.h"
 #include "shrpx_config_test.h"
+#include "shrpx_cache_test.h"
+#include "shrpx_session_cache_test.h"
+#include "shrpx_accesslog_test.h"
+#include "shrpx_stats_test.h"
+#include "shrpx_gzip_test.h"
+#include "shrpx_http2_session_test.h"
+#include "shrpx_http_downstream_connection_test.h"
+#include "shrpx_splice_tunnel_test.h"
 #include "http2_test.h"
 #include "util_test.h"
 
@@ -70,6 +78,10 @@ int main(int argc, char* argv[])
                    shrpx::test_shrpx_ssl_create_lookup_tree) ||
       !CU_add_test(pSuite, "ssl_cert_lookup_tree_add_cert_from_file",
                    shrpx::test_shrpx_ssl_cert_lookup_tree_add_cert_from_file) ||
+      !CU_add_test(pSuite, "ssl_merge_ticket_keys",
+                   shrpx::test_shrpx_ssl_merge_ticket_keys) ||
+      !CU_add_test(pSuite, "ssl_verify_ocsp_response",
+                   shrpx::test_shrpx_ssl_verify_ocsp_response) ||
       !CU_add_test(pSuite, "http2_split_add_header",
                    shrpx::test_http2_split_add_header) ||
       !CU_add_test(pSuite, "http2_sort_nva", shrpx::test_http2_sort_nva) ||
@@ -79,6 +91,8 @@ int main(int argc, char* argv[])
                    shrpx::test_http2_get_unique_header) ||
       !CU_add_test(pSuite, "http2_get_header",
                    shrpx::test_http2_get_header) ||
+      !CU_add_test(pSuite, "http2_index_headers",
+                   shrpx::test_http2_index_headers) ||
       !CU_add_test(pSuite, "http2_value_lws",
                    shrpx::test_http2_value_lws) ||
       !CU_add_test(pSuite, "http2_concat_norm_headers",
@@ -91,12 +105,18 @@ int main(int argc, char* argv[])
                    shrpx::test_http2_lws) ||
       !CU_add_test(pSuite, "http2_rewrite_location_uri",
                    shrpx::test_http2_rewrite_location_uri) ||
+      !CU_add_test(pSuite, "http2_parse_link_header",
+                   shrpx::test_http2_parse_link_header) ||
+      !CU_add_test(pSuite, "http2_accept_gzip",
+                   shrpx::test_http2_accept_gzip) ||
       !CU_add_test(pSuite, "downstream_normalize_request_headers",
                    shrpx::test_downstream_normalize_request_headers) ||
       !CU_add_test(pSuite, "downstream_normalize_response_headers",
                    shrpx::test_downstream_normalize_response_headers) ||
       !CU_add_test(pSuite, "downstream_get_norm_request_header",
                    shrpx::test_downstream_get_norm_request_header) ||
+      !CU_add_test(pSuite, "downstream_get_request_header",
+                   shrpx::test_downstream_get_request_header) ||
       !CU_add_test(pSuite, "downstream_get_norm_response_header",
                    shrpx::test_downstream_get_norm_response_header) ||
       !CU_add_test(pSuite, "downstream_crumble_request_cookie",
@@ -107,6 +127,50 @@ int main(int argc, char* argv[])
                    shrpx::test_downstream_rewrite_norm_location_response_header) ||
       !CU_add_test(pSuite, "config_parse_config_str_list",
                    shrpx::test_shrpx_config_parse_config_str_list) ||
+      !CU_add_test(pSuite, "cache_parse_cache_control",
+                   shrpx::test_shrpx_cache_parse_cache_control) ||
+      !CU_add_test(pSuite, "cache_store_and_lookup",
+                   shrpx::test_shrpx_cache_store_and_lookup) ||
+      !CU_add_test(pSuite, "cache_vary",
+                   shrpx::test_shrpx_cache_vary) ||
+      !CU_add_test(pSuite, "cache_eviction",
+                   shrpx::test_shrpx_cache_eviction) ||
+      !CU_add_test(pSuite, "cache_replace_admission",
+                   shrpx::test_shrpx_cache_replace_admission) ||
+      !CU_add_test(pSuite, "cache_inflight",
+                   shrpx::test_shrpx_cache_inflight) ||
+      !CU_add_test(pSuite, "cache_coalesce_followers",
+                   shrpx::test_shrpx_cache_coalesce_followers) ||
+      !CU_add_test(pSuite, "cache_coalesce_backpressure",
+                   shrpx::test_shrpx_cache_coalesce_backpressure) ||
+      !CU_add_test(pSuite, "session_cache_store_and_lookup",
+                   shrpx::test_shrpx_session_cache_store_and_lookup) ||
+      !CU_add_test(pSuite, "session_cache_eviction",
+                   shrpx::test_shrpx_session_cache_eviction) ||
+      !CU_add_test(pSuite, "session_cache_index",
+                   shrpx::test_shrpx_session_cache_index) ||
+      !CU_add_test(pSuite, "session_cache_file",
+                   shrpx::test_shrpx_session_cache_file) ||
+      !CU_add_test(pSuite, "accesslog_parse_log_format",
+                   shrpx::test_shrpx_accesslog_parse_log_format) ||
+      !CU_add_test(pSuite, "accesslog_format_access_log",
+                   shrpx::test_shrpx_accesslog_format_access_log) ||
+      !CU_add_test(pSuite, "stats_format", shrpx::test_shrpx_stats_format) ||
+      !CU_add_test(pSuite, "stats_request", shrpx::test_shrpx_stats_request) ||
+      !CU_add_test(pSuite, "gzip_content_type_match",
+                   shrpx::test_shrpx_gzip_content_type_match) ||
+      !CU_add_test(pSuite, "gzip_deflate", shrpx::test_shrpx_gzip_deflate) ||
+      !CU_add_test(pSuite, "gzip_start_response_compression",
+                   shrpx::test_shrpx_gzip_start_response_compression) ||
+      !CU_add_test(pSuite, "http2_session_derive_backend_priority",
+                   shrpx::test_shrpx_http2_session_derive_backend_priority) ||
+      !CU_add_test(pSuite, "http_downstream_connection_upgrade_chunk_boundary",
+                   shrpx::
+                   test_shrpx_http_downstream_connection_upgrade_chunk_boundary) ||
+      !CU_add_test(pSuite, "splice_tunnel_forward",
+                   shrpx::test_shrpx_splice_tunnel_forward) ||
+      !CU_add_test(pSuite, "splice_tunnel_error",
+                   shrpx::test_shrpx_splice_tunnel_error) ||
       !CU_add_test(pSuite, "util_streq", shrpx::test_util_streq) ||
       !CU_add_test(pSuite, "util_strieq", shrpx::test_util_strieq) ||
       !CU_add_test(pSuite, "util_inp_strlower",
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <netdb.h>
 #include <signal.h>
 #include <netinet/in.h>
@@ -35,12 +36,17 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <syslog.h>
+#include <fcntl.h>
+#include <limits.h>
 
 #include <limits>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <string>
+#include <chrono>
+#include <future>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -52,14 +58,34 @@
 #include "shrpx_config.h"
 #include "shrpx_listen_handler.h"
 #include "shrpx_ssl.h"
+#include "shrpx_session_cache.h"
+#include "shrpx_accesslog.h"
+#include "shrpx_timeout.h"
+#include "shrpx_client_handler.h"
 #include "util.h"
 #include "app_helper.h"
 #include "ssl.h"
 
+extern char **environ;
+
 using namespace nghttp2;
 
 namespace shrpx {
 
+namespace {
+// Environment variables to pass the listening sockets to the new
+// binary.
+const char ENV_LISTENER4_FD[] = "NGHTTPX_LISTENER4_FD";
+const char ENV_LISTENER6_FD[] = "NGHTTPX_LISTENER6_FD";
+} // namespace
+
+namespace {
+// The path to the executable file of this program and the command
+// line arguments, which are used to execute the new binary.
+std::string exec_path;
+std::vector<std::string> exec_args;
+} // namespace
+
 namespace {
 void ssl_acceptcb(evconnlistener *listener, int fd,
                   sockaddr *addr, int addrlen, void *arg)
@@ -129,6 +155,46 @@ void evlistener_errorcb(evconnlistener *listener, void *ptr)
 }
 } // namespace
 
+namespace {
+evconnlistener* new_evlistener(ListenHandler *handler, int fd)
+{
+  auto evlistener = evconnlistener_new
+    (handler->get_evbase(),
+     ssl_acceptcb,
+     handler,
+     LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE,
+     get_config()->backlog,
+     fd);
+  evconnlistener_set_error_cb(evlistener, evlistener_errorcb);
+  return evlistener;
+}
+} // namespace
+
+namespace {
+// Returns the listening socket whose descriptor is given in the
+// environment variable |envname|, or -1 if the variable is not set
+// or does not refer to a listening socket.
+int get_inherited_listener_fd(const char *envname)
+{
+  auto envfd = getenv(envname);
+  if(!envfd) {
+    return -1;
+  }
+  char *end;
+  errno = 0;
+  auto n = strtol(envfd, &end, 10);
+  int val;
+  socklen_t len = sizeof(val);
+  if(errno != 0 || end == envfd || *end != '\0' || n < 0 || n > INT_MAX ||
+     getsockopt(n, SOL_SOCKET, SO_ACCEPTCONN, &val, &len) == -1 || !val) {
+    LOG(WARNING) << "Ignoring " << envname << "=" << envfd
+                 << ": not a listening socket";
+    return -1;
+  }
+  return n;
+}
+} // namespace
+
 namespace {
 evconnlistener* create_evlistener(ListenHandler *handler, int family)
 {
@@ -136,6 +202,20 @@ evconnlistener* create_evlistener(ListenHandler *handler, int family)
   addrinfo hints;
   int fd = -1;
   int r;
+
+  auto envname = family == AF_INET ? ENV_LISTENER4_FD : ENV_LISTENER6_FD;
+  fd = get_inherited_listener_fd(envname);
+  unsetenv(envname);
+  if(fd != -1) {
+    // The socket was inherited from the process which executed us.
+    if(LOG_ENABLED(INFO)) {
+      LOG(INFO) << "Listening on inherited IPv"
+                << (family == AF_INET ? "4" : "6") << " socket fd=" << fd;
+    }
+    evutil_make_socket_nonblocking(fd);
+    return new_evlistener(handler, fd);
+  }
+
   char service[10];
   snprintf(service, sizeof(service), "%u", get_config()->port);
   memset(&hints, 0, sizeof(addrinfo));
@@ -205,15 +285,7 @@ evconnlistener* create_evlistener(ListenHandler *handler, int family)
     return 0;
   }
 
-  auto evlistener = evconnlistener_new
-    (handler->get_evbase(),
-     ssl_acceptcb,
-     handler,
-     LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE,
-     get_config()->backlog,
-     fd);
-  evconnlistener_set_error_cb(evlistener, evlistener_errorcb);
-  return evlistener;
+  return new_evlistener(handler, fd);
 }
 } // namespace
 
@@ -250,6 +322,229 @@ void save_pid()
 }
 } // namespace
 
+namespace {
+void rotate_ticket_key_cb(evutil_socket_t fd, short what, void *arg)
+{
+  if(ssl::update_ticket_keys() != 0) {
+    LOG(ERROR) << "Failed to update TLS session ticket keys. Keep using "
+               << "the current keys.";
+  }
+}
+} // namespace
+
+namespace {
+void update_ocsp_cb(evutil_socket_t fd, short what, void *arg)
+{
+  auto ocsp_update = static_cast<std::future<void>*>(arg);
+  // Reading and verifying the response files are done in the
+  // separate thread so that they do not block the event loop. The
+  // new responses are published to the handshakes atomically.
+  if(ocsp_update->valid() &&
+     ocsp_update->wait_for(std::chrono::seconds(0)) !=
+     std::future_status::ready) {
+    // The previous update is still running.
+    return;
+  }
+  *ocsp_update = std::async(std::launch::async, ssl::update_ocsp_staples);
+}
+} // namespace
+
+namespace {
+void reopen_accesslog_cb(evutil_socket_t sig, short what, void *arg)
+{
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Reopening accesslog file";
+  }
+  reopen_accesslog();
+}
+} // namespace
+
+namespace {
+void exec_binary_cb(evutil_socket_t sig, short what, void *arg)
+{
+  auto listener_handler = static_cast<ListenHandler*>(arg);
+
+  if(exec_path.empty()) {
+    LOG(ERROR) << "Not executing new binary: the path to the executable "
+               << "is unknown";
+    return;
+  }
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Executing new binary " << exec_path;
+  }
+
+  // Everything is prepared before fork() because only async-signal
+  // safe functions can be used in the child process.
+  auto argv = std::vector<char*>();
+  for(auto& arg : exec_args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  auto envs = std::vector<std::string>();
+  for(auto p = environ; *p; ++p) {
+    if(util::startsWith(*p, ENV_LISTENER4_FD) ||
+       util::startsWith(*p, ENV_LISTENER6_FD)) {
+      continue;
+    }
+    envs.push_back(*p);
+  }
+  int fd4 = -1, fd6 = -1;
+  if(listener_handler->get_evlistener4()) {
+    fd4 = evconnlistener_get_fd(listener_handler->get_evlistener4());
+    envs.push_back(std::string(ENV_LISTENER4_FD) + "=" + util::utos(fd4));
+  }
+  if(listener_handler->get_evlistener6()) {
+    fd6 = evconnlistener_get_fd(listener_handler->get_evlistener6());
+    envs.push_back(std::string(ENV_LISTENER6_FD) + "=" + util::utos(fd6));
+  }
+  if(fd4 == -1 && fd6 == -1) {
+    LOG(ERROR) << "Not executing new binary: graceful shutdown in progress";
+    return;
+  }
+  auto envp = std::vector<char*>();
+  for(auto& env : envs) {
+    envp.push_back(const_cast<char*>(env.c_str()));
+  }
+  envp.push_back(nullptr);
+
+  auto maxfd = sysconf(_SC_OPEN_MAX);
+
+  auto pid = fork();
+  if(pid == -1) {
+    LOG(ERROR) << "fork() failed: " << strerror(errno);
+    return;
+  }
+  if(pid == 0) {
+    // Child process. Do not leak client and backend connections to
+    // the new binary; otherwise they would not be closed when this
+    // process closes them.
+    for(long fd = 3; fd < maxfd; ++fd) {
+      if(fd != fd4 && fd != fd6) {
+        close(fd);
+      }
+    }
+    for(auto fd : {fd4, fd6}) {
+      if(fd != -1) {
+        fcntl(fd, F_SETFD, 0);
+      }
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+    execve(exec_path.c_str(), argv.data(), envp.data());
+    _exit(EXIT_FAILURE);
+  }
+
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "New binary started, pid=" << pid;
+  }
+}
+} // namespace
+
+namespace {
+void reap_child_cb(evutil_socket_t sig, short what, void *arg)
+{
+  // Collect the new binary executed by exec_binary_cb if it exited,
+  // so that it does not remain as a zombie.
+  for(;;) {
+    int status;
+    auto pid = waitpid(-1, &status, WNOHANG);
+    if(pid <= 0) {
+      break;
+    }
+    if(LOG_ENABLED(INFO)) {
+      LOG(INFO) << "Child process " << pid << " exited, status=" << status;
+    }
+  }
+}
+} // namespace
+
+namespace {
+struct GracefulShutdown {
+  std::chrono::steady_clock::time_point deadline;
+  event *timerev;
+};
+} // namespace
+
+namespace {
+void graceful_shutdown_timeoutcb(evutil_socket_t fd, short what, void *arg)
+{
+  auto shutdown = static_cast<GracefulShutdown*>(arg);
+  auto num = get_num_client_handlers();
+  if(num == 0 || std::chrono::steady_clock::now() >= shutdown->deadline) {
+    if(LOG_ENABLED(INFO)) {
+      LOG(INFO) << "Graceful shutdown finished, " << num
+                << " connection(s) left";
+    }
+    event_base_loopbreak(event_get_base(shutdown->timerev));
+  }
+}
+} // namespace
+
+namespace {
+void graceful_shutdown_cb(evutil_socket_t sig, short what, void *arg)
+{
+  static GracefulShutdown shutdown;
+  static const timeval tick = { 0, 100000 };
+
+  auto listener_handler = static_cast<ListenHandler*>(arg);
+
+  if(shutdown.timerev) {
+    return;
+  }
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Graceful shutdown commencing";
+  }
+  listener_handler->close_evlistener();
+  listener_handler->graceful_shutdown_worker();
+
+  auto& timeout = get_config()->graceful_shutdown_timeout;
+  shutdown.deadline = std::chrono::steady_clock::now() +
+    std::chrono::seconds(timeout.tv_sec);
+  shutdown.timerev = event_new(listener_handler->get_evbase(), -1, EV_PERSIST,
+                               graceful_shutdown_timeoutcb, &shutdown);
+  if(!shutdown.timerev || event_add(shutdown.timerev, &tick) != 0) {
+    LOG(FATAL) << "Failed to schedule graceful shutdown";
+    exit(EXIT_FAILURE);
+  }
+}
+} // namespace
+
+namespace {
+// Returns the absolute path to the executable file named |argv0|.
+// If |argv0| does not contain '/', it is searched in PATH. Returns
+// empty string if it is not found.
+std::string get_exec_path(const char *argv0)
+{
+  char buf[PATH_MAX];
+  if(strchr(argv0, '/')) {
+    if(!realpath(argv0, buf)) {
+      return "";
+    }
+    return buf;
+  }
+  auto path = getenv("PATH");
+  if(!path) {
+    return "";
+  }
+  for(const char *first = path;;) {
+    auto last = strchr(first, ':');
+    auto dir = last ? std::string(first, last) : std::string(first);
+    auto candidate = dir + "/" + argv0;
+    if(access(candidate.c_str(), X_OK) == 0 &&
+       realpath(candidate.c_str(), buf)) {
+      return buf;
+    }
+    if(!last) {
+      return "";
+    }
+    first = last + 1;
+  }
+}
+} // namespace
+
 namespace {
 int event_loop()
 {
@@ -258,6 +553,7 @@ int event_loop()
     LOG(FATAL) << "event_base_new() failed";
     exit(EXIT_FAILURE);
   }
+  init_timeouts(evbase);
   SSL_CTX *sv_ssl_ctx, *cl_ssl_ctx;
 
   if(get_config()->client_mode) {
@@ -273,6 +569,30 @@ int event_loop()
   }
 
   auto listener_handler = new ListenHandler(evbase, sv_ssl_ctx, cl_ssl_ctx);
+
+  event *ticket_keyev = nullptr;
+  if(sv_ssl_ctx && !get_config()->no_tls_ticket) {
+    ticket_keyev = event_new(evbase, -1, EV_PERSIST, rotate_ticket_key_cb,
+                             nullptr);
+    if(!ticket_keyev ||
+       event_add(ticket_keyev,
+                 &get_config()->tls_ticket_key_rotation_interval) != 0) {
+      LOG(FATAL) << "Failed to schedule TLS session ticket key rotation";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // The destructor waits for the running update to finish.
+  std::future<void> ocsp_update;
+  event *ocspev = nullptr;
+  if(sv_ssl_ctx && !get_config()->no_ocsp) {
+    ocspev = event_new(evbase, -1, EV_PERSIST, update_ocsp_cb, &ocsp_update);
+    if(!ocspev ||
+       event_add(ocspev, &get_config()->ocsp_update_interval) != 0) {
+      LOG(FATAL) << "Failed to schedule OCSP response update";
+      exit(EXIT_FAILURE);
+    }
+  }
   if(get_config()->daemon) {
     if(daemon(0, 0) == -1) {
       LOG(FATAL) << "Failed to daemonize: " << strerror(errno);
@@ -284,6 +604,21 @@ int event_loop()
     save_pid();
   }
 
+  event *reopenev = nullptr;
+  if(get_config()->accesslog_file) {
+    // The writer thread must be started after daemon(3) since fork
+    // does not copy threads.
+    if(start_accesslog_writer() != 0) {
+      LOG(FATAL) << "Failed to start accesslog writer";
+      exit(EXIT_FAILURE);
+    }
+    reopenev = evsignal_new(evbase, SIGUSR1, reopen_accesslog_cb, nullptr);
+    if(!reopenev || event_add(reopenev, nullptr) != 0) {
+      LOG(FATAL) << "Failed to register SIGUSR1 handler";
+      exit(EXIT_FAILURE);
+    }
+  }
+
   auto evlistener6 = create_evlistener(listener_handler, AF_INET6);
   auto evlistener4 = create_evlistener(listener_handler, AF_INET);
   if(!evlistener6 && !evlistener4) {
@@ -291,6 +626,20 @@ int event_loop()
                << get_config()->host << ", port " << get_config()->port;
     exit(EXIT_FAILURE);
   }
+  listener_handler->set_evlistener4(evlistener4);
+  listener_handler->set_evlistener6(evlistener6);
+
+  auto execev = evsignal_new(evbase, SIGUSR2, exec_binary_cb,
+                             listener_handler);
+  auto quitev = evsignal_new(evbase, SIGQUIT, graceful_shutdown_cb,
+                             listener_handler);
+  auto chldev = evsignal_new(evbase, SIGCHLD, reap_child_cb, nullptr);
+  if(!execev || event_add(execev, nullptr) != 0 ||
+     !quitev || event_add(quitev, nullptr) != 0 ||
+     !chldev || event_add(chldev, nullptr) != 0) {
+    LOG(FATAL) << "Failed to register SIGUSR2, SIGQUIT and SIGCHLD handler";
+    exit(EXIT_FAILURE);
+  }
 
   // ListenHandler loads private key, and we listen on a priveleged port.
   // After that, we drop the root privileges if needed.
@@ -298,20 +647,37 @@ int event_loop()
 
   if(get_config()->num_worker > 1) {
     listener_handler->create_worker_thread(get_config()->num_worker);
-  } else if(get_config()->downstream_proto == PROTO_HTTP2) {
-    listener_handler->create_http2_session();
+  } else {
+    if(get_config()->downstream_proto == PROTO_HTTP2) {
+      listener_handler->create_http2_session();
+    }
+    if(get_config()->cache_size > 0) {
+      listener_handler->create_response_cache();
+    }
   }
 
   if(LOG_ENABLED(INFO)) {
     LOG(INFO) << "Entering event loop";
   }
   event_base_loop(evbase, 0);
-  if(evlistener4) {
-    evconnlistener_free(evlistener4);
+  // Worker threads may still serve the connections left after
+  // graceful shutdown timed out. Stop them before returning.
+  listener_handler->join_worker();
+  // Flush the access log records of the stopped workers.
+  stop_accesslog_writer();
+  if(ticket_keyev) {
+    event_free(ticket_keyev);
   }
-  if(evlistener6) {
-    evconnlistener_free(evlistener6);
+  if(ocspev) {
+    event_free(ocspev);
   }
+  if(reopenev) {
+    event_free(reopenev);
+  }
+  event_free(execev);
+  event_free(quitev);
+  event_free(chldev);
+  listener_handler->close_evlistener();
   return 0;
 }
 } // namespace
@@ -334,6 +700,15 @@ const char *DEFAULT_NPN_LIST = NGHTTP2_PROTO_VERSION_ID ","
   "http/1.1";
 } // namespace
 
+namespace {
+const char *DEFAULT_GZIP_TYPES = "text/html,text/plain,text/css,"
+  "application/javascript,application/json,application/xml,image/svg+xml";
+} // namespace
+
+namespace {
+const char *DEFAULT_STATS_ALLOW = "127.0.0.1,::1";
+} // namespace
+
 namespace {
 const char *DEFAULT_TLS_PROTO_LIST = "TLSv1.2,TLSv1.1,TLSv1.0";
 } // namespace
@@ -374,6 +749,9 @@ void fill_default_config()
   // Timeout for pooled (idle) connections
   mod_config()->downstream_idle_read_timeout.tv_sec = 60;
 
+  mod_config()->graceful_shutdown_timeout.tv_sec = 30;
+  mod_config()->graceful_shutdown_timeout.tv_usec = 0;
+
   // window bits for HTTP/2.0 and SPDY upstream/downstream connection
   // per stream. 2**16-1 = 64KiB-1, which is HTTP/2.0 default. Please
   // note that SPDY/3 default is 64KiB.
@@ -395,6 +773,7 @@ void fill_default_config()
 
   mod_config()->num_worker = 1;
   mod_config()->http2_max_concurrent_streams = 100;
+  mod_config()->http2_max_push_streams = 16;
   mod_config()->add_x_forwarded_for = false;
   mod_config()->no_via = false;
   mod_config()->accesslog = false;
@@ -434,6 +813,12 @@ void fill_default_config()
   mod_config()->worker_write_rate = 0;
   mod_config()->worker_write_burst = 0;
   mod_config()->npn_list = nullptr;
+  mod_config()->gzip_types = nullptr;
+  mod_config()->gzip_types_len = 0;
+  mod_config()->stats_allow = nullptr;
+  mod_config()->stats_allow_len = 0;
+  mod_config()->gzip_min_length = 256;
+  mod_config()->gzip = false;
   mod_config()->verify_client = false;
   mod_config()->verify_client_cacert = nullptr;
   mod_config()->client_private_key_file = nullptr;
@@ -443,6 +828,26 @@ void fill_default_config()
   mod_config()->http2_no_cookie_crumbling = false;
   mod_config()->upstream_frame_debug = false;
   mod_config()->padding = 0;
+  mod_config()->cache_size = 0;
+  mod_config()->cache_max_object_size = 1024*1024;
+  mod_config()->tls_ticket_key_rotation_interval.tv_sec = 3600;
+  mod_config()->tls_ticket_key_rotation_interval.tv_usec = 0;
+  mod_config()->tls_ticket_key_history = 12;
+  mod_config()->no_tls_ticket = false;
+  mod_config()->session_cache = nullptr;
+  mod_config()->tls_session_cache_size = 0;
+  mod_config()->tls_session_cache_file = nullptr;
+  mod_config()->ocsp_update_interval.tv_sec = 3600;
+  mod_config()->ocsp_update_interval.tv_usec = 0;
+  mod_config()->no_ocsp = false;
+  mod_config()->accesslog_file = nullptr;
+  set_config_str(&mod_config()->accesslog_format,
+                 "$remote_addr - - [$time_local] \"$request\" $status "
+                 "$body_bytes_sent \"$http_referer\" \"$http_user_agent\" "
+                 "$request_time $upstream_response_time");
+  mod_config()->accesslog_buffer_size = 1 << 20;
+  mod_config()->stats_path = nullptr;
+  mod_config()->tunnel_splice = false;
 }
 } // namespace
 
@@ -557,6 +962,33 @@ void print_help(std::ostream& out)
       << "                     option means write burst size is unlimited.\n"
       << "                     Default: "
       << get_config()->worker_write_burst << "\n"
+      << "  --cache-size=<SIZE>\n"
+      << "                     Set the maximum size in bytes of in-memory\n"
+      << "                     response cache per worker. The cache stores\n"
+      << "                     GET responses which are fresh according to\n"
+      << "                     Cache-Control or Expires header field and\n"
+      << "                     serves them without contacting backend.\n"
+      << "                     Setting 0 to this option disables the cache.\n"
+      << "                     Default: "
+      << get_config()->cache_size << "\n"
+      << "  --cache-max-object-size=<SIZE>\n"
+      << "                     Set the maximum size of response body which\n"
+      << "                     can be stored in the cache.\n"
+      << "                     Default: "
+      << get_config()->cache_max_object_size << "\n"
+      << "  --gzip             Compress response body with gzip on the fly\n"
+      << "                     if client accepts it and the response is\n"
+      << "                     not compressed yet. The response cache\n"
+      << "                     stores uncompressed body.\n"
+      << "  --gzip-types=<LIST>\n"
+      << "                     Comma delimited list of media types of\n"
+      << "                     response compressed by --gzip.\n"
+      << "                     Default: " << DEFAULT_GZIP_TYPES << "\n"
+      << "  --gzip-min-length=<SIZE>\n"
+      << "                     Don't compress response whose\n"
+      << "                     content-length is less than <SIZE> bytes.\n"
+      << "                     Default: "
+      << get_config()->gzip_min_length << "\n"
       << "\n"
       << "Timeout:\n"
       << "  --frontend-http2-read-timeout=<SEC>\n"
@@ -583,6 +1015,12 @@ void print_help(std::ostream& out)
       << "                     Specify keep-alive timeout for backend\n"
       << "                     connection. Default: "
       << get_config()->downstream_idle_read_timeout.tv_sec << "\n"
+      << "  --graceful-shutdown-timeout=<SEC>\n"
+      << "                     Specify the maximum time to wait for the\n"
+      << "                     client connections to finish after\n"
+      << "                     graceful shutdown is started by SIGQUIT.\n"
+      << "                     Default: "
+      << get_config()->graceful_shutdown_timeout.tv_sec << "\n"
       << "  --backend-http-proxy-uri=<URI>\n"
       << "                     Specify proxy URI in the form\n"
       << "                     http://[<USER>:<PASS>@]<PROXY>:<PORT>. If\n"
@@ -668,6 +1106,65 @@ void print_help(std::ostream& out)
       << "                     comma only and any white spaces are treated\n"
       << "                     as a part of protocol string.\n"
       << "                     Default: " << DEFAULT_TLS_PROTO_LIST << "\n"
+      << "  --tls-ticket-key-file=<PATH>\n"
+      << "                     Path to file that contains 48 bytes random\n"
+      << "                     data used as TLS session ticket key. The\n"
+      << "                     first 16 bytes are key name, the next 16\n"
+      << "                     bytes are AES key and the last 16 bytes\n"
+      << "                     are HMAC key. This option can be used\n"
+      << "                     multiple times. The key in the first file\n"
+      << "                     is used to encrypt tickets and all keys are\n"
+      << "                     used to decrypt them. The files are reread\n"
+      << "                     every --tls-ticket-key-rotation-interval\n"
+      << "                     seconds, so the multiple instances sharing\n"
+      << "                     the files can resume each other's sessions.\n"
+      << "                     Without this option, the key is generated\n"
+      << "                     randomly and renewed every\n"
+      << "                     --tls-ticket-key-rotation-interval seconds.\n"
+      << "  --tls-ticket-key-rotation-interval=<SEC>\n"
+      << "                     Set the interval to rotate TLS session\n"
+      << "                     ticket keys.\n"
+      << "                     Default: "
+      << get_config()->tls_ticket_key_rotation_interval.tv_sec << "\n"
+      << "  --tls-ticket-key-history=<N>\n"
+      << "                     Set the number of previous TLS session\n"
+      << "                     ticket keys which are still accepted after\n"
+      << "                     rotation. The tickets encrypted by those\n"
+      << "                     keys are renewed.\n"
+      << "                     Default: "
+      << get_config()->tls_ticket_key_history << "\n"
+      << "  --no-tls-ticket    Disable TLS session ticket.\n"
+      << "  --tls-session-cache-size=<N>\n"
+      << "                     Set the maximum number of TLS sessions in\n"
+      << "                     session ID cache. If this option is used,\n"
+      << "                     nghttpx uses its own session cache, which\n"
+      << "                     is shared by all worker threads with less\n"
+      << "                     lock contention, instead of OpenSSL's\n"
+      << "                     internal session cache.\n"
+      << "                     Default: "
+      << get_config()->tls_session_cache_size << "\n"
+      << "  --tls-session-cache-file=<PATH>\n"
+      << "                     Place the session cache enabled by\n"
+      << "                     --tls-session-cache-size in the file <PATH>\n"
+      << "                     mapped into memory. The multiple nghttpx\n"
+      << "                     processes on the same host, which use the\n"
+      << "                     same <PATH> and --tls-session-cache-size,\n"
+      << "                     share the sessions. nghttpx refuses to\n"
+      << "                     start if the existing file was created\n"
+      << "                     with the different size.\n"
+      << "  --ocsp-update-interval=<SEC>\n"
+      << "                     Set the interval to reread OCSP response\n"
+      << "                     files. The OCSP response for a certificate\n"
+      << "                     is read from the file named after the\n"
+      << "                     certificate file with \".ocsp\" suffix,\n"
+      << "                     in DER format. It is stapled in TLS\n"
+      << "                     handshake if it is successful, signed\n"
+      << "                     by the issuer of the certificate and not\n"
+      << "                     expired. The issuer certificate must be\n"
+      << "                     included in the certificate file.\n"
+      << "                     Default: "
+      << get_config()->ocsp_update_interval.tv_sec << "\n"
+      << "  --no-ocsp          Disable OCSP stapling.\n"
       << "\n"
       << "HTTP/2.0 and SPDY:\n"
       << "  -c, --http2-max-concurrent-streams=<NUM>\n"
@@ -675,6 +1172,16 @@ void print_help(std::ostream& out)
       << "                     streams in one HTTP/2.0 and SPDY session.\n"
       << "                     Default: "
       << get_config()->http2_max_concurrent_streams << "\n"
+      << "  --http2-max-push-streams=<NUM>\n"
+      << "                     Set the maximum number of the pushed\n"
+      << "                     streams in flight in one HTTP/2.0 frontend\n"
+      << "                     session. The resources in Link header field\n"
+      << "                     with rel=preload in backend response are\n"
+      << "                     pushed if they have the same authority as\n"
+      << "                     the request. Specify 0 to disable server\n"
+      << "                     push.\n"
+      << "                     Default: "
+      << get_config()->http2_max_push_streams << "\n"
       << "  --frontend-http2-window-bits=<N>\n"
       << "                     Sets the per-stream initial window size of HTTP/2.0\n"
       << "                     SPDY frontend connection. For HTTP/2.0, the size is\n"
@@ -740,6 +1247,31 @@ void print_help(std::ostream& out)
       << "                     INFO, WARNING, ERROR and FATAL.\n"
       << "                     Default: WARNING\n"
       << "  --accesslog        Print simple accesslog to stderr.\n"
+      << "  --accesslog-file=<PATH>\n"
+      << "                     Write access log to the file <PATH> in\n"
+      << "                     the format given by --accesslog-format.\n"
+      << "                     The log records are buffered per worker\n"
+      << "                     and written by a dedicated thread, so\n"
+      << "                     workers never block on file I/O. Send\n"
+      << "                     SIGUSR1 to reopen the file after rotation.\n"
+      << "  --accesslog-format=<FORMAT>\n"
+      << "                     Specify the format of access log line.\n"
+      << "                     The following variables are available:\n"
+      << "                     $remote_addr, $time_local, $time_iso8601,\n"
+      << "                     $request, $request_method, $request_uri,\n"
+      << "                     $server_protocol, $status,\n"
+      << "                     $body_bytes_sent, $request_time,\n"
+      << "                     $upstream_response_time, $stream_id and\n"
+      << "                     $http_<NAME> for request header field\n"
+      << "                     <NAME> ('_' is replaced with '-').\n"
+      << "                     Default: "
+      << get_config()->accesslog_format << "\n"
+      << "  --accesslog-buffer-size=<SIZE>\n"
+      << "                     Set the size of access log buffer per\n"
+      << "                     worker in bytes. If the buffer is full,\n"
+      << "                     the records are dropped and counted.\n"
+      << "                     Default: "
+      << get_config()->accesslog_buffer_size << "\n"
       << "  --syslog           Send log messages to syslog.\n"
       << "  --syslog-facility=<FACILITY>\n"
       << "                     Set syslog facility.\n"
@@ -747,6 +1279,29 @@ void print_help(std::ostream& out)
       << str_syslog_facility(get_config()->syslog_facility) << "\n"
       << "\n"
       << "Misc:\n"
+      << "  --tunnel-splice    Forward established tunnel (CONNECT or\n"
+      << "                     HTTP Upgrade) with splice(2) when both\n"
+      << "                     HTTP/1 frontend and backend connections\n"
+      << "                     are plain TCP. The data are not copied\n"
+      << "                     to user space, but --read-rate and\n"
+      << "                     --write-rate options do not apply to\n"
+      << "                     the tunnel.\n"
+      << "  --stats-path=<PATH>\n"
+      << "                     Answer GET request to <PATH> with the\n"
+      << "                     metrics of this process in Prometheus\n"
+      << "                     text format instead of forwarding it to\n"
+      << "                     backend. The metrics are counted per\n"
+      << "                     worker without locking and summed when\n"
+      << "                     requested. Only the clients listed in\n"
+      << "                     --stats-allow can access it; the request\n"
+      << "                     from other clients is forwarded to\n"
+      << "                     backend as usual.\n"
+      << "                     Default: disabled\n"
+      << "  --stats-allow=<LIST>\n"
+      << "                     Comma delimited list of client IP\n"
+      << "                     addresses allowed to access\n"
+      << "                     --stats-path.\n"
+      << "                     Default: " << DEFAULT_STATS_ALLOW << "\n"
       << "  --add-x-forwarded-for\n"
       << "                     Append X-Forwarded-For header field to the\n"
       << "                     downstream request.\n"
@@ -776,6 +1331,14 @@ void print_help(std::ostream& out)
       << "  -D, --daemon       Run in a background. If -D is used, the\n"
       << "                     current working directory is changed to '/'.\n"
       << "  --pid-file=<PATH>  Set path to save PID of this program.\n"
+      << "                     Send SIGUSR2 to this PID to execute the\n"
+      << "                     new binary at the path this program was\n"
+      << "                     started from. It takes over the listening\n"
+      << "                     sockets. Then SIGQUIT to the old process\n"
+      << "                     makes it stop accepting connections, send\n"
+      << "                     GOAWAY and exit after the connections\n"
+      << "                     finish. Use absolute paths in arguments\n"
+      << "                     so that the new binary can find files.\n"
       << "  --user=<USER>      Run this program as USER. This option is\n"
       << "                     intended to be used to drop root privileges.\n"
       << "  --conf=<PATH>      Load configuration from PATH.\n"
@@ -793,6 +1356,10 @@ int main(int argc, char **argv)
   create_config();
   fill_default_config();
 
+  // Save the command line before getopt_long() permutes it.
+  exec_path = get_exec_path(argv[0]);
+  exec_args.assign(argv, argv + argc);
+
   std::vector<std::pair<const char*, const char*> > cmdcfgs;
   while(1) {
     int flag;
@@ -860,6 +1427,27 @@ int main(int argc, char **argv)
       {"worker-read-burst", required_argument, &flag, 51},
       {"worker-write-rate", required_argument, &flag, 52},
       {"worker-write-burst", required_argument, &flag, 53},
+      {"cache-size", required_argument, &flag, 54},
+      {"cache-max-object-size", required_argument, &flag, 55},
+      {"tls-ticket-key-file", required_argument, &flag, 56},
+      {"tls-ticket-key-rotation-interval", required_argument, &flag, 57},
+      {"tls-ticket-key-history", required_argument, &flag, 58},
+      {"no-tls-ticket", no_argument, &flag, 59},
+      {"tls-session-cache-size", required_argument, &flag, 60},
+      {"tls-session-cache-file", required_argument, &flag, 61},
+      {"ocsp-update-interval", required_argument, &flag, 62},
+      {"no-ocsp", no_argument, &flag, 63},
+      {"accesslog-file", required_argument, &flag, 64},
+      {"accesslog-format", required_argument, &flag, 65},
+      {"accesslog-buffer-size", required_argument, &flag, 66},
+      {"stats-path", required_argument, &flag, 67},
+      {"tunnel-splice", no_argument, &flag, 68},
+      {"graceful-shutdown-timeout", required_argument, &flag, 69},
+      {"gzip", no_argument, &flag, 70},
+      {"gzip-types", required_argument, &flag, 71},
+      {"gzip-min-length", required_argument, &flag, 72},
+      {"http2-max-push-streams", required_argument, &flag, 73},
+      {"stats-allow", required_argument, &flag, 74},
       {nullptr, 0, nullptr, 0 }
     };
 
@@ -1116,6 +1704,91 @@ int main(int argc, char **argv)
         // --worker-write-burst
         cmdcfgs.emplace_back(SHRPX_OPT_WORKER_WRITE_BURST, optarg);
         break;
+      case 54:
+        // --cache-size
+        cmdcfgs.emplace_back(SHRPX_OPT_CACHE_SIZE, optarg);
+        break;
+      case 55:
+        // --cache-max-object-size
+        cmdcfgs.emplace_back(SHRPX_OPT_CACHE_MAX_OBJECT_SIZE, optarg);
+        break;
+      case 56:
+        // --tls-ticket-key-file
+        cmdcfgs.emplace_back(SHRPX_OPT_TLS_TICKET_KEY_FILE, optarg);
+        break;
+      case 57:
+        // --tls-ticket-key-rotation-interval
+        cmdcfgs.emplace_back(SHRPX_OPT_TLS_TICKET_KEY_ROTATION_INTERVAL,
+                             optarg);
+        break;
+      case 58:
+        // --tls-ticket-key-history
+        cmdcfgs.emplace_back(SHRPX_OPT_TLS_TICKET_KEY_HISTORY, optarg);
+        break;
+      case 59:
+        // --no-tls-ticket
+        cmdcfgs.emplace_back(SHRPX_OPT_NO_TLS_TICKET, "yes");
+        break;
+      case 60:
+        // --tls-session-cache-size
+        cmdcfgs.emplace_back(SHRPX_OPT_TLS_SESSION_CACHE_SIZE, optarg);
+        break;
+      case 61:
+        // --tls-session-cache-file
+        cmdcfgs.emplace_back(SHRPX_OPT_TLS_SESSION_CACHE_FILE, optarg);
+        break;
+      case 62:
+        // --ocsp-update-interval
+        cmdcfgs.emplace_back(SHRPX_OPT_OCSP_UPDATE_INTERVAL, optarg);
+        break;
+      case 63:
+        // --no-ocsp
+        cmdcfgs.emplace_back(SHRPX_OPT_NO_OCSP, "yes");
+        break;
+      case 64:
+        // --accesslog-file
+        cmdcfgs.emplace_back(SHRPX_OPT_ACCESSLOG_FILE, optarg);
+        break;
+      case 65:
+        // --accesslog-format
+        cmdcfgs.emplace_back(SHRPX_OPT_ACCESSLOG_FORMAT, optarg);
+        break;
+      case 66:
+        // --accesslog-buffer-size
+        cmdcfgs.emplace_back(SHRPX_OPT_ACCESSLOG_BUFFER_SIZE, optarg);
+        break;
+      case 67:
+        // --stats-path
+        cmdcfgs.emplace_back(SHRPX_OPT_STATS_PATH, optarg);
+        break;
+      case 68:
+        // --tunnel-splice
+        cmdcfgs.emplace_back(SHRPX_OPT_TUNNEL_SPLICE, "yes");
+        break;
+      case 69:
+        // --graceful-shutdown-timeout
+        cmdcfgs.emplace_back(SHRPX_OPT_GRACEFUL_SHUTDOWN_TIMEOUT, optarg);
+        break;
+      case 70:
+        // --gzip
+        cmdcfgs.emplace_back(SHRPX_OPT_GZIP, "yes");
+        break;
+      case 71:
+        // --gzip-types
+        cmdcfgs.emplace_back(SHRPX_OPT_GZIP_TYPES, optarg);
+        break;
+      case 72:
+        // --gzip-min-length
+        cmdcfgs.emplace_back(SHRPX_OPT_GZIP_MIN_LENGTH, optarg);
+        break;
+      case 73:
+        // --http2-max-push-streams
+        cmdcfgs.emplace_back(SHRPX_OPT_HTTP2_MAX_PUSH_STREAMS, optarg);
+        break;
+      case 74:
+        // --stats-allow
+        cmdcfgs.emplace_back(SHRPX_OPT_STATS_ALLOW, optarg);
+        break;
       default:
         break;
       }
@@ -1156,11 +1829,38 @@ int main(int argc, char **argv)
     mod_config()->npn_list = parse_config_str_list(&mod_config()->npn_list_len,
                                                    DEFAULT_NPN_LIST);
   }
+  if(!get_config()->gzip_types) {
+    mod_config()->gzip_types = parse_config_str_list
+      (&mod_config()->gzip_types_len, DEFAULT_GZIP_TYPES);
+  }
+  if(!get_config()->stats_allow) {
+    mod_config()->stats_allow = parse_config_str_list
+      (&mod_config()->stats_allow_len, DEFAULT_STATS_ALLOW);
+  }
   if(!get_config()->tls_proto_list) {
     mod_config()->tls_proto_list = parse_config_str_list
       (&mod_config()->tls_proto_list_len, DEFAULT_TLS_PROTO_LIST);
   }
 
+  if(get_config()->tls_session_cache_size > 0) {
+    auto session_cache = new SessionCache
+      (get_config()->tls_session_cache_size);
+    if(session_cache->init(get_config()->tls_session_cache_file) != 0) {
+      LOG(FATAL) << "Failed to initialize TLS session cache.";
+      exit(EXIT_FAILURE);
+    }
+    mod_config()->session_cache = session_cache;
+  }
+
+  if(!get_config()->no_tls_ticket &&
+     (!get_config()->subcerts.empty() ||
+      (get_config()->cert_file && get_config()->private_key_file))) {
+    if(ssl::update_ticket_keys() != 0) {
+      LOG(FATAL) << "Failed to initialize TLS session ticket keys.";
+      exit(EXIT_FAILURE);
+    }
+  }
+
   if(!get_config()->subcerts.empty()) {
     mod_config()->cert_tree = ssl::cert_lookup_tree_new();
   }
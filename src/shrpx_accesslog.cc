@@ -25,13 +25,27 @@
 #include "shrpx_accesslog.h"
 
 #include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include <ctime>
 #include <cstdio>
 #include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <memory>
 
 #include "shrpx_config.h"
 #include "shrpx_downstream.h"
+#include "shrpx_upstream.h"
+#include "shrpx_client_handler.h"
+#include "shrpx_log.h"
+#include "util.h"
 
 namespace shrpx {
 
@@ -122,4 +136,476 @@ void upstream_response(const std::string& client_ip, unsigned int status_code,
   }
 }
 
+namespace {
+const struct {
+  const char *name;
+  LogFragmentType type;
+} LOG_VARS[] = {
+  {"remote_addr", LOG_REMOTE_ADDR},
+  {"time_local", LOG_TIME_LOCAL},
+  {"time_iso8601", LOG_TIME_ISO8601},
+  {"request", LOG_REQUEST},
+  {"request_method", LOG_REQUEST_METHOD},
+  {"request_uri", LOG_REQUEST_URI},
+  {"server_protocol", LOG_SERVER_PROTOCOL},
+  {"status", LOG_STATUS},
+  {"body_bytes_sent", LOG_BODY_BYTES_SENT},
+  {"request_time", LOG_REQUEST_TIME},
+  {"upstream_response_time", LOG_UPSTREAM_RESPONSE_TIME},
+  {"stream_id", LOG_STREAM_ID},
+};
+} // namespace
+
+namespace {
+bool log_var_char(char c)
+{
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+    ('0' <= c && c <= '9') || c == '_' || c == '-';
+}
+} // namespace
+
+int parse_log_format(std::vector<LogFragment>& fragments,
+                     const char *format)
+{
+  fragments.clear();
+  std::string literal;
+  for(auto p = format; *p;) {
+    if(*p != '$') {
+      literal += *p++;
+      continue;
+    }
+    ++p;
+    bool brace = *p == '{';
+    if(brace) {
+      ++p;
+    }
+    auto first = p;
+    for(; log_var_char(*p); ++p);
+    std::string name(first, p);
+    if(brace) {
+      if(*p != '}') {
+        return -1;
+      }
+      ++p;
+    }
+    if(name.empty()) {
+      return -1;
+    }
+    for(auto& c : name) {
+      c = util::lowcase(c);
+    }
+    LogFragment frag;
+    if(util::startsWith(name, "http_") && name.size() > 5) {
+      frag.type = LOG_HTTP;
+      frag.value = name.substr(5);
+      for(auto& c : frag.value) {
+        if(c == '_') {
+          c = '-';
+        }
+      }
+    } else {
+      bool found = false;
+      for(auto& var : LOG_VARS) {
+        if(name == var.name) {
+          frag.type = var.type;
+          found = true;
+          break;
+        }
+      }
+      if(!found) {
+        return -1;
+      }
+    }
+    if(!literal.empty()) {
+      fragments.push_back({LOG_LITERAL, std::move(literal)});
+      literal.clear();
+    }
+    fragments.push_back(std::move(frag));
+  }
+  if(!literal.empty()) {
+    fragments.push_back({LOG_LITERAL, std::move(literal)});
+  }
+  return 0;
+}
+
+namespace {
+// Appends |s| to |out|, escaping '"', '\' and non-printable
+// characters as \xHH so that a record never spans lines.
+void append_escaped(std::string& out, const std::string& s)
+{
+  if(s.empty()) {
+    out += '-';
+    return;
+  }
+  for(auto c : s) {
+    auto b = static_cast<uint8_t>(c);
+    if(b < 0x20 || b >= 0x7f || c == '"' || c == '\\') {
+      static const char HEX[] = "0123456789ABCDEF";
+      out += "\\x";
+      out += HEX[b >> 4];
+      out += HEX[b & 0xf];
+    } else {
+      out += c;
+    }
+  }
+}
+} // namespace
+
+namespace {
+void append_seconds(std::string& out, double t)
+{
+  if(t < 0) {
+    out += '-';
+    return;
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.3f", t);
+  out += buf;
+}
+} // namespace
+
+namespace {
+void append_time(std::string& out, time_t t, bool iso8601)
+{
+  tm tms;
+  char buf[64];
+  if(localtime_r(&t, &tms) == nullptr) {
+    out += '-';
+    return;
+  }
+  auto len = strftime(buf, sizeof(buf), iso8601 ?
+                      "%Y-%m-%dT%H:%M:%S%z" : "%d/%b/%Y:%H:%M:%S %z",
+                      &tms);
+  if(len == 0) {
+    out += '-';
+    return;
+  }
+  if(iso8601 && len >= 5) {
+    // +hhmm -> +hh:mm
+    out.append(buf, len - 2);
+    out += ':';
+    out.append(buf + len - 2, 2);
+  } else {
+    out.append(buf, len);
+  }
+}
+} // namespace
+
+namespace {
+void append_protocol(std::string& out, Downstream *downstream)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "HTTP/%d.%d", downstream->get_request_major(),
+           downstream->get_request_minor());
+  out += buf;
+}
+} // namespace
+
+void format_access_log(std::string& out,
+                       const std::vector<LogFragment>& fragments,
+                       const LogSpec& spec)
+{
+  auto downstream = spec.downstream;
+  for(auto& frag : fragments) {
+    switch(frag.type) {
+    case LOG_LITERAL:
+      out += frag.value;
+      break;
+    case LOG_REMOTE_ADDR:
+      out += spec.remote_addr;
+      break;
+    case LOG_TIME_LOCAL:
+      append_time(out, spec.time_now, false);
+      break;
+    case LOG_TIME_ISO8601:
+      append_time(out, spec.time_now, true);
+      break;
+    case LOG_REQUEST:
+      append_escaped(out, downstream->get_request_method());
+      out += ' ';
+      append_escaped(out, downstream->get_request_path());
+      out += ' ';
+      append_protocol(out, downstream);
+      break;
+    case LOG_REQUEST_METHOD:
+      append_escaped(out, downstream->get_request_method());
+      break;
+    case LOG_REQUEST_URI:
+      append_escaped(out, downstream->get_request_path());
+      break;
+    case LOG_SERVER_PROTOCOL:
+      append_protocol(out, downstream);
+      break;
+    case LOG_STATUS:
+      out += util::utos(downstream->get_response_http_status());
+      break;
+    case LOG_BODY_BYTES_SENT:
+      out += util::utos(downstream->get_response_sent_bodylen());
+      break;
+    case LOG_REQUEST_TIME:
+      append_seconds(out, spec.request_time);
+      break;
+    case LOG_UPSTREAM_RESPONSE_TIME:
+      append_seconds(out, spec.upstream_response_time);
+      break;
+    case LOG_STREAM_ID:
+      out += util::utos(downstream->get_stream_id());
+      break;
+    case LOG_HTTP: {
+      bool found = false;
+      for(auto& nv : downstream->get_request_headers()) {
+        if(util::strieq(nv.first, frag.value)) {
+          append_escaped(out, nv.second);
+          found = true;
+          break;
+        }
+      }
+      if(!found) {
+        out += '-';
+      }
+      break;
+    }
+    }
+  }
+  out += '\n';
+}
+
+namespace {
+// Single producer, single consumer byte ring. The worker thread which
+// owns this ring appends records and the writer thread drains them.
+struct LogRing {
+  LogRing(size_t size)
+    : buf(size), mask(size - 1), head(0), tail(0), dropped(0)
+  {}
+  std::vector<char> buf;
+  size_t mask;
+  // Written by producer only
+  std::atomic<size_t> head;
+  // Written by consumer only
+  std::atomic<size_t> tail;
+  std::atomic<uint64_t> dropped;
+  // Appends |s| as a whole. Returns false if there is not enough
+  // room.
+  bool push(const std::string& s)
+  {
+    auto h = head.load(std::memory_order_relaxed);
+    auto t = tail.load(std::memory_order_acquire);
+    if(buf.size() - (h - t) < s.size()) {
+      return false;
+    }
+    auto off = h & mask;
+    auto n = std::min(s.size(), buf.size() - off);
+    memcpy(&buf[off], s.data(), n);
+    memcpy(&buf[0], s.data() + n, s.size() - n);
+    head.store(h + s.size(), std::memory_order_release);
+    return true;
+  }
+  // Moves all available bytes to |out|.
+  void drain(std::string& out)
+  {
+    auto t = tail.load(std::memory_order_relaxed);
+    auto h = head.load(std::memory_order_acquire);
+    auto len = h - t;
+    if(len == 0) {
+      return;
+    }
+    auto off = t & mask;
+    auto n = std::min(len, buf.size() - off);
+    out.append(&buf[off], n);
+    out.append(&buf[0], len - n);
+    tail.store(h, std::memory_order_release);
+  }
+};
+} // namespace
+
+namespace {
+struct AccessLogWriter {
+  std::vector<LogFragment> fragments;
+  std::thread thread;
+  std::mutex mu;
+  // Signaled when stop or reopen is set
+  std::condition_variable cv;
+  // Guarded by mu
+  std::vector<std::shared_ptr<LogRing>> rings;
+  // Guarded by mu
+  bool stop;
+  std::atomic<bool> reopen;
+  int fd;
+};
+} // namespace
+
+namespace {
+AccessLogWriter *writer = nullptr;
+} // namespace
+
+namespace {
+thread_local LogRing *local_ring = nullptr;
+} // namespace
+
+namespace {
+int open_accesslog_file()
+{
+  auto path = get_config()->accesslog_file;
+  auto fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if(fd == -1) {
+    LOG(ERROR) << "Failed to open accesslog file " << path
+               << ": errno=" << errno;
+  }
+  return fd;
+}
+} // namespace
+
+namespace {
+// Writes |data| to |fd|. Returns the number of bytes written, which
+// is less than data.size() on error.
+size_t write_all(int fd, const std::string& data)
+{
+  size_t off = 0;
+  while(off < data.size()) {
+    auto rv = write(fd, data.data() + off, data.size() - off);
+    if(rv == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    off += rv;
+  }
+  return off;
+}
+} // namespace
+
+namespace {
+void accesslog_writer_loop()
+{
+  std::string batch;
+  std::vector<std::shared_ptr<LogRing>> rings;
+  uint64_t dropped = 0;
+  // The number of records which could not be written to the file
+  uint64_t write_dropped = 0;
+  for(;;) {
+    bool stop;
+    {
+      std::unique_lock<std::mutex> lock(writer->mu);
+      writer->cv.wait_for(lock, std::chrono::milliseconds(100), []
+                          {
+                            return writer->stop || writer->reopen;
+                          });
+      stop = writer->stop;
+      rings = writer->rings;
+    }
+    if(writer->reopen.exchange(false)) {
+      auto fd = open_accesslog_file();
+      if(fd != -1) {
+        if(writer->fd != -1) {
+          close(writer->fd);
+        }
+        writer->fd = fd;
+      }
+    }
+    uint64_t total_dropped = write_dropped;
+    for(auto& ring : rings) {
+      ring->drain(batch);
+      total_dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    if(!batch.empty()) {
+      size_t nwrite = 0;
+      if(writer->fd != -1) {
+        nwrite = write_all(writer->fd, batch);
+      }
+      if(nwrite < batch.size()) {
+        // Count the records which were not written completely.
+        auto n = std::count(std::begin(batch) + nwrite, std::end(batch),
+                            '\n');
+        write_dropped += n;
+        total_dropped += n;
+      }
+      batch.clear();
+    }
+    if(total_dropped != dropped) {
+      LOG(WARNING) << "accesslog: " << total_dropped - dropped
+                   << " records dropped";
+      dropped = total_dropped;
+    }
+    if(stop) {
+      // The worker threads have finished, and the rings were drained
+      // for the last time.
+      return;
+    }
+  }
+}
+} // namespace
+
+int start_accesslog_writer()
+{
+  auto w = new AccessLogWriter();
+  if(parse_log_format(w->fragments, get_config()->accesslog_format) != 0) {
+    delete w;
+    return -1;
+  }
+  w->stop = false;
+  w->reopen = false;
+  w->fd = -1;
+  writer = w;
+  writer->fd = open_accesslog_file();
+  if(writer->fd == -1) {
+    return -1;
+  }
+  writer->thread = std::thread(accesslog_writer_loop);
+  return 0;
+}
+
+void stop_accesslog_writer()
+{
+  if(!writer || !writer->thread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(writer->mu);
+    writer->stop = true;
+  }
+  writer->cv.notify_one();
+  writer->thread.join();
+  if(writer->fd != -1) {
+    close(writer->fd);
+    writer->fd = -1;
+  }
+}
+
+void reopen_accesslog()
+{
+  if(writer) {
+    writer->reopen = true;
+    writer->cv.notify_one();
+  }
+}
+
+void upstream_accesslog(const std::string& client_ip,
+                        Downstream *downstream)
+{
+  if(!writer) {
+    return;
+  }
+  if(!local_ring) {
+    auto ring = std::make_shared<LogRing>(get_config()->accesslog_buffer_size);
+    local_ring = ring.get();
+    std::lock_guard<std::mutex> lock(writer->mu);
+    writer->rings.push_back(std::move(ring));
+  }
+  auto now = std::chrono::steady_clock::now();
+  LogSpec spec;
+  spec.downstream = downstream;
+  spec.remote_addr = client_ip.c_str();
+  spec.time_now = time(nullptr);
+  spec.request_time = std::chrono::duration<double>
+    (now - downstream->get_request_start_time()).count();
+  spec.upstream_response_time = downstream->get_upstream_response_time();
+
+  std::string line;
+  format_access_log(line, writer->fragments, spec);
+  if(!local_ring->push(line)) {
+    local_ring->dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
 } // namespace shrpx
@@ -28,6 +28,10 @@
 #include "shrpx.h"
 
 #include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
 
 namespace shrpx {
 
@@ -37,6 +41,79 @@ void upstream_connect(const std::string& client_ip);
 void upstream_response(const std::string& client_ip, unsigned int status_code,
                        Downstream *downstream);
 
+enum LogFragmentType {
+  LOG_LITERAL,
+  LOG_REMOTE_ADDR,
+  LOG_TIME_LOCAL,
+  LOG_TIME_ISO8601,
+  LOG_REQUEST,
+  LOG_REQUEST_METHOD,
+  LOG_REQUEST_URI,
+  LOG_SERVER_PROTOCOL,
+  LOG_STATUS,
+  LOG_BODY_BYTES_SENT,
+  LOG_REQUEST_TIME,
+  LOG_UPSTREAM_RESPONSE_TIME,
+  LOG_STREAM_ID,
+  // Request header field; the name is in value.
+  LOG_HTTP
+};
+
+struct LogFragment {
+  LogFragmentType type;
+  // Literal string for LOG_LITERAL, or header field name in
+  // lowercase for LOG_HTTP.
+  std::string value;
+};
+
+// Parses nginx style access log format |format| and stores the
+// result in |fragments|. The variables are introduced by '$', and
+// optionally enclosed by '{' and '}'. This function returns 0 if it
+// succeeds, or -1 if the format contains unknown or malformed
+// variable.
+int parse_log_format(std::vector<LogFragment>& fragments,
+                     const char *format);
+
+struct LogSpec {
+  Downstream *downstream;
+  const char *remote_addr;
+  time_t time_now;
+  // The elapsed time in seconds since the request started
+  double request_time;
+  // The elapsed time in seconds between the request is sent to
+  // backend and the response is received. Negative if backend was
+  // not involved.
+  double upstream_response_time;
+};
+
+// Appends a line for |spec| formatted by |fragments| to |out|,
+// including trailing new line.
+void format_access_log(std::string& out,
+                       const std::vector<LogFragment>& fragments,
+                       const LogSpec& spec);
+
+// Starts the thread which writes access log to
+// Config::accesslog_file. The worker threads format log records and
+// put them to their own ring buffer without locking, and this thread
+// drains them in batch. If the ring buffer is full, the record is
+// dropped and counted, as well as the records which could not be
+// written to the file. This function returns 0 if it succeeds, or
+// -1.
+int start_accesslog_writer();
+
+// Writes the records left in the ring buffers, and stops the writer
+// thread. This function must be called after the worker threads
+// stopped.
+void stop_accesslog_writer();
+
+// Lets the writer thread reopen the access log file.
+void reopen_accesslog();
+
+// Queues the access log record of completed |downstream| if
+// Config::accesslog_file is set.
+void upstream_accesslog(const std::string& client_ip,
+                        Downstream *downstream);
+
 } // namespace shrpx
 
 #endif // SHRPX_LOG_H
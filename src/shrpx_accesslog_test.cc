@@ -0,0 +1,93 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_accesslog_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_accesslog.h"
+#include "shrpx_downstream.h"
+
+namespace shrpx {
+
+void test_shrpx_accesslog_parse_log_format(void)
+{
+  std::vector<LogFragment> frags;
+
+  CU_ASSERT(0 == parse_log_format(frags, "$remote_addr [${status}]"
+                                  "$http_user_agent$http_X_Foo-"));
+  CU_ASSERT(6 == frags.size());
+  CU_ASSERT(LOG_REMOTE_ADDR == frags[0].type);
+  CU_ASSERT(LOG_LITERAL == frags[1].type);
+  CU_ASSERT(" [" == frags[1].value);
+  CU_ASSERT(LOG_STATUS == frags[2].type);
+  CU_ASSERT(LOG_LITERAL == frags[3].type);
+  CU_ASSERT("]" == frags[3].value);
+  CU_ASSERT(LOG_HTTP == frags[4].type);
+  CU_ASSERT("user-agent" == frags[4].value);
+  CU_ASSERT(LOG_HTTP == frags[5].type);
+  CU_ASSERT("x-foo-" == frags[5].value);
+
+  CU_ASSERT(0 == parse_log_format(frags, "plain"));
+  CU_ASSERT(1 == frags.size());
+  CU_ASSERT("plain" == frags[0].value);
+
+  CU_ASSERT(-1 == parse_log_format(frags, "$unknown"));
+  CU_ASSERT(-1 == parse_log_format(frags, "$"));
+  CU_ASSERT(-1 == parse_log_format(frags, "${status"));
+  CU_ASSERT(-1 == parse_log_format(frags, "$http_"));
+}
+
+void test_shrpx_accesslog_format_access_log(void)
+{
+  std::vector<LogFragment> frags;
+  CU_ASSERT(0 == parse_log_format
+            (frags, "$remote_addr \"$request\" $status $body_bytes_sent "
+             "\"$http_user_agent\" \"$http_referer\" $request_time "
+             "$upstream_response_time $stream_id"));
+
+  Downstream downstream(nullptr, 3, 0);
+  downstream.set_request_method("GET");
+  downstream.set_request_path("/a\"b");
+  downstream.set_request_major(1);
+  downstream.set_request_minor(1);
+  downstream.add_request_header("User-Agent", "ua\n1");
+  downstream.set_response_http_status(200);
+  downstream.add_response_sent_bodylen(100);
+  downstream.add_response_sent_bodylen(23);
+
+  LogSpec spec;
+  spec.downstream = &downstream;
+  spec.remote_addr = "192.0.2.1";
+  spec.time_now = 0;
+  spec.request_time = 1.5;
+  spec.upstream_response_time = -1;
+
+  std::string out;
+  format_access_log(out, frags, spec);
+  CU_ASSERT("192.0.2.1 \"GET /a\\x22b HTTP/1.1\" 200 123 \"ua\\x0A1\" "
+            "\"-\" 1.500 - 3\n" == out);
+}
+
+} // namespace shrpx
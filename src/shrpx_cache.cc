@@ -0,0 +1,794 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_cache.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+
+#include "shrpx_downstream.h"
+#include "shrpx_coalesced_downstream_connection.h"
+#include "shrpx_upstream.h"
+#include "shrpx_log.h"
+#include "util.h"
+
+namespace shrpx {
+
+namespace {
+// Returns the substring of |s| in [first, last) without leading and
+// trailing white spaces.
+std::string trim(const std::string& s, size_t first, size_t last)
+{
+  while(first < last && (s[first] == ' ' || s[first] == '\t')) {
+    ++first;
+  }
+  while(first < last && (s[last-1] == ' ' || s[last-1] == '\t')) {
+    --last;
+  }
+  return s.substr(first, last - first);
+}
+} // namespace
+
+namespace {
+// Splits comma delimited list |s| and returns the elements without
+// white spaces around them. Empty elements are skipped.
+std::vector<std::string> split_list(const std::string& s)
+{
+  std::vector<std::string> res;
+  for(size_t first = 0; first < s.size();) {
+    auto last = s.find(',', first);
+    if(last == std::string::npos) {
+      last = s.size();
+    }
+    auto elem = trim(s, first, last);
+    if(!elem.empty()) {
+      res.push_back(std::move(elem));
+    }
+    first = last + 1;
+  }
+  return res;
+}
+} // namespace
+
+namespace {
+// Returns the values of header fields named |name| in |headers|,
+// joined by ", ". The name comparison is case-insensitive and
+// |headers| need not be sorted.
+std::string join_header_values(const Headers& headers, const char *name)
+{
+  std::string res;
+  for(auto& kv : headers) {
+    if(!util::strieq(kv.first.c_str(), name)) {
+      continue;
+    }
+    if(!res.empty()) {
+      res += ", ";
+    }
+    res += kv.second;
+  }
+  return res;
+}
+} // namespace
+
+namespace {
+int64_t parse_delta_seconds(const std::string& s)
+{
+  auto first = s.c_str();
+  if(*first == '"') {
+    ++first;
+  }
+  if(!util::isDigit(*first)) {
+    return -1;
+  }
+  return strtoll(first, nullptr, 10);
+}
+} // namespace
+
+CacheControl parse_cache_control(const std::string& value)
+{
+  CacheControl cc = {-1, -1, false, false, false, false};
+  for(auto& directive : split_list(value)) {
+    auto eq = directive.find('=');
+    auto name = directive.substr(0, eq);
+    auto arg = eq == std::string::npos ? "" : trim(directive, eq + 1,
+                                                    directive.size());
+    if(util::strieq(name.c_str(), "max-age")) {
+      cc.max_age = parse_delta_seconds(arg);
+    } else if(util::strieq(name.c_str(), "s-maxage")) {
+      cc.s_maxage = parse_delta_seconds(arg);
+    } else if(util::strieq(name.c_str(), "no-store")) {
+      cc.no_store = true;
+    } else if(util::strieq(name.c_str(), "no-cache")) {
+      cc.no_cache = true;
+    } else if(util::strieq(name.c_str(), "private")) {
+      cc.priv = true;
+    } else if(util::strieq(name.c_str(), "public")) {
+      cc.pub = true;
+    }
+  }
+  return cc;
+}
+
+size_t CacheEntry::size() const
+{
+  size_t res = sizeof(*this) + key.size() + body.size() + etag.size();
+  for(auto& kv : response_headers) {
+    res += kv.first.size() + kv.second.size();
+  }
+  for(auto& kv : vary) {
+    res += kv.first.size() + kv.second.size();
+  }
+  return res;
+}
+
+namespace {
+const size_t SKETCH_DEPTH = 4;
+// The maximum value of a counter in the sketch
+const uint8_t SKETCH_COUNTER_MAX = 15;
+} // namespace
+
+namespace {
+size_t compute_sketch_width(size_t max_size)
+{
+  // Assume that average entry is 4KiB and prepare counters for each
+  // of them.
+  size_t n = std::min(std::max(max_size / 4096, static_cast<size_t>(1024)),
+                      static_cast<size_t>(1 << 20));
+  size_t width = 1;
+  while(width < n) {
+    width <<= 1;
+  }
+  return width;
+}
+} // namespace
+
+ResponseCache::ResponseCache(size_t max_size, size_t max_object_size)
+  : sketch_width_(compute_sketch_width(max_size)),
+    sketch_samples_(0),
+    max_size_(max_size),
+    max_object_size_(max_object_size),
+    size_(0)
+{
+  sketch_.resize(sketch_width_ * SKETCH_DEPTH);
+}
+
+ResponseCache::~ResponseCache()
+{}
+
+namespace {
+// Returns the index of counter in |row|-th row of the sketch for
+// hash value |h|.
+size_t sketch_index(uint64_t h, size_t row, size_t width)
+{
+  auto h2 = ((h * 0x9e3779b97f4a7c15ULL) >> 32) | 1;
+  return row * width + ((h + row * h2) & (width - 1));
+}
+} // namespace
+
+void ResponseCache::record_access(const std::string& key)
+{
+  uint64_t h = std::hash<std::string>()(key);
+  for(size_t i = 0; i < SKETCH_DEPTH; ++i) {
+    auto& c = sketch_[sketch_index(h, i, sketch_width_)];
+    if(c < SKETCH_COUNTER_MAX) {
+      ++c;
+    }
+  }
+  // Age the counters periodically so that the sketch follows the
+  // recent popularity.
+  if(++sketch_samples_ >= sketch_width_ * 10) {
+    for(auto& c : sketch_) {
+      c >>= 1;
+    }
+    sketch_samples_ /= 2;
+  }
+}
+
+uint32_t ResponseCache::estimate_frequency(const std::string& key) const
+{
+  uint64_t h = std::hash<std::string>()(key);
+  uint32_t res = SKETCH_COUNTER_MAX;
+  for(size_t i = 0; i < SKETCH_DEPTH; ++i) {
+    res = std::min(res, static_cast<uint32_t>
+                   (sketch_[sketch_index(h, i, sketch_width_)]));
+  }
+  return res;
+}
+
+namespace {
+bool vary_match(const CacheEntry *entry, const Headers& request_headers)
+{
+  for(auto& kv : entry->vary) {
+    if(join_header_values(request_headers, kv.first.c_str()) != kv.second) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+std::shared_ptr<CacheEntry> ResponseCache::lookup(Downstream *downstream,
+                                                  const std::string& scheme,
+                                                  time_t now)
+{
+  if(downstream->get_request_method() != "GET" ||
+     downstream->get_upgrade_request()) {
+    return nullptr;
+  }
+  auto& headers = downstream->get_request_headers();
+  if(http2::get_header(headers, "authorization") ||
+     http2::get_header(headers, "transfer-encoding")) {
+    return nullptr;
+  }
+  auto content_length = http2::get_header(headers, "content-length");
+  if(content_length &&
+     strtoll(content_length->second.c_str(), nullptr, 10) != 0) {
+    return nullptr;
+  }
+  auto cc = parse_cache_control(join_header_values(headers,
+                                                   "cache-control"));
+  if(cc.no_store) {
+    return nullptr;
+  }
+  auto key = create_cache_key(downstream, scheme);
+  if(key.empty()) {
+    return nullptr;
+  }
+  record_access(key);
+  downstream->set_cache_key(key);
+
+  // The client asks for the end-to-end reload. Send the request to
+  // backend, but the response may still be stored.
+  if(cc.no_cache || cc.max_age == 0 ||
+     util::strifind(join_header_values(headers, "pragma").c_str(),
+                    "no-cache")) {
+    return nullptr;
+  }
+
+  auto i = index_.find(key);
+  if(i == std::end(index_)) {
+    return nullptr;
+  }
+  for(auto j : (*i).second) {
+    auto entry = *j;
+    if(!vary_match(entry.get(), headers)) {
+      continue;
+    }
+    if(entry->expires <= now) {
+      // Stale entry is not revalidated; just drop it and let the
+      // request go to backend.
+      remove(j);
+      return nullptr;
+    }
+    lru_.splice(std::begin(lru_), lru_, j);
+    return entry;
+  }
+  return nullptr;
+}
+
+namespace {
+bool cacheable_status(unsigned int status)
+{
+  switch(status) {
+  case 200:
+  case 203:
+  case 204:
+  case 300:
+  case 301:
+  case 404:
+  case 405:
+  case 410:
+  case 414:
+  case 501:
+    return true;
+  default:
+    return false;
+  }
+}
+} // namespace
+
+namespace {
+// Returns true if response header field |name| is stored in the
+// cache entry.
+bool storable_header(const std::string& name)
+{
+  return !name.empty() && name[0] != ':' &&
+    name != "age" &&
+    name != "connection" &&
+    name != "content-length" &&
+    name != "keep-alive" &&
+    name != "proxy-connection" &&
+    name != "te" &&
+    name != "trailer" &&
+    name != "transfer-encoding" &&
+    name != "upgrade";
+}
+} // namespace
+
+namespace {
+// Returns true if the request in |downstream| can share the response
+// with the identical request. The conditional and range requests are
+// not coalesced because their responses depend on the request.
+bool coalescable_request(const Downstream *downstream)
+{
+  auto& headers = downstream->get_request_headers();
+  return !http2::get_header(headers, "if-match") &&
+    !http2::get_header(headers, "if-none-match") &&
+    !http2::get_header(headers, "if-modified-since") &&
+    !http2::get_header(headers, "if-unmodified-since") &&
+    !http2::get_header(headers, "if-range") &&
+    !http2::get_header(headers, "range");
+}
+} // namespace
+
+DownstreamConnection* ResponseCache::get_coalesced_connection
+(ClientHandler *handler, Downstream *downstream)
+{
+  auto& key = downstream->get_cache_key();
+  if(key.empty() || !coalescable_request(downstream)) {
+    return nullptr;
+  }
+  auto i = inflight_.find(key);
+  if(i == std::end(inflight_)) {
+    inflight_[key] = downstream;
+    downstream->set_inflight_cache(this);
+    return nullptr;
+  }
+  auto leader = (*i).second;
+  // The response headers which backend adds depend on the request
+  // HTTP version (e.g., transfer-encoding), so only share the
+  // response among the same version.
+  if(leader->get_request_major() != downstream->get_request_major() ||
+     leader->get_request_minor() != downstream->get_request_minor()) {
+    return nullptr;
+  }
+  if(LOG_ENABLED(INFO)) {
+    DLOG(INFO, downstream) << "Coalesced to in-flight DOWNSTREAM:" << leader
+                           << ", " << key;
+  }
+  // The leader stores the response.
+  downstream->set_cache_key("");
+  return new CoalescedDownstreamConnection(handler, leader);
+}
+
+void ResponseCache::remove_inflight(Downstream *downstream)
+{
+  if(downstream->get_inflight_cache() != this) {
+    return;
+  }
+  auto i = inflight_.find(downstream->get_cache_key());
+  if(i != std::end(inflight_) && (*i).second == downstream) {
+    inflight_.erase(i);
+  }
+  downstream->set_inflight_cache(nullptr);
+}
+
+void ResponseCache::fan_out_header(Downstream *downstream)
+{
+  // The followers may be removed from the list while we are
+  // iterating.
+  auto followers = downstream->get_followers();
+  auto& headers = downstream->get_response_headers();
+  auto cc = parse_cache_control(join_header_values(headers,
+                                                   "cache-control"));
+  auto vary = split_list(join_header_values(headers, "vary"));
+  bool shareable = !cc.no_store && !cc.no_cache && !cc.priv &&
+    !http2::get_header(headers, "set-cookie") &&
+    std::find(std::begin(vary), std::end(vary), "*") == std::end(vary);
+  // Without framing, the end of body is signaled by closing
+  // connection.
+  bool close = !http2::get_header(headers, "content-length") &&
+    !downstream->get_chunked_response();
+  for(auto dconn : followers) {
+    auto follower = dconn->get_downstream();
+    bool match = shareable;
+    for(auto& name : vary) {
+      if(!match) {
+        break;
+      }
+      match = join_header_values(downstream->get_request_headers(),
+                                 name.c_str()) ==
+        join_header_values(follower->get_request_headers(), name.c_str());
+    }
+    if(!match) {
+      // Let the follower send its own request.
+      dconn->release();
+      continue;
+    }
+    follower->set_response_http_status
+      (downstream->get_response_http_status());
+    follower->set_response_major(downstream->get_response_major());
+    follower->set_response_minor(downstream->get_response_minor());
+    for(auto& kv : headers) {
+      follower->add_response_header(kv.first, kv.second);
+    }
+    if(close) {
+      follower->set_response_connection_close(true);
+    }
+    follower->set_response_state(Downstream::HEADER_COMPLETE);
+    if(follower->get_upstream()->on_downstream_header_complete(follower)
+       != 0) {
+      follower->set_response_state(Downstream::MSG_RESET);
+      dconn->release();
+      continue;
+    }
+    dconn->notify();
+  }
+}
+
+void ResponseCache::on_response_header(Downstream *downstream, time_t now)
+{
+  // Once response headers are received, the new identical request
+  // cannot share the response.
+  remove_inflight(downstream);
+  if(!downstream->get_followers().empty()) {
+    fan_out_header(downstream);
+  }
+  if(downstream->get_cache_key().empty() ||
+     !cacheable_status(downstream->get_response_http_status())) {
+    return;
+  }
+  auto& headers = downstream->get_response_headers();
+  if(http2::get_header(headers, "set-cookie")) {
+    return;
+  }
+  auto cc = parse_cache_control(join_header_values(headers,
+                                                   "cache-control"));
+  if(cc.no_store || cc.no_cache || cc.priv) {
+    return;
+  }
+  auto content_length = http2::get_header(headers, "content-length");
+  if(content_length &&
+     static_cast<size_t>(strtoll(content_length->second.c_str(),
+                                 nullptr, 10)) > max_object_size_) {
+    return;
+  }
+
+  time_t date = 0;
+  auto date_hd = http2::get_header(headers, "date");
+  if(date_hd) {
+    date = util::parse_http_date(date_hd->second);
+  }
+  if(date == 0 || date > now) {
+    date = now;
+  }
+
+  int64_t lifetime;
+  if(cc.s_maxage >= 0) {
+    lifetime = cc.s_maxage;
+  } else if(cc.max_age >= 0) {
+    lifetime = cc.max_age;
+  } else {
+    auto expires = http2::get_header(headers, "expires");
+    if(!expires) {
+      // We only cache the response with explicit freshness.
+      return;
+    }
+    lifetime = util::parse_http_date(expires->second) - date;
+  }
+
+  int64_t initial_age = now - date;
+  auto age = http2::get_header(headers, "age");
+  if(age) {
+    initial_age = std::max(initial_age,
+                           static_cast<int64_t>(parse_delta_seconds
+                                                (age->second)));
+  }
+  if(lifetime <= initial_age) {
+    return;
+  }
+
+  auto entry = util::make_unique<CacheEntry>();
+
+  for(auto& name : split_list(join_header_values(headers, "vary"))) {
+    if(name == "*") {
+      return;
+    }
+    util::inp_strlower(name);
+    entry->vary.emplace_back
+      (name, join_header_values(downstream->get_request_headers(),
+                                name.c_str()));
+  }
+
+  for(auto& kv : headers) {
+    if(storable_header(kv.first)) {
+      entry->response_headers.push_back(kv);
+    }
+  }
+  entry->key = downstream->get_cache_key();
+  entry->etag = http2::value_to_str(http2::get_header(headers, "etag"));
+  entry->date = now - initial_age;
+  entry->expires = entry->date + lifetime;
+  entry->last_modified = 0;
+  auto last_modified = http2::get_header(headers, "last-modified");
+  if(last_modified) {
+    entry->last_modified = util::parse_http_date(last_modified->second);
+  }
+  entry->status = downstream->get_response_http_status();
+
+  downstream->set_cache_entry(std::move(entry));
+}
+
+void ResponseCache::on_response_body(Downstream *downstream,
+                                     const uint8_t *data, size_t len)
+{
+  auto followers = downstream->get_followers();
+  for(auto dconn : followers) {
+    auto follower = dconn->get_downstream();
+    if(follower->get_upstream()->on_downstream_body(follower, data, len)
+       != 0) {
+      follower->set_response_state(Downstream::MSG_RESET);
+      dconn->release();
+      continue;
+    }
+    dconn->notify();
+  }
+  auto entry = downstream->get_cache_entry();
+  if(!entry) {
+    return;
+  }
+  if(entry->body.size() + len > max_object_size_) {
+    downstream->set_cache_entry(nullptr);
+    return;
+  }
+  entry->body.append(reinterpret_cast<const char*>(data), len);
+}
+
+void ResponseCache::on_response_complete(Downstream *downstream)
+{
+  auto followers = downstream->get_followers();
+  for(auto dconn : followers) {
+    auto follower = dconn->get_downstream();
+    follower->set_response_state(Downstream::MSG_COMPLETE);
+    if(follower->get_upstream()->on_downstream_body_complete(follower) != 0) {
+      follower->set_response_state(Downstream::MSG_RESET);
+    }
+    // The follower is done with the leader.
+    dconn->release();
+  }
+  auto entry = downstream->pop_cache_entry();
+  if(!entry) {
+    return;
+  }
+  auto content_length = http2::get_header(downstream->get_response_headers(),
+                                          "content-length");
+  if(content_length &&
+     static_cast<size_t>(strtoll(content_length->second.c_str(),
+                                 nullptr, 10)) != entry->body.size()) {
+    return;
+  }
+  auto& hds = entry->response_headers;
+  auto nv = Headers::value_type("content-length",
+                                util::utos(entry->body.size()));
+  hds.insert(std::lower_bound(std::begin(hds), std::end(hds), nv,
+                              http2::name_less),
+             std::move(nv));
+  store(std::shared_ptr<CacheEntry>(std::move(entry)));
+}
+
+bool ResponseCache::store(std::shared_ptr<CacheEntry> entry)
+{
+  auto entry_size = entry->size();
+  if(entry_size > max_size_) {
+    return false;
+  }
+  // The old variant is replaced only if the new entry is admitted.
+  auto old = std::end(lru_);
+  size_t old_size = 0;
+  auto i = index_.find(entry->key);
+  if(i != std::end(index_)) {
+    for(auto j : (*i).second) {
+      if((*j)->vary == entry->vary) {
+        old = j;
+        old_size = (*j)->size();
+        break;
+      }
+    }
+  }
+  // Choose the victims from the LRU tail first, so that nothing is
+  // removed if the admission is rejected.
+  auto freq = estimate_frequency(entry->key);
+  std::vector<EntryList::iterator> victims;
+  auto size = size_ - old_size;
+  for(auto victim = std::end(lru_); size + entry_size > max_size_;) {
+    --victim;
+    if(victim == old) {
+      continue;
+    }
+    if(estimate_frequency((*victim)->key) > freq) {
+      if(LOG_ENABLED(INFO)) {
+        LOG(INFO) << "Cache admission rejected " << entry->key;
+      }
+      return false;
+    }
+    victims.push_back(victim);
+    size -= (*victim)->size();
+  }
+  if(old != std::end(lru_)) {
+    remove(old);
+  }
+  for(auto victim : victims) {
+    remove(victim);
+  }
+  size_ += entry_size;
+  lru_.push_front(entry);
+  index_[entry->key].push_back(std::begin(lru_));
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Cache stored " << entry->key << ", size=" << entry_size
+              << ", total=" << size_;
+  }
+  return true;
+}
+
+void ResponseCache::remove(EntryList::iterator i)
+{
+  auto& key = (*i)->key;
+  auto j = index_.find(key);
+  if(j != std::end(index_)) {
+    auto& variants = (*j).second;
+    variants.erase(std::find(std::begin(variants), std::end(variants), i));
+    if(variants.empty()) {
+      index_.erase(j);
+    }
+  }
+  size_ -= (*i)->size();
+  lru_.erase(i);
+}
+
+size_t ResponseCache::get_size() const
+{
+  return size_;
+}
+
+size_t ResponseCache::get_num_entries() const
+{
+  return lru_.size();
+}
+
+std::string create_cache_key(const Downstream *downstream,
+                             const std::string& scheme)
+{
+  auto& path = downstream->get_request_path();
+  if(path.empty()) {
+    return "";
+  }
+  if(path[0] != '/') {
+    // absolute-form used in forward proxy
+    if(path.find("://") == std::string::npos) {
+      return "";
+    }
+    return path;
+  }
+  auto authority = downstream->get_request_http2_authority();
+  if(authority.empty()) {
+    authority = http2::value_to_str
+      (downstream->get_request_header(http2::HD_HOST));
+  }
+  util::inp_strlower(authority);
+  std::string key = scheme;
+  key += "://";
+  key += authority;
+  key += path;
+  return key;
+}
+
+namespace {
+// Removes weak indicator from entity-tag |etag|.
+std::string strip_weak(const std::string& etag)
+{
+  if(util::startsWith(etag, "W/")) {
+    return etag.substr(2);
+  }
+  return etag;
+}
+} // namespace
+
+namespace {
+bool etag_match(const std::string& if_none_match, const std::string& etag)
+{
+  auto tag = strip_weak(etag);
+  for(auto& t : split_list(if_none_match)) {
+    if(t == "*" || strip_weak(t) == tag) {
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
+namespace {
+// Returns true if response header field |name| is sent in 304
+// response.
+bool not_modified_header(const std::string& name)
+{
+  return
+    name == "cache-control" ||
+    name == "content-location" ||
+    name == "date" ||
+    name == "etag" ||
+    name == "expires" ||
+    name == "last-modified" ||
+    name == "vary";
+}
+} // namespace
+
+bool prepare_cached_response(Downstream *downstream, const CacheEntry *entry,
+                             time_t now)
+{
+  auto& headers = downstream->get_request_headers();
+  bool not_modified = false;
+  auto if_none_match = http2::get_header(headers, "if-none-match");
+  if(if_none_match) {
+    not_modified = !entry->etag.empty() &&
+      etag_match(if_none_match->second, entry->etag);
+  } else {
+    auto if_modified_since = http2::get_header(headers, "if-modified-since");
+    if(if_modified_since && entry->last_modified != 0) {
+      auto t = util::parse_http_date(if_modified_since->second);
+      not_modified = t != 0 && entry->last_modified <= t;
+    }
+  }
+  // The response is served from the cache; don't store it again.
+  downstream->set_cache_key("");
+  downstream->set_response_major(1);
+  downstream->set_response_minor(1);
+  for(auto& kv : entry->response_headers) {
+    if(!not_modified || not_modified_header(kv.first)) {
+      downstream->add_response_header(kv.first, kv.second);
+    }
+  }
+  downstream->add_response_header
+    ("age", util::utos(std::max(static_cast<int64_t>(0),
+                                static_cast<int64_t>(now - entry->date))));
+  if(not_modified) {
+    downstream->set_response_http_status(304);
+    return false;
+  }
+  downstream->set_response_http_status(entry->status);
+  return true;
+}
+
+namespace {
+void release_cache_entry(const void *data, size_t datalen, void *extra)
+{
+  delete static_cast<std::shared_ptr<CacheEntry>*>(extra);
+}
+} // namespace
+
+int add_cached_body(evbuffer *buf, const std::shared_ptr<CacheEntry>& entry)
+{
+  if(entry->body.empty()) {
+    return 0;
+  }
+  auto ref = new std::shared_ptr<CacheEntry>(entry);
+  if(evbuffer_add_reference(buf, entry->body.data(), entry->body.size(),
+                            release_cache_entry, ref) != 0) {
+    delete ref;
+    return -1;
+  }
+  return 0;
+}
+
+} // namespace shrpx
@@ -0,0 +1,175 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_CACHE_H
+#define SHRPX_CACHE_H
+
+#include "shrpx.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <list>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include <event2/buffer.h>
+
+#include "http2.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+class Downstream;
+class DownstreamConnection;
+class ClientHandler;
+
+// Parsed Cache-Control header field. The delta-seconds values are -1
+// if the directive is not present.
+struct CacheControl {
+  int64_t max_age;
+  int64_t s_maxage;
+  bool no_store;
+  bool no_cache;
+  bool priv;
+  bool pub;
+};
+
+// Parses Cache-Control header field value |value|. The multiple
+// header fields are expected to be joined by ',' beforehand.
+CacheControl parse_cache_control(const std::string& value);
+
+struct CacheEntry {
+  // The primary key, see create_cache_key().
+  std::string key;
+  // The response header fields without hop-by-hop header fields and
+  // age. content-length is set to the size of body. Sorted by name.
+  Headers response_headers;
+  // The pairs of request header field name listed in Vary and its
+  // value in the request which produced this response.
+  Headers vary;
+  std::string body;
+  std::string etag;
+  // The time when the response was generated by the origin server;
+  // the time when we received it minus the age it already had.
+  time_t date;
+  // The time when the response becomes stale.
+  time_t expires;
+  time_t last_modified;
+  unsigned int status;
+  // Returns the approximate amount of memory this entry consumes.
+  size_t size() const;
+};
+
+// Per worker in-memory HTTP response cache. The entries are evicted
+// in LRU order when the total size of entries exceeds the budget.
+// The new entry is only admitted over the LRU victim if it is more
+// frequently requested, which is estimated by a small count-min
+// sketch (TinyLFU). This object is not thread-safe; each worker
+// thread has its own instance.
+class ResponseCache {
+public:
+  ResponseCache(size_t max_size, size_t max_object_size);
+  ~ResponseCache();
+  // Looks up the fresh response for the request in |downstream|.
+  // |scheme| is the scheme of the request URI. This function must
+  // be called after request headers are normalized. If the request
+  // is cacheable, the cache key is set to |downstream| so that the
+  // response is stored later. Returns the entry if a fresh response
+  // is found, or nullptr.
+  std::shared_ptr<CacheEntry> lookup(Downstream *downstream,
+                                     const std::string& scheme,
+                                     time_t now);
+  // Call this function when response headers are received from
+  // backend. This function must be called after response headers
+  // are normalized. If the response is storable, a pending entry is
+  // attached to |downstream|.
+  void on_response_header(Downstream *downstream, time_t now);
+  // Appends response body to the pending entry of |downstream|.
+  void on_response_body(Downstream *downstream,
+                        const uint8_t *data, size_t len);
+  // Stores the pending entry of |downstream| if any.
+  void on_response_complete(Downstream *downstream);
+  // If there is in-flight request identical to |downstream|, returns
+  // DownstreamConnection which shares the response of that request.
+  // Otherwise, |downstream| is registered as in-flight request if it
+  // can be shared, and returns nullptr. This function must be called
+  // after lookup().
+  DownstreamConnection* get_coalesced_connection(ClientHandler *handler,
+                                                 Downstream *downstream);
+  // Removes |downstream| from in-flight requests.
+  void remove_inflight(Downstream *downstream);
+  // Inserts |entry| into the cache, possibly evicting other entries.
+  // Returns true if |entry| is stored.
+  bool store(std::shared_ptr<CacheEntry> entry);
+  // Total size of stored entries.
+  size_t get_size() const;
+  size_t get_num_entries() const;
+private:
+  typedef std::list<std::shared_ptr<CacheEntry>> EntryList;
+  void remove(EntryList::iterator i);
+  // Records the access to |key| in frequency sketch.
+  void record_access(const std::string& key);
+  // Returns the estimated access frequency of |key|.
+  uint32_t estimate_frequency(const std::string& key) const;
+  // Copies response headers of |downstream| to its followers.
+  void fan_out_header(Downstream *downstream);
+  // primary key -> in-flight request
+  std::unordered_map<std::string, Downstream*> inflight_;
+  // MRU entry comes first.
+  EntryList lru_;
+  // primary key -> stored variants of the key
+  std::unordered_map<std::string, std::vector<EntryList::iterator>> index_;
+  // count-min sketch counters; 4 rows of sketch_width_ counters
+  std::vector<uint8_t> sketch_;
+  size_t sketch_width_;
+  size_t sketch_samples_;
+  size_t max_size_;
+  size_t max_object_size_;
+  size_t size_;
+};
+
+// Creates primary cache key from |scheme|, authority (or host) and
+// request path in |downstream|.
+std::string create_cache_key(const Downstream *downstream,
+                             const std::string& scheme);
+
+// Fills response status and headers of |downstream| using |entry|.
+// If the request carries a validator matching |entry|, 304 response
+// is prepared instead. Returns true if the response has body, which
+// should be sent using add_cached_body().
+bool prepare_cached_response(Downstream *downstream, const CacheEntry *entry,
+                             time_t now);
+
+// Adds body of |entry| to |buf| without copying. The reference to
+// |entry| is held until |buf| releases the data. Returns 0 if it
+// succeeds, or -1.
+int add_cached_body(evbuffer *buf, const std::shared_ptr<CacheEntry>& entry);
+
+} // namespace shrpx
+
+#endif // SHRPX_CACHE_H
@@ -0,0 +1,575 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_cache_test.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <CUnit/CUnit.h>
+
+#include <event2/bufferevent.h>
+
+#include "shrpx_cache.h"
+#include "shrpx_config.h"
+#include "shrpx_client_handler.h"
+#include "shrpx_coalesced_downstream_connection.h"
+#include "shrpx_downstream.h"
+#include "shrpx_timeout.h"
+#include "shrpx_upstream.h"
+#include "util.h"
+
+namespace shrpx {
+
+void test_shrpx_cache_parse_cache_control(void)
+{
+  auto cc = parse_cache_control("public, max-age=60, s-maxage=\"120\"");
+  CU_ASSERT(cc.pub);
+  CU_ASSERT(!cc.priv);
+  CU_ASSERT(60 == cc.max_age);
+  CU_ASSERT(120 == cc.s_maxage);
+  CU_ASSERT(!cc.no_store);
+
+  cc = parse_cache_control("No-Store,private ,no-cache=\"set-cookie\"");
+  CU_ASSERT(cc.no_store);
+  CU_ASSERT(cc.priv);
+  CU_ASSERT(cc.no_cache);
+  CU_ASSERT(-1 == cc.max_age);
+  CU_ASSERT(-1 == cc.s_maxage);
+
+  cc = parse_cache_control("max-age=foo");
+  CU_ASSERT(-1 == cc.max_age);
+}
+
+namespace {
+void prepare_request(Downstream *downstream, const std::string& path)
+{
+  downstream->set_request_method("GET");
+  downstream->set_request_http2_authority("example.org");
+  downstream->set_request_path(path);
+  downstream->normalize_request_headers();
+}
+} // namespace
+
+namespace {
+// Passes response for |downstream| to |cache| as if it was received
+// from backend.
+void receive_response(ResponseCache *cache, Downstream *downstream,
+                      const char *cache_control, const std::string& body,
+                      time_t now)
+{
+  downstream->set_response_http_status(200);
+  downstream->add_response_header("Cache-Control", cache_control);
+  downstream->add_response_header("Content-Length", util::utos(body.size()));
+  downstream->add_response_header("Connection", "keep-alive");
+  downstream->add_response_header("ETag", "\"alpha\"");
+  downstream->normalize_response_headers();
+  cache->on_response_header(downstream, now);
+  cache->on_response_body(downstream,
+                          reinterpret_cast<const uint8_t*>(body.c_str()),
+                          body.size());
+  cache->on_response_complete(downstream);
+}
+} // namespace
+
+namespace {
+// Records the response passed from ResponseCache to the followers.
+class RecordingUpstream : public Upstream {
+public:
+  RecordingUpstream(ClientHandler *handler)
+    : handler_(handler),
+      header_complete(0),
+      body_complete(0),
+      readcb_called(0)
+  {}
+  virtual int on_read() { return 0; }
+  virtual int on_write() { return 0; }
+  virtual int on_event() { return 0; }
+  virtual int on_graceful_shutdown() { return 0; }
+  virtual bufferevent_data_cb get_downstream_readcb() { return readcb; }
+  virtual bufferevent_data_cb get_downstream_writecb() { return nullptr; }
+  virtual bufferevent_event_cb get_downstream_eventcb() { return nullptr; }
+  virtual ClientHandler* get_client_handler() const { return handler_; }
+  virtual int on_downstream_header_complete(Downstream *downstream)
+  {
+    ++header_complete;
+    return 0;
+  }
+  virtual int on_downstream_body(Downstream *downstream,
+                                 const uint8_t *data, size_t len)
+  {
+    body.append(reinterpret_cast<const char*>(data), len);
+    return 0;
+  }
+  virtual int on_downstream_body_complete(Downstream *downstream)
+  {
+    ++body_complete;
+    return 0;
+  }
+  virtual void pause_read(IOCtrlReason reason) {}
+  virtual int resume_read(IOCtrlReason reason, Downstream *downstream)
+  {
+    return 0;
+  }
+  static void readcb(bufferevent *bev, void *ptr)
+  {
+    auto dconn = static_cast<DownstreamConnection*>(ptr);
+    auto upstream = static_cast<RecordingUpstream*>
+      (dconn->get_downstream()->get_upstream());
+    ++upstream->readcb_called;
+  }
+  ClientHandler *handler_;
+  std::string body;
+  int header_complete;
+  int body_complete;
+  int readcb_called;
+};
+} // namespace
+
+namespace {
+// DownstreamConnection which only records the request sent through
+// it.
+class RecordingDownstreamConnection : public DownstreamConnection {
+public:
+  RecordingDownstreamConnection(ClientHandler *handler)
+    : DownstreamConnection(handler),
+      push_request_headers_called(0),
+      rdbits(0)
+  {}
+  virtual int attach_downstream(Downstream *downstream)
+  {
+    downstream->set_downstream_connection(this);
+    downstream_ = downstream;
+    return 0;
+  }
+  virtual void detach_downstream(Downstream *downstream)
+  {
+    downstream->set_downstream_connection(nullptr);
+    downstream_ = nullptr;
+  }
+  virtual int push_request_headers()
+  {
+    ++push_request_headers_called;
+    return 0;
+  }
+  virtual int push_upload_data_chunk(const uint8_t *data, size_t datalen)
+  {
+    return 0;
+  }
+  virtual int end_upload_data() { return 0; }
+  virtual void pause_read(IOCtrlReason reason) { rdbits |= reason; }
+  virtual int resume_read(IOCtrlReason reason)
+  {
+    rdbits &= ~reason;
+    return 0;
+  }
+  virtual void force_resume_read() { rdbits = 0; }
+  virtual bool get_output_buffer_full() { return false; }
+  virtual int on_read() { return 0; }
+  virtual int on_write() { return 0; }
+  virtual void on_upstream_change(Upstream *upstream) {}
+  virtual int on_priority_change(int32_t pri) { return 0; }
+  int push_request_headers_called;
+  // Reasons why reading is paused
+  uint32_t rdbits;
+};
+} // namespace
+
+namespace {
+// Coalesces the request for |path| in |downstream| to the in-flight
+// leader. Returns the attached connection, or nullptr.
+CoalescedDownstreamConnection* coalesce(ResponseCache *cache,
+                                        ClientHandler *handler,
+                                        Downstream *downstream,
+                                        const std::string& path,
+                                        time_t now)
+{
+  prepare_request(downstream, path);
+  cache->lookup(downstream, "https", now);
+  auto dconn = cache->get_coalesced_connection(handler, downstream);
+  if(!dconn || dconn->attach_downstream(downstream) != 0) {
+    delete dconn;
+    return nullptr;
+  }
+  return static_cast<CoalescedDownstreamConnection*>(dconn);
+}
+} // namespace
+
+void test_shrpx_cache_store_and_lookup(void)
+{
+  ResponseCache cache(1024*1024, 1024);
+  time_t now = 1000000;
+  {
+    Downstream d(nullptr, 0, 0);
+    prepare_request(&d, "/alpha");
+    CU_ASSERT(!cache.lookup(&d, "https", now));
+    CU_ASSERT("https://example.org/alpha" == d.get_cache_key());
+    receive_response(&cache, &d, "max-age=60", "hello", now);
+  }
+  CU_ASSERT(1 == cache.get_num_entries());
+  {
+    // private response is not stored.
+    Downstream d(nullptr, 0, 0);
+    prepare_request(&d, "/bravo");
+    cache.lookup(&d, "https", now);
+    receive_response(&cache, &d, "private, max-age=60", "hello", now);
+  }
+  CU_ASSERT(1 == cache.get_num_entries());
+  {
+    // Too large body is not stored.
+    Downstream d(nullptr, 0, 0);
+    prepare_request(&d, "/charlie");
+    cache.lookup(&d, "https", now);
+    receive_response(&cache, &d, "max-age=60", std::string(2048, 'x'), now);
+  }
+  CU_ASSERT(1 == cache.get_num_entries());
+  {
+    Downstream d(nullptr, 0, 0);
+    prepare_request(&d, "/alpha");
+    auto entry = cache.lookup(&d, "https", now + 10);
+    CU_ASSERT(entry);
+    CU_ASSERT("hello" == entry->body);
+    CU_ASSERT(prepare_cached_response(&d, entry.get(), now + 10));
+    d.normalize_response_headers();
+    CU_ASSERT(200 == d.get_response_http_status());
+    CU_ASSERT("10" == (*d.get_norm_response_header("age")).second);
+    CU_ASSERT("5" == (*d.get_norm_response_header("content-length")).second);
+    CU_ASSERT(std::end(d.get_response_headers()) ==
+              d.get_norm_response_header("connection"));
+    CU_ASSERT(d.get_cache_key().empty());
+  }
+  {
+    // Conditional request matching etag gets 304.
+    Downstream d(nullptr, 0, 0);
+    d.add_request_header("if-none-match", "W/\"alpha\"");
+    prepare_request(&d, "/alpha");
+    auto entry = cache.lookup(&d, "https", now + 10);
+    CU_ASSERT(entry);
+    CU_ASSERT(!prepare_cached_response(&d, entry.get(), now + 10));
+    CU_ASSERT(304 == d.get_response_http_status());
+  }
+  {
+    // Request with no-cache bypasses the cache.
+    Downstream d(nullptr, 0, 0);
+    d.add_request_header("cache-control", "no-cache");
+    prepare_request(&d, "/alpha");
+    CU_ASSERT(!cache.lookup(&d, "https", now + 10));
+    CU_ASSERT(!d.get_cache_key().empty());
+  }
+  {
+    // Stale entry is removed.
+    Downstream d(nullptr, 0, 0);
+    prepare_request(&d, "/alpha");
+    CU_ASSERT(!cache.lookup(&d, "https", now + 60));
+    CU_ASSERT(0 == cache.get_num_entries());
+    CU_ASSERT(0 == cache.get_size());
+  }
+}
+
+void test_shrpx_cache_vary(void)
+{
+  ResponseCache cache(1024*1024, 1024);
+  time_t now = 1000000;
+  {
+    Downstream d(nullptr, 0, 0);
+    d.add_request_header("accept-encoding", "gzip");
+    prepare_request(&d, "/");
+    cache.lookup(&d, "http", now);
+    d.add_response_header("vary", "Accept-Encoding");
+    receive_response(&cache, &d, "max-age=60", "gzipped", now);
+  }
+  {
+    Downstream d(nullptr, 0, 0);
+    prepare_request(&d, "/");
+    CU_ASSERT(!cache.lookup(&d, "http", now));
+    d.add_response_header("vary", "Accept-Encoding");
+    receive_response(&cache, &d, "max-age=60", "identity", now);
+  }
+  CU_ASSERT(2 == cache.get_num_entries());
+  {
+    Downstream d(nullptr, 0, 0);
+    d.add_request_header("accept-encoding", "gzip");
+    prepare_request(&d, "/");
+    auto entry = cache.lookup(&d, "http", now);
+    CU_ASSERT(entry);
+    CU_ASSERT("gzipped" == entry->body);
+  }
+  {
+    Downstream d(nullptr, 0, 0);
+    d.add_request_header("accept-encoding", "deflate");
+    prepare_request(&d, "/");
+    CU_ASSERT(!cache.lookup(&d, "http", now));
+  }
+}
+
+namespace {
+std::shared_ptr<CacheEntry> create_entry(const std::string& key,
+                                         size_t bodylen)
+{
+  auto entry = std::make_shared<CacheEntry>();
+  entry->key = key;
+  entry->body = std::string(bodylen, 'x');
+  entry->date = 0;
+  entry->expires = 0;
+  entry->last_modified = 0;
+  entry->status = 200;
+  return entry;
+}
+} // namespace
+
+void test_shrpx_cache_eviction(void)
+{
+  auto entry_size = create_entry("a", 1000)->size();
+  ResponseCache cache(entry_size * 2, 4096);
+
+  CU_ASSERT(cache.store(create_entry("a", 1000)));
+  CU_ASSERT(cache.store(create_entry("b", 1000)));
+  CU_ASSERT(2 == cache.get_num_entries());
+  // "a" is the least recently used one, and evicted.
+  CU_ASSERT(cache.store(create_entry("c", 1000)));
+  CU_ASSERT(2 == cache.get_num_entries());
+  CU_ASSERT(entry_size * 2 == cache.get_size());
+
+  // Entry larger than the whole cache is never stored.
+  CU_ASSERT(!cache.store(create_entry("d", entry_size * 2)));
+  CU_ASSERT(2 == cache.get_num_entries());
+}
+
+void test_shrpx_cache_replace_admission(void)
+{
+  time_t now = 1000000000;
+  Downstream a(nullptr, 0, 0), b(nullptr, 0, 0);
+  prepare_request(&a, "/a");
+  prepare_request(&b, "/b");
+  auto akey = create_cache_key(&a, "https");
+  auto bkey = create_cache_key(&b, "https");
+  auto entry_size = create_entry(akey, 1000)->size();
+  ResponseCache cache(entry_size * 2 + 100, 4096);
+
+  CU_ASSERT(cache.store(create_entry(akey, 1000)));
+  auto bent = create_entry(bkey, 1000);
+  bent->expires = now + 60;
+  CU_ASSERT(cache.store(bent));
+  // "b" is accessed more often than "a".
+  for(int i = 0; i < 3; ++i) {
+    CU_ASSERT(bent == cache.lookup(&b, "https", now));
+  }
+
+  // Larger new variant of "a" needs room which only "b" can make,
+  // and "b" wins the admission. The old variant is kept.
+  CU_ASSERT(!cache.store(create_entry(akey, 1200)));
+  CU_ASSERT(2 == cache.get_num_entries());
+  CU_ASSERT(entry_size * 2 == cache.get_size());
+
+  // The new variant which fits replaces the old one.
+  CU_ASSERT(cache.store(create_entry(akey, 1050)));
+  CU_ASSERT(2 == cache.get_num_entries());
+  CU_ASSERT(entry_size * 2 + 50 == cache.get_size());
+}
+
+void test_shrpx_cache_inflight(void)
+{
+  ResponseCache cache(1 << 20, 1 << 20);
+  time_t now = 1000000000;
+  {
+    Downstream leader(nullptr, 0, 0);
+    prepare_request(&leader, "/alpha");
+    cache.lookup(&leader, "https", now);
+    // The first request becomes the leader.
+    CU_ASSERT(nullptr == cache.get_coalesced_connection(nullptr, &leader));
+    CU_ASSERT(&cache == leader.get_inflight_cache());
+
+    // Conditional request is not coalesced.
+    Downstream d(nullptr, 0, 0);
+    d.add_request_header("If-None-Match", "\"alpha\"");
+    prepare_request(&d, "/alpha");
+    cache.lookup(&d, "https", now);
+    CU_ASSERT(nullptr == cache.get_coalesced_connection(nullptr, &d));
+    CU_ASSERT(nullptr == d.get_inflight_cache());
+
+    // The leader is no longer in-flight once the response headers
+    // are received.
+    receive_response(&cache, &leader, "max-age=60", "alpha", now);
+    CU_ASSERT(nullptr == leader.get_inflight_cache());
+  }
+  {
+    // This leader is deleted without response.
+    Downstream d(nullptr, 0, 0);
+    prepare_request(&d, "/alpha");
+    cache.lookup(&d, "https", now);
+    CU_ASSERT(nullptr == cache.get_coalesced_connection(nullptr, &d));
+    CU_ASSERT(&cache == d.get_inflight_cache());
+  }
+  {
+    // Deleted leader was removed from in-flight requests.
+    Downstream d(nullptr, 0, 0);
+    prepare_request(&d, "/alpha");
+    cache.lookup(&d, "https", now);
+    CU_ASSERT(nullptr == cache.get_coalesced_connection(nullptr, &d));
+    CU_ASSERT(&cache == d.get_inflight_cache());
+  }
+}
+
+void test_shrpx_cache_coalesce_followers(void)
+{
+  if(!get_config()) {
+    create_config();
+  }
+  auto evbase = event_base_new();
+  init_timeouts(evbase);
+  auto cfg = ev_token_bucket_cfg_new(EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     nullptr);
+  auto group = bufferevent_rate_limit_group_new(evbase, cfg);
+  int fds[2];
+  CU_ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  auto bev = bufferevent_socket_new(evbase, fds[0], 0);
+  auto handler = new ClientHandler(bev, group, fds[0], nullptr, "127.0.0.1");
+
+  ResponseCache cache(1 << 20, 1 << 20);
+  time_t now = 1000000000;
+  RecordingUpstream upstream(handler);
+  {
+    // The leader and the followers are not counted in worker
+    // statistics, which are checked by another test.
+    Downstream leader(nullptr, 0, 0);
+    prepare_request(&leader, "/alpha");
+    cache.lookup(&leader, "https", now);
+    CU_ASSERT(nullptr == cache.get_coalesced_connection(handler, &leader));
+
+    Downstream f1(&upstream, 0, 0), f2(&upstream, 0, 0);
+    CU_ASSERT(nullptr != coalesce(&cache, handler, &f1, "/alpha", now));
+    CU_ASSERT(nullptr != coalesce(&cache, handler, &f2, "/alpha", now));
+    CU_ASSERT(2 == leader.get_followers().size());
+
+    receive_response(&cache, &leader, "max-age=60", "hello", now);
+
+    // Both followers received the response of the leader, and are
+    // released from the leader.
+    CU_ASSERT(2 == upstream.header_complete);
+    CU_ASSERT("hellohello" == upstream.body);
+    CU_ASSERT(2 == upstream.body_complete);
+    CU_ASSERT(leader.get_followers().empty());
+    CU_ASSERT(200 == f1.get_response_http_status());
+    CU_ASSERT(Downstream::MSG_COMPLETE == f1.get_response_state());
+    CU_ASSERT(Downstream::MSG_COMPLETE == f2.get_response_state());
+
+    // Each follower is woken up.
+    event_base_loop(evbase, EVLOOP_NONBLOCK);
+    CU_ASSERT(2 == upstream.readcb_called);
+
+    f1.set_response_http_status(0);
+    f2.set_response_http_status(0);
+  }
+  {
+    // The leader fails without response. The follower sends its own
+    // request to backend.
+    auto backend = new RecordingDownstreamConnection(handler);
+    handler->pool_downstream_connection(backend);
+
+    Downstream f(&upstream, 0, 0);
+    {
+      Downstream leader(nullptr, 0, 0);
+      prepare_request(&leader, "/bravo");
+      cache.lookup(&leader, "https", now);
+      CU_ASSERT(nullptr == cache.get_coalesced_connection(handler, &leader));
+      CU_ASSERT(nullptr != coalesce(&cache, handler, &f, "/bravo", now));
+    }
+    upstream.readcb_called = 0;
+    event_base_loop(evbase, EVLOOP_NONBLOCK);
+    CU_ASSERT(backend == f.get_downstream_connection());
+    CU_ASSERT(1 == backend->push_request_headers_called);
+    CU_ASSERT(0 == upstream.readcb_called);
+  }
+
+  delete handler;
+  close(fds[1]);
+  bufferevent_rate_limit_group_free(group);
+  ev_token_bucket_cfg_free(cfg);
+  event_base_free(evbase);
+}
+
+void test_shrpx_cache_coalesce_backpressure(void)
+{
+  if(!get_config()) {
+    create_config();
+  }
+  auto evbase = event_base_new();
+  init_timeouts(evbase);
+  auto cfg = ev_token_bucket_cfg_new(EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     nullptr);
+  auto group = bufferevent_rate_limit_group_new(evbase, cfg);
+  int fds[2];
+  CU_ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  auto bev = bufferevent_socket_new(evbase, fds[0], 0);
+  auto handler = new ClientHandler(bev, group, fds[0], nullptr, "127.0.0.1");
+
+  ResponseCache cache(1 << 20, 1 << 20);
+  time_t now = 1000000000;
+  RecordingUpstream upstream(handler);
+  {
+    Downstream leader(nullptr, 0, 0);
+    prepare_request(&leader, "/alpha");
+    auto backend = new RecordingDownstreamConnection(handler);
+    backend->attach_downstream(&leader);
+    cache.lookup(&leader, "https", now);
+    CU_ASSERT(nullptr == cache.get_coalesced_connection(handler, &leader));
+
+    Downstream f1(&upstream, 0, 0), f2(&upstream, 0, 0);
+    CU_ASSERT(nullptr != coalesce(&cache, handler, &f1, "/alpha", now));
+    CU_ASSERT(nullptr != coalesce(&cache, handler, &f2, "/alpha", now));
+
+    // The leader reads from backend only when no follower is
+    // blocked.
+    f1.pause_read(SHRPX_NO_BUFFER);
+    CU_ASSERT(SHRPX_FOLLOWER_BLOCK == backend->rdbits);
+    f1.pause_read(SHRPX_NO_BUFFER);
+    f2.pause_read(SHRPX_NO_BUFFER);
+    CU_ASSERT(SHRPX_FOLLOWER_BLOCK == backend->rdbits);
+    f1.resume_read(SHRPX_NO_BUFFER);
+    CU_ASSERT(SHRPX_FOLLOWER_BLOCK == backend->rdbits);
+    f2.resume_read(SHRPX_NO_BUFFER);
+    CU_ASSERT(0 == backend->rdbits);
+
+    // The followers released from the leader do not keep it paused.
+    f1.pause_read(SHRPX_NO_BUFFER);
+    CU_ASSERT(SHRPX_FOLLOWER_BLOCK == backend->rdbits);
+    receive_response(&cache, &leader, "max-age=60", "hello", now);
+    CU_ASSERT(leader.get_followers().empty());
+    CU_ASSERT(0 == backend->rdbits);
+
+    event_base_loop(evbase, EVLOOP_NONBLOCK);
+    f1.set_response_http_status(0);
+    f2.set_response_http_status(0);
+  }
+
+  delete handler;
+  close(fds[1]);
+  bufferevent_rate_limit_group_free(group);
+  ev_token_bucket_cfg_free(cfg);
+  event_base_free(evbase);
+}
+
+} // namespace shrpx
@@ -26,6 +26,9 @@
 
 #include <unistd.h>
 #include <cerrno>
+#include <atomic>
+#include <vector>
+#include <unordered_set>
 
 #include "shrpx_upstream.h"
 #include "shrpx_http2_upstream.h"
@@ -35,6 +38,8 @@
 #include "shrpx_http2_downstream_connection.h"
 #include "shrpx_accesslog.h"
 #include "shrpx_ssl.h"
+#include "shrpx_stats.h"
+#include "shrpx_timeout.h"
 #ifdef HAVE_SPDYLAY
 #include "shrpx_spdy_upstream.h"
 #endif // HAVE_SPDYLAY
@@ -44,6 +49,15 @@ using namespace nghttp2;
 
 namespace shrpx {
 
+namespace {
+// The client connections handled by the current thread
+thread_local std::unordered_set<ClientHandler*> live_handlers;
+// true if graceful shutdown has been started in the current thread
+thread_local bool graceful_shutdown_started = false;
+// The number of client connections in all threads
+std::atomic<size_t> num_client_handlers(0);
+} // namespace
+
 namespace {
 void upstream_readcb(bufferevent *bev, void *arg)
 {
@@ -113,14 +127,22 @@ void upstream_eventcb(bufferevent *bev, short events, void *arg)
       if(LOG_ENABLED(INFO)) {
         CLOG(INFO, handler) << "SSL/TLS handshake completed";
       }
+      auto stats = get_worker_stats();
+      stats->tls_handshakes.add(1);
+      if(SSL_session_reused(handler->get_ssl())) {
+        stats->tls_resumptions.add(1);
+        if(LOG_ENABLED(INFO)) {
+          CLOG(INFO, handler) << "SSL/TLS session reused";
+        }
+      }
       if(handler->validate_next_proto() != 0) {
         delete handler;
         return;
       }
-      if(LOG_ENABLED(INFO)) {
-        if(SSL_session_reused(handler->get_ssl())) {
-          CLOG(INFO, handler) << "SSL/TLS session reused";
-        }
+      if(handler->get_graceful_shutdown() &&
+         handler->get_upstream()->on_graceful_shutdown() != 0) {
+        delete handler;
+        return;
       }
       // At this point, input buffer is already filled with some
       // bytes.  The read callback is not called until new data
@@ -226,6 +248,7 @@ namespace {
 void tls_raw_readcb(evbuffer *buffer, const evbuffer_cb_info *info, void *arg)
 {
   auto handler = static_cast<ClientHandler*>(arg);
+  get_worker_stats()->bytes_in.add(info->n_added);
   if(handler->get_tls_renegotiation()) {
     if(LOG_ENABLED(INFO)) {
       CLOG(INFO, handler) << "Close connection due to TLS renegotiation";
@@ -239,6 +262,7 @@ namespace {
 void tls_raw_writecb(evbuffer *buffer, const evbuffer_cb_info *info, void *arg)
 {
   auto handler = static_cast<ClientHandler*>(arg);
+  get_worker_stats()->bytes_out.add(info->n_deleted);
   // upstream_writecb() is called when external bufferevent
   // handler->bev's output buffer gets empty. But the underlying
   // bufferevent may have pending output buffer.
@@ -246,6 +270,20 @@ void tls_raw_writecb(evbuffer *buffer, const evbuffer_cb_info *info, void *arg)
 }
 } // namespace
 
+namespace {
+void raw_readcb(evbuffer *buffer, const evbuffer_cb_info *info, void *arg)
+{
+  get_worker_stats()->bytes_in.add(info->n_added);
+}
+} // namespace
+
+namespace {
+void raw_writecb(evbuffer *buffer, const evbuffer_cb_info *info, void *arg)
+{
+  get_worker_stats()->bytes_out.add(info->n_deleted);
+}
+} // namespace
+
 ClientHandler::ClientHandler(bufferevent *bev,
                              bufferevent_rate_limit_group *rate_limit_group,
                              int fd, SSL *ssl,
@@ -253,15 +291,21 @@ ClientHandler::ClientHandler(bufferevent *bev,
   : ipaddr_(ipaddr),
     bev_(bev),
     http2session_(nullptr),
+    response_cache_(nullptr),
     ssl_(ssl),
     left_connhd_len_(NGHTTP2_CLIENT_CONNECTION_HEADER_LEN),
     fd_(fd),
+    stats_proto_(-1),
     should_close_after_write_(false),
     tls_handshake_(false),
-    tls_renegotiation_(false)
+    tls_renegotiation_(false),
+    graceful_shutdown_(graceful_shutdown_started)
 {
   int rv;
 
+  live_handlers.insert(this);
+  ++num_client_handlers;
+
   auto rate_limit_bev = bufferevent_get_underlying(bev_);
   if(!rate_limit_bev) {
     rate_limit_bev = bev_;
@@ -280,8 +324,8 @@ ClientHandler::ClientHandler(bufferevent *bev,
 
   bufferevent_enable(bev_, EV_READ | EV_WRITE);
   bufferevent_setwatermark(bev_, EV_READ, 0, SHRPX_READ_WARTER_MARK);
-  set_upstream_timeouts(&get_config()->upstream_read_timeout,
-                        &get_config()->upstream_write_timeout);
+  set_upstream_timeouts(get_timeouts()->upstream_read,
+                        get_timeouts()->upstream_write);
   if(ssl_) {
     SSL_set_app_data(ssl_, reinterpret_cast<char*>(this));
     set_bev_cb(nullptr, upstream_writecb, upstream_eventcb);
@@ -294,7 +338,10 @@ ClientHandler::ClientHandler(bufferevent *bev,
     // upgraded to HTTP/2.0 through HTTP Upgrade or direct HTTP/2.0
     // connection.
     upstream_ = util::make_unique<HttpsUpstream>(this);
+    set_stats_proto(STATS_PROTO_HTTP1);
     set_bev_cb(upstream_http1_connhd_readcb, nullptr, upstream_eventcb);
+    evbuffer_add_cb(bufferevent_get_input(bev_), raw_readcb, this);
+    evbuffer_add_cb(bufferevent_get_output(bev_), raw_writecb, this);
   }
 }
 
@@ -331,6 +378,9 @@ ClientHandler::~ClientHandler()
   for(auto dconn : dconn_pool_) {
     delete dconn;
   }
+  set_stats_proto(-1);
+  live_handlers.erase(this);
+  --num_client_handlers;
   if(LOG_ENABLED(INFO)) {
     CLOG(INFO, this) << "Deleted";
   }
@@ -388,17 +438,20 @@ int ClientHandler::validate_next_proto()
         set_bev_cb(upstream_http2_connhd_readcb, upstream_writecb,
                    upstream_eventcb);
         upstream_ = util::make_unique<Http2Upstream>(this);
+        set_stats_proto(STATS_PROTO_HTTP2);
         return 0;
       } else {
 #ifdef HAVE_SPDYLAY
         uint16_t version = spdylay_npn_get_version(next_proto, next_proto_len);
         if(version) {
           upstream_ = util::make_unique<SpdyUpstream>(version, this);
+          set_stats_proto(STATS_PROTO_SPDY);
           return 0;
         }
 #endif // HAVE_SPDYLAY
         if(next_proto_len == 8 && memcmp("http/1.1", next_proto, 8) == 0) {
           upstream_ = util::make_unique<HttpsUpstream>(this);
+          set_stats_proto(STATS_PROTO_HTTP1);
           return 0;
         }
       }
@@ -415,6 +468,7 @@ int ClientHandler::validate_next_proto()
       CLOG(INFO, this) << "No protocol negotiated. Fallback to HTTP/1.1";
     }
     upstream_ = util::make_unique<HttpsUpstream>(this);
+    set_stats_proto(STATS_PROTO_HTTP1);
     return 0;
   }
   if(LOG_ENABLED(INFO)) {
@@ -480,6 +534,7 @@ DownstreamConnection* ClientHandler::get_downstream_connection()
   } else {
     auto dconn = *std::begin(dconn_pool_);
     dconn_pool_.erase(dconn);
+    get_worker_stats()->backend_pool_hits.add(1);
     if(LOG_ENABLED(INFO)) {
       CLOG(INFO, this) << "Reuse downstream connection DCONN:" << dconn
                        << " from pool";
@@ -513,6 +568,16 @@ Http2Session* ClientHandler::get_http2_session() const
   return http2session_;
 }
 
+void ClientHandler::set_response_cache(ResponseCache *cache)
+{
+  response_cache_ = cache;
+}
+
+ResponseCache* ClientHandler::get_response_cache() const
+{
+  return response_cache_;
+}
+
 size_t ClientHandler::get_left_connhd_len() const
 {
   return left_connhd_len_;
@@ -526,6 +591,7 @@ void ClientHandler::set_left_connhd_len(size_t left)
 void ClientHandler::direct_http2_upgrade()
 {
   upstream_= util::make_unique<Http2Upstream>(this);
+  set_stats_proto(STATS_PROTO_HTTP2);
   set_bev_cb(upstream_readcb, upstream_writecb, upstream_eventcb);
 }
 
@@ -539,6 +605,7 @@ int ClientHandler::perform_http2_upgrade(HttpsUpstream *http)
   // http pointer is now owned by upstream.
   upstream_.release();
   upstream_ = std::move(upstream);
+  set_stats_proto(STATS_PROTO_HTTP2);
   set_bev_cb(upstream_http2_connhd_readcb, upstream_writecb, upstream_eventcb);
   static char res[] = "HTTP/1.1 101 Switching Protocols\r\n"
     "Connection: Upgrade\r\n"
@@ -586,4 +653,50 @@ bool ClientHandler::get_tls_renegotiation() const
   return tls_renegotiation_;
 }
 
+int ClientHandler::graceful_shutdown()
+{
+  graceful_shutdown_ = true;
+  if(!upstream_) {
+    // TLS handshake is in progress. The upstream is notified when it
+    // is created.
+    return 0;
+  }
+  return upstream_->on_graceful_shutdown();
+}
+
+bool ClientHandler::get_graceful_shutdown() const
+{
+  return graceful_shutdown_;
+}
+
+void ClientHandler::set_stats_proto(int proto)
+{
+  auto stats = get_worker_stats();
+  if(stats_proto_ != -1) {
+    stats->client_connections[stats_proto_].add(-1);
+  }
+  stats_proto_ = proto;
+  if(stats_proto_ != -1) {
+    stats->client_connections[stats_proto_].add(1);
+  }
+}
+
+void graceful_shutdown_client_handlers()
+{
+  graceful_shutdown_started = true;
+  // ClientHandler may be deleted in the loop.
+  auto handlers = std::vector<ClientHandler*>(std::begin(live_handlers),
+                                              std::end(live_handlers));
+  for(auto handler : handlers) {
+    if(handler->graceful_shutdown() != 0) {
+      delete handler;
+    }
+  }
+}
+
+size_t get_num_client_handlers()
+{
+  return num_client_handlers;
+}
+
 } // namespace shrpx
@@ -41,6 +41,7 @@ class Upstream;
 class DownstreamConnection;
 class Http2Session;
 class HttpsUpstream;
+class ResponseCache;
 
 class ClientHandler {
 public:
@@ -69,6 +70,8 @@ public:
   SSL* get_ssl() const;
   void set_http2_session(Http2Session *http2session);
   Http2Session* get_http2_session() const;
+  void set_response_cache(ResponseCache *cache);
+  ResponseCache* get_response_cache() const;
   size_t get_left_connhd_len() const;
   void set_left_connhd_len(size_t left);
   // Call this function when HTTP/2.0 connection header is received at
@@ -85,7 +88,14 @@ public:
   bool get_tls_handshake() const;
   void set_tls_renegotiation(bool f);
   bool get_tls_renegotiation() const;
+  // Starts graceful shutdown of this connection. Returns -1 if the
+  // connection can be closed immediately.
+  int graceful_shutdown();
+  bool get_graceful_shutdown() const;
 private:
+  // Moves this connection to the active connection count of |proto|,
+  // which is one of STATS_PROTO_*.
+  void set_stats_proto(int proto);
   std::set<DownstreamConnection*> dconn_pool_;
   std::unique_ptr<Upstream> upstream_;
   std::string ipaddr_;
@@ -93,15 +103,29 @@ private:
   // Shared HTTP2 session for each thread. NULL if backend is not
   // HTTP2. Not deleted by this object.
   Http2Session *http2session_;
+  // Response cache shared by connections in each thread. NULL if
+  // caching is disabled. Not deleted by this object.
+  ResponseCache *response_cache_;
   SSL *ssl_;
   // The number of bytes of HTTP/2.0 client connection header to read
   size_t left_connhd_len_;
   int fd_;
+  // The protocol this connection is counted as, or -1
+  int stats_proto_;
   bool should_close_after_write_;
   bool tls_handshake_;
   bool tls_renegotiation_;
+  bool graceful_shutdown_;
 };
 
+// Starts graceful shutdown of all client connections handled by the
+// current thread. The connections accepted by this thread after this
+// call are also shut down gracefully.
+void graceful_shutdown_client_handlers();
+
+// Returns the number of client connections alive in this process.
+size_t get_num_client_handlers();
+
 } // namespace shrpx
 
 #endif // SHRPX_CLIENT_HANDLER_H
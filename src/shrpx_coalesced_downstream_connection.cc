@@ -0,0 +1,190 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_coalesced_downstream_connection.h"
+
+#include "shrpx_client_handler.h"
+#include "shrpx_upstream.h"
+#include "shrpx_downstream.h"
+#include "shrpx_log.h"
+
+namespace shrpx {
+
+namespace {
+void notifycb(evutil_socket_t fd, short events, void *arg)
+{
+  auto dconn = static_cast<CoalescedDownstreamConnection*>(arg);
+  dconn->on_notify();
+}
+} // namespace
+
+CoalescedDownstreamConnection::CoalescedDownstreamConnection
+(ClientHandler *client_handler, Downstream *leader)
+  : DownstreamConnection(client_handler),
+    leader_(leader),
+    notifyev_(event_new(client_handler->get_evbase(), -1, 0, notifycb, this)),
+    leader_paused_(false)
+{}
+
+CoalescedDownstreamConnection::~CoalescedDownstreamConnection()
+{
+  if(LOG_ENABLED(INFO)) {
+    DCLOG(INFO, this) << "Deleting";
+  }
+  if(notifyev_) {
+    event_free(notifyev_);
+  }
+  if(leader_) {
+    resume_leader();
+    leader_->remove_follower(this);
+  }
+  // Downstream and DownstreamConnection may be deleted
+  // asynchronously.
+  if(downstream_) {
+    downstream_->set_downstream_connection(nullptr);
+  }
+}
+
+int CoalescedDownstreamConnection::attach_downstream(Downstream *downstream)
+{
+  if(LOG_ENABLED(INFO)) {
+    DCLOG(INFO, this) << "Attaching to DOWNSTREAM:" << downstream
+                      << ", coalesced to DOWNSTREAM:" << leader_;
+  }
+  if(!notifyev_ || !leader_) {
+    return -1;
+  }
+  leader_->add_follower(this);
+  downstream->set_downstream_connection(this);
+  downstream_ = downstream;
+  return 0;
+}
+
+void CoalescedDownstreamConnection::detach_downstream(Downstream *downstream)
+{
+  if(LOG_ENABLED(INFO)) {
+    DCLOG(INFO, this) << "Detaching from DOWNSTREAM:" << downstream;
+  }
+  downstream->set_downstream_connection(nullptr);
+  downstream_ = nullptr;
+  delete this;
+}
+
+void CoalescedDownstreamConnection::pause_read(IOCtrlReason reason)
+{
+  if(leader_ && !leader_paused_) {
+    leader_paused_ = true;
+    leader_->pause_follower_read();
+  }
+}
+
+int CoalescedDownstreamConnection::resume_read(IOCtrlReason reason)
+{
+  resume_leader();
+  return 0;
+}
+
+void CoalescedDownstreamConnection::force_resume_read()
+{
+  resume_leader();
+}
+
+void CoalescedDownstreamConnection::resume_leader()
+{
+  if(leader_ && leader_paused_) {
+    leader_paused_ = false;
+    leader_->resume_follower_read();
+  }
+}
+
+void CoalescedDownstreamConnection::notify()
+{
+  event_active(notifyev_, 0, 0);
+}
+
+void CoalescedDownstreamConnection::on_leader_gone()
+{
+  leader_ = nullptr;
+  leader_paused_ = false;
+  notify();
+}
+
+void CoalescedDownstreamConnection::release()
+{
+  if(leader_) {
+    resume_leader();
+    leader_->remove_follower(this);
+    leader_ = nullptr;
+  }
+  notify();
+}
+
+void CoalescedDownstreamConnection::on_notify()
+{
+  auto downstream = downstream_;
+  if(!downstream) {
+    return;
+  }
+  if(!leader_ && downstream->get_response_state() == Downstream::INITIAL) {
+    reissue_request();
+    return;
+  }
+  if(!leader_ &&
+     downstream->get_response_state() == Downstream::HEADER_COMPLETE) {
+    // The leader has gone in the middle of the response body.
+    downstream->set_response_state(Downstream::MSG_RESET);
+  }
+  auto upstream = downstream->get_upstream();
+  (upstream->get_downstream_readcb())(nullptr, this);
+  // This object may be deleted
+}
+
+void CoalescedDownstreamConnection::reissue_request()
+{
+  auto downstream = downstream_;
+  auto upstream = downstream->get_upstream();
+  if(LOG_ENABLED(INFO)) {
+    DCLOG(INFO, this) << "Leader has gone without response. Send request "
+                      << "to backend";
+  }
+  auto dconn = client_handler_->get_downstream_connection();
+  if(dconn->attach_downstream(downstream) != 0) {
+    delete dconn;
+    downstream->set_response_state(Downstream::MSG_RESET);
+    (upstream->get_downstream_readcb())(nullptr, this);
+    // This object may be deleted
+    return;
+  }
+  // Now downstream is owned by dconn.
+  downstream_ = nullptr;
+  if(downstream->push_request_headers() != 0 ||
+     (downstream->get_request_state() == Downstream::MSG_COMPLETE &&
+      downstream->end_upload_data() != 0)) {
+    downstream->set_response_state(Downstream::MSG_RESET);
+    (upstream->get_downstream_readcb())(nullptr, dconn);
+  }
+  delete this;
+}
+
+} // namespace shrpx
@@ -0,0 +1,97 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_COALESCED_DOWNSTREAM_CONNECTION_H
+#define SHRPX_COALESCED_DOWNSTREAM_CONNECTION_H
+
+#include "shrpx.h"
+
+#include <event.h>
+
+#include "shrpx_downstream_connection.h"
+
+namespace shrpx {
+
+// DownstreamConnection for the request coalesced to the identical
+// in-flight request (leader). It has no backend connection; the
+// response of the leader is copied to the downstream attached to
+// this object by ResponseCache, and then notify() lets upstream
+// process it as if it was read from backend. If the leader has gone
+// before its response headers are copied, the request is sent to
+// backend using an ordinary DownstreamConnection.
+class CoalescedDownstreamConnection : public DownstreamConnection {
+public:
+  CoalescedDownstreamConnection(ClientHandler *client_handler,
+                                Downstream *leader);
+  virtual ~CoalescedDownstreamConnection();
+  virtual int attach_downstream(Downstream *downstream);
+  // This object is not reusable, and deleted in this function.
+  virtual void detach_downstream(Downstream *downstream);
+
+  virtual int push_request_headers() { return 0; }
+  virtual int push_upload_data_chunk(const uint8_t *data, size_t datalen)
+  {
+    return -1;
+  }
+  virtual int end_upload_data() { return 0; }
+
+  // The leader stops reading response from backend while this
+  // request's upstream cannot take more response body.
+  virtual void pause_read(IOCtrlReason reason);
+  virtual int resume_read(IOCtrlReason reason);
+  virtual void force_resume_read();
+
+  virtual bool get_output_buffer_full() { return false; }
+
+  virtual int on_read() { return 0; }
+  virtual int on_write() { return 0; }
+
+  virtual void on_upstream_change(Upstream *upstream) {}
+  virtual int on_priority_change(int32_t pri) { return 0; }
+
+  // Schedules upstream's downstream read callback in the next event
+  // loop iteration.
+  void notify();
+  // Called when the leader is deleted.
+  void on_leader_gone();
+  // Detaches this object from the leader and schedules the
+  // notification. If no response has been copied yet, the request is
+  // sent to backend instead.
+  void release();
+  void on_notify();
+private:
+  // Sends request to backend using ordinary DownstreamConnection.
+  // This object is deleted in this function.
+  void reissue_request();
+  // Lets the leader resume reading if this object paused it.
+  void resume_leader();
+  Downstream *leader_;
+  event *notifyev_;
+  // true if this object paused the leader
+  bool leader_paused_;
+};
+
+} // namespace shrpx
+
+#endif // SHRPX_COALESCED_DOWNSTREAM_CONNECTION_H
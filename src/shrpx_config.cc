@@ -43,6 +43,7 @@
 #include "shrpx_log.h"
 #include "shrpx_ssl.h"
 #include "shrpx_http.h"
+#include "shrpx_accesslog.h"
 #include "http2.h"
 #include "util.h"
 
@@ -121,6 +122,28 @@ const char SHRPX_OPT_FRONTEND_HTTP2_DUMP_RESPONSE_HEADER[] =
 const char SHRPX_OPT_HTTP2_NO_COOKIE_CRUMBLING[] = "http2-no-cookie-crumbling";
 const char SHRPX_OPT_FRONTEND_FRAME_DEBUG[] = "frontend-frame-debug";
 const char SHRPX_OPT_PADDING[] = "padding";
+const char SHRPX_OPT_CACHE_SIZE[] = "cache-size";
+const char SHRPX_OPT_CACHE_MAX_OBJECT_SIZE[] = "cache-max-object-size";
+const char SHRPX_OPT_TLS_TICKET_KEY_FILE[] = "tls-ticket-key-file";
+const char SHRPX_OPT_TLS_TICKET_KEY_ROTATION_INTERVAL[] =
+  "tls-ticket-key-rotation-interval";
+const char SHRPX_OPT_TLS_TICKET_KEY_HISTORY[] = "tls-ticket-key-history";
+const char SHRPX_OPT_NO_TLS_TICKET[] = "no-tls-ticket";
+const char SHRPX_OPT_TLS_SESSION_CACHE_SIZE[] = "tls-session-cache-size";
+const char SHRPX_OPT_TLS_SESSION_CACHE_FILE[] = "tls-session-cache-file";
+const char SHRPX_OPT_OCSP_UPDATE_INTERVAL[] = "ocsp-update-interval";
+const char SHRPX_OPT_NO_OCSP[] = "no-ocsp";
+const char SHRPX_OPT_ACCESSLOG_FILE[] = "accesslog-file";
+const char SHRPX_OPT_ACCESSLOG_FORMAT[] = "accesslog-format";
+const char SHRPX_OPT_ACCESSLOG_BUFFER_SIZE[] = "accesslog-buffer-size";
+const char SHRPX_OPT_STATS_PATH[] = "stats-path";
+const char SHRPX_OPT_STATS_ALLOW[] = "stats-allow";
+const char SHRPX_OPT_TUNNEL_SPLICE[] = "tunnel-splice";
+const char SHRPX_OPT_GRACEFUL_SHUTDOWN_TIMEOUT[] = "graceful-shutdown-timeout";
+const char SHRPX_OPT_GZIP[] = "gzip";
+const char SHRPX_OPT_GZIP_TYPES[] = "gzip-types";
+const char SHRPX_OPT_GZIP_MIN_LENGTH[] = "gzip-min-length";
+const char SHRPX_OPT_HTTP2_MAX_PUSH_STREAMS[] = "http2-max-push-streams";
 
 namespace {
 Config *config = nullptr;
@@ -272,6 +295,8 @@ int parse_config(const char *opt, const char *optarg)
     mod_config()->num_worker = strtol(optarg, nullptr, 10);
   } else if(util::strieq(opt, SHRPX_OPT_HTTP2_MAX_CONCURRENT_STREAMS)) {
     mod_config()->http2_max_concurrent_streams = strtol(optarg, nullptr, 10);
+  } else if(util::strieq(opt, SHRPX_OPT_HTTP2_MAX_PUSH_STREAMS)) {
+    mod_config()->http2_max_push_streams = strtoul(optarg, nullptr, 10);
   } else if(util::strieq(opt, SHRPX_OPT_LOG_LEVEL)) {
     if(Log::set_severity_level_by_name(optarg) == -1) {
       LOG(ERROR) << "Invalid severity level: " << optarg;
@@ -309,6 +334,9 @@ int parse_config(const char *opt, const char *optarg)
   } else if(util::strieq(opt, SHRPX_OPT_BACKEND_KEEP_ALIVE_TIMEOUT)) {
     timeval tv = {strtol(optarg, nullptr, 10), 0};
     mod_config()->downstream_idle_read_timeout = tv;
+  } else if(util::strieq(opt, SHRPX_OPT_GRACEFUL_SHUTDOWN_TIMEOUT)) {
+    timeval tv = {strtol(optarg, nullptr, 10), 0};
+    mod_config()->graceful_shutdown_timeout = tv;
   } else if(util::strieq(opt, SHRPX_OPT_FRONTEND_HTTP2_WINDOW_BITS) ||
             util::strieq(opt, SHRPX_OPT_BACKEND_HTTP2_WINDOW_BITS)) {
     size_t *resp;
@@ -498,6 +526,74 @@ int parse_config(const char *opt, const char *optarg)
     mod_config()->upstream_frame_debug = util::strieq(optarg, "yes");
   } else if(util::strieq(opt, SHRPX_OPT_PADDING)) {
     mod_config()->padding = strtoul(optarg, nullptr, 10);
+  } else if(util::strieq(opt, SHRPX_OPT_CACHE_SIZE)) {
+    mod_config()->cache_size = strtoul(optarg, nullptr, 10);
+  } else if(util::strieq(opt, SHRPX_OPT_CACHE_MAX_OBJECT_SIZE)) {
+    mod_config()->cache_max_object_size = strtoul(optarg, nullptr, 10);
+  } else if(util::strieq(opt, SHRPX_OPT_TLS_TICKET_KEY_FILE)) {
+    mod_config()->tls_ticket_key_files.push_back(optarg);
+  } else if(util::strieq(opt, SHRPX_OPT_TLS_TICKET_KEY_ROTATION_INTERVAL)) {
+    timeval tv = {strtol(optarg, nullptr, 10), 0};
+    if(tv.tv_sec <= 0) {
+      LOG(ERROR) << "tls-ticket-key-rotation-interval must be positive";
+      return -1;
+    }
+    mod_config()->tls_ticket_key_rotation_interval = tv;
+  } else if(util::strieq(opt, SHRPX_OPT_TLS_TICKET_KEY_HISTORY)) {
+    mod_config()->tls_ticket_key_history = strtoul(optarg, nullptr, 10);
+  } else if(util::strieq(opt, SHRPX_OPT_NO_TLS_TICKET)) {
+    mod_config()->no_tls_ticket = util::strieq(optarg, "yes");
+  } else if(util::strieq(opt, SHRPX_OPT_TLS_SESSION_CACHE_SIZE)) {
+    mod_config()->tls_session_cache_size = strtoul(optarg, nullptr, 10);
+  } else if(util::strieq(opt, SHRPX_OPT_TLS_SESSION_CACHE_FILE)) {
+    set_config_str(&mod_config()->tls_session_cache_file, optarg);
+  } else if(util::strieq(opt, SHRPX_OPT_OCSP_UPDATE_INTERVAL)) {
+    timeval tv = {strtol(optarg, nullptr, 10), 0};
+    if(tv.tv_sec <= 0) {
+      LOG(ERROR) << "ocsp-update-interval must be positive";
+      return -1;
+    }
+    mod_config()->ocsp_update_interval = tv;
+  } else if(util::strieq(opt, SHRPX_OPT_NO_OCSP)) {
+    mod_config()->no_ocsp = util::strieq(optarg, "yes");
+  } else if(util::strieq(opt, SHRPX_OPT_ACCESSLOG_FILE)) {
+    set_config_str(&mod_config()->accesslog_file, optarg);
+  } else if(util::strieq(opt, SHRPX_OPT_ACCESSLOG_FORMAT)) {
+    std::vector<LogFragment> fragments;
+    if(parse_log_format(fragments, optarg) != 0) {
+      LOG(ERROR) << "Invalid accesslog-format: " << optarg;
+      return -1;
+    }
+    set_config_str(&mod_config()->accesslog_format, optarg);
+  } else if(util::strieq(opt, SHRPX_OPT_ACCESSLOG_BUFFER_SIZE)) {
+    size_t size = strtoul(optarg, nullptr, 10);
+    if(size < 4096) {
+      LOG(ERROR) << "accesslog-buffer-size must be at least 4096";
+      return -1;
+    }
+    size_t n = 1;
+    for(; n < size; n <<= 1);
+    mod_config()->accesslog_buffer_size = n;
+  } else if(util::strieq(opt, SHRPX_OPT_STATS_PATH)) {
+    if(optarg[0] != '/') {
+      LOG(ERROR) << "stats-path must start with '/'";
+      return -1;
+    }
+    set_config_str(&mod_config()->stats_path, optarg);
+  } else if(util::strieq(opt, SHRPX_OPT_STATS_ALLOW)) {
+    delete [] mod_config()->stats_allow;
+    mod_config()->stats_allow = parse_config_str_list
+      (&mod_config()->stats_allow_len, optarg);
+  } else if(util::strieq(opt, SHRPX_OPT_TUNNEL_SPLICE)) {
+    mod_config()->tunnel_splice = util::strieq(optarg, "yes");
+  } else if(util::strieq(opt, SHRPX_OPT_GZIP)) {
+    mod_config()->gzip = util::strieq(optarg, "yes");
+  } else if(util::strieq(opt, SHRPX_OPT_GZIP_TYPES)) {
+    delete [] mod_config()->gzip_types;
+    mod_config()->gzip_types = parse_config_str_list
+      (&mod_config()->gzip_types_len, optarg);
+  } else if(util::strieq(opt, SHRPX_OPT_GZIP_MIN_LENGTH)) {
+    mod_config()->gzip_min_length = strtoul(optarg, nullptr, 10);
   } else if(util::strieq(opt, "conf")) {
     LOG(WARNING) << "conf is ignored";
   } else {
@@ -46,6 +46,8 @@ struct CertLookupTree;
 
 } // namespace ssl
 
+class SessionCache;
+
 extern const char SHRPX_OPT_PRIVATE_KEY_FILE[];
 extern const char SHRPX_OPT_PRIVATE_KEY_PASSWD_FILE[];
 extern const char SHRPX_OPT_CERTIFICATE_FILE[];
@@ -108,6 +110,27 @@ extern const char SHRPX_OPT_FRONTEND_HTTP2_DUMP_RESPONSE_HEADER[];
 extern const char SHRPX_OPT_HTTP2_NO_COOKIE_CRUMBLING[];
 extern const char SHRPX_OPT_FRONTEND_FRAME_DEBUG[];
 extern const char SHRPX_OPT_PADDING[];
+extern const char SHRPX_OPT_CACHE_SIZE[];
+extern const char SHRPX_OPT_CACHE_MAX_OBJECT_SIZE[];
+extern const char SHRPX_OPT_TLS_TICKET_KEY_FILE[];
+extern const char SHRPX_OPT_TLS_TICKET_KEY_ROTATION_INTERVAL[];
+extern const char SHRPX_OPT_TLS_TICKET_KEY_HISTORY[];
+extern const char SHRPX_OPT_NO_TLS_TICKET[];
+extern const char SHRPX_OPT_TLS_SESSION_CACHE_SIZE[];
+extern const char SHRPX_OPT_TLS_SESSION_CACHE_FILE[];
+extern const char SHRPX_OPT_OCSP_UPDATE_INTERVAL[];
+extern const char SHRPX_OPT_NO_OCSP[];
+extern const char SHRPX_OPT_ACCESSLOG_FILE[];
+extern const char SHRPX_OPT_ACCESSLOG_FORMAT[];
+extern const char SHRPX_OPT_ACCESSLOG_BUFFER_SIZE[];
+extern const char SHRPX_OPT_STATS_PATH[];
+extern const char SHRPX_OPT_STATS_ALLOW[];
+extern const char SHRPX_OPT_TUNNEL_SPLICE[];
+extern const char SHRPX_OPT_GRACEFUL_SHUTDOWN_TIMEOUT[];
+extern const char SHRPX_OPT_GZIP[];
+extern const char SHRPX_OPT_GZIP_TYPES[];
+extern const char SHRPX_OPT_GZIP_MIN_LENGTH[];
+extern const char SHRPX_OPT_HTTP2_MAX_PUSH_STREAMS[];
 
 union sockaddr_union {
   sockaddr sa;
@@ -124,6 +147,8 @@ enum shrpx_proto {
 struct Config {
   // The list of (private key file, certificate file) pair
   std::vector<std::pair<std::string, std::string>> subcerts;
+  // The list of files containing TLS session ticket keys
+  std::vector<std::string> tls_ticket_key_files;
   sockaddr_union downstream_addr;
   // binary form of http proxy host and port
   sockaddr_union downstream_http_proxy_addr;
@@ -133,6 +158,13 @@ struct Config {
   timeval downstream_read_timeout;
   timeval downstream_write_timeout;
   timeval downstream_idle_read_timeout;
+  // The maximum time to wait for the connections to finish after
+  // graceful shutdown is started
+  timeval graceful_shutdown_timeout;
+  // The interval to rotate TLS session ticket keys
+  timeval tls_ticket_key_rotation_interval;
+  // The interval to reread OCSP response files
+  timeval ocsp_update_interval;
   char *host;
   char *private_key_file;
   char *private_key_passwd;
@@ -140,6 +172,19 @@ struct Config {
   char *dh_param_file;
   SSL_CTX *default_ssl_ctx;
   ssl::CertLookupTree *cert_tree;
+  // External TLS session cache. nullptr if OpenSSL's internal cache
+  // is used.
+  SessionCache *session_cache;
+  // Path to file where TLS session cache is placed
+  char *tls_session_cache_file;
+  // Path to access log file. nullptr if access log is not written to
+  // file.
+  char *accesslog_file;
+  // The format of access log line, see parse_log_format().
+  char *accesslog_format;
+  // The request path answered with the metrics of this process.
+  // nullptr if disabled.
+  char *stats_path;
   const char *server_name;
   char *downstream_host;
   char *downstream_hostport;
@@ -163,6 +208,12 @@ struct Config {
   // list of supported SSL/TLS protocol strings. The each element of
   // this list is a NULL-terminated string.
   char **tls_proto_list;
+  // list of media types of response which is compressed by gzip.
+  // The each element of this list is a NULL-terminated string.
+  char **gzip_types;
+  // list of client IP addresses allowed to access stats_path. The
+  // each element of this list is a NULL-terminated string.
+  char **stats_allow;
   // Path to file containing CA certificate solely used for client
   // certificate validation
   char *verify_client_cacert;
@@ -173,6 +224,9 @@ struct Config {
   size_t downstream_addrlen;
   size_t num_worker;
   size_t http2_max_concurrent_streams;
+  // The maximum number of pushed streams in flight per HTTP/2
+  // frontend connection. 0 disables server push.
+  size_t http2_max_push_streams;
   size_t http2_upstream_window_bits;
   size_t http2_downstream_window_bits;
   size_t http2_upstream_connection_window_bits;
@@ -191,7 +245,28 @@ struct Config {
   size_t npn_list_len;
   // The number of elements in tls_proto_list
   size_t tls_proto_list_len;
+  // The number of elements in gzip_types
+  size_t gzip_types_len;
+  // The number of elements in stats_allow
+  size_t stats_allow_len;
+  // The response whose content-length is less than this value is
+  // not compressed.
+  size_t gzip_min_length;
   size_t padding;
+  // The maximum total size of response cache per worker. 0 disables
+  // the cache.
+  size_t cache_size;
+  // The maximum size of response body stored in the cache
+  size_t cache_max_object_size;
+  // The number of previous TLS session ticket keys which are still
+  // accepted for decryption.
+  size_t tls_ticket_key_history;
+  // The maximum number of sessions in external TLS session cache. 0
+  // means OpenSSL's internal cache is used.
+  size_t tls_session_cache_size;
+  // The size of access log ring buffer per worker in bytes. This is
+  // a power of 2.
+  size_t accesslog_buffer_size;
   // downstream protocol; this will be determined by given options.
   shrpx_proto downstream_proto;
   int syslog_facility;
@@ -227,6 +302,13 @@ struct Config {
   bool tty;
   bool http2_no_cookie_crumbling;
   bool upstream_frame_debug;
+  bool no_tls_ticket;
+  bool no_ocsp;
+  // true if established tunnel between plain TCP connections is
+  // forwarded by splice(2)
+  bool tunnel_splice;
+  // true if response is compressed by gzip on the fly
+  bool gzip;
 };
 
 const Config* get_config();
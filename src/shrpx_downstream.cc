@@ -25,6 +25,7 @@
 #include "shrpx_downstream.h"
 
 #include <cassert>
+#include <algorithm>
 
 #include "http-parser/http_parser.h"
 
@@ -33,18 +34,27 @@
 #include "shrpx_config.h"
 #include "shrpx_error.h"
 #include "shrpx_downstream_connection.h"
+#include "shrpx_cache.h"
+#include "shrpx_gzip.h"
+#include "shrpx_coalesced_downstream_connection.h"
+#include "shrpx_accesslog.h"
+#include "shrpx_stats.h"
 #include "util.h"
 #include "http2.h"
 
 namespace shrpx {
 
 Downstream::Downstream(Upstream *upstream, int stream_id, int priority)
-  : request_bodylen_(0),
+  : request_start_time_(std::chrono::steady_clock::now()),
+    request_bodylen_(0),
+    response_sent_bodylen_(0),
     upstream_(upstream),
     dconn_(nullptr),
+    inflight_cache_(nullptr),
     response_body_buf_(nullptr),
     request_headers_sum_(0),
     response_headers_sum_(0),
+    num_paused_followers_(0),
     stream_id_(stream_id),
     priority_(priority),
     downstream_stream_id_(-1),
@@ -62,6 +72,7 @@ Downstream::Downstream(Upstream *upstream, int stream_id, int priority)
     request_connection_close_(false),
     request_expect_100_continue_(false),
     request_header_key_prev_(false),
+    request_headers_normalized_(false),
     chunked_response_(false),
     response_connection_close_(false),
     response_header_key_prev_(false)
@@ -72,6 +83,15 @@ Downstream::~Downstream()
   if(LOG_ENABLED(INFO)) {
     DLOG(INFO, this) << "Deleting";
   }
+  if(upstream_ && response_http_status_ != 0) {
+    stats_record_request(response_http_status_,
+                         std::chrono::duration_cast<std::chrono::microseconds>
+                         (std::chrono::steady_clock::now() -
+                          request_start_time_).count());
+    if(get_config()->accesslog_file) {
+      upstream_accesslog(upstream_->get_client_handler()->get_ipaddr(), this);
+    }
+  }
   if(response_body_buf_) {
     // Passing NULL to evbuffer_free() causes segmentation fault.
     evbuffer_free(response_body_buf_);
@@ -79,6 +99,12 @@ Downstream::~Downstream()
   if(dconn_) {
     delete dconn_;
   }
+  if(inflight_cache_) {
+    inflight_cache_->remove_inflight(this);
+  }
+  for(auto dconn : followers_) {
+    dconn->on_leader_gone();
+  }
   if(LOG_ENABLED(INFO)) {
     DLOG(INFO, this) << "Deleted";
   }
@@ -234,6 +260,7 @@ void Downstream::crumble_request_cookie()
   }
   request_headers_.insert(std::end(request_headers_),
                           std::begin(cookie_hdrs), std::end(cookie_hdrs));
+  request_headers_normalized_ = false;
 }
 
 const std::string& Downstream::get_assembled_request_cookie() const
@@ -243,18 +270,42 @@ const std::string& Downstream::get_assembled_request_cookie() const
 
 void Downstream::normalize_request_headers()
 {
+  if(request_headers_normalized_) {
+    return;
+  }
   http2::normalize_headers(request_headers_);
+  http2::index_headers(request_hdidx_, request_headers_);
+  request_headers_normalized_ = true;
 }
 
 Headers::const_iterator Downstream::get_norm_request_header
 (const std::string& name) const
 {
+  if(request_headers_normalized_) {
+    auto token = http2::lookup_token(name);
+    if(token != -1) {
+      auto i = request_hdidx_[token];
+      if(i == -1) {
+        return std::end(request_headers_);
+      }
+      return std::begin(request_headers_) + i;
+    }
+  }
   return get_norm_header(request_headers_, name);
 }
 
+const Headers::value_type* Downstream::get_request_header(int token) const
+{
+  assert(request_headers_normalized_);
+  return http2::get_header(request_hdidx_, token, request_headers_);
+}
+
 void Downstream::concat_norm_request_headers()
 {
   request_headers_ = http2::concat_norm_headers(std::move(request_headers_));
+  if(request_headers_normalized_) {
+    http2::index_headers(request_hdidx_, request_headers_);
+  }
 }
 
 void Downstream::add_request_header(std::string name, std::string value)
@@ -262,6 +313,7 @@ void Downstream::add_request_header(std::string name, std::string value)
   request_header_key_prev_ = true;
   request_headers_sum_ += name.size() + value.size();
   request_headers_.emplace_back(std::move(name), std::move(value));
+  request_headers_normalized_ = false;
 }
 
 void Downstream::set_last_request_header_value(std::string value)
@@ -280,6 +332,7 @@ void Downstream::split_add_request_header
 {
   request_headers_sum_ += namelen + valuelen;
   http2::split_add_header(request_headers_, name, namelen, value, valuelen);
+  request_headers_normalized_ = false;
 }
 
 bool Downstream::get_request_header_key_prev() const
@@ -293,6 +346,7 @@ void Downstream::append_last_request_header_key(const char *data, size_t len)
   request_headers_sum_ += len;
   auto& item = request_headers_.back();
   item.first.append(data, len);
+  request_headers_normalized_ = false;
 }
 
 void Downstream::append_last_request_header_value(const char *data, size_t len)
@@ -443,6 +497,7 @@ int Downstream::push_request_headers()
     DLOG(INFO, this) << "dconn_ is NULL";
     return -1;
   }
+  upstream_start_time_ = std::chrono::steady_clock::now();
   return dconn_->push_request_headers();
 }
 
@@ -522,6 +577,41 @@ void Downstream::rewrite_norm_location_response_header
   }
 }
 
+void Downstream::start_response_compression()
+{
+  bool vary_found = false;
+  for(auto i = std::begin(response_headers_);
+      i != std::end(response_headers_);) {
+    auto& name = (*i).first;
+    auto& value = (*i).second;
+    if(name == "content-length" || name == "content-encoding") {
+      i = response_headers_.erase(i);
+      continue;
+    }
+    if(name == "etag" && !util::startsWith(value, "W/")) {
+      // The compressed representation is no longer byte-for-byte
+      // identical to the one backend validates.
+      value.insert(0, "W/");
+    } else if(name == "vary" &&
+              (util::strifind(value.c_str(), "accept-encoding") ||
+               value == "*")) {
+      vary_found = true;
+    }
+    ++i;
+  }
+  response_headers_.emplace_back("content-encoding", "gzip");
+  if(!vary_found) {
+    response_headers_.emplace_back("vary", "Accept-Encoding");
+  }
+  normalize_response_headers();
+  response_deflater_ = util::make_unique<ResponseDeflater>();
+}
+
+ResponseDeflater* Downstream::get_response_deflater() const
+{
+  return response_deflater_.get();
+}
+
 void Downstream::add_response_header(std::string name, std::string value)
 {
   response_header_key_prev_ = true;
@@ -651,6 +741,10 @@ int Downstream::change_priority(int32_t pri)
 void Downstream::set_response_state(int state)
 {
   response_state_ = state;
+  if(state == MSG_COMPLETE &&
+     upstream_start_time_.time_since_epoch().count() != 0) {
+    upstream_end_time_ = std::chrono::steady_clock::now();
+  }
 }
 
 int Downstream::get_response_state() const
@@ -768,4 +862,95 @@ void Downstream::set_response_rst_stream_error_code
   response_rst_stream_error_code_ = error_code;
 }
 
+void Downstream::set_cache_key(std::string key)
+{
+  cache_key_ = std::move(key);
+}
+
+const std::string& Downstream::get_cache_key() const
+{
+  return cache_key_;
+}
+
+void Downstream::set_cache_entry(std::unique_ptr<CacheEntry> entry)
+{
+  cache_entry_ = std::move(entry);
+}
+
+CacheEntry* Downstream::get_cache_entry() const
+{
+  return cache_entry_.get();
+}
+
+std::unique_ptr<CacheEntry> Downstream::pop_cache_entry()
+{
+  return std::move(cache_entry_);
+}
+
+void Downstream::set_inflight_cache(ResponseCache *cache)
+{
+  inflight_cache_ = cache;
+}
+
+ResponseCache* Downstream::get_inflight_cache() const
+{
+  return inflight_cache_;
+}
+
+void Downstream::add_follower(CoalescedDownstreamConnection *dconn)
+{
+  followers_.push_back(dconn);
+}
+
+void Downstream::remove_follower(CoalescedDownstreamConnection *dconn)
+{
+  followers_.erase(std::remove(std::begin(followers_), std::end(followers_),
+                               dconn), std::end(followers_));
+}
+
+const std::vector<CoalescedDownstreamConnection*>&
+Downstream::get_followers() const
+{
+  return followers_;
+}
+
+void Downstream::pause_follower_read()
+{
+  if(num_paused_followers_++ == 0) {
+    pause_read(SHRPX_FOLLOWER_BLOCK);
+  }
+}
+
+void Downstream::resume_follower_read()
+{
+  if(--num_paused_followers_ == 0) {
+    resume_read(SHRPX_FOLLOWER_BLOCK);
+  }
+}
+
+void Downstream::add_response_sent_bodylen(size_t len)
+{
+  response_sent_bodylen_ += len;
+}
+
+int64_t Downstream::get_response_sent_bodylen() const
+{
+  return response_sent_bodylen_;
+}
+
+std::chrono::steady_clock::time_point
+Downstream::get_request_start_time() const
+{
+  return request_start_time_;
+}
+
+double Downstream::get_upstream_response_time() const
+{
+  if(upstream_end_time_.time_since_epoch().count() == 0) {
+    return -1;
+  }
+  return std::chrono::duration<double>
+    (upstream_end_time_ - upstream_start_time_).count();
+}
+
 } // namespace shrpx
@@ -31,6 +31,8 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <chrono>
 
 #include <event.h>
 #include <event2/bufferevent.h>
@@ -46,6 +48,10 @@ namespace shrpx {
 
 class Upstream;
 class DownstreamConnection;
+class CoalescedDownstreamConnection;
+class ResponseCache;
+class ResponseDeflater;
+struct CacheEntry;
 
 class Downstream {
 public:
@@ -86,7 +92,10 @@ public:
   void crumble_request_cookie();
   void assemble_request_cookie();
   const std::string& get_assembled_request_cookie() const;
-  // Makes key lowercase and sort headers by name using <
+  // Makes key lowercase and sort headers by name using <. The
+  // well-known header fields are indexed so that they can be looked
+  // up in constant time. This function does nothing if headers have
+  // not been modified since the last call.
   void normalize_request_headers();
   // Returns iterator pointing to the request header with the name
   // |name|. If multiple header have |name| as name, return first
@@ -95,6 +104,10 @@ public:
   // called after calling normalize_request_headers().
   Headers::const_iterator get_norm_request_header
   (const std::string& name) const;
+  // Returns the request header field indexed by |token| (one of
+  // http2::HD_*), or nullptr. This function must be called after
+  // calling normalize_request_headers().
+  const Headers::value_type* get_request_header(int token) const;
   // Concatenates request header fields with same name by NULL as
   // delimiter. See http2::concat_norm_headers(). This function must
   // be called after calling normalize_request_headers().
@@ -167,6 +180,13 @@ public:
   void rewrite_norm_location_response_header
   (const std::string& upstream_scheme,
    uint16_t upstream_port);
+  // Rewrites response header fields for the body compressed by gzip
+  // and creates the compressor. This function must be called after
+  // calling normalize_response_headers().
+  void start_response_compression();
+  // Returns the compressor of response body, or nullptr if the
+  // response is not compressed.
+  ResponseDeflater* get_response_deflater() const;
   void add_response_header(std::string name, std::string value);
   void set_last_response_header_value(std::string value);
 
@@ -204,28 +224,82 @@ public:
   // Change the priority of downstream
   int change_priority(int32_t pri);
 
+  // Sets the response cache key of this request. Empty string means
+  // the response must not be stored.
+  void set_cache_key(std::string key);
+  const std::string& get_cache_key() const;
+  // Sets the cache entry which is being filled with the response.
+  void set_cache_entry(std::unique_ptr<CacheEntry> entry);
+  CacheEntry* get_cache_entry() const;
+  std::unique_ptr<CacheEntry> pop_cache_entry();
+  // Sets the cache where this request is registered as in-flight
+  // request. Other identical requests are coalesced to this request
+  // while it is registered.
+  void set_inflight_cache(ResponseCache *cache);
+  ResponseCache* get_inflight_cache() const;
+  // Adds/removes the connection of the request which shares the
+  // response of this request.
+  void add_follower(CoalescedDownstreamConnection *dconn);
+  void remove_follower(CoalescedDownstreamConnection *dconn);
+  const std::vector<CoalescedDownstreamConnection*>& get_followers() const;
+  // Called when the upstream of a follower cannot take more response
+  // body, and when it can again. Reading response from backend is
+  // paused while any follower is blocked.
+  void pause_follower_read();
+  void resume_follower_read();
+
+  // Adds |len| to the number of response body bytes sent to the
+  // client.
+  void add_response_sent_bodylen(size_t len);
+  int64_t get_response_sent_bodylen() const;
+  // Returns the time when this object was created.
+  std::chrono::steady_clock::time_point get_request_start_time() const;
+  // Returns the elapsed time in seconds between the request headers
+  // were pushed to backend and the response was completed, or -1 if
+  // backend was not involved.
+  double get_upstream_response_time() const;
+
   // Maximum buffer size for header name/value pairs.
   static const size_t MAX_HEADERS_SUM = 32768;
 private:
   Headers request_headers_;
   Headers response_headers_;
+  // Index of well-known header fields in request_headers_. Valid
+  // only if request_headers_normalized_ is true.
+  http2::HeaderIndex request_hdidx_;
 
   std::string request_method_;
   std::string request_path_;
   std::string request_http2_scheme_;
   std::string request_http2_authority_;
   std::string assembled_request_cookie_;
+  std::string cache_key_;
+  // The response being stored to the cache. nullptr if the response
+  // is not storable.
+  std::unique_ptr<CacheEntry> cache_entry_;
+  std::unique_ptr<ResponseDeflater> response_deflater_;
+  // The connections of requests coalesced to this request
+  std::vector<CoalescedDownstreamConnection*> followers_;
+  std::chrono::steady_clock::time_point request_start_time_;
+  std::chrono::steady_clock::time_point upstream_start_time_;
+  std::chrono::steady_clock::time_point upstream_end_time_;
   // the length of request body
   int64_t request_bodylen_;
+  // the length of response body sent to the client
+  int64_t response_sent_bodylen_;
 
   Upstream *upstream_;
   DownstreamConnection *dconn_;
+  // Not deleted by this object.
+  ResponseCache *inflight_cache_;
   // This buffer is used to temporarily store downstream response
   // body. nghttp2 library reads data from this in the callback.
   evbuffer *response_body_buf_;
 
   size_t request_headers_sum_;
   size_t response_headers_sum_;
+  // The number of followers which paused reading
+  size_t num_paused_followers_;
 
   int32_t stream_id_;
   int32_t priority_;
@@ -254,6 +328,8 @@ private:
   bool request_connection_close_;
   bool request_expect_100_continue_;
   bool request_header_key_prev_;
+  // true if request_headers_ is normalized and indexed
+  bool request_headers_normalized_;
 
   bool chunked_response_;
   bool response_connection_close_;
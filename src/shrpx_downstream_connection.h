@@ -27,6 +27,8 @@
 
 #include "shrpx.h"
 
+#include <event2/bufferevent.h>
+
 #include "shrpx_io_control.h"
 
 namespace shrpx {
@@ -58,6 +60,14 @@ public:
   virtual void on_upstream_change(Upstream *uptream) = 0;
   virtual int on_priority_change(int32_t pri) = 0;
 
+  // Returns the bufferevent of the plain TCP connection dedicated to
+  // this object, which can be handed over to SpliceTunnel. Returns
+  // nullptr if there is no such connection.
+  virtual bufferevent* get_tunnel_bev()
+  {
+    return nullptr;
+  }
+
   ClientHandler* get_client_handler();
   Downstream* get_downstream();
 protected:
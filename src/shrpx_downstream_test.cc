@@ -89,6 +89,25 @@ void test_downstream_get_norm_request_header(void)
   CU_ASSERT(i == std::end(d.get_request_headers()));
 }
 
+void test_downstream_get_request_header(void)
+{
+  Downstream d(nullptr, 0, 0);
+  d.add_request_header("Via", "1.1 alpha");
+  d.add_request_header("Host", "bravo");
+  d.normalize_request_headers();
+  CU_ASSERT("bravo" == d.get_request_header(http2::HD_HOST)->second);
+  CU_ASSERT(nullptr == d.get_request_header(http2::HD_CONTENT_LENGTH));
+  auto i = d.get_norm_request_header("via");
+  CU_ASSERT("1.1 alpha" == (*i).second);
+
+  // Adding header field invalidates index
+  d.add_request_header("Content-Length", "100");
+  d.normalize_request_headers();
+  CU_ASSERT("100" == d.get_request_header(http2::HD_CONTENT_LENGTH)->second);
+  CU_ASSERT("bravo" == d.get_request_header(http2::HD_HOST)->second);
+  CU_ASSERT("1.1 alpha" == d.get_request_header(http2::HD_VIA)->second);
+}
+
 void test_downstream_get_norm_response_header(void)
 {
   Downstream d(nullptr, 0, 0);
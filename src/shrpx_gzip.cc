@@ -0,0 +1,233 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_gzip.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#include "shrpx_config.h"
+#include "shrpx_downstream.h"
+#include "http2.h"
+#include "util.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+bool content_type_match(const std::string& value,
+                        char **types, size_t typeslen)
+{
+  auto last = value.find(';');
+  if(last == std::string::npos) {
+    last = value.size();
+  }
+  for(; last > 0 && (value[last - 1] == ' ' || value[last - 1] == '\t');
+      --last);
+  for(size_t i = 0; i < typeslen; ++i) {
+    if(util::strieq(types[i],
+                    reinterpret_cast<const uint8_t*>(value.c_str()), last)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool response_compressible(const Downstream *downstream)
+{
+  auto config = get_config();
+  if(!config->gzip) {
+    return false;
+  }
+  auto& method = downstream->get_request_method();
+  if(method == "HEAD" || method == "CONNECT") {
+    return false;
+  }
+  // HTTP/1.0 client cannot receive the body of unknown length
+  // without closing connection.
+  if(downstream->get_request_major() < 1 ||
+     (downstream->get_request_major() == 1 &&
+      downstream->get_request_minor() < 1)) {
+    return false;
+  }
+  auto status = downstream->get_response_http_status();
+  if(status < 200 || status == 204 || status == 206 || status == 304) {
+    return false;
+  }
+  auto& headers = downstream->get_response_headers();
+  auto content_encoding = http2::get_header(headers, "content-encoding");
+  if(content_encoding &&
+     !util::strieq(content_encoding->second.c_str(), "identity")) {
+    return false;
+  }
+  auto content_type = http2::get_header(headers, "content-type");
+  if(!content_type ||
+     !content_type_match(content_type->second, config->gzip_types,
+                         config->gzip_types_len)) {
+    return false;
+  }
+  auto content_length = http2::get_header(headers, "content-length");
+  if(content_length &&
+     strtoull(content_length->second.c_str(), nullptr, 10) <
+     config->gzip_min_length) {
+    return false;
+  }
+  for(auto& kv : headers) {
+    if(kv.first == "cache-control" &&
+       util::strifind(kv.second.c_str(), "no-transform")) {
+      return false;
+    }
+  }
+  auto accept_encoding = downstream->get_norm_request_header
+    ("accept-encoding");
+  if(accept_encoding == std::end(downstream->get_request_headers())) {
+    return false;
+  }
+  return http2::accept_gzip((*accept_encoding).second);
+}
+
+namespace {
+// Per thread pool of deflate contexts. deflateInit2() allocates
+// a few hundred KiB for each context, so they are reset and reused.
+// The idle contexts are freed when the thread exits.
+struct DeflatePool {
+  ~DeflatePool()
+  {
+    for(auto zst : contexts) {
+      deflateEnd(zst);
+      delete zst;
+    }
+  }
+  std::vector<z_stream*> contexts;
+};
+} // namespace
+
+namespace {
+thread_local DeflatePool deflate_pool;
+} // namespace
+
+namespace {
+// The pool keeps at most this number of idle contexts.
+const size_t MAX_DEFLATE_POOL_SIZE = 128;
+} // namespace
+
+ResponseDeflater::ResponseDeflater()
+  : zst_(nullptr),
+    pending_(false)
+{
+  auto& contexts = deflate_pool.contexts;
+  if(!contexts.empty()) {
+    zst_ = contexts.back();
+    contexts.pop_back();
+    return;
+  }
+  auto zst = new z_stream();
+  // windowBits 15 + 16 makes zlib write gzip header and trailer.
+  if(deflateInit2(zst, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                  Z_DEFAULT_STRATEGY) != Z_OK) {
+    delete zst;
+    return;
+  }
+  zst_ = zst;
+}
+
+ResponseDeflater::~ResponseDeflater()
+{
+  if(!zst_) {
+    return;
+  }
+  auto& contexts = deflate_pool.contexts;
+  if(contexts.size() < MAX_DEFLATE_POOL_SIZE &&
+     deflateReset(zst_) == Z_OK) {
+    contexts.push_back(zst_);
+    return;
+  }
+  deflateEnd(zst_);
+  delete zst_;
+}
+
+int ResponseDeflater::deflate(evbuffer *out, const uint8_t *data, size_t len,
+                              bool finish)
+{
+  if(!zst_) {
+    return -1;
+  }
+  zst_->next_in = const_cast<uint8_t*>(data);
+  zst_->avail_in = len;
+  if(finish) {
+    pending_ = false;
+    return write_output(out, Z_FINISH);
+  }
+  if(len > 0) {
+    pending_ = true;
+  }
+  return write_output(out, Z_NO_FLUSH);
+}
+
+int ResponseDeflater::flush(evbuffer *out)
+{
+  if(!zst_) {
+    return -1;
+  }
+  if(!pending_) {
+    return 0;
+  }
+  pending_ = false;
+  zst_->next_in = nullptr;
+  zst_->avail_in = 0;
+  return write_output(out, Z_SYNC_FLUSH);
+}
+
+int ResponseDeflater::write_output(evbuffer *out, int flush)
+{
+  for(;;) {
+    evbuffer_iovec vec;
+    if(evbuffer_reserve_space(out, 4096, &vec, 1) != 1) {
+      return -1;
+    }
+    zst_->next_out = static_cast<uint8_t*>(vec.iov_base);
+    zst_->avail_out = vec.iov_len;
+    auto rv = ::deflate(zst_, flush);
+    if(rv != Z_OK && rv != Z_STREAM_END && rv != Z_BUF_ERROR) {
+      return -1;
+    }
+    vec.iov_len -= zst_->avail_out;
+    if(evbuffer_commit_space(out, &vec, 1) != 0) {
+      return -1;
+    }
+    if(rv == Z_STREAM_END) {
+      break;
+    }
+    // For Z_NO_FLUSH and Z_SYNC_FLUSH, all input is consumed and all
+    // output available is written if there is room left in the
+    // output buffer.
+    if(flush != Z_FINISH && zst_->avail_in == 0 && zst_->avail_out > 0) {
+      break;
+    }
+  }
+  return 0;
+}
+
+} // namespace shrpx
@@ -0,0 +1,81 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_GZIP_H
+#define SHRPX_GZIP_H
+
+#include "shrpx.h"
+
+#include <stdint.h>
+
+#include <string>
+
+#include <zlib.h>
+
+#include <event2/buffer.h>
+
+namespace shrpx {
+
+class Downstream;
+
+// Returns true if the media type of Content-Type header field value
+// |value| is included in |types| which has |typeslen| elements.
+// Parameters in |value| are ignored and the comparison is case
+// insensitive.
+bool content_type_match(const std::string& value,
+                        char **types, size_t typeslen);
+
+// Returns true if the response of |downstream| should be compressed
+// on the fly according to the configuration. This function must be
+// called after normalize_response_headers().
+bool response_compressible(const Downstream *downstream);
+
+// Streaming gzip compressor for response body. The zlib context is
+// taken from the per thread pool and returned to it on destruction,
+// so that streams do not allocate new deflate state.
+class ResponseDeflater {
+public:
+  ResponseDeflater();
+  ~ResponseDeflater();
+  // Compresses |data| of length |len| and appends the output to
+  // |out|. zlib may buffer the compressed data internally until
+  // flush() is called. If |finish| is true, the gzip stream is
+  // terminated and all remaining data are written. Returns 0 if it
+  // succeeds, or -1.
+  int deflate(evbuffer *out, const uint8_t *data, size_t len, bool finish);
+  // Writes the data buffered in zlib to |out|, so that the receiver
+  // can decompress all data given so far. Flushing degrades the
+  // compression ratio, so call this only when the output has been
+  // drained. This function does nothing if no data are buffered.
+  // Returns 0 if it succeeds, or -1.
+  int flush(evbuffer *out);
+private:
+  int write_output(evbuffer *out, int flush);
+  z_stream *zst_;
+  bool pending_;
+};
+
+} // namespace shrpx
+
+#endif // SHRPX_GZIP_H
@@ -0,0 +1,143 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_gzip_test.h"
+
+#include <string>
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_gzip.h"
+#include "shrpx_downstream.h"
+#include "http2.h"
+
+namespace shrpx {
+
+void test_shrpx_gzip_content_type_match(void)
+{
+  char text_html[] = "text/html";
+  char app_json[] = "application/json";
+  char *types[] = { text_html, app_json };
+  CU_ASSERT(content_type_match("text/html", types, 2));
+  CU_ASSERT(content_type_match("Text/HTML; charset=utf-8", types, 2));
+  CU_ASSERT(content_type_match("application/json ;charset=utf-8", types, 2));
+  CU_ASSERT(!content_type_match("text/htmlx", types, 2));
+  CU_ASSERT(!content_type_match("image/png", types, 2));
+  CU_ASSERT(!content_type_match("", types, 2));
+}
+
+namespace {
+std::string inflate_all(evbuffer *buf)
+{
+  auto len = evbuffer_get_length(buf);
+  auto in = evbuffer_pullup(buf, -1);
+  z_stream zst = {};
+  std::string out;
+  if(inflateInit2(&zst, 15 + 16) != Z_OK) {
+    return out;
+  }
+  zst.next_in = in;
+  zst.avail_in = len;
+  uint8_t temp[1024];
+  for(;;) {
+    zst.next_out = temp;
+    zst.avail_out = sizeof(temp);
+    auto rv = inflate(&zst, Z_NO_FLUSH);
+    out.append(temp, temp + sizeof(temp) - zst.avail_out);
+    if(rv != Z_OK || (zst.avail_in == 0 && zst.avail_out > 0)) {
+      break;
+    }
+  }
+  inflateEnd(&zst);
+  return out;
+}
+} // namespace
+
+void test_shrpx_gzip_deflate(void)
+{
+  std::string data;
+  for(int i = 0; i < 10000; ++i) {
+    data += "nghttpx ";
+    data += std::to_string(i % 7);
+  }
+  auto buf = evbuffer_new();
+  {
+    ResponseDeflater deflater;
+    CU_ASSERT(0 == deflater.deflate
+              (buf, reinterpret_cast<const uint8_t*>(data.c_str()),
+               data.size() / 2, false));
+    // After flush(), the data given so far can be decompressed.
+    CU_ASSERT(0 == deflater.flush(buf));
+    CU_ASSERT(evbuffer_get_length(buf) > 0);
+    CU_ASSERT(data.substr(0, data.size() / 2) == inflate_all(buf));
+    // Nothing is pending, so flush() writes nothing.
+    auto buflen = evbuffer_get_length(buf);
+    CU_ASSERT(0 == deflater.flush(buf));
+    CU_ASSERT(buflen == evbuffer_get_length(buf));
+    CU_ASSERT(0 == deflater.deflate
+              (buf, reinterpret_cast<const uint8_t*>(data.c_str()) +
+               data.size() / 2, data.size() - data.size() / 2, true));
+    CU_ASSERT(evbuffer_get_length(buf) < data.size());
+    CU_ASSERT(data == inflate_all(buf));
+  }
+  evbuffer_drain(buf, evbuffer_get_length(buf));
+  {
+    // The context returned to the pool is reset.
+    ResponseDeflater deflater;
+    CU_ASSERT(0 == deflater.deflate
+              (buf, reinterpret_cast<const uint8_t*>("hello"), 5, true));
+    CU_ASSERT("hello" == inflate_all(buf));
+  }
+  evbuffer_free(buf);
+}
+
+void test_shrpx_gzip_start_response_compression(void)
+{
+  Downstream d(nullptr, 0, 0);
+  d.add_response_header("Content-Length", "1000");
+  d.add_response_header("etag", "\"abc\"");
+  d.add_response_header("content-type", "text/html");
+  d.add_response_header("vary", "Cookie");
+  d.normalize_response_headers();
+  d.start_response_compression();
+
+  CU_ASSERT(nullptr != d.get_response_deflater());
+  auto& headers = d.get_response_headers();
+  CU_ASSERT(!http2::get_header(headers, "content-length"));
+  CU_ASSERT("gzip" == http2::get_header(headers, "content-encoding")->second);
+  CU_ASSERT("W/\"abc\"" == http2::get_header(headers, "etag")->second);
+  CU_ASSERT("Accept-Encoding" == d.get_norm_response_header("vary")[1].second);
+
+  Downstream d2(nullptr, 0, 0);
+  d2.add_response_header("etag", "W/\"abc\"");
+  d2.add_response_header("vary", "accept-encoding");
+  d2.normalize_response_headers();
+  d2.start_response_compression();
+
+  auto& headers2 = d2.get_response_headers();
+  CU_ASSERT("W/\"abc\"" == http2::get_header(headers2, "etag")->second);
+  CU_ASSERT(3 == headers2.size());
+}
+
+} // namespace shrpx
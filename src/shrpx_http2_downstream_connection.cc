@@ -536,10 +536,13 @@ int Http2DownstreamConnection::on_priority_change(int32_t pri)
     return 0;
   }
   downstream_->set_priority(pri);
-  if(http2session_->get_state() != Http2Session::CONNECTED) {
+  // If the request is not submitted yet, the new priority is used
+  // when it is submitted.
+  if(http2session_->get_state() != Http2Session::CONNECTED || !sd_) {
     return 0;
   }
-  rv = http2session_->submit_priority(this, pri);
+  rv = http2session_->submit_priority
+    (this, derive_backend_priority(pri, sd_->rank));
   if(rv != 0) {
     DLOG(FATAL, this) << "nghttp2_submit_priority() failed";
     return -1;
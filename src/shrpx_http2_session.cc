@@ -27,6 +27,7 @@
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <vector>
+#include <algorithm>
 
 #include <openssl/err.h>
 
@@ -40,6 +41,8 @@
 #include "shrpx_client_handler.h"
 #include "shrpx_ssl.h"
 #include "shrpx_http.h"
+#include "shrpx_stats.h"
+#include "shrpx_timeout.h"
 #include "http2.h"
 #include "util.h"
 #include "base64.h"
@@ -48,6 +51,15 @@ using namespace nghttp2;
 
 namespace shrpx {
 
+int32_t derive_backend_priority(int32_t pri, size_t rank)
+{
+  const size_t MAX_RANK = (1 << 13) - 1;
+  auto upri = static_cast<uint32_t>(pri);
+  auto cls = upri >> 28;
+  auto r = static_cast<uint32_t>(std::min(rank, MAX_RANK));
+  return (cls << 28) | (r << 15) | ((upri >> 13) & 0x7fff);
+}
+
 Http2Session::Http2Session(event_base *evbase, SSL_CTX *ssl_ctx)
   : evbase_(evbase),
     ssl_ctx_(ssl_ctx),
@@ -142,6 +154,7 @@ int Http2Session::disconnect()
     delete s;
   }
   streams_.clear();
+  client_streams_.clear();
   return 0;
 }
 
@@ -379,8 +392,8 @@ int Http2Session::initiate_connection()
       return SHRPX_ERR_NETWORK;
     }
     bufferevent_enable(bev_, EV_READ);
-    bufferevent_set_timeouts(bev_, &get_config()->downstream_read_timeout,
-                             &get_config()->downstream_write_timeout);
+    bufferevent_set_timeouts(bev_, get_timeouts()->downstream_read,
+                             get_timeouts()->downstream_write);
 
     // No need to set writecb because we write the request when
     // connected at once.
@@ -471,13 +484,14 @@ int Http2Session::initiate_connection()
     if(rv != 0) {
       return SHRPX_ERR_NETWORK;
     }
+    get_worker_stats()->backend_connects.add(1);
 
     bufferevent_setwatermark(bev_, EV_READ, 0, SHRPX_READ_WARTER_MARK);
     bufferevent_enable(bev_, EV_READ);
     bufferevent_setcb(bev_, readcb, writecb, eventcb, this);
     // Set timeout for HTTP2 session
-    bufferevent_set_timeouts(bev_, &get_config()->downstream_read_timeout,
-                             &get_config()->downstream_write_timeout);
+    bufferevent_set_timeouts(bev_, get_timeouts()->downstream_read,
+                             get_timeouts()->downstream_write);
 
     // We have been already connected when no TLS and proxy is used.
     if(state_ != CONNECTED) {
@@ -565,6 +579,10 @@ void Http2Session::remove_downstream_connection
 void Http2Session::remove_stream_data(StreamData *sd)
 {
   streams_.erase(sd);
+  auto i = client_streams_.find(sd->client_handler);
+  if(i != std::end(client_streams_) && --(*i).second == 0) {
+    client_streams_.erase(i);
+  }
   if(sd->dconn) {
     sd->dconn->detach_stream_data();
   }
@@ -578,9 +596,13 @@ int Http2Session::submit_request(Http2DownstreamConnection *dconn,
 {
   assert(state_ == CONNECTED);
   auto sd = util::make_unique<StreamData>();
-  int rv = nghttp2_submit_request(session_, pri, nva, nvlen,
-                                  data_prd, sd.get());
+  sd->client_handler = dconn->get_client_handler();
+  sd->rank = client_streams_[sd->client_handler];
+  int rv = nghttp2_submit_request(session_,
+                                  derive_backend_priority(pri, sd->rank),
+                                  nva, nvlen, data_prd, sd.get());
   if(rv == 0) {
+    ++client_streams_[sd->client_handler];
     dconn->attach_stream_data(sd.get());
     streams_.insert(sd.release());
   } else {
@@ -759,8 +781,7 @@ int Http2Session::start_settings_timer()
     return -1;
   }
   // SETTINGS ACK timeout is 10 seconds for now
-  timeval settings_timeout = { 10, 0 };
-  rv = evtimer_add(settings_timerev_, &settings_timeout);
+  rv = evtimer_add(settings_timerev_, get_timeouts()->settings);
   if(rv == -1) {
     return -1;
   }
@@ -29,6 +29,7 @@
 
 #include <set>
 #include <memory>
+#include <unordered_map>
 
 #include <openssl/ssl.h>
 
@@ -42,11 +43,28 @@
 namespace shrpx {
 
 class Http2DownstreamConnection;
+class ClientHandler;
 
 struct StreamData {
   Http2DownstreamConnection *dconn;
+  // The client connection which made the request. Only used as a
+  // key, never dereferenced.
+  ClientHandler *client_handler;
+  // The number of streams which the client connection had in the
+  // session when this stream was submitted.
+  size_t rank;
 };
 
+// Maps the priority |pri| of client stream to the priority of backend
+// stream. |rank| is the number of streams which the client connection
+// already has in the backend session. The top 3 bits of |pri| select
+// the priority class. In the same class, the n-th stream of a client
+// connection is ordered after the (n-1)-th streams of all client
+// connections, so that a client with many concurrent streams does not
+// starve the others. The order of |pri| is kept among streams of the
+// same class and rank.
+int32_t derive_backend_priority(int32_t pri, size_t rank);
+
 class Http2Session {
 public:
   Http2Session(event_base *evbase, SSL_CTX *ssl_ctx);
@@ -64,6 +82,8 @@ public:
 
   void remove_stream_data(StreamData *sd);
 
+  // |pri| is the priority of client stream. It is mapped to the
+  // priority of backend stream by derive_backend_priority().
   int submit_request(Http2DownstreamConnection *dconn,
                      int32_t pri, const nghttp2_nv *nva, size_t nvlen,
                      const nghttp2_data_provider *data_prd);
@@ -74,6 +94,7 @@ public:
   // |dconn|.
   int submit_window_update(Http2DownstreamConnection *dconn, int32_t amount);
 
+  // |pri| is the priority of backend stream.
   int submit_priority(Http2DownstreamConnection *dconn, int32_t pri);
 
   int terminate_session(nghttp2_error_code error_code);
@@ -125,6 +146,8 @@ public:
 private:
   std::set<Http2DownstreamConnection*> dconns_;
   std::set<StreamData*> streams_;
+  // The number of streams in streams_ per client connection
+  std::unordered_map<ClientHandler*, size_t> client_streams_;
   // Used to parse the response from HTTP proxy
   std::unique_ptr<http_parser> proxy_htp_;
   event_base *evbase_;
@@ -0,0 +1,60 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_http2_session_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_http2_session.h"
+
+namespace shrpx {
+
+void test_shrpx_http2_session_derive_backend_priority(void)
+{
+  // The first stream of client connection keeps its priority.
+  CU_ASSERT(NGHTTP2_PRI_DEFAULT ==
+            derive_backend_priority(NGHTTP2_PRI_DEFAULT, 0));
+  CU_ASSERT(0 == derive_backend_priority(0, 0));
+
+  // The stream in higher class always comes first.
+  CU_ASSERT(derive_backend_priority(0, 1000) <
+            derive_backend_priority(NGHTTP2_PRI_DEFAULT, 0));
+  CU_ASSERT(derive_backend_priority(NGHTTP2_PRI_LOWEST, 0) <=
+            static_cast<int32_t>(NGHTTP2_PRI_LOWEST));
+  CU_ASSERT(derive_backend_priority(NGHTTP2_PRI_LOWEST, 100000) <=
+            static_cast<int32_t>(NGHTTP2_PRI_LOWEST));
+
+  // In the same class, the streams are interleaved across client
+  // connections.
+  CU_ASSERT(derive_backend_priority(NGHTTP2_PRI_DEFAULT + (1 << 20), 0) <
+            derive_backend_priority(NGHTTP2_PRI_DEFAULT, 1));
+  CU_ASSERT(derive_backend_priority(NGHTTP2_PRI_DEFAULT, 1) <
+            derive_backend_priority(NGHTTP2_PRI_DEFAULT, 2));
+
+  // The order of client priority is kept in the same class and rank.
+  CU_ASSERT(derive_backend_priority(NGHTTP2_PRI_DEFAULT, 3) <
+            derive_backend_priority(NGHTTP2_PRI_DEFAULT + (1 << 20), 3));
+}
+
+} // namespace shrpx
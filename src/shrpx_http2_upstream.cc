@@ -36,6 +36,10 @@
 #include "shrpx_config.h"
 #include "shrpx_http.h"
 #include "shrpx_accesslog.h"
+#include "shrpx_cache.h"
+#include "shrpx_gzip.h"
+#include "shrpx_stats.h"
+#include "shrpx_timeout.h"
 #include "http2.h"
 #include "util.h"
 #include "base64.h"
@@ -157,8 +161,7 @@ int Http2Upstream::start_settings_timer()
     return -1;
   }
   // SETTINGS ACK timeout is 10 seconds for now
-  timeval settings_timeout = { 10, 0 };
-  rv = evtimer_add(settings_timerev_, &settings_timeout);
+  rv = evtimer_add(settings_timerev_, get_timeouts()->settings);
   if(rv == -1) {
     return -1;
   }
@@ -233,12 +236,62 @@ int on_begin_headers_callback(nghttp2_session *session,
 }
 } // namespace
 
+namespace {
+// Sends |downstream| to backend, or answers it from the cache.
+// |end_stream| is true if the request has no body. Returns 0 if it
+// succeeds, or -1.
+int start_request(Http2Upstream *upstream, Downstream *downstream,
+                  bool end_stream)
+{
+  int rv;
+  auto cache = upstream->get_client_handler()->get_response_cache();
+  if(cache && end_stream) {
+    auto entry = cache->lookup(downstream,
+                               downstream->get_request_http2_scheme(),
+                               time(nullptr));
+    if(entry) {
+      downstream->set_request_state(Downstream::MSG_COMPLETE);
+      if(upstream->send_cached_response(downstream, entry) != 0) {
+        return -1;
+      }
+      return 0;
+    }
+  }
+
+  DownstreamConnection *dconn = nullptr;
+  if(cache) {
+    dconn = cache->get_coalesced_connection(upstream->get_client_handler(),
+                                            downstream);
+  }
+  if(!dconn) {
+    dconn = upstream->get_client_handler()->get_downstream_connection();
+  }
+  rv = dconn->attach_downstream(downstream);
+  if(rv != 0) {
+    // If downstream connection fails, issue RST_STREAM.
+    upstream->rst_stream(downstream, NGHTTP2_INTERNAL_ERROR);
+    downstream->set_request_state(Downstream::CONNECT_FAIL);
+    return 0;
+  }
+  rv = downstream->push_request_headers();
+  if(rv != 0) {
+    upstream->rst_stream(downstream, NGHTTP2_INTERNAL_ERROR);
+    return 0;
+  }
+  downstream->set_request_state(Downstream::HEADER_COMPLETE);
+  if(end_stream) {
+    downstream->set_request_state(Downstream::MSG_COMPLETE);
+  }
+
+  return 0;
+}
+} // namespace
+
 namespace {
 int on_request_headers(Http2Upstream *upstream,
                        nghttp2_session *session,
                        const nghttp2_frame *frame)
 {
-  int rv;
   auto downstream = upstream->find_downstream(frame->hd.stream_id);
   if(!downstream) {
     return 0;
@@ -311,22 +364,18 @@ int on_request_headers(Http2Upstream *upstream,
 
   downstream->check_upgrade_request();
 
-  auto dconn = upstream->get_client_handler()->get_downstream_connection();
-  rv = dconn->attach_downstream(downstream);
-  if(rv != 0) {
-    // If downstream connection fails, issue RST_STREAM.
-    upstream->rst_stream(downstream, NGHTTP2_INTERNAL_ERROR);
-    downstream->set_request_state(Downstream::CONNECT_FAIL);
-    return 0;
-  }
-  rv = downstream->push_request_headers();
-  if(rv != 0) {
-    upstream->rst_stream(downstream, NGHTTP2_INTERNAL_ERROR);
+  if((frame->hd.flags & NGHTTP2_FLAG_END_STREAM) &&
+     stats_request(downstream, upstream->get_client_handler()->get_ipaddr())) {
+    downstream->set_request_state(Downstream::MSG_COMPLETE);
+    if(upstream->send_stats_response(downstream) != 0) {
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
     return 0;
   }
-  downstream->set_request_state(Downstream::HEADER_COMPLETE);
-  if(frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
-    downstream->set_request_state(Downstream::MSG_COMPLETE);
+
+  if(start_request(upstream, downstream,
+                   frame->hd.flags & NGHTTP2_FLAG_END_STREAM) != 0) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
   }
 
   return 0;
@@ -370,6 +419,11 @@ int on_frame_recv_callback
   }
   case NGHTTP2_SETTINGS:
     if((frame->hd.flags & NGHTTP2_FLAG_ACK) == 0) {
+      for(size_t i = 0; i < frame->settings.niv; ++i) {
+        if(frame->settings.iv[i].settings_id == NGHTTP2_SETTINGS_ENABLE_PUSH) {
+          upstream->set_push_enabled(frame->settings.iv[i].value == 1);
+        }
+      }
       break;
     }
     upstream->stop_settings_timer();
@@ -420,6 +474,10 @@ int on_frame_send_callback(nghttp2_session* session,
     if(upstream->start_settings_timer() != 0) {
       return NGHTTP2_ERR_CALLBACK_FAILURE;
     }
+  } else if(frame->hd.type == NGHTTP2_PUSH_PROMISE) {
+    if(upstream->on_push_promise_sent(frame) != 0) {
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
   }
   return 0;
 }
@@ -442,6 +500,8 @@ int on_frame_not_send_callback(nghttp2_session *session,
     if(downstream) {
       upstream->rst_stream(downstream, NGHTTP2_INTERNAL_ERROR);
     }
+  } else if(frame->hd.type == NGHTTP2_PUSH_PROMISE) {
+    upstream->on_push_promise_not_sent(frame);
   }
   return 0;
 }
@@ -478,10 +538,12 @@ nghttp2_error_code infer_upstream_rst_stream_error_code
 Http2Upstream::Http2Upstream(ClientHandler *handler)
   : handler_(handler),
     session_(nullptr),
-    settings_timerev_(nullptr)
+    settings_timerev_(nullptr),
+    num_pushes_(0),
+    push_enabled_(true)
 {
-  handler->set_upstream_timeouts(&get_config()->http2_upstream_read_timeout,
-                                 &get_config()->upstream_write_timeout);
+  handler->set_upstream_timeouts(get_timeouts()->http2_upstream_read,
+                                 get_timeouts()->upstream_write);
 
   nghttp2_session_callbacks callbacks;
   memset(&callbacks, 0, sizeof(callbacks));
@@ -533,6 +595,9 @@ Http2Upstream::Http2Upstream(ClientHandler *handler)
 
 Http2Upstream::~Http2Upstream()
 {
+  for(auto& kv : pending_pushes_) {
+    delete kv.second;
+  }
   nghttp2_session_del(session_);
   if(settings_timerev_) {
     event_free(settings_timerev_);
@@ -617,6 +682,20 @@ int Http2Upstream::on_event()
   return 0;
 }
 
+int Http2Upstream::on_graceful_shutdown()
+{
+  int rv;
+  rv = nghttp2_submit_goaway(session_, NGHTTP2_FLAG_NONE, NGHTTP2_NO_ERROR,
+                             nullptr, 0);
+  if(rv != 0) {
+    ULOG(ERROR, this) << "nghttp2_submit_goaway() failed: "
+                      << nghttp2_strerror(rv);
+    return -1;
+  }
+  // The session is terminated in send() when all streams are closed.
+  return send();
+}
+
 ClientHandler* Http2Upstream::get_client_handler() const
 {
   return handler_;
@@ -867,6 +946,17 @@ ssize_t downstream_data_read_callback(nghttp2_session *session,
   auto handler = upstream->get_client_handler();
   auto body = downstream->get_response_body_buf();
   assert(body);
+  auto deflater = downstream->get_response_deflater();
+  if(deflater && evbuffer_get_length(body) == 0) {
+    // The compressed data are flushed only when the buffer has been
+    // drained, since flushing on every chunk degrades the compression
+    // ratio.
+    if(deflater->flush(body) != 0) {
+      ULOG(FATAL, upstream) << "Compressing response body failed";
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+    downstream->add_response_sent_bodylen(evbuffer_get_length(body));
+  }
   int nread = evbuffer_remove(body, buf, length);
   if(nread == -1) {
     ULOG(FATAL, upstream) << "evbuffer_remove() failed";
@@ -943,6 +1033,56 @@ int Http2Upstream::error_reply(Downstream *downstream,
   return 0;
 }
 
+int Http2Upstream::send_cached_response
+(Downstream *downstream, const std::shared_ptr<CacheEntry>& entry)
+{
+  if(LOG_ENABLED(INFO)) {
+    DLOG(INFO, downstream) << "Serving response from cache: " << entry->key;
+  }
+  auto has_body = prepare_cached_response(downstream, entry.get(),
+                                          time(nullptr));
+  // The response is not sent until send() is called, so it is safe to
+  // submit headers before body is ready.
+  if(on_downstream_header_complete(downstream) != 0) {
+    return -1;
+  }
+  auto body = downstream->get_response_body_buf();
+  auto deflater = downstream->get_response_deflater();
+  if(has_body && deflater) {
+    auto len = evbuffer_get_length(body);
+    if(deflater->deflate(body,
+                         reinterpret_cast<const uint8_t*>
+                         (entry->body.c_str()),
+                         entry->body.size(), false) != 0) {
+      ULOG(FATAL, this) << "Compressing response body failed";
+      return -1;
+    }
+    downstream->add_response_sent_bodylen(evbuffer_get_length(body) - len);
+  } else if(has_body) {
+    if(add_cached_body(body, entry) != 0) {
+      ULOG(FATAL, this) << "evbuffer_add_reference() failed";
+      return -1;
+    }
+    downstream->add_response_sent_bodylen(entry->body.size());
+  }
+  downstream->set_response_state(Downstream::MSG_COMPLETE);
+  return on_downstream_body_complete(downstream);
+}
+
+int Http2Upstream::send_stats_response(Downstream *downstream)
+{
+  auto body = format_stats();
+  prepare_stats_response(downstream, body);
+  if(on_downstream_header_complete(downstream) != 0 ||
+     on_downstream_body(downstream,
+                        reinterpret_cast<const uint8_t*>(body.c_str()),
+                        body.size()) != 0) {
+    return -1;
+  }
+  downstream->set_response_state(Downstream::MSG_COMPLETE);
+  return on_downstream_body_complete(downstream);
+}
+
 bufferevent_data_cb Http2Upstream::get_downstream_readcb()
 {
   return downstream_readcb;
@@ -965,6 +1105,9 @@ void Http2Upstream::add_downstream(Downstream *downstream)
 
 void Http2Upstream::remove_downstream(Downstream *downstream)
 {
+  if(downstream->get_stream_id() % 2 == 0) {
+    --num_pushes_;
+  }
   downstream_queue_.remove(downstream);
 }
 
@@ -990,6 +1133,18 @@ int Http2Upstream::on_downstream_header_complete(Downstream *downstream)
     downstream->rewrite_norm_location_response_header
       (get_client_handler()->get_upstream_scheme(), get_config()->port);
   }
+  auto cache = get_client_handler()->get_response_cache();
+  if(cache) {
+    cache->on_response_header(downstream, time(nullptr));
+  }
+  if(response_compressible(downstream)) {
+    downstream->start_response_compression();
+  }
+  // PUSH_PROMISE is submitted before the response so that it is sent
+  // before the response which refers to the pushed resources.
+  if(prepare_push_promise(downstream) != 0) {
+    return -1;
+  }
   downstream->concat_norm_response_headers();
   auto end_headers = std::end(downstream->get_response_headers());
   size_t nheader = downstream->get_response_headers().size();
@@ -1061,10 +1216,25 @@ int Http2Upstream::on_downstream_body(Downstream *downstream,
   auto upstream = downstream->get_upstream();
   auto handler = upstream->get_client_handler();
   auto body = downstream->get_response_body_buf();
-  int rv = evbuffer_add(body, data, len);
-  if(rv != 0) {
-    ULOG(FATAL, this) << "evbuffer_add() failed";
-    return -1;
+  auto deflater = downstream->get_response_deflater();
+  if(deflater) {
+    auto buflen = evbuffer_get_length(body);
+    if(deflater->deflate(body, data, len, false) != 0) {
+      ULOG(FATAL, this) << "Compressing response body failed";
+      return -1;
+    }
+    downstream->add_response_sent_bodylen(evbuffer_get_length(body) - buflen);
+  } else {
+    int rv = evbuffer_add(body, data, len);
+    if(rv != 0) {
+      ULOG(FATAL, this) << "evbuffer_add() failed";
+      return -1;
+    }
+    downstream->add_response_sent_bodylen(len);
+  }
+  auto cache = handler->get_response_cache();
+  if(cache) {
+    cache->on_response_body(downstream, data, len);
   }
   nghttp2_session_resume_data(session_, downstream->get_stream_id());
 
@@ -1084,6 +1254,20 @@ int Http2Upstream::on_downstream_body_complete(Downstream *downstream)
   if(LOG_ENABLED(INFO)) {
     DLOG(INFO, downstream) << "HTTP response completed";
   }
+  auto deflater = downstream->get_response_deflater();
+  if(deflater) {
+    auto body = downstream->get_response_body_buf();
+    auto buflen = evbuffer_get_length(body);
+    if(deflater->deflate(body, nullptr, 0, true) != 0) {
+      ULOG(FATAL, this) << "Compressing response body failed";
+      return -1;
+    }
+    downstream->add_response_sent_bodylen(evbuffer_get_length(body) - buflen);
+  }
+  auto cache = get_client_handler()->get_response_cache();
+  if(cache) {
+    cache->on_response_complete(downstream);
+  }
   nghttp2_session_resume_data(session_, downstream->get_stream_id());
   return 0;
 }
@@ -1114,4 +1298,186 @@ int Http2Upstream::resume_read(IOCtrlReason reason, Downstream *downstream)
   return send();
 }
 
+void Http2Upstream::set_push_enabled(bool f)
+{
+  push_enabled_ = f;
+}
+
+namespace {
+// Returns the path of the link |uri| if it refers to the same scheme
+// and authority as the request. Otherwise returns empty string.
+// Relative references which do not start with '/' are not
+// supported.
+std::string get_push_path(const std::string& uri, const std::string& scheme,
+                          const std::string& authority)
+{
+  std::string path;
+  if(util::startsWith(uri, "/")) {
+    if(util::startsWith(uri, "//")) {
+      return "";
+    }
+    path = uri;
+  } else {
+    auto prefix = scheme + "://" + authority;
+    if(!util::istartsWith(uri, prefix) || uri.size() == prefix.size() ||
+       uri[prefix.size()] != '/') {
+      return "";
+    }
+    path = uri.substr(prefix.size());
+  }
+  auto fragment = path.find('#');
+  if(fragment != std::string::npos) {
+    path.erase(fragment);
+  }
+  return path;
+}
+} // namespace
+
+namespace {
+// The request header fields copied to pushed request. They affect
+// the response which client would receive for the resource.
+const char *PUSH_REQUEST_HEADERS[] = {
+  "accept-encoding",
+  "accept-language",
+  "cookie",
+  "user-agent"
+};
+} // namespace
+
+int Http2Upstream::prepare_push_promise(Downstream *downstream)
+{
+  auto max_pushes = get_config()->http2_max_push_streams;
+  // Only the stream initiated by client can be associated with
+  // pushed stream.
+  if(!push_enabled_ || num_pushes_ >= max_pushes ||
+     get_config()->http2_proxy || get_config()->client_proxy ||
+     downstream->get_stream_id() % 2 == 0 ||
+     downstream->get_request_method() != "GET" ||
+     downstream->get_response_http_status() != 200) {
+    return 0;
+  }
+  auto& headers = downstream->get_response_headers();
+  if(!http2::get_header(headers, "link")) {
+    return 0;
+  }
+  // The response tailored to the user agent by cookie may refer to
+  // the resources which other users do not get.
+  if(http2::get_header(headers, "set-cookie")) {
+    return 0;
+  }
+  for(auto& kv : headers) {
+    if(kv.first == "vary" &&
+       (util::strifind(kv.second.c_str(), "cookie") ||
+        kv.second.find('*') != std::string::npos)) {
+      return 0;
+    }
+  }
+  auto& scheme = downstream->get_request_http2_scheme();
+  auto authority = downstream->get_request_http2_authority();
+  if(authority.empty()) {
+    authority = http2::value_to_str
+      (http2::get_header(downstream->get_request_headers(), "host"));
+  }
+  if(scheme.empty() || authority.empty()) {
+    return 0;
+  }
+  std::vector<std::string> paths;
+  for(auto& kv : headers) {
+    if(kv.first != "link") {
+      continue;
+    }
+    for(auto& uri : http2::parse_link_header(kv.second.c_str(),
+                                             kv.second.size())) {
+      auto path = get_push_path(uri, scheme, authority);
+      if(path.empty() || path == downstream->get_request_path() ||
+         std::find(std::begin(paths), std::end(paths), path) !=
+         std::end(paths)) {
+        continue;
+      }
+      if(num_pushes_ >= max_pushes) {
+        return 0;
+      }
+      paths.push_back(path);
+
+      auto promised = util::make_unique<Downstream>
+        (this, -1, downstream->get_priority());
+      for(auto name : PUSH_REQUEST_HEADERS) {
+        for(auto& hd : downstream->get_request_headers()) {
+          if(hd.first == name) {
+            promised->add_request_header(hd.first, hd.second);
+          }
+        }
+      }
+      promised->normalize_request_headers();
+      promised->set_request_method("GET");
+      promised->set_request_http2_scheme(scheme);
+      promised->set_request_http2_authority(authority);
+      promised->set_request_path(path);
+
+      auto nva = std::vector<nghttp2_nv>{
+        http2::make_nv_ll(":method", "GET"),
+        http2::make_nv_ls(":path", path),
+        http2::make_nv_ls(":scheme", scheme),
+        http2::make_nv_ls(":authority", authority)
+      };
+      if(LOG_ENABLED(INFO)) {
+        ULOG(INFO, this) << "Pushing " << path << " associated with stream_id="
+                         << downstream->get_stream_id();
+      }
+      int rv = nghttp2_submit_push_promise(session_, NGHTTP2_FLAG_END_HEADERS,
+                                           downstream->get_stream_id(),
+                                           nva.data(), nva.size(),
+                                           promised.get());
+      if(rv != 0) {
+        ULOG(FATAL, this) << "nghttp2_submit_push_promise() failed: "
+                          << nghttp2_strerror(rv);
+        return -1;
+      }
+      pending_pushes_.emplace(downstream->get_stream_id(), promised.release());
+      ++num_pushes_;
+    }
+  }
+  return 0;
+}
+
+int Http2Upstream::on_push_promise_sent(const nghttp2_frame *frame)
+{
+  auto promised_stream_id = frame->push_promise.promised_stream_id;
+  auto downstream = static_cast<Downstream*>
+    (nghttp2_session_get_stream_user_data(session_, promised_stream_id));
+  auto range = pending_pushes_.equal_range(frame->hd.stream_id);
+  auto i = range.first;
+  for(; i != range.second && (*i).second != downstream; ++i);
+  if(i == range.second) {
+    return 0;
+  }
+  pending_pushes_.erase(i);
+  downstream->set_stream_id(promised_stream_id);
+  add_downstream(downstream);
+  downstream->init_response_body_buf();
+  return start_request(this, downstream, true);
+}
+
+void Http2Upstream::on_push_promise_not_sent(const nghttp2_frame *frame)
+{
+  auto& push_promise = frame->push_promise;
+  std::string path;
+  for(size_t i = 0; i < push_promise.nvlen; ++i) {
+    auto& nv = push_promise.nva[i];
+    if(util::streq(":path", 5, nv.name, nv.namelen)) {
+      path.assign(nv.value, nv.value + nv.valuelen);
+      break;
+    }
+  }
+  auto range = pending_pushes_.equal_range(frame->hd.stream_id);
+  for(auto i = range.first; i != range.second; ++i) {
+    if((*i).second->get_request_path() == path) {
+      delete (*i).second;
+      pending_pushes_.erase(i);
+      --num_pushes_;
+      return;
+    }
+  }
+}
+
 } // namespace shrpx
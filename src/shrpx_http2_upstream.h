@@ -28,6 +28,7 @@
 #include "shrpx.h"
 
 #include <memory>
+#include <map>
 
 #include <nghttp2/nghttp2.h>
 
@@ -38,6 +39,7 @@ namespace shrpx {
 
 class ClientHandler;
 class HttpsUpstream;
+struct CacheEntry;
 
 class Http2Upstream : public Upstream {
 public:
@@ -46,6 +48,7 @@ public:
   virtual int on_read();
   virtual int on_write();
   virtual int on_event();
+  virtual int on_graceful_shutdown();
   int send();
   virtual ClientHandler* get_client_handler() const;
   virtual bufferevent_data_cb get_downstream_readcb();
@@ -63,6 +66,11 @@ public:
   int window_update(Downstream *downstream, int32_t window_size_increment);
   int terminate_session(nghttp2_error_code error_code);
   int error_reply(Downstream *downstream, unsigned int status_code);
+  // Sends the response stored in |entry| to |downstream|.
+  int send_cached_response(Downstream *downstream,
+                           const std::shared_ptr<CacheEntry>& entry);
+  // Sends the metrics of this process to |downstream|.
+  int send_stats_response(Downstream *downstream);
 
   virtual void pause_read(IOCtrlReason reason);
   virtual int resume_read(IOCtrlReason reason, Downstream *downstream);
@@ -79,13 +87,31 @@ public:
   int upgrade_upstream(HttpsUpstream *upstream);
   int start_settings_timer();
   void stop_settings_timer();
+  // Submits PUSH_PROMISE for the resources listed in Link header
+  // field with rel=preload in the response of |downstream|. This
+  // function must be called after normalize_response_headers().
+  // Returns 0 if it succeeds, or -1.
+  int prepare_push_promise(Downstream *downstream);
+  // Starts the request of the pushed stream promised by |frame|,
+  // which has just been sent. Returns 0 if it succeeds, or -1.
+  int on_push_promise_sent(const nghttp2_frame *frame);
+  // Discards the pushed request of |frame| which could not be sent.
+  void on_push_promise_not_sent(const nghttp2_frame *frame);
+  void set_push_enabled(bool f);
 private:
   DownstreamQueue downstream_queue_;
   std::unique_ptr<HttpsUpstream> pre_upstream_;
   ClientHandler *handler_;
   nghttp2_session *session_;
   event *settings_timerev_;
+  // The pushed requests whose PUSH_PROMISE is not sent yet, keyed by
+  // the associated stream ID. They have no stream ID until then.
+  std::multimap<int32_t, Downstream*> pending_pushes_;
+  // The number of pushed streams in flight, including pending ones
+  size_t num_pushes_;
   bool flow_control_;
+  // false if client disabled server push by SETTINGS_ENABLE_PUSH
+  bool push_enabled_;
 };
 
 } // namespace shrpx
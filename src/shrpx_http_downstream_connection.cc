@@ -30,6 +30,8 @@
 #include "shrpx_config.h"
 #include "shrpx_error.h"
 #include "shrpx_http.h"
+#include "shrpx_stats.h"
+#include "shrpx_timeout.h"
 #include "http2.h"
 #include "util.h"
 
@@ -41,12 +43,6 @@ namespace {
 const size_t OUTBUF_MAX_THRES = 64*1024;
 } // namespace
 
-// Workaround for the inability for Bufferevent to remove timeout from
-// bufferevent. Specify this long timeout instead of removing.
-namespace {
-timeval max_timeout = { 86400, 0 };
-} // namespace
-
 HttpDownstreamConnection::HttpDownstreamConnection
 (ClientHandler *client_handler)
   : DownstreamConnection(client_handler),
@@ -93,6 +89,7 @@ int HttpDownstreamConnection::attach_downstream(Downstream *downstream)
       bev_ = nullptr;
       return SHRPX_ERR_NETWORK;
     }
+    get_worker_stats()->backend_connects.add(1);
     if(LOG_ENABLED(INFO)) {
       DCLOG(INFO, this) << "Connecting to downstream server";
     }
@@ -113,9 +110,11 @@ int HttpDownstreamConnection::attach_downstream(Downstream *downstream)
                     upstream->get_downstream_eventcb(), this);
   // HTTP request/response model, we first issue request to downstream
   // server, so just enable write timeout here.
+  // Workaround for the inability for Bufferevent to remove timeout
+  // from bufferevent. Specify long timeout instead of removing.
   bufferevent_set_timeouts(bev_,
-                           &max_timeout,
-                           &get_config()->downstream_write_timeout);
+                           get_timeouts()->max,
+                           get_timeouts()->downstream_write);
   return 0;
 }
 
@@ -249,8 +248,8 @@ int HttpDownstreamConnection::push_request_headers()
   // downstream server is too slow to recv/send, the connection will
   // be dropped by read timeout.
   bufferevent_set_timeouts(bev_,
-                           &get_config()->downstream_read_timeout,
-                           &get_config()->downstream_write_timeout);
+                           get_timeouts()->downstream_read,
+                           get_timeouts()->downstream_write);
 
   return 0;
 }
@@ -347,8 +346,8 @@ void HttpDownstreamConnection::detach_downstream(Downstream *downstream)
   // On idle state, just enable read timeout. Normally idle downstream
   // connection will get EOF from the downstream server and closed.
   bufferevent_set_timeouts(bev_,
-                           &get_config()->downstream_idle_read_timeout,
-                           &get_config()->downstream_write_timeout);
+                           get_timeouts()->downstream_idle_read,
+                           get_timeouts()->downstream_write);
   client_handler_->pool_downstream_connection(this);
 }
 
@@ -501,41 +500,55 @@ http_parser_settings htp_hooks = {
 int HttpDownstreamConnection::on_read()
 {
   auto input = bufferevent_get_input(bev_);
-  size_t inputlen = evbuffer_get_length(input);
-  auto mem = evbuffer_pullup(input, -1);
-  if(downstream_->get_upgraded()) {
-    // For upgraded connection, just pass data to the upstream.
+  // Process the input chunk by chunk, without linearizing it.
+  evbuffer_iovec vec;
+  if(!downstream_->get_upgraded()) {
+    while(evbuffer_peek(input, -1, nullptr, &vec, 1) > 0) {
+      size_t nread = http_parser_execute(&response_htp_, &htp_hooks,
+                                         static_cast<const char*>
+                                         (vec.iov_base),
+                                         vec.iov_len);
+
+      if(evbuffer_drain(input, nread) != 0) {
+        DCLOG(FATAL, this) << "evbuffer_drain() failed";
+        return -1;
+      }
+      // The bytes following the upgrade response belong to the
+      // tunnel, even if the response ended at the chunk boundary.
+      if(nread < vec.iov_len ||
+         HTTP_PARSER_ERRNO(&response_htp_) != HPE_OK ||
+         response_htp_.upgrade || downstream_->get_upgraded()) {
+        break;
+      }
+    }
+    auto htperr = HTTP_PARSER_ERRNO(&response_htp_);
+    if(htperr != HPE_OK) {
+      if(LOG_ENABLED(INFO)) {
+        DCLOG(INFO, this) << "HTTP parser failure: "
+                          << "(" << http_errno_name(htperr) << ") "
+                          << http_errno_description(htperr);
+      }
+      return SHRPX_ERR_HTTP_PARSE;
+    }
+    if(!downstream_->get_upgraded()) {
+      return 0;
+    }
+  }
+  // For upgraded connection, just pass data to the upstream.
+  while(evbuffer_peek(input, -1, nullptr, &vec, 1) > 0) {
     int rv;
     rv = downstream_->get_upstream()->on_downstream_body
-      (downstream_, reinterpret_cast<const uint8_t*>(mem), inputlen);
+      (downstream_, static_cast<const uint8_t*>(vec.iov_base),
+       vec.iov_len);
     if(rv != 0) {
       return rv;
     }
-    if(evbuffer_drain(input, inputlen) != 0) {
+    if(evbuffer_drain(input, vec.iov_len) != 0) {
       DCLOG(FATAL, this) << "evbuffer_drain() failed";
       return -1;
     }
-    return 0;
-  }
-  size_t nread = http_parser_execute(&response_htp_, &htp_hooks,
-                                     reinterpret_cast<const char*>(mem),
-                                     inputlen);
-
-  if(evbuffer_drain(input, nread) != 0) {
-    DCLOG(FATAL, this) << "evbuffer_drain() failed";
-    return -1;
-  }
-  auto htperr = HTTP_PARSER_ERRNO(&response_htp_);
-  if(htperr == HPE_OK) {
-    return 0;
-  } else {
-    if(LOG_ENABLED(INFO)) {
-      DCLOG(INFO, this) << "HTTP parser failure: "
-                        << "(" << http_errno_name(htperr) << ") "
-                        << http_errno_description(htperr);
-    }
-    return SHRPX_ERR_HTTP_PARSE;
   }
+  return 0;
 }
 
 int HttpDownstreamConnection::on_write()
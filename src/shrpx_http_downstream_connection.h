@@ -63,6 +63,11 @@ public:
     return 0;
   }
 
+  virtual bufferevent* get_tunnel_bev()
+  {
+    return bev_;
+  }
+
   bufferevent* get_bev();
 private:
   bufferevent *bev_;
@@ -0,0 +1,165 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2013 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_http_downstream_connection_test.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <CUnit/CUnit.h>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+
+#include "shrpx_http_downstream_connection.h"
+#include "shrpx_config.h"
+#include "shrpx_client_handler.h"
+#include "shrpx_downstream.h"
+#include "shrpx_timeout.h"
+#include "shrpx_upstream.h"
+
+namespace shrpx {
+
+namespace {
+// Records the response passed from HttpDownstreamConnection.
+class RecordingUpstream : public Upstream {
+public:
+  RecordingUpstream(ClientHandler *handler)
+    : handler_(handler),
+      header_complete(0)
+  {}
+  virtual int on_read() { return 0; }
+  virtual int on_write() { return 0; }
+  virtual int on_event() { return 0; }
+  virtual int on_graceful_shutdown() { return 0; }
+  virtual bufferevent_data_cb get_downstream_readcb() { return nullptr; }
+  virtual bufferevent_data_cb get_downstream_writecb() { return nullptr; }
+  virtual bufferevent_event_cb get_downstream_eventcb() { return nullptr; }
+  virtual ClientHandler* get_client_handler() const { return handler_; }
+  virtual int on_downstream_header_complete(Downstream *downstream)
+  {
+    ++header_complete;
+    return 0;
+  }
+  virtual int on_downstream_body(Downstream *downstream,
+                                 const uint8_t *data, size_t len)
+  {
+    body.append(reinterpret_cast<const char*>(data), len);
+    return 0;
+  }
+  virtual int on_downstream_body_complete(Downstream *downstream)
+  {
+    return 0;
+  }
+  virtual void pause_read(IOCtrlReason reason) {}
+  virtual int resume_read(IOCtrlReason reason, Downstream *downstream)
+  {
+    return 0;
+  }
+  ClientHandler *handler_;
+  std::string body;
+  int header_complete;
+};
+} // namespace
+
+void test_shrpx_http_downstream_connection_upgrade_chunk_boundary(void)
+{
+  if(!get_config()) {
+    create_config();
+  }
+  auto evbase = event_base_new();
+  init_timeouts(evbase);
+  auto cfg = ev_token_bucket_cfg_new(EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     nullptr);
+  auto group = bufferevent_rate_limit_group_new(evbase, cfg);
+  int fds[2];
+  CU_ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  auto bev = bufferevent_socket_new(evbase, fds[0], 0);
+  auto handler = new ClientHandler(bev, group, fds[0], nullptr, "127.0.0.1");
+
+  // Backend which accepts the connection, but never talks.
+  auto lfd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_union addr = {};
+  addr.in.sin_family = AF_INET;
+  addr.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrlen = sizeof(addr.in);
+  CU_ASSERT(0 == bind(lfd, &addr.sa, addrlen));
+  CU_ASSERT(0 == listen(lfd, 1));
+  CU_ASSERT(0 == getsockname(lfd, &addr.sa, &addrlen));
+  auto saved_addr = get_config()->downstream_addr;
+  auto saved_addrlen = get_config()->downstream_addrlen;
+  mod_config()->downstream_addr = addr;
+  mod_config()->downstream_addrlen = addrlen;
+
+  RecordingUpstream upstream(handler);
+  {
+    Downstream downstream(&upstream, 0, 0);
+    downstream.set_request_method("GET");
+    downstream.add_request_header("Upgrade", "websocket");
+    downstream.add_request_header("Connection", "Upgrade");
+    auto dconn = new HttpDownstreamConnection(handler);
+    CU_ASSERT(0 == dconn->attach_downstream(&downstream));
+
+    // The upgrade response ends exactly at the end of the first
+    // chunk. The following chunks are tunneled data.
+    static const char resp[] =
+      "HTTP/1.1 101 Switching Protocols\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "\r\n";
+    static const char data1[] = "GET / HTTP/1.1\r\n";
+    static const char data2[] = "\r\n";
+    auto input = bufferevent_get_input(dconn->get_bev());
+    evbuffer_add_reference(input, resp, sizeof(resp) - 1,
+                           nullptr, nullptr);
+    evbuffer_add_reference(input, data1, sizeof(data1) - 1,
+                           nullptr, nullptr);
+    evbuffer_add_reference(input, data2, sizeof(data2) - 1,
+                           nullptr, nullptr);
+    CU_ASSERT(3 == evbuffer_peek(input, -1, nullptr, nullptr, 0));
+
+    CU_ASSERT(0 == dconn->on_read());
+    CU_ASSERT(downstream.get_upgraded());
+    CU_ASSERT(1 == upstream.header_complete);
+    CU_ASSERT("GET / HTTP/1.1\r\n\r\n" == upstream.body);
+    CU_ASSERT(0 == evbuffer_get_length(input));
+
+    downstream.set_response_http_status(0);
+  }
+
+  mod_config()->downstream_addr = saved_addr;
+  mod_config()->downstream_addrlen = saved_addrlen;
+  close(lfd);
+  delete handler;
+  close(fds[1]);
+  bufferevent_rate_limit_group_free(group);
+  ev_token_bucket_cfg_free(cfg);
+  event_base_free(evbase);
+}
+
+} // namespace shrpx
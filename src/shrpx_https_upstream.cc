@@ -36,6 +36,10 @@
 #include "shrpx_config.h"
 #include "shrpx_error.h"
 #include "shrpx_accesslog.h"
+#include "shrpx_cache.h"
+#include "shrpx_gzip.h"
+#include "shrpx_stats.h"
+#include "shrpx_splice_tunnel.h"
 #include "http2.h"
 #include "util.h"
 
@@ -59,6 +63,8 @@ HttpsUpstream::HttpsUpstream(ClientHandler *handler)
 
 HttpsUpstream::~HttpsUpstream()
 {
+  // Free the events of the tunnel before the connections are closed.
+  splice_tunnel_.reset();
   delete downstream_;
 }
 
@@ -67,6 +73,27 @@ void HttpsUpstream::reset_current_header_length()
   current_header_length_ = 0;
 }
 
+int HttpsUpstream::start_splice_tunnel(Downstream *downstream)
+{
+  if(!get_config()->tunnel_splice || handler_->get_ssl()) {
+    return -1;
+  }
+  if(splice_tunnel_) {
+    return 0;
+  }
+  auto dconn = downstream->get_downstream_connection();
+  if(!dconn || !dconn->get_tunnel_bev()) {
+    return -1;
+  }
+  auto tunnel = util::make_unique<SpliceTunnel>
+    (handler_, downstream, handler_->get_bev(), dconn->get_tunnel_bev());
+  if(tunnel->init() != 0) {
+    return -1;
+  }
+  splice_tunnel_ = std::move(tunnel);
+  return 0;
+}
+
 namespace {
 int htp_msg_begin(http_parser *htp)
 {
@@ -147,7 +174,9 @@ int htp_hdrs_completecb(http_parser *htp)
   downstream->set_request_major(htp->http_major);
   downstream->set_request_minor(htp->http_minor);
 
-  downstream->set_request_connection_close(!http_should_keep_alive(htp));
+  downstream->set_request_connection_close
+    (!http_should_keep_alive(htp) ||
+     upstream->get_client_handler()->get_graceful_shutdown());
 
   downstream->check_upgrade_request();
   if(LOG_ENABLED(INFO)) {
@@ -179,7 +208,35 @@ int htp_hdrs_completecb(http_parser *htp)
     }
   }
 
-  auto dconn = upstream->get_client_handler()->get_downstream_connection();
+  auto handler = upstream->get_client_handler();
+  if(stats_request(downstream, handler->get_ipaddr())) {
+    downstream->normalize_request_headers();
+    if(upstream->send_stats_response(downstream) != 0) {
+      return -1;
+    }
+    return 0;
+  }
+
+  auto cache = handler->get_response_cache();
+  if(cache) {
+    downstream->normalize_request_headers();
+    auto entry = cache->lookup(downstream, handler->get_upstream_scheme(),
+                               time(nullptr));
+    if(entry) {
+      if(upstream->send_cached_response(downstream, entry) != 0) {
+        return -1;
+      }
+      return 0;
+    }
+  }
+
+  DownstreamConnection *dconn = nullptr;
+  if(cache) {
+    dconn = cache->get_coalesced_connection(handler, downstream);
+  }
+  if(!dconn) {
+    dconn = handler->get_downstream_connection();
+  }
 
   if(downstream->get_expect_100_continue()) {
     static const char reply_100[] = "HTTP/1.1 100 Continue\r\n\r\n";
@@ -233,9 +290,13 @@ int htp_msg_completecb(http_parser *htp)
   }
   auto downstream = upstream->get_downstream();
   downstream->set_request_state(Downstream::MSG_COMPLETE);
-  rv = downstream->end_upload_data();
-  if(rv != 0) {
-    return -1;
+  // If the response was served from the cache, there is no
+  // downstream connection.
+  if(downstream->get_downstream_connection()) {
+    rv = downstream->end_upload_data();
+    if(rv != 0) {
+      return -1;
+    }
   }
   // Stop further processing to complete this request
   http_parser_pause(htp, 1);
@@ -263,104 +324,172 @@ int HttpsUpstream::on_read()
 {
   auto bev = handler_->get_bev();
   auto input = bufferevent_get_input(bev);
-  size_t inputlen = evbuffer_get_length(input);
-  auto mem = evbuffer_pullup(input, -1);
-
-  if(inputlen == 0) {
-    return 0;
-  }
-  auto downstream = get_downstream();
-  // downstream can be nullptr here, because it is initialized in the
-  // callback chain called by http_parser_execute()
-  if(downstream && downstream->get_upgraded()) {
-    int rv = downstream->push_upload_data_chunk
-      (reinterpret_cast<const uint8_t*>(mem), inputlen);
-    if(rv != 0) {
-      return -1;
-    }
-    if(evbuffer_drain(input, inputlen) != 0) {
-      ULOG(FATAL, this) << "evbuffer_drain() failed";
-      return -1;
+  // The input is processed chunk by chunk as it is stored in evbuffer.
+  // Linearizing the whole input with evbuffer_pullup() would move all
+  // buffered bytes on every read.
+  evbuffer_iovec vec;
+
+  // Pipelined requests whose responses are served without backend
+  // (e.g., from cache) are processed in this loop.
+  for(;;) {
+    if(evbuffer_get_length(input) == 0) {
+      return 0;
     }
-    if(downstream->get_output_buffer_full()) {
-      if(LOG_ENABLED(INFO)) {
-        ULOG(INFO, this) << "Downstream output buffer is full";
+    auto downstream = get_downstream();
+    // downstream can be nullptr here, because it is initialized in the
+    // callback chain called by http_parser_execute()
+    if(downstream && downstream->get_upgraded()) {
+      while(evbuffer_peek(input, -1, nullptr, &vec, 1) > 0) {
+        int rv = downstream->push_upload_data_chunk
+          (static_cast<const uint8_t*>(vec.iov_base), vec.iov_len);
+        if(rv != 0) {
+          return -1;
+        }
+        if(evbuffer_drain(input, vec.iov_len) != 0) {
+          ULOG(FATAL, this) << "evbuffer_drain() failed";
+          return -1;
+        }
       }
-      pause_read(SHRPX_NO_BUFFER);
+      if(downstream->get_output_buffer_full()) {
+        if(LOG_ENABLED(INFO)) {
+          ULOG(INFO, this) << "Downstream output buffer is full";
+        }
+        pause_read(SHRPX_NO_BUFFER);
+      }
+      return 0;
     }
-    return 0;
-  }
 
-  size_t nread = http_parser_execute(&htp_, &htp_hooks,
-                                     reinterpret_cast<const char*>(mem),
-                                     inputlen);
-  if(evbuffer_drain(input, nread) != 0) {
-    ULOG(FATAL, this) << "evbuffer_drain() failed";
-    return -1;
-  }
-  // Well, actually header length + some body bytes
-  current_header_length_ += nread;
-  // Get downstream again because it may be initialized in http parser
-  // execution
-  downstream = get_downstream();
-  auto handler = get_client_handler();
-  auto htperr = HTTP_PARSER_ERRNO(&htp_);
-  if(htperr == HPE_PAUSED) {
-    if(downstream->get_request_state() == Downstream::CONNECT_FAIL) {
-      handler->set_should_close_after_write(true);
-      // Following paues_read is needed to avoid reading next data.
-      pause_read(SHRPX_MSG_BLOCK);
-      if(error_reply(503) != 0) {
+    while(evbuffer_peek(input, -1, nullptr, &vec, 1) > 0) {
+      size_t nread = http_parser_execute(&htp_, &htp_hooks,
+                                         static_cast<const char*>(vec.iov_base),
+                                         vec.iov_len);
+      if(evbuffer_drain(input, nread) != 0) {
+        ULOG(FATAL, this) << "evbuffer_drain() failed";
         return -1;
       }
-      // Downstream gets deleted after response body is read.
-    } else {
-      assert(downstream->get_request_state() == Downstream::MSG_COMPLETE);
-      if(downstream->get_downstream_connection() == 0) {
-        // Error response has already be sent
-        assert(downstream->get_response_state() == Downstream::MSG_COMPLETE);
-        delete_downstream();
+      // Well, actually header length + some body bytes
+      current_header_length_ += nread;
+      if(nread < vec.iov_len || HTTP_PARSER_ERRNO(&htp_) != HPE_OK) {
+        break;
+      }
+    }
+    // Get downstream again because it may be initialized in http parser
+    // execution
+    downstream = get_downstream();
+    auto handler = get_client_handler();
+    auto htperr = HTTP_PARSER_ERRNO(&htp_);
+    if(htperr == HPE_PAUSED) {
+      if(downstream->get_request_state() == Downstream::CONNECT_FAIL) {
+        handler->set_should_close_after_write(true);
+        // Following paues_read is needed to avoid reading next data.
+        pause_read(SHRPX_MSG_BLOCK);
+        if(error_reply(503) != 0) {
+          return -1;
+        }
+        // Downstream gets deleted after response body is read.
       } else {
-        if(handler->get_http2_upgrade_allowed() &&
-           downstream->http2_upgrade_request()) {
-          if(handler->perform_http2_upgrade(this) != 0) {
-            return -1;
+        assert(downstream->get_request_state() == Downstream::MSG_COMPLETE);
+        if(downstream->get_downstream_connection() == 0) {
+          // Error response or cached response has already be sent
+          assert(downstream->get_response_state() == Downstream::MSG_COMPLETE);
+          delete_downstream();
+          if(!handler->get_should_close_after_write()) {
+            // Process next pipelined HTTP request
+            http_parser_pause(&htp_, 0);
+            continue;
+          }
+        } else {
+          if(handler->get_http2_upgrade_allowed() &&
+             downstream->http2_upgrade_request()) {
+            if(handler->perform_http2_upgrade(this) != 0) {
+              return -1;
+            }
+            return 0;
           }
-          return 0;
+          pause_read(SHRPX_MSG_BLOCK);
         }
-        pause_read(SHRPX_MSG_BLOCK);
       }
-    }
-  } else if(htperr == HPE_OK) {
-    // downstream can be NULL here.
-    if(downstream) {
-      if(downstream->get_output_buffer_full()) {
-        if(LOG_ENABLED(INFO)) {
-          ULOG(INFO, this) << "Downstream output buffer is full";
+    } else if(htperr == HPE_OK) {
+      // downstream can be NULL here.
+      if(downstream) {
+        if(downstream->get_output_buffer_full()) {
+          if(LOG_ENABLED(INFO)) {
+            ULOG(INFO, this) << "Downstream output buffer is full";
+          }
+          pause_read(SHRPX_NO_BUFFER);
         }
-        pause_read(SHRPX_NO_BUFFER);
+      }
+    } else {
+      if(LOG_ENABLED(INFO)) {
+        ULOG(INFO, this) << "HTTP parse failure: "
+                         << "(" << http_errno_name(htperr) << ") "
+                         << http_errno_description(htperr);
+      }
+      handler->set_should_close_after_write(true);
+      pause_read(SHRPX_MSG_BLOCK);
+      if(error_reply(400) != 0) {
+        return -1;
       }
     }
-  } else {
-    if(LOG_ENABLED(INFO)) {
-      ULOG(INFO, this) << "HTTP parse failure: "
-                       << "(" << http_errno_name(htperr) << ") "
-                       << http_errno_description(htperr);
-    }
-    handler->set_should_close_after_write(true);
-    pause_read(SHRPX_MSG_BLOCK);
-    if(error_reply(400) != 0) {
+    return 0;
+  }
+}
+
+namespace {
+// Compresses |data| of length |len| using |deflater| and writes the
+// output to |output| as a chunk. If |finish| is true, the compressed
+// stream is terminated. Otherwise, the compressed data are flushed
+// only if |output| has been drained, since flushing on every chunk
+// degrades the compression ratio; HttpsUpstream::on_write() flushes
+// the rest. Returns the number of compressed bytes, or -1.
+ssize_t add_deflated_chunk(evbuffer *output, ResponseDeflater *deflater,
+                           const uint8_t *data, size_t len, bool finish)
+{
+  auto buf = evbuffer_new();
+  if(!buf) {
+    return -1;
+  }
+  if(deflater->deflate(buf, data, len, finish) != 0 ||
+     (!finish && evbuffer_get_length(output) == 0 &&
+      deflater->flush(buf) != 0)) {
+    evbuffer_free(buf);
+    return -1;
+  }
+  auto nwrite = evbuffer_get_length(buf);
+  if(nwrite > 0) {
+    char chunk_size_hex[16];
+    auto rv = snprintf(chunk_size_hex, sizeof(chunk_size_hex), "%X\r\n",
+                       static_cast<unsigned int>(nwrite));
+    if(evbuffer_add(output, chunk_size_hex, rv) != 0 ||
+       evbuffer_add_buffer(output, buf) != 0 ||
+       evbuffer_add(output, "\r\n", 2) != 0) {
+      evbuffer_free(buf);
       return -1;
     }
   }
-  return 0;
+  evbuffer_free(buf);
+  return nwrite;
 }
+} // namespace
 
 int HttpsUpstream::on_write()
 {
   int rv = 0;
   auto downstream = get_downstream();
   if(downstream) {
+    // Flush the compressed data held back while the output buffer
+    // was not empty.
+    auto deflater = downstream->get_response_deflater();
+    if(deflater) {
+      auto nwrite = add_deflated_chunk
+        (bufferevent_get_output(handler_->get_bev()), deflater,
+         nullptr, 0, false);
+      if(nwrite == -1) {
+        ULOG(FATAL, this) << "Compressing response body failed";
+        return -1;
+      }
+      downstream->add_response_sent_bodylen(nwrite);
+    }
     rv = downstream->resume_read(SHRPX_NO_BUFFER);
   }
   return rv;
@@ -371,6 +500,30 @@ int HttpsUpstream::on_event()
   return 0;
 }
 
+int HttpsUpstream::on_graceful_shutdown()
+{
+  auto downstream = get_downstream();
+  if(!downstream ||
+     (downstream->get_request_state() == Downstream::MSG_COMPLETE &&
+      downstream->get_response_state() == Downstream::MSG_COMPLETE)) {
+    // No request in progress
+    if(handler_->get_outbuf_length() == 0) {
+      return -1;
+    }
+    handler_->set_should_close_after_write(true);
+    return 0;
+  }
+  if(downstream->get_upgraded()) {
+    // We cannot interrupt tunneled connection; it is closed when the
+    // graceful shutdown deadline is reached.
+    return 0;
+  }
+  // The response carries "Connection: close" if its header is not
+  // sent yet, and the connection is closed after the response.
+  downstream->set_request_connection_close(true);
+  return 0;
+}
+
 ClientHandler* HttpsUpstream::get_client_handler() const
 {
   return handler_;
@@ -404,6 +557,14 @@ void https_downstream_readcb(bufferevent *bev, void *ptr)
   if(downstream->get_response_state() == Downstream::MSG_RESET) {
     delete upstream->get_client_handler();
   } else if(rv == 0) {
+    // For HTTP Upgrade, the parser has already completed the 101
+    // response message.
+    if(downstream->get_upgraded() &&
+       (downstream->get_response_state() == Downstream::HEADER_COMPLETE ||
+        downstream->get_response_state() == Downstream::MSG_COMPLETE) &&
+       upstream->start_splice_tunnel(downstream) == 0) {
+      return;
+    }
     if(downstream->get_response_state() == Downstream::MSG_COMPLETE) {
       if(downstream->get_response_connection_close()) {
         // Connection close
@@ -605,6 +766,54 @@ int HttpsUpstream::error_reply(unsigned int status_code)
   return 0;
 }
 
+int HttpsUpstream::send_cached_response
+(Downstream *downstream, const std::shared_ptr<CacheEntry>& entry)
+{
+  if(LOG_ENABLED(INFO)) {
+    DLOG(INFO, downstream) << "Serving response from cache: " << entry->key;
+  }
+  auto has_body = prepare_cached_response(downstream, entry.get(),
+                                          time(nullptr));
+  if(on_downstream_header_complete(downstream) != 0) {
+    return -1;
+  }
+  auto deflater = downstream->get_response_deflater();
+  if(has_body && deflater) {
+    auto nwrite = add_deflated_chunk
+      (bufferevent_get_output(handler_->get_bev()), deflater,
+       reinterpret_cast<const uint8_t*>(entry->body.c_str()),
+       entry->body.size(), false);
+    if(nwrite == -1) {
+      ULOG(FATAL, this) << "Compressing response body failed";
+      return -1;
+    }
+    downstream->add_response_sent_bodylen(nwrite);
+  } else if(has_body) {
+    if(add_cached_body(bufferevent_get_output(handler_->get_bev()),
+                       entry) != 0) {
+      ULOG(FATAL, this) << "evbuffer_add_reference() failed";
+      return -1;
+    }
+    downstream->add_response_sent_bodylen(entry->body.size());
+  }
+  downstream->set_response_state(Downstream::MSG_COMPLETE);
+  return on_downstream_body_complete(downstream);
+}
+
+int HttpsUpstream::send_stats_response(Downstream *downstream)
+{
+  auto body = format_stats();
+  prepare_stats_response(downstream, body);
+  if(on_downstream_header_complete(downstream) != 0 ||
+     on_downstream_body(downstream,
+                        reinterpret_cast<const uint8_t*>(body.c_str()),
+                        body.size()) != 0) {
+    return -1;
+  }
+  downstream->set_response_state(Downstream::MSG_COMPLETE);
+  return on_downstream_body_complete(downstream);
+}
+
 bufferevent_data_cb HttpsUpstream::get_downstream_readcb()
 {
   return https_downstream_readcb;
@@ -661,6 +870,18 @@ int HttpsUpstream::on_downstream_header_complete(Downstream *downstream)
     downstream->rewrite_norm_location_response_header
       (get_client_handler()->get_upstream_scheme(), get_config()->port);
   }
+  auto cache = get_client_handler()->get_response_cache();
+  if(cache) {
+    cache->on_response_header(downstream, time(nullptr));
+  }
+  if(response_compressible(downstream)) {
+    downstream->start_response_compression();
+    if(!downstream->get_chunked_response()) {
+      // The length of compressed body is not known in advance.
+      downstream->add_response_header("transfer-encoding", "chunked");
+      downstream->normalize_response_headers();
+    }
+  }
   auto end_headers = std::end(downstream->get_response_headers());
   http2::build_http1_headers_from_norm_headers
     (hdrs, downstream->get_response_headers());
@@ -727,7 +948,21 @@ int HttpsUpstream::on_downstream_body(Downstream *downstream,
   if(len == 0) {
     return 0;
   }
+  auto cache = handler_->get_response_cache();
+  if(cache) {
+    cache->on_response_body(downstream, data, len);
+  }
   auto output = bufferevent_get_output(handler_->get_bev());
+  auto deflater = downstream->get_response_deflater();
+  if(deflater) {
+    auto nwrite = add_deflated_chunk(output, deflater, data, len, false);
+    if(nwrite == -1) {
+      ULOG(FATAL, this) << "Compressing response body failed";
+      return -1;
+    }
+    downstream->add_response_sent_bodylen(nwrite);
+    return 0;
+  }
   if(downstream->get_chunked_response()) {
     char chunk_size_hex[16];
     rv = snprintf(chunk_size_hex, sizeof(chunk_size_hex), "%X\r\n",
@@ -741,6 +976,7 @@ int HttpsUpstream::on_downstream_body(Downstream *downstream,
     ULOG(FATAL, this) << "evbuffer_add() failed";
     return -1;
   }
+  downstream->add_response_sent_bodylen(len);
   if(downstream->get_chunked_response()) {
     if(evbuffer_add(output, "\r\n", 2) != 0) {
       ULOG(FATAL, this) << "evbuffer_add() failed";
@@ -754,6 +990,15 @@ int HttpsUpstream::on_downstream_body_complete(Downstream *downstream)
 {
   if(downstream->get_chunked_response()) {
     auto output = bufferevent_get_output(handler_->get_bev());
+    auto deflater = downstream->get_response_deflater();
+    if(deflater) {
+      auto nwrite = add_deflated_chunk(output, deflater, nullptr, 0, true);
+      if(nwrite == -1) {
+        ULOG(FATAL, this) << "Compressing response body failed";
+        return -1;
+      }
+      downstream->add_response_sent_bodylen(nwrite);
+    }
     if(evbuffer_add(output, "0\r\n\r\n", 5) != 0) {
       ULOG(FATAL, this) << "evbuffer_add() failed";
       return -1;
@@ -762,6 +1007,10 @@ int HttpsUpstream::on_downstream_body_complete(Downstream *downstream)
   if(LOG_ENABLED(INFO)) {
     DLOG(INFO, downstream) << "HTTP response completed";
   }
+  auto cache = handler_->get_response_cache();
+  if(cache) {
+    cache->on_response_complete(downstream);
+  }
   if(downstream->get_request_connection_close() ||
      downstream->get_response_connection_close()) {
     auto handler = get_client_handler();
@@ -29,6 +29,8 @@
 
 #include <stdint.h>
 
+#include <memory>
+
 #include "http-parser/http_parser.h"
 
 #include "shrpx_upstream.h"
@@ -36,6 +38,8 @@
 namespace shrpx {
 
 class ClientHandler;
+class SpliceTunnel;
+struct CacheEntry;
 
 class HttpsUpstream : public Upstream {
 public:
@@ -44,6 +48,7 @@ public:
   virtual int on_read();
   virtual int on_write();
   virtual int on_event();
+  virtual int on_graceful_shutdown();
   //int send();
   virtual ClientHandler* get_client_handler() const;
   virtual bufferevent_data_cb get_downstream_readcb();
@@ -54,6 +59,11 @@ public:
   Downstream* get_downstream() const;
   Downstream* pop_downstream();
   int error_reply(unsigned int status_code);
+  // Sends the response stored in |entry| to |downstream|.
+  int send_cached_response(Downstream *downstream,
+                           const std::shared_ptr<CacheEntry>& entry);
+  // Sends the metrics of this process to |downstream|.
+  int send_stats_response(Downstream *downstream);
 
   virtual void pause_read(IOCtrlReason reason);
   virtual int resume_read(IOCtrlReason reason, Downstream *downstream);
@@ -64,12 +74,18 @@ public:
   virtual int on_downstream_body_complete(Downstream *downstream);
 
   void reset_current_header_length();
+  // Hands over established tunnel of |downstream| to SpliceTunnel if
+  // --tunnel-splice is enabled and both connections are plain TCP.
+  // This function returns 0 if the tunnel is started, or -1 if the
+  // connection should be handled as usual.
+  int start_splice_tunnel(Downstream *downstream);
 private:
   ClientHandler *handler_;
   http_parser htp_;
   size_t current_header_length_;
   Downstream *downstream_;
   IOControl ioctrl_;
+  std::unique_ptr<SpliceTunnel> splice_tunnel_;
 };
 
 } // namespace shrpx
@@ -36,7 +36,9 @@ namespace shrpx {
 
 enum IOCtrlReason {
   SHRPX_NO_BUFFER = 1 << 0,
-  SHRPX_MSG_BLOCK = 1 << 1
+  SHRPX_MSG_BLOCK = 1 << 1,
+  // The coalesced requests cannot take more response body
+  SHRPX_FOLLOWER_BLOCK = 1 << 2
 };
 
 class IOControl {
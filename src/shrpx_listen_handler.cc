@@ -38,6 +38,7 @@
 #include "shrpx_worker.h"
 #include "shrpx_config.h"
 #include "shrpx_http2_session.h"
+#include "shrpx_cache.h"
 
 namespace shrpx {
 
@@ -48,14 +49,19 @@ ListenHandler::ListenHandler(event_base *evbase, SSL_CTX *sv_ssl_ctx,
     cl_ssl_ctx_(cl_ssl_ctx),
     workers_(nullptr),
     http2session_(nullptr),
+    response_cache_(nullptr),
     rate_limit_group_(bufferevent_rate_limit_group_new
                       (evbase, get_config()->worker_rate_limit_cfg)),
+    evlistener4_(nullptr),
+    evlistener6_(nullptr),
     num_worker_(0),
     worker_round_robin_cnt_(0)
 {}
 
 ListenHandler::~ListenHandler()
 {
+  close_evlistener();
+  join_worker();
   bufferevent_rate_limit_group_free(rate_limit_group_);
 }
 
@@ -76,8 +82,7 @@ void ListenHandler::create_worker_thread(size_t num)
     info->sv_ssl_ctx = sv_ssl_ctx_;
     info->cl_ssl_ctx = cl_ssl_ctx_;
     try {
-      auto thread = std::thread{start_threaded_worker, info};
-      thread.detach();
+      threads_.emplace_back(start_threaded_worker, info);
     } catch(const std::system_error& error) {
       LLOG(ERROR, this) << "Could not start thread: code=" << error.code()
                         << " msg=" << error.what();
@@ -90,9 +95,10 @@ void ListenHandler::create_worker_thread(size_t num)
                                       BEV_OPT_DEFER_CALLBACKS);
     if(!bev) {
       LLOG(ERROR, this) << "bufferevent_socket_new() failed";
-      for(size_t j = 0; j < 2; ++j) {
-        close(info->sv[j]);
-      }
+      // The worker exits when it sees EOF.
+      close(info->sv[0]);
+      threads_.back().join();
+      threads_.pop_back();
       continue;
     }
     info->bev = bev;
@@ -117,12 +123,14 @@ int ListenHandler::accept_connection(evutil_socket_t fd,
       return 0;
     }
     client->set_http2_session(http2session_);
+    client->set_response_cache(response_cache_);
     return 0;
   }
   size_t idx = worker_round_robin_cnt_ % num_worker_;
   ++worker_round_robin_cnt_;
   WorkerEvent wev;
   memset(&wev, 0, sizeof(wev));
+  wev.type = NEW_CONNECTION;
   wev.client_fd = fd;
   memcpy(&wev.client_addr, addr, addrlen);
   wev.client_addrlen = addrlen;
@@ -147,4 +155,72 @@ int ListenHandler::create_http2_session()
   return rv;
 }
 
+void ListenHandler::create_response_cache()
+{
+  response_cache_ = new ResponseCache(get_config()->cache_size,
+                                      get_config()->cache_max_object_size);
+}
+
+void ListenHandler::set_evlistener4(evconnlistener *evlistener4)
+{
+  evlistener4_ = evlistener4;
+}
+
+evconnlistener* ListenHandler::get_evlistener4() const
+{
+  return evlistener4_;
+}
+
+void ListenHandler::set_evlistener6(evconnlistener *evlistener6)
+{
+  evlistener6_ = evlistener6;
+}
+
+evconnlistener* ListenHandler::get_evlistener6() const
+{
+  return evlistener6_;
+}
+
+void ListenHandler::close_evlistener()
+{
+  if(evlistener4_) {
+    evconnlistener_free(evlistener4_);
+    evlistener4_ = nullptr;
+  }
+  if(evlistener6_) {
+    evconnlistener_free(evlistener6_);
+    evlistener6_ = nullptr;
+  }
+}
+
+void ListenHandler::graceful_shutdown_worker()
+{
+  if(num_worker_ == 0) {
+    graceful_shutdown_client_handlers();
+    return;
+  }
+  WorkerEvent wev;
+  memset(&wev, 0, sizeof(wev));
+  wev.type = GRACEFUL_SHUTDOWN;
+  for(size_t i = 0; i < num_worker_; ++i) {
+    auto output = bufferevent_get_output(workers_[i].bev);
+    if(evbuffer_add(output, &wev, sizeof(wev)) != 0) {
+      LLOG(FATAL, this) << "evbuffer_add() failed";
+    }
+  }
+}
+
+void ListenHandler::join_worker()
+{
+  for(size_t i = 0; i < num_worker_; ++i) {
+    bufferevent_free(workers_[i].bev);
+    close(workers_[i].sv[0]);
+  }
+  for(auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+  num_worker_ = 0;
+}
+
 } // namespace shrpx
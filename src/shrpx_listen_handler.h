@@ -30,10 +30,14 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include <vector>
+#include <thread>
+
 #include <openssl/ssl.h>
 
 #include <event.h>
 #include <event2/bufferevent.h>
+#include <event2/listener.h>
 
 namespace shrpx {
 
@@ -45,6 +49,7 @@ struct WorkerInfo {
 };
 
 class Http2Session;
+class ResponseCache;
 
 class ListenHandler {
 public:
@@ -54,6 +59,20 @@ public:
   void create_worker_thread(size_t num);
   event_base* get_evbase() const;
   int create_http2_session();
+  void create_response_cache();
+  void set_evlistener4(evconnlistener *evlistener4);
+  evconnlistener* get_evlistener4() const;
+  void set_evlistener6(evconnlistener *evlistener6);
+  evconnlistener* get_evlistener6() const;
+  // Closes listening sockets. This process does not accept new
+  // connection after this call.
+  void close_evlistener();
+  // Starts graceful shutdown of client connections in all worker
+  // threads.
+  void graceful_shutdown_worker();
+  // Closes the channels to worker threads, which makes them exit
+  // their event loops, and waits for them to finish.
+  void join_worker();
 private:
   event_base *evbase_;
   // The frontend server SSL_CTX
@@ -61,10 +80,16 @@ private:
   // The backend server SSL_CTX
   SSL_CTX *cl_ssl_ctx_;
   WorkerInfo *workers_;
+  std::vector<std::thread> threads_;
   // Shared backend HTTP2 session. NULL if multi-threaded. In
   // multi-threaded case, see shrpx_worker.cc.
   Http2Session *http2session_;
+  // Response cache used in single-threaded case. NULL if
+  // multi-threaded or caching is disabled.
+  ResponseCache *response_cache_;
   bufferevent_rate_limit_group *rate_limit_group_;
+  evconnlistener *evlistener4_;
+  evconnlistener *evlistener6_;
   size_t num_worker_;
   unsigned int worker_round_robin_cnt_;
 };
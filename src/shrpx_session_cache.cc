@@ -0,0 +1,395 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_session_cache.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "shrpx_log.h"
+
+namespace shrpx {
+
+namespace {
+const uint32_t SESSION_CACHE_MAGIC = 0x6e676873;
+const uint32_t SESSION_CACHE_VERSION = 2;
+} // namespace
+
+// The layout of the cache memory is the header, followed by
+// SessionCache::NUM_SHARDS shards. Each shard consists of
+// SessionCacheShard, the hash table buckets, the array of
+// SessionCacheSlot, and the array of session data, so that looking
+// up slots does not touch session data. All structures must be
+// usable from the multiple processes; they contain no pointers. The
+// hash table chains the slots by index plus 1, and 0 terminates the
+// chain.
+struct SessionCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t slots_per_shard;
+};
+
+struct SessionCacheShard {
+  pthread_mutex_t mutex;
+  // Incremented on each access, and used for LRU eviction
+  uint64_t clock;
+};
+
+struct SessionCacheSlot {
+  int64_t expiry;
+  uint64_t last_used;
+  // The hash of id
+  uint32_t hash;
+  // The next slot in the same bucket
+  uint32_t next;
+  uint16_t datalen;
+  // 0 if this slot is empty.
+  uint8_t idlen;
+  uint8_t id[SessionCache::MAX_ID_LENGTH];
+};
+
+namespace {
+size_t align(size_t n)
+{
+  return (n + 63) & ~static_cast<size_t>(63);
+}
+} // namespace
+
+namespace {
+size_t compute_num_buckets(size_t slots)
+{
+  size_t n = 1;
+  while(n < slots) {
+    n <<= 1;
+  }
+  return n;
+}
+} // namespace
+
+SessionCache::SessionCache(size_t size)
+  : mem_(nullptr),
+    memlen_(0),
+    slots_per_shard_((size + NUM_SHARDS - 1) / NUM_SHARDS),
+    buckets_per_shard_(compute_num_buckets(slots_per_shard_)),
+    shard_index_size_(align(sizeof(SessionCacheShard) +
+                            sizeof(uint32_t) * buckets_per_shard_ +
+                            sizeof(SessionCacheSlot) * slots_per_shard_)),
+    shard_size_(shard_index_size_ + MAX_SESSION_LENGTH * slots_per_shard_)
+{}
+
+SessionCache::~SessionCache()
+{
+  if(mem_) {
+    munmap(mem_, memlen_);
+  }
+}
+
+int SessionCache::init(const char *path)
+{
+  memlen_ = align(sizeof(SessionCacheHeader)) + shard_size_ * NUM_SHARDS;
+  if(!path) {
+    auto mem = mmap(nullptr, memlen_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED) {
+      LOG(ERROR) << "mmap() failed: " << strerror(errno);
+      return -1;
+    }
+    mem_ = static_cast<SessionCacheHeader*>(mem);
+    return init_memory(false);
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if(fd == -1) {
+    LOG(ERROR) << "Could not open session cache file " << path << ": "
+               << strerror(errno);
+    return -1;
+  }
+  // Serialize initialization among processes
+  if(flock(fd, LOCK_EX) == -1) {
+    LOG(ERROR) << "flock() failed: " << strerror(errno);
+    close(fd);
+    return -1;
+  }
+  struct stat st;
+  if(fstat(fd, &st) == -1) {
+    LOG(ERROR) << "fstat() failed: " << strerror(errno);
+    close(fd);
+    return -1;
+  }
+  // The file which is in use by another process is never resized nor
+  // reinitialized, since it would break its mapping and the mutexes
+  // held in it.  Only the empty file, which no process has
+  // initialized yet, is set up here.
+  bool created = st.st_size == 0;
+  if(!created && static_cast<size_t>(st.st_size) != memlen_) {
+    LOG(ERROR) << "Session cache file " << path << " has different size: "
+               << st.st_size << " bytes, expected " << memlen_
+               << " bytes. Remove it or use the same "
+               << "--tls-session-cache-size";
+    close(fd);
+    return -1;
+  }
+  if(created && ftruncate(fd, memlen_) == -1) {
+    LOG(ERROR) << "ftruncate() failed: " << strerror(errno);
+    close(fd);
+    return -1;
+  }
+  auto mem = mmap(nullptr, memlen_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+  if(mem == MAP_FAILED) {
+    LOG(ERROR) << "mmap() failed: " << strerror(errno);
+    close(fd);
+    return -1;
+  }
+  mem_ = static_cast<SessionCacheHeader*>(mem);
+  int rv = 0;
+  if(created) {
+    if(LOG_ENABLED(INFO)) {
+      LOG(INFO) << "Initializing session cache file " << path;
+    }
+    rv = init_memory(true);
+  } else if(mem_->magic != SESSION_CACHE_MAGIC ||
+            mem_->version != SESSION_CACHE_VERSION ||
+            mem_->slots_per_shard != slots_per_shard_) {
+    LOG(ERROR) << "Session cache file " << path
+               << " is corrupted or has incompatible layout. Remove it";
+    rv = -1;
+  }
+  // The mapping keeps the open file description, so closing fd does
+  // not release the lock.
+  flock(fd, LOCK_UN);
+  close(fd);
+  return rv;
+}
+
+int SessionCache::init_memory(bool shared)
+{
+  pthread_mutexattr_t attr;
+  if(pthread_mutexattr_init(&attr) != 0) {
+    return -1;
+  }
+  if(shared &&
+     (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+      pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0)) {
+    LOG(ERROR) << "Process shared mutex is not available";
+    pthread_mutexattr_destroy(&attr);
+    return -1;
+  }
+  mem_->magic = 0;
+  for(size_t i = 0; i < NUM_SHARDS; ++i) {
+    auto shard = get_shard(i);
+    memset(shard, 0, shard_index_size_);
+    if(pthread_mutex_init(&shard->mutex, &attr) != 0) {
+      pthread_mutexattr_destroy(&attr);
+      return -1;
+    }
+  }
+  pthread_mutexattr_destroy(&attr);
+  mem_->version = SESSION_CACHE_VERSION;
+  mem_->slots_per_shard = slots_per_shard_;
+  mem_->magic = SESSION_CACHE_MAGIC;
+  return 0;
+}
+
+SessionCacheShard* SessionCache::get_shard(size_t i) const
+{
+  return reinterpret_cast<SessionCacheShard*>
+    (reinterpret_cast<uint8_t*>(mem_) + align(sizeof(SessionCacheHeader)) +
+     shard_size_ * i);
+}
+
+uint32_t* SessionCache::get_bucket(SessionCacheShard *shard,
+                                   uint32_t h) const
+{
+  // The lower bits of hash select the shard.
+  return reinterpret_cast<uint32_t*>(shard + 1) +
+    ((h / NUM_SHARDS) & (buckets_per_shard_ - 1));
+}
+
+SessionCacheSlot* SessionCache::get_slot(SessionCacheShard *shard,
+                                         size_t i) const
+{
+  return reinterpret_cast<SessionCacheSlot*>
+    (reinterpret_cast<uint32_t*>(shard + 1) + buckets_per_shard_) + i;
+}
+
+uint8_t* SessionCache::get_data(SessionCacheShard *shard,
+                                SessionCacheSlot *slot) const
+{
+  auto i = slot - get_slot(shard, 0);
+  return reinterpret_cast<uint8_t*>(shard) + shard_index_size_ +
+    MAX_SESSION_LENGTH * i;
+}
+
+void SessionCache::lock(SessionCacheShard *shard)
+{
+  if(pthread_mutex_lock(&shard->mutex) == EOWNERDEAD) {
+    // The process died while updating this shard. The slots may be
+    // inconsistent.
+    LOG(WARNING) << "Session cache shard was left locked; clearing it";
+    memset(shard + 1, 0, shard_index_size_ - sizeof(SessionCacheShard));
+    pthread_mutex_consistent(&shard->mutex);
+  }
+}
+
+void SessionCache::unlock(SessionCacheShard *shard)
+{
+  pthread_mutex_unlock(&shard->mutex);
+}
+
+namespace {
+// FNV-1a. The hash must not differ among processes sharing the
+// cache.
+uint32_t hash_id(const uint8_t *id, size_t idlen)
+{
+  uint32_t h = 2166136261u;
+  for(size_t i = 0; i < idlen; ++i) {
+    h ^= id[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+} // namespace
+
+SessionCacheSlot* SessionCache::find(SessionCacheShard *shard, uint32_t h,
+                                     const uint8_t *id, size_t idlen) const
+{
+  for(auto i = *get_bucket(shard, h); i != 0;) {
+    auto slot = get_slot(shard, i - 1);
+    if(slot->hash == h && slot->idlen == idlen &&
+       memcmp(slot->id, id, idlen) == 0) {
+      return slot;
+    }
+    i = slot->next;
+  }
+  return nullptr;
+}
+
+void SessionCache::link(SessionCacheShard *shard, SessionCacheSlot *slot)
+{
+  auto bucket = get_bucket(shard, slot->hash);
+  slot->next = *bucket;
+  *bucket = slot - get_slot(shard, 0) + 1;
+}
+
+void SessionCache::unlink(SessionCacheShard *shard, SessionCacheSlot *slot)
+{
+  uint32_t idx = slot - get_slot(shard, 0) + 1;
+  for(auto p = get_bucket(shard, slot->hash); *p != 0;
+      p = &get_slot(shard, *p - 1)->next) {
+    if(*p == idx) {
+      *p = slot->next;
+      break;
+    }
+  }
+  slot->next = 0;
+  slot->idlen = 0;
+}
+
+int SessionCache::store(const uint8_t *id, size_t idlen,
+                        const uint8_t *data, size_t datalen, time_t expiry)
+{
+  if(idlen == 0 || idlen > MAX_ID_LENGTH || datalen > MAX_SESSION_LENGTH ||
+     slots_per_shard_ == 0) {
+    return -1;
+  }
+  auto h = hash_id(id, idlen);
+  auto shard = get_shard(h % NUM_SHARDS);
+  lock(shard);
+  auto slot = find(shard, h, id, idlen);
+  if(!slot) {
+    // Pick empty slot, or least recently used one.
+    slot = get_slot(shard, 0);
+    for(size_t i = 0; i < slots_per_shard_ && slot->idlen != 0; ++i) {
+      auto s = get_slot(shard, i);
+      if(s->idlen == 0 || s->last_used < slot->last_used) {
+        slot = s;
+      }
+    }
+  }
+  // Make slot empty while data is being written.
+  if(slot->idlen != 0) {
+    unlink(shard, slot);
+  }
+  memcpy(get_data(shard, slot), data, datalen);
+  slot->datalen = datalen;
+  slot->expiry = expiry;
+  slot->last_used = ++shard->clock;
+  slot->hash = h;
+  memcpy(slot->id, id, idlen);
+  slot->idlen = idlen;
+  link(shard, slot);
+  unlock(shard);
+  return 0;
+}
+
+bool SessionCache::lookup(std::string& data, const uint8_t *id, size_t idlen,
+                          time_t now)
+{
+  if(idlen == 0 || idlen > MAX_ID_LENGTH || slots_per_shard_ == 0) {
+    return false;
+  }
+  auto h = hash_id(id, idlen);
+  auto shard = get_shard(h % NUM_SHARDS);
+  lock(shard);
+  auto slot = find(shard, h, id, idlen);
+  if(!slot) {
+    unlock(shard);
+    return false;
+  }
+  if(slot->expiry <= now) {
+    unlink(shard, slot);
+    unlock(shard);
+    return false;
+  }
+  slot->last_used = ++shard->clock;
+  data.assign(reinterpret_cast<char*>(get_data(shard, slot)), slot->datalen);
+  unlock(shard);
+  return true;
+}
+
+void SessionCache::remove(const uint8_t *id, size_t idlen)
+{
+  if(idlen == 0 || idlen > MAX_ID_LENGTH || slots_per_shard_ == 0) {
+    return;
+  }
+  auto h = hash_id(id, idlen);
+  auto shard = get_shard(h % NUM_SHARDS);
+  lock(shard);
+  auto slot = find(shard, h, id, idlen);
+  if(slot) {
+    unlink(shard, slot);
+  }
+  unlock(shard);
+}
+
+} // namespace shrpx
@@ -0,0 +1,111 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_SESSION_CACHE_H
+#define SHRPX_SESSION_CACHE_H
+
+#include "shrpx.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+
+namespace shrpx {
+
+struct SessionCacheHeader;
+struct SessionCacheShard;
+struct SessionCacheSlot;
+
+// TLS session cache keyed by session ID, which replaces OpenSSL's
+// internal session cache. The cache is split into shards by the hash
+// of session ID, and each shard has its own lock, so that the worker
+// threads do not contend on a single lock. Each shard has fixed
+// number of slots, which are indexed by the hash table, and the
+// least recently used session is evicted when the shard is full. Since the memory layout is fixed, the cache
+// can be placed in a file mapped by the multiple processes on the
+// same host, which then resume each other's sessions.
+class SessionCache {
+public:
+  // |size| is the maximum number of sessions.
+  SessionCache(size_t size);
+  ~SessionCache();
+  // Allocates the cache. If |path| is not nullptr, the cache is
+  // mapped from the file |path|, which is created if it does not
+  // exist. Only the empty file is initialized; if the existing file
+  // has the different layout, this function fails rather than
+  // resetting the memory other processes may be using.
+  // This function returns 0 if it succeeds, or -1.
+  int init(const char *path);
+  // Stores the serialized session |data| of length |datalen| with
+  // session ID |id| of length |idlen|. The session expires at
+  // |expiry|. This function returns 0 if it succeeds, or -1 if the
+  // session cannot be stored.
+  int store(const uint8_t *id, size_t idlen,
+            const uint8_t *data, size_t datalen, time_t expiry);
+  // Copies the serialized session with session ID |id| of length
+  // |idlen| to |data|. This function returns true if the unexpired
+  // session is found.
+  bool lookup(std::string& data, const uint8_t *id, size_t idlen,
+              time_t now);
+  // Removes the session with session ID |id| of length |idlen|.
+  void remove(const uint8_t *id, size_t idlen);
+  // The maximum length of the serialized session which can be stored.
+  static const size_t MAX_SESSION_LENGTH = 2048;
+  // The maximum length of session ID.
+  static const size_t MAX_ID_LENGTH = 32;
+  static const size_t NUM_SHARDS = 32;
+private:
+  SessionCacheShard* get_shard(size_t i) const;
+  // Returns the slot with session ID |id| of hash |h| in |shard|, or
+  // nullptr.
+  SessionCacheSlot* find(SessionCacheShard *shard, uint32_t h,
+                         const uint8_t *id, size_t idlen) const;
+  // Adds |slot| to/removes |slot| from the hash table of |shard|. The
+  // slot is empty if it is not in the hash table.
+  void link(SessionCacheShard *shard, SessionCacheSlot *slot);
+  void unlink(SessionCacheShard *shard, SessionCacheSlot *slot);
+  // Returns the hash table bucket of |shard| for hash |h|.
+  uint32_t* get_bucket(SessionCacheShard *shard, uint32_t h) const;
+  SessionCacheSlot* get_slot(SessionCacheShard *shard, size_t i) const;
+  uint8_t* get_data(SessionCacheShard *shard, SessionCacheSlot *slot) const;
+  // Locks |shard|. If the previous owner of the lock died while
+  // holding it, the shard is cleared.
+  void lock(SessionCacheShard *shard);
+  void unlock(SessionCacheShard *shard);
+  // Initializes the memory pointed by mem_.
+  int init_memory(bool shared);
+  SessionCacheHeader *mem_;
+  size_t memlen_;
+  size_t slots_per_shard_;
+  // The number of hash table buckets per shard; power of 2
+  size_t buckets_per_shard_;
+  // The size of shard, excluding session data
+  size_t shard_index_size_;
+  size_t shard_size_;
+};
+
+} // namespace shrpx
+
+#endif // SHRPX_SESSION_CACHE_H
@@ -0,0 +1,186 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_session_cache_test.h"
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_session_cache.h"
+#include "util.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+namespace {
+const uint8_t* u8(const char *s)
+{
+  return reinterpret_cast<const uint8_t*>(s);
+}
+} // namespace
+
+void test_shrpx_session_cache_store_and_lookup(void)
+{
+  SessionCache cache(100);
+  CU_ASSERT(0 == cache.init(nullptr));
+  time_t now = 1000000000;
+  std::string data;
+
+  CU_ASSERT(!cache.lookup(data, u8("alpha"), 5, now));
+  CU_ASSERT(0 == cache.store(u8("alpha"), 5, u8("session-alpha"), 13,
+                             now + 10));
+  CU_ASSERT(cache.lookup(data, u8("alpha"), 5, now));
+  CU_ASSERT("session-alpha" == data);
+  // Prefix of the stored ID does not match.
+  CU_ASSERT(!cache.lookup(data, u8("alph"), 4, now));
+
+  // Overwrite
+  CU_ASSERT(0 == cache.store(u8("alpha"), 5, u8("session-alpha2"), 14,
+                             now + 10));
+  CU_ASSERT(cache.lookup(data, u8("alpha"), 5, now));
+  CU_ASSERT("session-alpha2" == data);
+
+  // Expired
+  CU_ASSERT(!cache.lookup(data, u8("alpha"), 5, now + 10));
+
+  CU_ASSERT(0 == cache.store(u8("bravo"), 5, u8("session-bravo"), 13,
+                             now + 10));
+  cache.remove(u8("bravo"), 5);
+  CU_ASSERT(!cache.lookup(data, u8("bravo"), 5, now));
+
+  // Too large session
+  std::string large(SessionCache::MAX_SESSION_LENGTH + 1, 'a');
+  CU_ASSERT(-1 == cache.store(u8("charlie"), 7, u8(large.c_str()),
+                              large.size(), now + 10));
+}
+
+void test_shrpx_session_cache_eviction(void)
+{
+  // 1 slot per shard
+  SessionCache cache(SessionCache::NUM_SHARDS);
+  CU_ASSERT(0 == cache.init(nullptr));
+  time_t now = 1000000000;
+  std::string data;
+  size_t stored = 0;
+  for(int i = 0; i < 1000; ++i) {
+    auto id = util::utos(i);
+    cache.store(u8(id.c_str()), id.size(), u8(id.c_str()), id.size(),
+                now + 10);
+  }
+  for(int i = 0; i < 1000; ++i) {
+    auto id = util::utos(i);
+    if(cache.lookup(data, u8(id.c_str()), id.size(), now)) {
+      CU_ASSERT(id == data);
+      ++stored;
+    }
+  }
+  CU_ASSERT(stored <= SessionCache::NUM_SHARDS);
+  CU_ASSERT(stored > 0);
+  // The last one is always available.
+  CU_ASSERT(cache.lookup(data, u8("999"), 3, now));
+}
+
+void test_shrpx_session_cache_index(void)
+{
+  // 4 slots per shard, which share 4 hash table buckets. Evicted and
+  // removed slots must be unlinked from the middle of the chains.
+  SessionCache cache(SessionCache::NUM_SHARDS * 4);
+  CU_ASSERT(0 == cache.init(nullptr));
+  time_t now = 1000000000;
+  std::string data;
+  for(int i = 0; i < 1000; ++i) {
+    auto id = util::utos(i);
+    auto value = "session-" + id;
+    CU_ASSERT(0 == cache.store(u8(id.c_str()), id.size(), u8(value.c_str()),
+                               value.size(), now + 10));
+    CU_ASSERT(cache.lookup(data, u8(id.c_str()), id.size(), now));
+    CU_ASSERT(value == data);
+  }
+  std::vector<std::string> stored;
+  for(int i = 0; i < 1000; ++i) {
+    auto id = util::utos(i);
+    if(cache.lookup(data, u8(id.c_str()), id.size(), now)) {
+      CU_ASSERT("session-" + id == data);
+      stored.push_back(id);
+    }
+  }
+  CU_ASSERT(stored.size() <= SessionCache::NUM_SHARDS * 4);
+  CU_ASSERT(stored.size() > SessionCache::NUM_SHARDS);
+  // Remove every other session.
+  for(size_t i = 0; i < stored.size(); i += 2) {
+    cache.remove(u8(stored[i].c_str()), stored[i].size());
+  }
+  for(size_t i = 0; i < stored.size(); ++i) {
+    auto& id = stored[i];
+    CU_ASSERT((i % 2 == 1) ==
+              cache.lookup(data, u8(id.c_str()), id.size(), now));
+  }
+}
+
+void test_shrpx_session_cache_file(void)
+{
+  char path[] = "/tmp/nghttpx-session-cache-test-XXXXXX";
+  auto fd = mkstemp(path);
+  CU_ASSERT(fd != -1);
+  close(fd);
+  time_t now = 1000000000;
+  std::string data;
+  {
+    SessionCache cache1(100), cache2(100);
+    CU_ASSERT(0 == cache1.init(path));
+    CU_ASSERT(0 == cache2.init(path));
+    CU_ASSERT(0 == cache1.store(u8("alpha"), 5, u8("session-alpha"), 13,
+                                now + 10));
+    // Sessions are shared through the file.
+    CU_ASSERT(cache2.lookup(data, u8("alpha"), 5, now));
+    CU_ASSERT("session-alpha" == data);
+  }
+  {
+    // The different size is rejected, leaving the file untouched.
+    SessionCache cache(200);
+    CU_ASSERT(-1 == cache.init(path));
+  }
+  {
+    SessionCache cache(100);
+    CU_ASSERT(0 == cache.init(path));
+    CU_ASSERT(cache.lookup(data, u8("alpha"), 5, now));
+    CU_ASSERT("session-alpha" == data);
+  }
+  {
+    // The empty file is initialized with the new size.
+    CU_ASSERT(0 == truncate(path, 0));
+    SessionCache cache(200);
+    CU_ASSERT(0 == cache.init(path));
+    CU_ASSERT(!cache.lookup(data, u8("alpha"), 5, now));
+  }
+  unlink(path);
+}
+
+} // namespace shrpx
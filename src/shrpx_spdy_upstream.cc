@@ -37,6 +37,7 @@
 #include "shrpx_config.h"
 #include "shrpx_http.h"
 #include "shrpx_accesslog.h"
+#include "shrpx_timeout.h"
 #include "http2.h"
 #include "util.h"
 
@@ -371,8 +372,8 @@ SpdyUpstream::SpdyUpstream(uint16_t version, ClientHandler *handler)
     session_(nullptr)
 {
   //handler->set_bev_cb(spdy_readcb, 0, spdy_eventcb);
-  handler->set_upstream_timeouts(&get_config()->http2_upstream_read_timeout,
-                                 &get_config()->upstream_write_timeout);
+  handler->set_upstream_timeouts(get_timeouts()->http2_upstream_read,
+                                 get_timeouts()->upstream_write);
 
   spdylay_session_callbacks callbacks;
   memset(&callbacks, 0, sizeof(callbacks));
@@ -492,6 +493,18 @@ int SpdyUpstream::on_event()
   return 0;
 }
 
+int SpdyUpstream::on_graceful_shutdown()
+{
+  int rv;
+  rv = spdylay_submit_goaway(session_, SPDYLAY_GOAWAY_OK);
+  if(rv != 0) {
+    ULOG(ERROR, this) << "spdylay_submit_goaway() failed: "
+                      << spdylay_strerror(rv);
+    return -1;
+  }
+  return send();
+}
+
 ClientHandler* SpdyUpstream::get_client_handler() const
 {
   return handler_;
@@ -928,6 +941,7 @@ int SpdyUpstream::on_downstream_body(Downstream *downstream,
     ULOG(FATAL, this) << "evbuffer_add() failed";
     return -1;
   }
+  downstream->add_response_sent_bodylen(len);
   spdylay_session_resume_data(session_, downstream->get_stream_id());
 
   auto outbuflen = upstream->get_client_handler()->get_outbuf_length() +
@@ -0,0 +1,304 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_splice_tunnel.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+
+#include "shrpx_client_handler.h"
+#include "shrpx_downstream.h"
+#include "shrpx_config.h"
+#include "shrpx_stats.h"
+#include "shrpx_timeout.h"
+#include "shrpx_log.h"
+
+namespace shrpx {
+
+namespace {
+// The maximum number of bytes moved into the pipe at once
+const size_t SPLICE_CHUNK = 64*1024;
+} // namespace
+
+namespace {
+void readcb(evutil_socket_t fd, short what, void *arg)
+{
+  auto ch = static_cast<SpliceChannel*>(arg);
+  switch(ch->tunnel->transfer(ch)) {
+  case SpliceTunnel::TRANSFER_OK:
+    break;
+  case SpliceTunnel::TRANSFER_FINISHED:
+    if(LOG_ENABLED(INFO)) {
+      LOG(INFO) << "Spliced tunnel finished";
+    }
+    ch->tunnel->close();
+    break;
+  default:
+    if(LOG_ENABLED(INFO)) {
+      LOG(INFO) << "Spliced tunnel failed";
+    }
+    ch->tunnel->close();
+    break;
+  }
+}
+} // namespace
+
+namespace {
+int add_event(event *ev)
+{
+  return event_add(ev, nullptr) == 0 ?
+    SpliceTunnel::TRANSFER_OK : SpliceTunnel::TRANSFER_ERROR;
+}
+} // namespace
+
+namespace {
+void timeoutcb(evutil_socket_t fd, short what, void *arg)
+{
+  auto tunnel = static_cast<SpliceTunnel*>(arg);
+  tunnel->on_timeout();
+}
+} // namespace
+
+namespace {
+void init_channel(SpliceChannel *ch, SpliceTunnel *tunnel, int src, int dst,
+                  bool response)
+{
+  ch->tunnel = tunnel;
+  ch->pending = nullptr;
+  ch->rev = nullptr;
+  ch->wev = nullptr;
+  ch->src = src;
+  ch->dst = dst;
+  ch->pipefd[0] = ch->pipefd[1] = -1;
+  ch->pipelen = 0;
+  ch->eof = false;
+  ch->shut = false;
+  ch->response = response;
+}
+} // namespace
+
+namespace {
+void free_channel(SpliceChannel *ch)
+{
+  if(ch->rev) {
+    event_free(ch->rev);
+  }
+  if(ch->wev) {
+    event_free(ch->wev);
+  }
+  if(ch->pending) {
+    evbuffer_free(ch->pending);
+  }
+  for(auto fd : ch->pipefd) {
+    if(fd != -1) {
+      ::close(fd);
+    }
+  }
+}
+} // namespace
+
+SpliceTunnel::SpliceTunnel(ClientHandler *handler, Downstream *downstream,
+                           bufferevent *client_bev, bufferevent *backend_bev)
+  : handler_(handler),
+    downstream_(downstream),
+    client_bev_(client_bev),
+    backend_bev_(backend_bev),
+    timerev_(nullptr),
+    active_(false),
+    closing_(false)
+{
+  auto client_fd = bufferevent_getfd(client_bev);
+  auto backend_fd = bufferevent_getfd(backend_bev);
+  init_channel(&c2b_, this, client_fd, backend_fd, false);
+  init_channel(&b2c_, this, backend_fd, client_fd, true);
+}
+
+SpliceTunnel::~SpliceTunnel()
+{
+  free_channel(&c2b_);
+  free_channel(&b2c_);
+  if(timerev_) {
+    event_free(timerev_);
+  }
+}
+
+int SpliceTunnel::init()
+{
+#ifdef HAVE_SPLICE
+  auto evbase = bufferevent_get_base(client_bev_);
+  for(auto ch : {&c2b_, &b2c_}) {
+    if(pipe2(ch->pipefd, O_NONBLOCK | O_CLOEXEC) == -1) {
+      return -1;
+    }
+    ch->pending = evbuffer_new();
+    ch->rev = event_new(evbase, ch->src, EV_READ | EV_PERSIST, readcb, ch);
+    ch->wev = event_new(evbase, ch->dst, EV_WRITE, readcb, ch);
+    if(!ch->pending || !ch->rev || !ch->wev) {
+      return -1;
+    }
+  }
+  timerev_ = event_new(evbase, -1, EV_PERSIST, timeoutcb, this);
+  if(!timerev_) {
+    return -1;
+  }
+
+  // From here, the tunnel owns the connections.
+  for(auto bev : {client_bev_, backend_bev_}) {
+    bufferevent_disable(bev, EV_READ | EV_WRITE);
+    bufferevent_setcb(bev, nullptr, nullptr, nullptr, nullptr);
+    // bufferevent prohibits draining output buffer by others.
+    evbuffer_unfreeze(bufferevent_get_output(bev), 1);
+  }
+  // The data already read or queued by bufferevents go first. Moving
+  // buffers does not fail unless they are frozen.
+  evbuffer_add_buffer(c2b_.pending, bufferevent_get_output(backend_bev_));
+  evbuffer_add_buffer(c2b_.pending, bufferevent_get_input(client_bev_));
+  evbuffer_add_buffer(b2c_.pending, bufferevent_get_output(client_bev_));
+  evbuffer_add_buffer(b2c_.pending, bufferevent_get_input(backend_bev_));
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Forwarding tunnel with splice. client fd=" << c2b_.src
+              << ", backend fd=" << c2b_.dst;
+  }
+  event_add(timerev_, get_timeouts()->upstream_read);
+  for(auto ch : {&c2b_, &b2c_}) {
+    if(transfer(ch) != TRANSFER_OK) {
+      // We are called from the callback of the connection; close it
+      // later.
+      closing_ = true;
+      event_active(timerev_, EV_TIMEOUT, 0);
+      break;
+    }
+  }
+  return 0;
+#else // !HAVE_SPLICE
+  return -1;
+#endif // !HAVE_SPLICE
+}
+
+int SpliceTunnel::transfer(SpliceChannel *ch)
+{
+#ifdef HAVE_SPLICE
+  auto stats = get_worker_stats();
+  for(;;) {
+    if(evbuffer_get_length(ch->pending) > 0) {
+      auto nwrite = evbuffer_write(ch->pending, ch->dst);
+      if(nwrite == -1) {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          return TRANSFER_ERROR;
+        }
+      } else if(nwrite > 0) {
+        active_ = true;
+      }
+      if(evbuffer_get_length(ch->pending) > 0) {
+        event_del(ch->rev);
+        return add_event(ch->wev);
+      }
+    }
+    if(ch->pipelen > 0) {
+      auto n = splice(ch->pipefd[0], nullptr, ch->dst, nullptr, ch->pipelen,
+                      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if(n == -1) {
+        if(errno == EINTR) {
+          continue;
+        }
+        if(errno != EAGAIN) {
+          return TRANSFER_ERROR;
+        }
+        // Stop reading until dst becomes writable so that the pipe
+        // does not grow.
+        event_del(ch->rev);
+        return add_event(ch->wev);
+      }
+      ch->pipelen -= n;
+      active_ = true;
+      if(ch->response) {
+        stats->bytes_out.add(n);
+        downstream_->add_response_sent_bodylen(n);
+      }
+      continue;
+    }
+    if(ch->eof) {
+      if(!ch->shut) {
+        ch->shut = true;
+        event_del(ch->rev);
+        shutdown(ch->dst, SHUT_WR);
+      }
+      if(c2b_.shut && b2c_.shut) {
+        return TRANSFER_FINISHED;
+      }
+      return TRANSFER_OK;
+    }
+    auto n = splice(ch->src, nullptr, ch->pipefd[1], nullptr, SPLICE_CHUNK,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if(n == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      if(errno != EAGAIN) {
+        return TRANSFER_ERROR;
+      }
+      return add_event(ch->rev);
+    }
+    if(n == 0) {
+      ch->eof = true;
+      continue;
+    }
+    ch->pipelen += n;
+    if(!ch->response) {
+      stats->bytes_in.add(n);
+    }
+  }
+#else // !HAVE_SPLICE
+  return TRANSFER_ERROR;
+#endif // !HAVE_SPLICE
+}
+
+void SpliceTunnel::close()
+{
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Closing spliced tunnel. client fd=" << c2b_.src;
+  }
+  delete handler_;
+}
+
+void SpliceTunnel::on_timeout()
+{
+  if(closing_) {
+    close();
+    return;
+  }
+  if(active_) {
+    active_ = false;
+    return;
+  }
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Spliced tunnel timed out";
+  }
+  close();
+}
+
+} // namespace shrpx
@@ -0,0 +1,107 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_SPLICE_TUNNEL_H
+#define SHRPX_SPLICE_TUNNEL_H
+
+#include "shrpx.h"
+
+#include <event.h>
+#include <event2/bufferevent.h>
+
+namespace shrpx {
+
+class ClientHandler;
+class Downstream;
+class SpliceTunnel;
+
+// One direction of SpliceTunnel.
+struct SpliceChannel {
+  SpliceTunnel *tunnel;
+  // The data which were buffered by bufferevents before the tunnel
+  // started. They are written to dst before spliced data.
+  evbuffer *pending;
+  event *rev;
+  event *wev;
+  int src;
+  int dst;
+  // pipefd[0] is read end
+  int pipefd[2];
+  // The number of bytes in the pipe
+  size_t pipelen;
+  // true if src reached EOF
+  bool eof;
+  // true if dst has been shut down for writing
+  bool shut;
+  // true if this channel carries data from backend to client
+  bool response;
+};
+
+// Forwards data between the client and backend TCP connections of
+// established tunnel (CONNECT or HTTP Upgrade) with splice(2), so
+// that the data never enter user space. This is only used when both
+// connections are plain TCP. The bufferevents of both connections
+// are disabled while the tunnel runs, and their buffered data are
+// sent first. When both directions reached EOF, or an error occurs,
+// the ClientHandler is deleted.
+class SpliceTunnel {
+public:
+  SpliceTunnel(ClientHandler *handler, Downstream *downstream,
+               bufferevent *client_bev, bufferevent *backend_bev);
+  ~SpliceTunnel();
+  // Takes over the connections and starts forwarding. This function
+  // returns 0 if it succeeds, or -1. If it fails, the bufferevents
+  // are left untouched. Once this function succeeds, the tunnel
+  // closes the connections by itself.
+  int init();
+  enum {
+    TRANSFER_ERROR = -1,
+    TRANSFER_OK = 0,
+    // Both directions reached EOF and have been shut down
+    TRANSFER_FINISHED = 1
+  };
+  // Moves data of |ch| as much as possible. This function returns
+  // TRANSFER_OK if the tunnel is still open, TRANSFER_FINISHED if
+  // both directions are done, or TRANSFER_ERROR.
+  int transfer(SpliceChannel *ch);
+  // Deletes ClientHandler, and therefore this object.
+  void close();
+  void on_timeout();
+private:
+  SpliceChannel c2b_;
+  SpliceChannel b2c_;
+  ClientHandler *handler_;
+  Downstream *downstream_;
+  bufferevent *client_bev_;
+  bufferevent *backend_bev_;
+  event *timerev_;
+  // true if any data were forwarded since the last timeout check
+  bool active_;
+  // true if the tunnel must be closed on the next timer callback
+  bool closing_;
+};
+
+} // namespace shrpx
+
+#endif // SHRPX_SPLICE_TUNNEL_H
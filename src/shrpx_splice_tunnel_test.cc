@@ -0,0 +1,257 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2013 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_splice_tunnel_test.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <cerrno>
+#include <string>
+
+#include <CUnit/CUnit.h>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+
+#include "shrpx_splice_tunnel.h"
+#include "shrpx_config.h"
+#include "shrpx_client_handler.h"
+#include "shrpx_downstream.h"
+#include "shrpx_downstream_connection.h"
+#include "shrpx_https_upstream.h"
+#include "shrpx_timeout.h"
+
+namespace shrpx {
+
+namespace {
+// DownstreamConnection which only owns the backend side of the
+// tunnel.
+class TunnelDownstreamConnection : public DownstreamConnection {
+public:
+  TunnelDownstreamConnection(ClientHandler *handler, bufferevent *bev)
+    : DownstreamConnection(handler),
+      bev_(bev)
+  {}
+  virtual ~TunnelDownstreamConnection()
+  {
+    bufferevent_free(bev_);
+  }
+  virtual int attach_downstream(Downstream *downstream)
+  {
+    downstream->set_downstream_connection(this);
+    downstream_ = downstream;
+    return 0;
+  }
+  virtual void detach_downstream(Downstream *downstream)
+  {
+    downstream->set_downstream_connection(nullptr);
+    downstream_ = nullptr;
+  }
+  virtual int push_request_headers() { return 0; }
+  virtual int push_upload_data_chunk(const uint8_t *data, size_t datalen)
+  {
+    return 0;
+  }
+  virtual int end_upload_data() { return 0; }
+  virtual void pause_read(IOCtrlReason reason) {}
+  virtual int resume_read(IOCtrlReason reason) { return 0; }
+  virtual void force_resume_read() {}
+  virtual bool get_output_buffer_full() { return false; }
+  virtual int on_read() { return 0; }
+  virtual int on_write() { return 0; }
+  virtual void on_upstream_change(Upstream *upstream) {}
+  virtual int on_priority_change(int32_t pri) { return 0; }
+  virtual bufferevent* get_tunnel_bev() { return bev_; }
+private:
+  bufferevent *bev_;
+};
+} // namespace
+
+namespace {
+// Returns the data which can be read from |fd| without blocking.
+std::string recv_all(int fd)
+{
+  std::string res;
+  char buf[4096];
+  for(;;) {
+    auto n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if(n <= 0) {
+      break;
+    }
+    res.append(buf, n);
+  }
+  return res;
+}
+} // namespace
+
+namespace {
+bool peer_closed(int fd)
+{
+  return send(fd, "x", 1, MSG_NOSIGNAL) == -1 && errno == EPIPE;
+}
+} // namespace
+
+namespace {
+// Establishes the tunnel between |cfd| and |bfd| as if HTTP Upgrade
+// succeeded. The tunnel is owned by ClientHandler, and closed by
+// itself. |client_pending| and |backend_pending| are the data which
+// have been queued to the client and backend respectively before the
+// tunnel starts.
+void start_tunnel(event_base *evbase, bufferevent_rate_limit_group *group,
+                  int cfd, int bfd,
+                  const std::string& client_pending,
+                  const std::string& backend_pending)
+{
+  auto bev = bufferevent_socket_new(evbase, cfd, 0);
+  auto handler = new ClientHandler(bev, group, cfd, nullptr, "127.0.0.1");
+  auto upstream = static_cast<HttpsUpstream*>(handler->get_upstream());
+
+  // The upstream owns downstream, and downstream owns dconn.
+  auto downstream = new Downstream(upstream, 0, 0);
+  upstream->attach_downstream(downstream);
+  auto backend_bev = bufferevent_socket_new(evbase, bfd,
+                                            BEV_OPT_CLOSE_ON_FREE);
+  auto dconn = new TunnelDownstreamConnection(handler, backend_bev);
+  dconn->attach_downstream(downstream);
+
+  // The parser has already completed 101 response message.
+  downstream->set_request_method("GET");
+  downstream->add_request_header("Upgrade", "websocket");
+  downstream->set_response_http_status(101);
+  downstream->check_upgrade_fulfilled();
+  CU_ASSERT(downstream->get_upgraded());
+  // Not counted in worker statistics
+  downstream->set_response_http_status(0);
+  downstream->set_response_state(Downstream::MSG_COMPLETE);
+
+  evbuffer_add(bufferevent_get_output(bev), client_pending.c_str(),
+               client_pending.size());
+  evbuffer_add(bufferevent_get_output(backend_bev), backend_pending.c_str(),
+               backend_pending.size());
+
+  upstream->get_downstream_readcb()(backend_bev, dconn);
+}
+} // namespace
+
+void test_shrpx_splice_tunnel_forward(void)
+{
+#ifdef HAVE_SPLICE
+  if(!get_config()) {
+    create_config();
+  }
+  auto saved_tunnel_splice = get_config()->tunnel_splice;
+  mod_config()->tunnel_splice = true;
+  auto evbase = event_base_new();
+  init_timeouts(evbase);
+  auto cfg = ev_token_bucket_cfg_new(EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     nullptr);
+  auto group = bufferevent_rate_limit_group_new(evbase, cfg);
+  // cfds[1] is the client, and bfds[1] is the backend.
+  int cfds[2], bfds[2];
+  CU_ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, cfds));
+  CU_ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, bfds));
+
+  // The data buffered before the tunnel starts go first.
+  start_tunnel(evbase, group, cfds[0], bfds[0], "world", "hello");
+  CU_ASSERT("hello" == recv_all(bfds[1]));
+  CU_ASSERT("world" == recv_all(cfds[1]));
+
+  CU_ASSERT(4 == write(cfds[1], "ping", 4));
+  event_base_loop(evbase, EVLOOP_NONBLOCK);
+  CU_ASSERT("ping" == recv_all(bfds[1]));
+
+  CU_ASSERT(4 == write(bfds[1], "pong", 4));
+  event_base_loop(evbase, EVLOOP_NONBLOCK);
+  CU_ASSERT("pong" == recv_all(cfds[1]));
+
+  // EOF from the client is propagated to the backend, and the
+  // tunnel keeps forwarding the other direction.
+  shutdown(cfds[1], SHUT_WR);
+  event_base_loop(evbase, EVLOOP_NONBLOCK);
+  char c;
+  CU_ASSERT(0 == recv(bfds[1], &c, 1, MSG_DONTWAIT));
+
+  CU_ASSERT(4 == write(bfds[1], "last", 4));
+  event_base_loop(evbase, EVLOOP_NONBLOCK);
+  CU_ASSERT("last" == recv_all(cfds[1]));
+  CU_ASSERT(!peer_closed(bfds[1]));
+
+  // When both directions are done, the connections are closed.
+  shutdown(bfds[1], SHUT_WR);
+  event_base_loop(evbase, EVLOOP_NONBLOCK);
+  CU_ASSERT(peer_closed(cfds[1]));
+  CU_ASSERT(peer_closed(bfds[1]));
+
+  close(cfds[1]);
+  close(bfds[1]);
+  bufferevent_rate_limit_group_free(group);
+  ev_token_bucket_cfg_free(cfg);
+  event_base_free(evbase);
+  mod_config()->tunnel_splice = saved_tunnel_splice;
+#endif // HAVE_SPLICE
+}
+
+void test_shrpx_splice_tunnel_error(void)
+{
+#ifdef HAVE_SPLICE
+  if(!get_config()) {
+    create_config();
+  }
+  auto saved_tunnel_splice = get_config()->tunnel_splice;
+  mod_config()->tunnel_splice = true;
+  auto evbase = event_base_new();
+  init_timeouts(evbase);
+  auto cfg = ev_token_bucket_cfg_new(EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX,
+                                     nullptr);
+  auto group = bufferevent_rate_limit_group_new(evbase, cfg);
+  int cfds[2], bfds[2];
+  CU_ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, cfds));
+  CU_ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, bfds));
+
+  start_tunnel(evbase, group, cfds[0], bfds[0], "", "");
+
+  // nghttpx ignores SIGPIPE.
+  auto saved_sigpipe = signal(SIGPIPE, SIG_IGN);
+
+  // The backend has gone while the client still sends data. The
+  // tunnel is closed although the client has not finished.
+  close(bfds[1]);
+  CU_ASSERT(4 == write(cfds[1], "ping", 4));
+  event_base_loop(evbase, EVLOOP_NONBLOCK);
+  CU_ASSERT(peer_closed(cfds[1]));
+  signal(SIGPIPE, saved_sigpipe);
+
+  close(cfds[1]);
+  bufferevent_rate_limit_group_free(group);
+  ev_token_bucket_cfg_free(cfg);
+  event_base_free(evbase);
+  mod_config()->tunnel_splice = saved_tunnel_splice;
+#endif // HAVE_SPLICE
+}
+
+} // namespace shrpx
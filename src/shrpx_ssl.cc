@@ -29,12 +29,23 @@
 #include <netinet/tcp.h>
 #include <pthread.h>
 
+#include <cstring>
 #include <vector>
 #include <string>
+#include <memory>
+#include <fstream>
 
 #include <openssl/crypto.h>
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#include <openssl/ocsp.h>
+#include <openssl/pem.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif // OPENSSL_VERSION_NUMBER >= 0x30000000L
 
 #include <event2/bufferevent.h>
 #include <event2/bufferevent_ssl.h>
@@ -45,6 +56,7 @@
 #include "shrpx_client_handler.h"
 #include "shrpx_config.h"
 #include "shrpx_accesslog.h"
+#include "shrpx_session_cache.h"
 #include "util.h"
 
 using namespace nghttp2;
@@ -150,6 +162,403 @@ void info_callback(const SSL *ssl, int where, int ret)
 }
 } // namespace
 
+namespace {
+// Current TLS session ticket keys.  Always accessed with
+// std::atomic_load() and std::atomic_store() so that the handshake
+// path does not serialize on a lock.
+std::shared_ptr<TicketKeys> ticket_keys;
+} // namespace
+
+std::shared_ptr<TicketKeys> get_ticket_keys()
+{
+  return std::atomic_load(&ticket_keys);
+}
+
+int read_ticket_key_files(std::vector<TicketKey>& keys,
+                          const std::vector<std::string>& files)
+{
+  for(auto& file : files) {
+    std::ifstream in(file, std::ios::binary);
+    if(!in) {
+      LOG(ERROR) << "Could not open TLS session ticket key file " << file;
+      return -1;
+    }
+    TicketKey key;
+    char buf[sizeof(key) + 1];
+    in.read(buf, sizeof(buf));
+    if(in.gcount() != sizeof(key)) {
+      LOG(ERROR) << "TLS session ticket key file " << file << " must be "
+                 << sizeof(key) << " bytes";
+      return -1;
+    }
+    memcpy(key.name, buf, sizeof(key.name));
+    memcpy(key.aes_key, buf + sizeof(key.name), sizeof(key.aes_key));
+    memcpy(key.hmac_key, buf + sizeof(key.name) + sizeof(key.aes_key),
+           sizeof(key.hmac_key));
+    keys.push_back(key);
+  }
+  return 0;
+}
+
+namespace {
+const TicketKey* find_ticket_key(const std::vector<TicketKey>& keys,
+                                 const uint8_t *name)
+{
+  for(auto& key : keys) {
+    if(memcmp(key.name, name, sizeof(key.name)) == 0) {
+      return &key;
+    }
+  }
+  return nullptr;
+}
+} // namespace
+
+std::shared_ptr<TicketKeys> merge_ticket_keys
+(std::vector<TicketKey> keys, const TicketKeys *old_keys, size_t history)
+{
+  auto res = std::make_shared<TicketKeys>();
+  res->keys = std::move(keys);
+  if(old_keys) {
+    size_t n = 0;
+    for(auto& key : old_keys->keys) {
+      if(n == history) {
+        break;
+      }
+      if(find_ticket_key(res->keys, key.name)) {
+        continue;
+      }
+      res->keys.push_back(key);
+      ++n;
+    }
+  }
+  return res;
+}
+
+int update_ticket_keys()
+{
+  std::vector<TicketKey> keys;
+  if(get_config()->tls_ticket_key_files.empty()) {
+    TicketKey key;
+    if(RAND_bytes(reinterpret_cast<unsigned char*>(&key), sizeof(key)) != 1) {
+      LOG(ERROR) << "RAND_bytes() failed: "
+                 << ERR_error_string(ERR_get_error(), nullptr);
+      return -1;
+    }
+    keys.push_back(key);
+  } else if(read_ticket_key_files(keys, get_config()->tls_ticket_key_files)
+            != 0) {
+    return -1;
+  }
+  auto old_keys = get_ticket_keys();
+  auto new_keys = merge_ticket_keys(std::move(keys), old_keys.get(),
+                                    get_config()->tls_ticket_key_history);
+  if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "TLS session ticket keys updated. " << new_keys->keys.size()
+              << " key(s) available";
+  }
+  std::atomic_store(&ticket_keys, std::move(new_keys));
+  return 0;
+}
+
+namespace {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int init_ticket_hmac(EVP_MAC_CTX *hctx, const TicketKey& key)
+{
+  OSSL_PARAM params[] = {
+    OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                     const_cast<char*>("SHA256"), 0),
+    OSSL_PARAM_construct_end()
+  };
+  return EVP_MAC_init(hctx, key.hmac_key, sizeof(key.hmac_key), params) == 1 ?
+    0 : -1;
+}
+#else // OPENSSL_VERSION_NUMBER < 0x30000000L
+int init_ticket_hmac(HMAC_CTX *hctx, const TicketKey& key)
+{
+  return HMAC_Init_ex(hctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(),
+                      nullptr) == 1 ? 0 : -1;
+}
+#endif // OPENSSL_VERSION_NUMBER < 0x30000000L
+} // namespace
+
+namespace {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                  EVP_CIPHER_CTX *ctx, EVP_MAC_CTX *hctx, int enc)
+#else // OPENSSL_VERSION_NUMBER < 0x30000000L
+int ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                  EVP_CIPHER_CTX *ctx, HMAC_CTX *hctx, int enc)
+#endif // OPENSSL_VERSION_NUMBER < 0x30000000L
+{
+  auto keys = get_ticket_keys();
+  if(!keys || keys->keys.empty()) {
+    return -1;
+  }
+  if(enc) {
+    auto& key = keys->keys[0];
+    if(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_128_cbc())) != 1) {
+      return -1;
+    }
+    memcpy(key_name, key.name, sizeof(key.name));
+    if(EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), nullptr, key.aes_key,
+                          iv) != 1 ||
+       init_ticket_hmac(hctx, key) != 0) {
+      return -1;
+    }
+    return 1;
+  }
+  auto key = find_ticket_key(keys->keys, key_name);
+  if(!key) {
+    // Unknown or expired key; do full handshake.
+    return 0;
+  }
+  if(init_ticket_hmac(hctx, *key) != 0 ||
+     EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), nullptr, key->aes_key,
+                        iv) != 1) {
+    return -1;
+  }
+  // Issue new ticket if it was encrypted by old key.
+  return key == &keys->keys[0] ? 1 : 2;
+}
+} // namespace
+
+namespace {
+int new_session_cb(SSL *ssl, SSL_SESSION *session)
+{
+  auto cache = get_config()->session_cache;
+  unsigned int idlen;
+  auto id = SSL_SESSION_get_id(session, &idlen);
+  auto len = i2d_SSL_SESSION(session, nullptr);
+  if(len <= 0 || static_cast<size_t>(len) > SessionCache::MAX_SESSION_LENGTH) {
+    if(LOG_ENABLED(INFO)) {
+      LOG(INFO) << "TLS session is too large to cache: " << len << " bytes";
+    }
+    return 0;
+  }
+  uint8_t buf[SessionCache::MAX_SESSION_LENGTH];
+  auto p = buf;
+  i2d_SSL_SESSION(session, &p);
+  cache->store(id, idlen, buf, len,
+               SSL_SESSION_get_time(session) +
+               SSL_SESSION_get_timeout(session));
+  // We don't keep the reference to |session|.
+  return 0;
+}
+} // namespace
+
+namespace {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+SSL_SESSION* get_session_cb(SSL *ssl, const unsigned char *id, int idlen,
+                            int *copy)
+#else // OPENSSL_VERSION_NUMBER < 0x10100000L
+SSL_SESSION* get_session_cb(SSL *ssl, unsigned char *id, int idlen,
+                            int *copy)
+#endif // OPENSSL_VERSION_NUMBER < 0x10100000L
+{
+  // The returned session is newly created, and its ownership is
+  // passed to OpenSSL.
+  *copy = 0;
+  std::string data;
+  if(!get_config()->session_cache->lookup(data, id, idlen, time(nullptr))) {
+    return nullptr;
+  }
+  auto p = reinterpret_cast<const unsigned char*>(data.c_str());
+  return d2i_SSL_SESSION(nullptr, &p, data.size());
+}
+} // namespace
+
+namespace {
+void remove_session_cb(SSL_CTX *ssl_ctx, SSL_SESSION *session)
+{
+  unsigned int idlen;
+  auto id = SSL_SESSION_get_id(session, &idlen);
+  get_config()->session_cache->remove(id, idlen);
+}
+} // namespace
+
+OCSPStaple::OCSPStaple()
+  : cert(nullptr),
+    issuer(nullptr)
+{}
+
+OCSPStaple::~OCSPStaple()
+{
+  if(cert) {
+    X509_free(cert);
+  }
+  if(issuer) {
+    X509_free(issuer);
+  }
+}
+
+OCSPStaple* get_ocsp_staple(SSL_CTX *ssl_ctx)
+{
+  return static_cast<OCSPStaple*>(SSL_CTX_get_app_data(ssl_ctx));
+}
+
+int verify_ocsp_response(const std::string& der, X509 *cert, X509 *issuer)
+{
+  auto p = reinterpret_cast<const unsigned char*>(der.c_str());
+  auto resp = d2i_OCSP_RESPONSE(nullptr, &p, der.size());
+  if(!resp) {
+    return -1;
+  }
+  util::auto_delete<OCSP_RESPONSE*> resp_deleter(resp, OCSP_RESPONSE_free);
+  if(OCSP_response_status(resp) != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+    return -1;
+  }
+  auto bs = OCSP_response_get1_basic(resp);
+  if(!bs) {
+    return -1;
+  }
+  util::auto_delete<OCSP_BASICRESP*> bs_deleter(bs, OCSP_BASICRESP_free);
+  // The response must be signed by the issuer itself, or by the
+  // responder whose certificate is issued by it.
+  auto store = X509_STORE_new();
+  if(!store) {
+    return -1;
+  }
+  util::auto_delete<X509_STORE*> store_deleter(store, X509_STORE_free);
+  auto certs = sk_X509_new_null();
+  if(!certs) {
+    return -1;
+  }
+  util::auto_delete<STACK_OF(X509)*> certs_deleter
+    (certs, [](STACK_OF(X509) *sk) { sk_X509_free(sk); });
+  if(X509_STORE_add_cert(store, issuer) != 1 ||
+     sk_X509_push(certs, issuer) == 0) {
+    return -1;
+  }
+  // The issuer may be an intermediate CA.
+  X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN);
+  if(OCSP_basic_verify(bs, certs, store, OCSP_TRUSTOTHER) != 1) {
+    ERR_clear_error();
+    return -1;
+  }
+  auto id = OCSP_cert_to_id(nullptr, cert, issuer);
+  if(!id) {
+    return -1;
+  }
+  util::auto_delete<OCSP_CERTID*> id_deleter(id, OCSP_CERTID_free);
+  auto single = OCSP_resp_get0(bs, OCSP_resp_find(bs, id, -1));
+  if(!single) {
+    return -1;
+  }
+  ASN1_GENERALIZEDTIME *thisupd, *nextupd;
+  if(OCSP_single_get0_status(single, nullptr, nullptr, &thisupd, &nextupd)
+     == -1) {
+    return -1;
+  }
+  // Allow 5 minutes clock skew
+  if(OCSP_check_validity(thisupd, nextupd, 300, -1) != 1) {
+    return -1;
+  }
+  return 0;
+}
+
+namespace {
+// Reads the server certificate and its issuer from the PEM encoded
+// certificate chain file |cert_file| into |staple|.
+void read_ocsp_cert_chain(OCSPStaple *staple, const char *cert_file)
+{
+  auto bio = BIO_new_file(cert_file, "r");
+  if(!bio) {
+    ERR_clear_error();
+    return;
+  }
+  util::auto_delete<BIO*> bio_deleter(bio, BIO_vfree);
+  staple->cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+  if(!staple->cert) {
+    ERR_clear_error();
+    return;
+  }
+  for(;;) {
+    auto x = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+    if(!x) {
+      break;
+    }
+    if(X509_check_issued(x, staple->cert) == X509_V_OK) {
+      staple->issuer = x;
+      break;
+    }
+    X509_free(x);
+  }
+  // Reading past the last certificate leaves an error.
+  ERR_clear_error();
+}
+} // namespace
+
+int update_ocsp_staple(SSL_CTX *ssl_ctx)
+{
+  auto staple = get_ocsp_staple(ssl_ctx);
+  if(!staple) {
+    return -1;
+  }
+  std::shared_ptr<std::string> response;
+  std::ifstream in(staple->path, std::ios::binary);
+  if(in) {
+    response = std::make_shared<std::string>
+      ((std::istreambuf_iterator<char>(in)),
+       std::istreambuf_iterator<char>());
+    if(!staple->cert || !staple->issuer) {
+      LOG(WARNING) << "Issuer certificate is not found in the certificate "
+                   << "chain file; OCSP response in " << staple->path
+                   << " is not stapled";
+      response.reset();
+    } else if(in.bad() ||
+              verify_ocsp_response(*response, staple->cert,
+                                   staple->issuer) != 0) {
+      LOG(WARNING) << "OCSP response in " << staple->path
+                   << " is not valid; not stapled";
+      response.reset();
+    }
+  } else if(LOG_ENABLED(INFO)) {
+    LOG(INFO) << "No OCSP response file " << staple->path;
+  }
+  if(response && LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Loaded OCSP response from " << staple->path;
+  }
+  std::atomic_store(&staple->response, response);
+  return response ? 0 : -1;
+}
+
+void update_ocsp_staples()
+{
+  if(get_config()->default_ssl_ctx) {
+    update_ocsp_staple(get_config()->default_ssl_ctx);
+  }
+  if(get_config()->cert_tree) {
+    for(auto ssl_ctx : get_config()->cert_tree->certs) {
+      if(ssl_ctx != get_config()->default_ssl_ctx) {
+        update_ocsp_staple(ssl_ctx);
+      }
+    }
+  }
+}
+
+namespace {
+int ocsp_resp_cb(SSL *ssl, void *arg)
+{
+  // The SSL_CTX may have been switched by servername_callback.
+  auto staple = get_ocsp_staple(SSL_get_SSL_CTX(ssl));
+  if(!staple) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  auto response = std::atomic_load(&staple->response);
+  if(!response) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  // OpenSSL takes ownership of the buffer.
+  auto buf = static_cast<unsigned char*>(OPENSSL_malloc(response->size()));
+  if(!buf) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  memcpy(buf, response->c_str(), response->size());
+  SSL_set_tlsext_status_ocsp_resp(ssl, buf, response->size());
+  return SSL_TLSEXT_ERR_OK;
+}
+} // namespace
+
 #if OPENSSL_VERSION_NUMBER >= 0x10002000L
 namespace {
 int alpn_select_proto_cb(SSL* ssl,
@@ -204,13 +613,32 @@ SSL_CTX* create_ssl_context(const char *private_key_file,
                       SSL_OP_ALL | SSL_OP_NO_SSLv2 | SSL_OP_NO_COMPRESSION |
                       SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION |
                       SSL_OP_SINGLE_ECDH_USE | SSL_OP_SINGLE_DH_USE |
-                      SSL_OP_NO_TICKET |
                       create_tls_proto_mask(get_config()->tls_proto_list,
                                             get_config()->tls_proto_list_len));
 
   const unsigned char sid_ctx[] = "shrpx";
   SSL_CTX_set_session_id_context(ssl_ctx, sid_ctx, sizeof(sid_ctx)-1);
-  SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER);
+  if(get_config()->session_cache) {
+    SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER |
+                                   SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(ssl_ctx, new_session_cb);
+    SSL_CTX_sess_set_get_cb(ssl_ctx, get_session_cb);
+    SSL_CTX_sess_set_remove_cb(ssl_ctx, remove_session_cb);
+  } else {
+    SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER);
+  }
+
+  if(get_config()->no_tls_ticket) {
+    SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_TICKET);
+  } else {
+    // The keys are shared among all SSL_CTXs and rotated
+    // periodically; see update_ticket_keys().
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ssl_ctx, ticket_key_cb);
+#else // OPENSSL_VERSION_NUMBER < 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_cb(ssl_ctx, ticket_key_cb);
+#endif // OPENSSL_VERSION_NUMBER < 0x30000000L
+  }
 
   const char *ciphers;
   if(get_config()->ciphers) {
@@ -321,6 +749,16 @@ SSL_CTX* create_ssl_context(const char *private_key_file,
   SSL_CTX_set_tlsext_servername_callback(ssl_ctx, servername_callback);
   SSL_CTX_set_info_callback(ssl_ctx, info_callback);
 
+  if(!get_config()->no_ocsp) {
+    auto staple = new OCSPStaple();
+    staple->path = cert_file;
+    staple->path += ".ocsp";
+    read_ocsp_cert_chain(staple, cert_file);
+    SSL_CTX_set_app_data(ssl_ctx, staple);
+    SSL_CTX_set_tlsext_status_cb(ssl_ctx, ocsp_resp_cb);
+    update_ocsp_staple(ssl_ctx);
+  }
+
   // NPN advertisement
   auto proto_list_len = set_npn_prefs(proto_list, get_config()->npn_list,
                                       get_config()->npn_list_len);
@@ -863,6 +1301,7 @@ int cert_lookup_tree_add_cert_from_file(CertLookupTree *lt, SSL_CTX *ssl_ctx,
   std::vector<std::string> dns_names;
   std::vector<std::string> ip_addrs;
   get_altnames(cert, dns_names, ip_addrs, common_name);
+  lt->certs.push_back(ssl_ctx);
   for(auto& dns_name : dns_names) {
     cert_lookup_tree_add_cert(lt, ssl_ctx, dns_name.c_str(), dns_name.size());
   }
@@ -28,6 +28,8 @@
 #include "shrpx.h"
 
 #include <vector>
+#include <string>
+#include <memory>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -40,6 +42,79 @@ class ClientHandler;
 
 namespace ssl {
 
+// TLS session ticket key. The format is the same as the key file:
+// 16 bytes key name, 16 bytes AES key and 16 bytes HMAC key.
+struct TicketKey {
+  uint8_t name[16];
+  uint8_t aes_key[16];
+  uint8_t hmac_key[16];
+};
+
+struct TicketKeys {
+  // The first key is used to encrypt tickets. All keys are used to
+  // decrypt them.
+  std::vector<TicketKey> keys;
+};
+
+// Reads ticket keys from |files| and appends them to |keys|. This
+// function returns 0 if it succeeds, or -1.
+int read_ticket_key_files(std::vector<TicketKey>& keys,
+                          const std::vector<std::string>& files);
+
+// Creates new key set which starts with |keys|, followed by at most
+// |history| keys in |old_keys| which are not in |keys|.
+std::shared_ptr<TicketKeys> merge_ticket_keys
+(std::vector<TicketKey> keys, const TicketKeys *old_keys, size_t history);
+
+// Loads the keys from Config::tls_ticket_key_files, or generates new
+// random key if no file is configured, and makes them current
+// ticket keys, retaining previous keys as configured by
+// Config::tls_ticket_key_history. The ticket keys are shared by all
+// SSL_CTXs and worker threads. This function returns 0 if it
+// succeeds, or -1. In case of failure, the current keys are
+// unchanged.
+int update_ticket_keys();
+
+// Returns current ticket keys. This function is thread-safe.
+std::shared_ptr<TicketKeys> get_ticket_keys();
+
+// OCSP response stapled in TLS handshake. Each server SSL_CTX has
+// one, attached as its app data, and the response for its
+// certificate is read from file |path|, which is the certificate
+// file path followed by ".ocsp". The response is replaced as a whole
+// by update_ocsp_staple(), so that the handshake never waits for
+// I/O.
+struct OCSPStaple {
+  OCSPStaple();
+  ~OCSPStaple();
+  std::string path;
+  // The server certificate and its issuer read from the certificate
+  // chain file. |issuer| is nullptr if the file does not contain it.
+  X509 *cert;
+  X509 *issuer;
+  // DER encoded OCSP response, or nullptr if not available. Use
+  // std::atomic_load() and std::atomic_store() to access this.
+  std::shared_ptr<std::string> response;
+};
+
+// Returns OCSPStaple attached to |ssl_ctx|, or nullptr.
+OCSPStaple* get_ocsp_staple(SSL_CTX *ssl_ctx);
+
+// Verifies that DER encoded OCSP response |der| is successful, is
+// signed by |issuer| or the responder it delegated to, contains the
+// status of |cert|, and is not expired at the moment. This function
+// returns 0 if it succeeds, or -1.
+int verify_ocsp_response(const std::string& der, X509 *cert, X509 *issuer);
+
+// Rereads OCSP response for |ssl_ctx| from file. If the file does
+// not exist or the response is invalid, the staple is removed. This
+// function returns 0 if the response is available, or -1.
+int update_ocsp_staple(SSL_CTX *ssl_ctx);
+
+// Rereads OCSP responses for the default SSL_CTX and all SSL_CTXs in
+// Config::cert_tree.
+void update_ocsp_staples();
+
 SSL_CTX* create_ssl_context(const char *private_key_file,
                             const char *cert_file);
 
@@ -98,6 +173,8 @@ struct CertNode {
 };
 
 struct CertLookupTree {
+  // The all SSL_CTXs added to this tree. Each SSL_CTX carries its
+  // OCSPStaple.
   std::vector<SSL_CTX*> certs;
   std::vector<char*> hosts;
   CertNode *root;
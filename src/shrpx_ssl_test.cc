@@ -24,6 +24,12 @@
  */
 #include "shrpx_ssl_test.h"
 
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <openssl/pem.h>
+
 #include <CUnit/CUnit.h>
 
 #include "shrpx_ssl.h"
@@ -130,4 +136,86 @@ void test_shrpx_ssl_cert_lookup_tree_add_cert_from_file(void)
   SSL_CTX_free(ssl_ctx);
 }
 
+namespace {
+ssl::TicketKey create_ticket_key(uint8_t c)
+{
+  ssl::TicketKey key;
+  memset(&key, c, sizeof(key));
+  return key;
+}
+} // namespace
+
+void test_shrpx_ssl_merge_ticket_keys(void)
+{
+  auto keys = ssl::merge_ticket_keys({create_ticket_key(1)}, nullptr, 2);
+  CU_ASSERT(1 == keys->keys.size());
+
+  keys = ssl::merge_ticket_keys({create_ticket_key(2)}, keys.get(), 2);
+  CU_ASSERT(2 == keys->keys.size());
+  CU_ASSERT(2 == keys->keys[0].name[0]);
+  CU_ASSERT(1 == keys->keys[1].name[0]);
+
+  keys = ssl::merge_ticket_keys({create_ticket_key(3)}, keys.get(), 2);
+  CU_ASSERT(3 == keys->keys.size());
+
+  // The oldest key is dropped.
+  keys = ssl::merge_ticket_keys({create_ticket_key(4)}, keys.get(), 2);
+  CU_ASSERT(3 == keys->keys.size());
+  CU_ASSERT(4 == keys->keys[0].name[0]);
+  CU_ASSERT(3 == keys->keys[1].name[0]);
+  CU_ASSERT(2 == keys->keys[2].name[0]);
+
+  // Unchanged key is not duplicated.
+  keys = ssl::merge_ticket_keys({create_ticket_key(4)}, keys.get(), 2);
+  CU_ASSERT(3 == keys->keys.size());
+  CU_ASSERT(4 == keys->keys[0].name[0]);
+  CU_ASSERT(3 == keys->keys[1].name[0]);
+  CU_ASSERT(2 == keys->keys[2].name[0]);
+}
+
+namespace {
+X509* read_cert(const char *path)
+{
+  auto f = fopen(path, "r");
+  if(!f) {
+    return nullptr;
+  }
+  auto cert = PEM_read_X509(f, nullptr, nullptr, nullptr);
+  fclose(f);
+  return cert;
+}
+} // namespace
+
+void test_shrpx_ssl_verify_ocsp_response(void)
+{
+  auto cert = read_cert(NGHTTP2_TESTS_DIR"/testdata/ocsp-cert.pem");
+  auto issuer = read_cert(NGHTTP2_TESTS_DIR"/testdata/ocsp-issuer.pem");
+  auto other = read_cert(NGHTTP2_TESTS_DIR"/testdata/cacert.pem");
+  CU_ASSERT(cert != nullptr);
+  CU_ASSERT(issuer != nullptr);
+  CU_ASSERT(other != nullptr);
+  std::ifstream in(NGHTTP2_TESTS_DIR"/testdata/ocsp-resp.der",
+                   std::ios::binary);
+  std::string der((std::istreambuf_iterator<char>(in)),
+                  std::istreambuf_iterator<char>());
+  CU_ASSERT(!der.empty());
+
+  CU_ASSERT(0 == ssl::verify_ocsp_response(der, cert, issuer));
+  // The response does not contain the status of |other|.
+  CU_ASSERT(-1 == ssl::verify_ocsp_response(der, other, issuer));
+  // The response is not signed by |other|.
+  CU_ASSERT(-1 == ssl::verify_ocsp_response(der, cert, other));
+  // Broken signature
+  auto broken = der;
+  broken[broken.size() - 1] ^= 0xff;
+  CU_ASSERT(-1 == ssl::verify_ocsp_response(broken, cert, issuer));
+  // Truncated response
+  CU_ASSERT(-1 == ssl::verify_ocsp_response(der.substr(0, der.size() / 2),
+                                            cert, issuer));
+
+  X509_free(other);
+  X509_free(issuer);
+  X509_free(cert);
+}
+
 } // namespace shrpx
@@ -29,6 +29,8 @@ namespace shrpx {
 
 void test_shrpx_ssl_create_lookup_tree(void);
 void test_shrpx_ssl_cert_lookup_tree_add_cert_from_file(void);
+void test_shrpx_ssl_merge_ticket_keys(void);
+void test_shrpx_ssl_verify_ocsp_response(void);
 
 } // namespace shrpx
 
@@ -0,0 +1,179 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_stats.h"
+
+#include <vector>
+#include <mutex>
+#include <sstream>
+
+#include "shrpx_config.h"
+#include "shrpx_downstream.h"
+#include "util.h"
+
+namespace shrpx {
+
+const int64_t STATS_LATENCY_BOUNDS[] = {
+  1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+  1000000, 2500000, 5000000, 10000000
+};
+
+namespace {
+std::mutex stats_mutex;
+// Guarded by stats_mutex
+std::vector<WorkerStats*> all_stats;
+} // namespace
+
+namespace {
+thread_local WorkerStats *local_stats = nullptr;
+} // namespace
+
+WorkerStats* get_worker_stats()
+{
+  if(!local_stats) {
+    local_stats = new WorkerStats();
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    all_stats.push_back(local_stats);
+  }
+  return local_stats;
+}
+
+void stats_record_request(unsigned int status_code, int64_t usec)
+{
+  auto stats = get_worker_stats();
+  if(100 <= status_code && status_code <= 599) {
+    stats->requests[status_code / 100 - 1].add(1);
+  }
+  size_t i = 0;
+  for(; i < STATS_NUM_LATENCY_BUCKETS - 1 &&
+        STATS_LATENCY_BOUNDS[i] < usec; ++i);
+  stats->latency[i].add(1);
+  stats->latency_sum.add(usec);
+}
+
+namespace {
+const char *STATS_PROTO_NAMES[] = { "h2", "spdy", "http/1.1" };
+} // namespace
+
+std::string format_stats()
+{
+  WorkerStats sum;
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    for(auto stats : all_stats) {
+      for(size_t i = 0; i < 5; ++i) {
+        sum.requests[i].add(stats->requests[i].get());
+      }
+      for(size_t i = 0; i < STATS_NUM_LATENCY_BUCKETS; ++i) {
+        sum.latency[i].add(stats->latency[i].get());
+      }
+      sum.latency_sum.add(stats->latency_sum.get());
+      for(size_t i = 0; i < STATS_NUM_PROTO; ++i) {
+        sum.client_connections[i].add(stats->client_connections[i].get());
+      }
+      sum.backend_connects.add(stats->backend_connects.get());
+      sum.backend_pool_hits.add(stats->backend_pool_hits.get());
+      sum.tls_handshakes.add(stats->tls_handshakes.get());
+      sum.tls_resumptions.add(stats->tls_resumptions.get());
+      sum.bytes_in.add(stats->bytes_in.get());
+      sum.bytes_out.add(stats->bytes_out.get());
+    }
+  }
+  std::ostringstream ss;
+  ss << "# TYPE nghttpx_requests_total counter\n";
+  for(size_t i = 0; i < 5; ++i) {
+    ss << "nghttpx_requests_total{status=\"" << i + 1 << "xx\"} "
+       << sum.requests[i].get() << "\n";
+  }
+  ss << "# TYPE nghttpx_request_duration_seconds histogram\n";
+  int64_t count = 0;
+  for(size_t i = 0; i < STATS_NUM_LATENCY_BUCKETS; ++i) {
+    count += sum.latency[i].get();
+    ss << "nghttpx_request_duration_seconds_bucket{le=\"";
+    if(i < STATS_NUM_LATENCY_BUCKETS - 1) {
+      ss << STATS_LATENCY_BOUNDS[i] / 1000000.0;
+    } else {
+      ss << "+Inf";
+    }
+    ss << "\"} " << count << "\n";
+  }
+  ss << "nghttpx_request_duration_seconds_sum "
+     << sum.latency_sum.get() / 1000000.0 << "\n"
+     << "nghttpx_request_duration_seconds_count " << count << "\n";
+  ss << "# TYPE nghttpx_client_connections gauge\n";
+  for(size_t i = 0; i < STATS_NUM_PROTO; ++i) {
+    ss << "nghttpx_client_connections{proto=\"" << STATS_PROTO_NAMES[i]
+       << "\"} " << sum.client_connections[i].get() << "\n";
+  }
+  ss << "# TYPE nghttpx_backend_connects_total counter\n"
+     << "nghttpx_backend_connects_total "
+     << sum.backend_connects.get() << "\n"
+     << "# TYPE nghttpx_backend_pool_hits_total counter\n"
+     << "nghttpx_backend_pool_hits_total "
+     << sum.backend_pool_hits.get() << "\n"
+     << "# TYPE nghttpx_tls_handshakes_total counter\n"
+     << "nghttpx_tls_handshakes_total "
+     << sum.tls_handshakes.get() << "\n"
+     << "# TYPE nghttpx_tls_resumptions_total counter\n"
+     << "nghttpx_tls_resumptions_total "
+     << sum.tls_resumptions.get() << "\n"
+     << "# TYPE nghttpx_client_bytes_in_total counter\n"
+     << "nghttpx_client_bytes_in_total " << sum.bytes_in.get() << "\n"
+     << "# TYPE nghttpx_client_bytes_out_total counter\n"
+     << "nghttpx_client_bytes_out_total " << sum.bytes_out.get() << "\n";
+  return ss.str();
+}
+
+bool stats_request(const Downstream *downstream, const std::string& ipaddr)
+{
+  auto stats_path = get_config()->stats_path;
+  if(!stats_path || downstream->get_request_method() != "GET") {
+    return false;
+  }
+  auto& path = downstream->get_request_path();
+  if(path.compare(0, path.find('?'), stats_path) != 0) {
+    return false;
+  }
+  for(size_t i = 0; i < get_config()->stats_allow_len; ++i) {
+    if(ipaddr == get_config()->stats_allow[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void prepare_stats_response(Downstream *downstream, const std::string& body)
+{
+  // The metrics must not be stored in the cache.
+  downstream->set_cache_key("");
+  downstream->set_response_major(1);
+  downstream->set_response_minor(1);
+  downstream->set_response_http_status(200);
+  downstream->add_response_header("cache-control", "no-store");
+  downstream->add_response_header("content-length", util::utos(body.size()));
+  downstream->add_response_header("content-type",
+                                  "text/plain; version=0.0.4");
+}
+
+} // namespace shrpx
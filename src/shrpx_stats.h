@@ -0,0 +1,114 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_STATS_H
+#define SHRPX_STATS_H
+
+#include "shrpx.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+namespace shrpx {
+
+class Downstream;
+
+// Counter which is only updated by a single thread. The update is a
+// plain load and store, not a locked read-modify-write, so it costs
+// the same as an ordinary integer. Other threads may read it at any
+// time and see a slightly stale value.
+class StatCounter {
+public:
+  StatCounter() : value_(0) {}
+  void add(int64_t n)
+  {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+  int64_t get() const
+  {
+    return value_.load(std::memory_order_relaxed);
+  }
+private:
+  std::atomic<int64_t> value_;
+};
+
+enum {
+  STATS_PROTO_HTTP2,
+  STATS_PROTO_SPDY,
+  STATS_PROTO_HTTP1,
+  STATS_NUM_PROTO
+};
+
+// The upper bounds of request latency histogram buckets in
+// microseconds. The last bucket is unbounded.
+extern const int64_t STATS_LATENCY_BOUNDS[];
+const size_t STATS_NUM_LATENCY_BUCKETS = 14;
+
+// The metrics of one worker thread. Only the owner thread updates
+// them, and they are aggregated when requested.
+struct WorkerStats {
+  // Index 0 is 1xx, and 4 is 5xx. Other status codes are not
+  // counted.
+  StatCounter requests[5];
+  // Non-cumulative counts of each bucket
+  StatCounter latency[STATS_NUM_LATENCY_BUCKETS];
+  // The sum of request latency in microseconds
+  StatCounter latency_sum;
+  StatCounter client_connections[STATS_NUM_PROTO];
+  StatCounter backend_connects;
+  StatCounter backend_pool_hits;
+  StatCounter tls_handshakes;
+  StatCounter tls_resumptions;
+  StatCounter bytes_in;
+  StatCounter bytes_out;
+};
+
+// Returns the metrics of the calling thread. The object is created
+// on the first call in the thread and lives until the process exits.
+WorkerStats* get_worker_stats();
+
+// Records the completed request with |status_code| which took
+// |usec| microseconds.
+void stats_record_request(unsigned int status_code, int64_t usec);
+
+// Returns the sum of the metrics of all threads in Prometheus text
+// format.
+std::string format_stats();
+
+// Returns true if |downstream| is the GET request to
+// Config::stats_path from the client at |ipaddr| listed in
+// Config::stats_allow.
+bool stats_request(const Downstream *downstream, const std::string& ipaddr);
+
+// Sets the response status and header fields of |downstream| for
+// the metrics |body| returned by format_stats(). The body is sent by
+// the caller.
+void prepare_stats_response(Downstream *downstream, const std::string& body);
+
+} // namespace shrpx
+
+#endif // SHRPX_STATS_H
@@ -0,0 +1,99 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_stats_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_stats.h"
+#include "shrpx_config.h"
+#include "shrpx_downstream.h"
+
+namespace shrpx {
+
+namespace {
+bool contains(const std::string& s, const char *line)
+{
+  return s.find(line) != std::string::npos;
+}
+} // namespace
+
+void test_shrpx_stats_format(void)
+{
+  stats_record_request(200, 500);
+  stats_record_request(204, 3000);
+  stats_record_request(503, 20000000);
+  auto stats = get_worker_stats();
+  stats->client_connections[STATS_PROTO_HTTP2].add(2);
+  stats->client_connections[STATS_PROTO_HTTP2].add(-1);
+  stats->bytes_out.add(100);
+
+  auto s = format_stats();
+  CU_ASSERT(contains(s, "nghttpx_requests_total{status=\"2xx\"} 2\n"));
+  CU_ASSERT(contains(s, "nghttpx_requests_total{status=\"5xx\"} 1\n"));
+  CU_ASSERT(contains(s, "nghttpx_request_duration_seconds_bucket"
+                     "{le=\"0.001\"} 1\n"));
+  CU_ASSERT(contains(s, "nghttpx_request_duration_seconds_bucket"
+                     "{le=\"0.005\"} 2\n"));
+  CU_ASSERT(contains(s, "nghttpx_request_duration_seconds_bucket"
+                     "{le=\"10\"} 2\n"));
+  CU_ASSERT(contains(s, "nghttpx_request_duration_seconds_bucket"
+                     "{le=\"+Inf\"} 3\n"));
+  CU_ASSERT(contains(s, "nghttpx_request_duration_seconds_count 3\n"));
+  CU_ASSERT(contains(s, "nghttpx_client_connections{proto=\"h2\"} 1\n"));
+  CU_ASSERT(contains(s, "nghttpx_client_bytes_out_total 100\n"));
+}
+
+void test_shrpx_stats_request(void)
+{
+  if(!get_config()) {
+    create_config();
+  }
+  char path[] = "/metrics";
+  char addr[] = "127.0.0.1";
+  char *allow[] = { addr };
+  mod_config()->stats_path = path;
+  mod_config()->stats_allow = allow;
+  mod_config()->stats_allow_len = 1;
+
+  Downstream downstream(nullptr, 0, 0);
+  downstream.set_request_method("GET");
+  downstream.set_request_path("/metrics?x=1");
+  CU_ASSERT(stats_request(&downstream, "127.0.0.1"));
+  // The client not listed in stats_allow
+  CU_ASSERT(!stats_request(&downstream, "192.168.0.1"));
+
+  downstream.set_request_path("/metrics/");
+  CU_ASSERT(!stats_request(&downstream, "127.0.0.1"));
+
+  downstream.set_request_path("/metrics");
+  downstream.set_request_method("POST");
+  CU_ASSERT(!stats_request(&downstream, "127.0.0.1"));
+
+  mod_config()->stats_path = nullptr;
+  mod_config()->stats_allow = nullptr;
+  mod_config()->stats_allow_len = 0;
+}
+
+} // namespace shrpx
@@ -35,10 +35,12 @@ namespace shrpx {
 
 ThreadEventReceiver::ThreadEventReceiver(event_base *evbase,
                                          SSL_CTX *ssl_ctx,
-                                         Http2Session *http2session)
+                                         Http2Session *http2session,
+                                         ResponseCache *response_cache)
   : evbase_(evbase),
     ssl_ctx_(ssl_ctx),
     http2session_(http2session),
+    response_cache_(response_cache),
     rate_limit_group_(bufferevent_rate_limit_group_new
                       (evbase_, get_config()->worker_rate_limit_cfg))
 {}
@@ -63,6 +65,13 @@ void ThreadEventReceiver::on_read(bufferevent *bev)
                         << sizeof(wev) << " Actual:" << nread;
       continue;
     }
+    if(wev.type == GRACEFUL_SHUTDOWN) {
+      if(LOG_ENABLED(INFO)) {
+        TLOG(INFO, this) << "Graceful shutdown commencing";
+      }
+      graceful_shutdown_client_handlers();
+      continue;
+    }
     if(LOG_ENABLED(INFO)) {
       TLOG(INFO, this) << "WorkerEvent: client_fd=" << wev.client_fd
                        << ", addrlen=" << wev.client_addrlen;
@@ -75,6 +84,7 @@ void ThreadEventReceiver::on_read(bufferevent *bev)
                                                  wev.client_addrlen);
     if(client_handler) {
       client_handler->set_http2_session(http2session_);
+      client_handler->set_response_cache(response_cache_);
 
       if(LOG_ENABLED(INFO)) {
         TLOG(INFO, this) << "CLIENT_HANDLER:" << client_handler << " created";
@@ -36,8 +36,17 @@
 namespace shrpx {
 
 class Http2Session;
+class ResponseCache;
+
+enum WorkerEventType {
+  // New client connection is accepted
+  NEW_CONNECTION = 0x01,
+  // Start graceful shutdown of client connections
+  GRACEFUL_SHUTDOWN = 0x02
+};
 
 struct WorkerEvent {
+  WorkerEventType type;
   sockaddr_union client_addr;
   size_t client_addrlen;
   evutil_socket_t client_fd;
@@ -46,7 +55,8 @@ struct WorkerEvent {
 class ThreadEventReceiver {
 public:
   ThreadEventReceiver(event_base *evbase, SSL_CTX *ssl_ctx,
-                      Http2Session *http2session);
+                      Http2Session *http2session,
+                      ResponseCache *response_cache);
   ~ThreadEventReceiver();
   void on_read(bufferevent *bev);
 private:
@@ -55,6 +65,9 @@ private:
   // Shared HTTP2 session for each thread. NULL if not client
   // mode. Not deleted by this object.
   Http2Session *http2session_;
+  // Response cache for each thread. NULL if caching is disabled. Not
+  // deleted by this object.
+  ResponseCache *response_cache_;
   bufferevent_rate_limit_group *rate_limit_group_;
 };
 
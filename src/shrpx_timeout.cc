@@ -0,0 +1,82 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_timeout.h"
+
+#include <cassert>
+
+#include "shrpx_config.h"
+
+namespace shrpx {
+
+namespace {
+thread_local Timeouts local_timeouts;
+thread_local bool local_timeouts_initialized = false;
+} // namespace
+
+namespace {
+const timeval* make_common_timeout(event_base *evbase, const timeval *tv)
+{
+  if(tv->tv_sec == 0 && tv->tv_usec == 0) {
+    return tv;
+  }
+  auto res = event_base_init_common_timeout(evbase, tv);
+  if(!res) {
+    // Too many distinct durations; fall back to the min-heap.
+    return tv;
+  }
+  return res;
+}
+} // namespace
+
+void init_timeouts(event_base *evbase)
+{
+  static const timeval settings_timeout = { 10, 0 };
+  static const timeval max_timeout = { 86400, 0 };
+
+  auto config = get_config();
+  auto& t = local_timeouts;
+  t.http2_upstream_read =
+    make_common_timeout(evbase, &config->http2_upstream_read_timeout);
+  t.upstream_read = make_common_timeout(evbase, &config->upstream_read_timeout);
+  t.upstream_write =
+    make_common_timeout(evbase, &config->upstream_write_timeout);
+  t.downstream_read =
+    make_common_timeout(evbase, &config->downstream_read_timeout);
+  t.downstream_write =
+    make_common_timeout(evbase, &config->downstream_write_timeout);
+  t.downstream_idle_read =
+    make_common_timeout(evbase, &config->downstream_idle_read_timeout);
+  t.settings = make_common_timeout(evbase, &settings_timeout);
+  t.max = make_common_timeout(evbase, &max_timeout);
+  local_timeouts_initialized = true;
+}
+
+const Timeouts* get_timeouts()
+{
+  assert(local_timeouts_initialized);
+  return &local_timeouts;
+}
+
+} // namespace shrpx
@@ -0,0 +1,67 @@
+/*
+ * nghttp2 - HTTP/2.0 C Library
+ *
+ * Copyright (c) 2014 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_TIMEOUT_H
+#define SHRPX_TIMEOUT_H
+
+#include "shrpx.h"
+
+#include <event.h>
+
+namespace shrpx {
+
+// The timeouts used by connections handled in the current thread.
+// Each of them is registered to the event_base of the thread as
+// libevent "common timeout". The events sharing a common timeout
+// are kept in a per-duration FIFO queue, which is backed by a single
+// entry in the min-heap of event_base. Therefore re-arming read or
+// write timeout of a bufferevent after each read or write is O(1)
+// list move, and the expired events are activated in a batch by a
+// single heap event. The pointers must only be used with the
+// event_base given to init_timeouts().
+struct Timeouts {
+  const timeval *http2_upstream_read;
+  const timeval *upstream_read;
+  const timeval *upstream_write;
+  const timeval *downstream_read;
+  const timeval *downstream_write;
+  const timeval *downstream_idle_read;
+  // Timeout for SETTINGS ACK
+  const timeval *settings;
+  // Used as read timeout when we effectively do not want one.
+  const timeval *max;
+};
+
+// Registers the timeouts in configuration to |evbase|. This function
+// must be called in the thread which runs |evbase| before any
+// connection is created.
+void init_timeouts(event_base *evbase);
+
+// Returns the timeouts for the current thread. init_timeouts() must
+// be called beforehand.
+const Timeouts* get_timeouts();
+
+} // namespace shrpx
+
+#endif // SHRPX_TIMEOUT_H
@@ -42,6 +42,10 @@ public:
   virtual int on_read() = 0;
   virtual int on_write() = 0;
   virtual int on_event() = 0;
+  // Called when the graceful shutdown is started. The upstream
+  // should finish the requests in progress and must not accept new
+  // ones. Returns -1 if the connection can be closed immediately.
+  virtual int on_graceful_shutdown() = 0;
   virtual bufferevent_data_cb get_downstream_readcb() = 0;
   virtual bufferevent_data_cb get_downstream_writecb() = 0;
   virtual bufferevent_event_cb get_downstream_eventcb() = 0;
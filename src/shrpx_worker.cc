@@ -36,6 +36,8 @@
 #include "shrpx_thread_event_receiver.h"
 #include "shrpx_log.h"
 #include "shrpx_http2_session.h"
+#include "shrpx_cache.h"
+#include "shrpx_timeout.h"
 #include "util.h"
 
 using namespace nghttp2;
@@ -66,10 +68,16 @@ namespace {
 void eventcb(bufferevent *bev, short events, void *arg)
 {
   if(events & BEV_EVENT_EOF) {
-    LOG(ERROR) << "Connection to main thread lost: eof";
+    // The main thread closed the channel to stop this worker.
+    if(LOG_ENABLED(INFO)) {
+      LOG(INFO) << "Connection to main thread closed; stopping worker";
+    }
+    event_base_loopbreak(bufferevent_get_base(bev));
+    return;
   }
   if(events & BEV_EVENT_ERROR) {
     LOG(ERROR) << "Connection to main thread lost: network error";
+    event_base_loopbreak(bufferevent_get_base(bev));
   }
 }
 } // namespace
@@ -82,6 +90,7 @@ void Worker::run()
     LOG(ERROR) << "event_base_new() failed";
     return;
   }
+  init_timeouts(evbase.get());
   auto bev = std::unique_ptr<bufferevent, decltype(&bufferevent_free)>
     (bufferevent_socket_new(evbase.get(), fd_, BEV_OPT_DEFER_CALLBACKS),
      bufferevent_free);
@@ -96,9 +105,13 @@ void Worker::run()
       DIE();
     }
   }
-  auto receiver = util::make_unique<ThreadEventReceiver>(evbase.get(),
-                                                         sv_ssl_ctx_,
-                                                         http2session.get());
+  std::unique_ptr<ResponseCache> response_cache;
+  if(get_config()->cache_size > 0) {
+    response_cache = util::make_unique<ResponseCache>
+      (get_config()->cache_size, get_config()->cache_max_object_size);
+  }
+  auto receiver = util::make_unique<ThreadEventReceiver>
+    (evbase.get(), sv_ssl_ctx_, http2session.get(), response_cache.get());
   bufferevent_enable(bev.get(), EV_READ);
   bufferevent_setcb(bev.get(), readcb, nullptr, eventcb, receiver.get());
 
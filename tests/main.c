@@ -208,6 +208,8 @@ int main(int argc, char* argv[])
                    test_nghttp2_session_pack_headers_with_padding3) ||
       !CU_add_test(pSuite, "session_pack_headers_with_padding4",
                    test_nghttp2_session_pack_headers_with_padding4) ||
+      !CU_add_test(pSuite, "session_data_no_copy",
+                   test_nghttp2_session_data_no_copy) ||
       !CU_add_test(pSuite, "pack_settings_payload",
                    test_nghttp2_pack_settings_payload) ||
       !CU_add_test(pSuite, "frame_pack_headers",
@@ -73,6 +73,8 @@ typedef struct {
   nghttp2_nv nv;
   size_t data_chunk_len;
   size_t padding_boundary;
+  size_t sent_data_len;
+  size_t no_copy_chunks;
 } my_user_data;
 
 static void scripted_data_feed_init(scripted_data_feed *df,
@@ -233,6 +235,76 @@ static ssize_t fixed_length_data_source_read_callback
   return wlen;
 }
 
+static ssize_t no_copy_data_source_read_callback
+(nghttp2_session *session, int32_t stream_id,
+ uint8_t *buf, size_t len, int *eof,
+ nghttp2_data_source *source, void *user_data)
+{
+  my_user_data *ud = (my_user_data*)user_data;
+  size_t wlen;
+  if(len < ud->data_source_length) {
+    wlen = len;
+  } else {
+    wlen = ud->data_source_length;
+  }
+  ud->data_source_length -= wlen;
+  *eof |= NGHTTP2_DATA_FLAG_NO_COPY;
+  if(ud->data_source_length == 0) {
+    *eof |= NGHTTP2_DATA_FLAG_EOF;
+  }
+  return wlen;
+}
+
+/* Returns the first ud->no_copy_chunks chunks in no copy mode, and
+   copies the rest to |buf|. */
+static ssize_t mixed_no_copy_data_source_read_callback
+(nghttp2_session *session, int32_t stream_id,
+ uint8_t *buf, size_t len, int *eof,
+ nghttp2_data_source *source, void *user_data)
+{
+  my_user_data *ud = (my_user_data*)user_data;
+  size_t wlen;
+  if(len < ud->data_source_length) {
+    wlen = len;
+  } else {
+    wlen = ud->data_source_length;
+  }
+  ud->data_source_length -= wlen;
+  if(ud->no_copy_chunks > 0) {
+    --ud->no_copy_chunks;
+    *eof |= NGHTTP2_DATA_FLAG_NO_COPY;
+  } else {
+    memset(buf, 0, wlen);
+  }
+  if(ud->data_source_length == 0) {
+    *eof |= NGHTTP2_DATA_FLAG_EOF;
+  }
+  return wlen;
+}
+
+static int block_count_send_data_callback
+(nghttp2_session *session, nghttp2_frame *frame,
+ const uint8_t *framehd, size_t length,
+ nghttp2_data_source *source, void *user_data)
+{
+  my_user_data *ud = (my_user_data*)user_data;
+  nghttp2_frame_hd hd;
+
+  if(ud->block_count == 0) {
+    return NGHTTP2_ERR_WOULDBLOCK;
+  }
+  --ud->block_count;
+
+  nghttp2_frame_unpack_frame_hd(&hd, framehd);
+  CU_ASSERT(NGHTTP2_DATA == hd.type);
+  CU_ASSERT(length == hd.length);
+  CU_ASSERT(length == frame->hd.length);
+
+  ud->sent_data_len += length;
+
+  return 0;
+}
+
 static ssize_t temporal_failure_data_source_read_callback
 (nghttp2_session *session, int32_t stream_id,
  uint8_t *buf, size_t len, int *eof,
@@ -4365,6 +4437,89 @@ void test_nghttp2_session_pack_headers_with_padding4(void)
   nghttp2_session_del(session);
 }
 
+void test_nghttp2_session_data_no_copy(void)
+{
+  nghttp2_session *session;
+  my_user_data ud;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_data_provider data_prd;
+  size_t datalen = 40000;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.send_callback = null_send_callback;
+  callbacks.on_frame_send_callback = on_frame_send_callback;
+  callbacks.send_data_callback = block_count_send_data_callback;
+
+  data_prd.read_callback = no_copy_data_source_read_callback;
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  nghttp2_submit_request(session, NGHTTP2_PRI_DEFAULT, NULL, 0, &data_prd,
+                         NULL);
+  ud.data_source_length = datalen;
+  ud.sent_data_len = 0;
+  ud.block_count = 1;
+  ud.frame_send_cb_called = 0;
+
+  /* Sends HEADERS and the first DATA, and then blocked */
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(2 == ud.frame_send_cb_called);
+  CU_ASSERT(NGHTTP2_DATA == ud.sent_frame_type);
+  CU_ASSERT(0 < ud.sent_data_len && ud.sent_data_len < datalen);
+  CU_ASSERT(NGHTTP2_OB_SEND_NO_COPY == session->aob.state);
+  CU_ASSERT(NGHTTP2_INITIAL_CONNECTION_WINDOW_SIZE - ud.sent_data_len ==
+            (size_t)session->remote_window_size);
+
+  ud.block_count = 100;
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(datalen == ud.sent_data_len);
+  CU_ASSERT(NGHTTP2_INITIAL_CONNECTION_WINDOW_SIZE - datalen ==
+            (size_t)session->remote_window_size);
+  CU_ASSERT(0 == nghttp2_session_want_write(session));
+
+  nghttp2_session_del(session);
+
+  /* Without send_data_callback, no copy mode is session error */
+  callbacks.send_data_callback = NULL;
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  nghttp2_submit_request(session, NGHTTP2_PRI_DEFAULT, NULL, 0, &data_prd,
+                         NULL);
+  ud.data_source_length = datalen;
+
+  CU_ASSERT(NGHTTP2_ERR_CALLBACK_FAILURE == nghttp2_session_send(session));
+
+  nghttp2_session_del(session);
+
+  /* No copy chunk followed by copied chunks.  Only the first one is
+     passed to send_data_callback. */
+  callbacks.send_data_callback = block_count_send_data_callback;
+  data_prd.read_callback = mixed_no_copy_data_source_read_callback;
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  nghttp2_submit_request(session, NGHTTP2_PRI_DEFAULT, NULL, 0, &data_prd,
+                         NULL);
+  ud.data_source_length = datalen;
+  ud.sent_data_len = 0;
+  ud.no_copy_chunks = 1;
+  ud.block_count = 100;
+  ud.frame_send_cb_called = 0;
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(0 == ud.data_source_length);
+  CU_ASSERT(0 < ud.sent_data_len && ud.sent_data_len < datalen);
+  CU_ASSERT(99 == ud.block_count);
+  CU_ASSERT(2 < ud.frame_send_cb_called);
+  CU_ASSERT(NGHTTP2_INITIAL_CONNECTION_WINDOW_SIZE - datalen ==
+            (size_t)session->remote_window_size);
+  CU_ASSERT(0 == nghttp2_session_want_write(session));
+
+  nghttp2_session_del(session);
+}
+
 void test_nghttp2_pack_settings_payload(void)
 {
   nghttp2_settings_entry iv[2];
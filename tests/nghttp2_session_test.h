@@ -95,6 +95,7 @@ void test_nghttp2_session_pack_headers_with_padding(void);
 void test_nghttp2_session_pack_headers_with_padding2(void);
 void test_nghttp2_session_pack_headers_with_padding3(void);
 void test_nghttp2_session_pack_headers_with_padding4(void);
+void test_nghttp2_session_data_no_copy(void);
 void test_nghttp2_pack_settings_payload(void);
 
 #endif /* NGHTTP2_SESSION_TEST_H */